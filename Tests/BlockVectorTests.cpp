@@ -0,0 +1,66 @@
+#include <Check.hpp>
+#include <Utils/BlockVector.hpp>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace varco;
+
+namespace {
+
+  bool sameElements(const BlockVector<int>& blocks, const std::vector<int>& model) {
+    if (blocks.size() != model.size() || blocks.empty() != model.empty())
+      return false;
+    for (size_t i = 0; i < model.size(); ++i) {
+      if (blocks[i] != model[i])
+        return false;
+    }
+    return std::equal(blocks.begin(), blocks.end(), model.begin());
+  }
+
+  void testAppendAndIterate() {
+    BlockVector<int> blocks;
+    std::vector<int> values, model;
+    for (int i = 0; i < 1000; ++i)
+      values.push_back(i);
+    model = values;
+    blocks.append(values); // Spans a few blocks
+    CHECK(values.empty());
+    CHECK(sameElements(blocks, model));
+    CHECK(blocks.back() == 999);
+    blocks.clear();
+    CHECK(blocks.empty() && blocks.size() == 0 && blocks.begin() == blocks.end());
+  }
+
+  // Random insertions (some large enough to split a block) and erasures against a vector
+  void testAgainstVector() {
+    std::mt19937 random(5);
+    BlockVector<int> blocks;
+    std::vector<int> model;
+    bool agrees = true;
+    for (int step = 0; step < 2000; ++step) {
+      if (model.empty() || random() % 2 == 0) {
+        size_t index = random() % (model.size() + 1);
+        std::vector<int> values(random() % 8 == 0 ? 600 : random() % 10);
+        for (auto& value : values)
+          value = static_cast<int>(random());
+        model.insert(model.begin() + index, values.begin(), values.end());
+        blocks.insert(index, values);
+      } else {
+        size_t index = random() % model.size(), count = random() % 300;
+        model.erase(model.begin() + index, model.begin() + std::min(model.size(), index + count));
+        blocks.erase(index, count);
+      }
+      agrees = agrees && sameElements(blocks, model);
+    }
+    CHECK(agrees);
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "BlockVector: appending and iterating", testAppendAndIterate },
+    { "BlockVector: random insertions and erasures", testAgainstVector },
+  });
+}
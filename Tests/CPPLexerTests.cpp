@@ -0,0 +1,196 @@
+#include <Check.hpp>
+#include <Lexers/CPPLexer.hpp>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace varco;
+
+namespace {
+
+  StyleDatabase lex(const std::string& text) {
+    CPPLexer lexer;
+    StyleDatabase styleDb;
+    lexer.lexInput(text, styleDb);
+    return styleDb;
+  }
+
+  // Whether the brackets at two positions were found and paired with each other
+  bool paired(const BracketIndex& index, size_t line1, size_t column1, size_t line2, size_t column2) {
+    uint32_t first = index.find(line1, column1), second = index.find(line2, column2);
+    return first != BracketIndex::NO_MATCH && second != BracketIndex::NO_MATCH &&
+           index.m_brackets[first].m_match == second && index.m_brackets[second].m_match == first;
+  }
+
+  const BracketIndex::Bracket *at(const BracketIndex& index, size_t line, size_t column) {
+    uint32_t bracket = index.find(line, column);
+    return bracket == BracketIndex::NO_MATCH ? nullptr : &index.m_brackets[bracket];
+  }
+
+  bool allMatched(const BracketIndex& index) {
+    for (const auto& bracket : index.m_brackets) {
+      if (bracket.m_match == BracketIndex::NO_MATCH)
+        return false;
+    }
+    return true;
+  }
+
+  void testBracketsArePaired() {
+    StyleDatabase styleDb = lex("int main() {\n  int a[2] = { 1, 2 };\n}\n");
+    const BracketIndex& index = styleDb.m_brackets;
+    CHECK(index.m_brackets.size() == 8);
+    CHECK(allMatched(index));
+    CHECK(paired(index, 0, 8, 0, 9));
+    CHECK(paired(index, 0, 11, 2, 0));
+    CHECK(paired(index, 1, 7, 1, 9));
+    CHECK(paired(index, 1, 13, 1, 20));
+    CHECK(at(index, 1, 13) && at(index, 1, 13)->m_depth == 1);
+    CHECK(index.find(1, 3) == BracketIndex::NO_MATCH);
+  }
+
+  void testBracketsInCommentsAndStringsAreSkipped() {
+    StyleDatabase styleDb = lex("void f() {\n  // ( [\n  g(\")\", '(');\n  /* } */\n}\n");
+    const BracketIndex& index = styleDb.m_brackets;
+    CHECK(allMatched(index));
+    CHECK(index.find(1, 5) == BracketIndex::NO_MATCH);
+    CHECK(paired(index, 2, 3, 2, 12));
+    CHECK(paired(index, 0, 9, 4, 0));
+  }
+
+  void testNestedParentheses() {
+    StyleDatabase styleDb = lex("int main() {\n  x = ((int)y);\n  f((a), ((b)));\n}\n");
+    const BracketIndex& index = styleDb.m_brackets;
+    CHECK(allMatched(index));
+    CHECK(paired(index, 1, 6, 1, 13));
+    CHECK(paired(index, 1, 7, 1, 11));
+    CHECK(at(index, 1, 7) && at(index, 1, 7)->m_depth == 2);
+    CHECK(paired(index, 2, 3, 2, 14));
+    CHECK(paired(index, 2, 4, 2, 6));
+    CHECK(paired(index, 2, 9, 2, 13));
+    CHECK(paired(index, 2, 10, 2, 12));
+  }
+
+  void testUnmatchedBrackets() {
+    StyleDatabase styleDb = lex("void f() {\n  g(1];\n");
+    const BracketIndex& index = styleDb.m_brackets;
+    CHECK(at(index, 0, 9) && at(index, 0, 9)->m_match == BracketIndex::NO_MATCH);
+    CHECK(at(index, 1, 5) && at(index, 1, 5)->m_match == BracketIndex::NO_MATCH);
+  }
+
+  std::string join(const std::vector<std::string>& lines) {
+    std::string text;
+    for (size_t i = 0; i < lines.size(); ++i)
+      text += (i > 0 ? "\n" : "") + lines[i];
+    return text;
+  }
+
+  bool sameStyles(const StyleDatabase& a, const StyleDatabase& b) {
+    if (a.styleSegment.size() != b.styleSegment.size() || a.firstSegmentOnLine != b.firstSegmentOnLine ||
+        a.lastSegmentOnLine != b.lastSegmentOnLine || a.previousSegment != b.previousSegment ||
+        a.m_absOffsetWhereLineBegins != b.m_absOffsetWhereLineBegins ||
+        a.m_brackets.m_brackets.size() != b.m_brackets.m_brackets.size() ||
+        a.m_brackets.m_firstOnLine != b.m_brackets.m_firstOnLine || a.m_foldRegions.size() != b.m_foldRegions.size())
+      return false;
+    for (size_t i = 0; i < a.styleSegment.size(); ++i) {
+      const auto &x = a.styleSegment[i], &y = b.styleSegment[i];
+      if (x.line != y.line || x.start != y.start || x.count != y.count || x.absStartPos != y.absStartPos || x.style != y.style)
+        return false;
+    }
+    for (size_t i = 0; i < a.m_brackets.m_brackets.size(); ++i) {
+      const auto &x = a.m_brackets.m_brackets[i], &y = b.m_brackets.m_brackets[i];
+      if (x.m_line != y.m_line || x.m_column != y.m_column || x.m_match != y.m_match || x.m_depth != y.m_depth ||
+          x.m_character != y.m_character)
+        return false;
+    }
+    for (size_t i = 0; i < a.m_foldRegions.size(); ++i) {
+      if (a.m_foldRegions[i].m_firstLine != b.m_foldRegions[i].m_firstLine ||
+          a.m_foldRegions[i].m_lastLine != b.m_foldRegions[i].m_lastLine)
+        return false;
+    }
+    return true;
+  }
+
+  // Random edits lexed again from the previous result, each compared with lexing the whole text
+  void testRelexingMatchesLexing() {
+    // Mostly lines which keep the brackets balanced: an unmatched '}' ends lexing
+    const std::vector<std::string> pieces = {
+      "  f(x, (y));", "  int a[2] = { 1, 2 };", "// (", "  std::string s = \"{\";", "  return;", "", "  std::cout << x;",
+      "  y = a::b(c);", "  g(h(1),", "    2);", "/* a", "   comment */", "#if X", "#endif", "  if (x) {", "  }",
+      "int main() {", "}", "class A {", "public:", "  void g();", "};"
+    };
+    std::mt19937 random(7);
+    std::vector<std::string> lines;
+    for (int i = 0; i < 30; ++i) {
+      lines.push_back(i % 2 ? "void f() {" : "#include <vector>");
+      for (int j = 0; j < 12; ++j)
+        lines.push_back(pieces[random() % 8]);
+      if (i % 2)
+        lines.push_back("}");
+    }
+    CPPLexer lexer;
+    StyleDatabase styleDb;
+    lexer.lexInput(join(lines), styleDb);
+
+    for (int edit = 0; edit < 300; ++edit) {
+      const size_t first = random() % lines.size();
+      const size_t oldCount = std::min<size_t>(lines.size() - first, random() % 3);
+      const size_t newCount = (oldCount == 0 ? 1 : 0) + random() % 3;
+      std::vector<std::string> inserted;
+      for (size_t i = 0; i < newCount; ++i) // Now and then a line which opens or closes a scope or a comment
+        inserted.push_back(pieces[random() % (random() % 10 ? 8 : pieces.size())]);
+      lines.erase(lines.begin() + first, lines.begin() + first + oldCount);
+      lines.insert(lines.begin() + first, inserted.begin(), inserted.end());
+
+      StyleDatabase relexed;
+      size_t firstLexed, endLexed;
+      lexer.reset();
+      CHECK(lexer.relexInput([&lines](size_t line) { return line < lines.size() ? &lines[line] : nullptr; },
+                             styleDb, first, oldCount, newCount, relexed, firstLexed, endLexed));
+      CHECK(firstLexed <= first && endLexed >= first + newCount);
+      StyleDatabase expected;
+      lexer.reset();
+      lexer.lexInput(join(lines), expected);
+      if (!CHECK(sameStyles(relexed, expected)))
+        return;
+      styleDb = std::move(relexed);
+    }
+  }
+
+  void testRelexingStopsInSync() {
+    std::vector<std::string> lines(1, "void f() {");
+    for (int i = 0; i < 1000; ++i)
+      lines.push_back("  g(x);");
+    lines.push_back("}");
+    CPPLexer lexer;
+    StyleDatabase styleDb, relexed;
+    lexer.lexInput(join(lines), styleDb);
+    lines[500] = "  int y = g(h(x));";
+    size_t firstLexed, endLexed;
+    lexer.reset();
+    CHECK(lexer.relexInput([&lines](size_t line) { return line < lines.size() ? &lines[line] : nullptr; },
+                           styleDb, 500, 1, 1, relexed, firstLexed, endLexed));
+    CHECK(firstLexed <= 500 && endLexed > 500 && endLexed - firstLexed <= 40);
+    CHECK(relexed.m_foldRegions.size() == 1 && relexed.m_foldRegions[0].m_lastLine == 1001);
+  }
+
+  void testFoldRegions() {
+    StyleDatabase styleDb = lex("void f() {\n  if (x) {\n    y();\n  }\n}\n");
+    CHECK(styleDb.m_foldRegions.size() == 2);
+    CHECK(styleDb.m_foldRegions[0].m_firstLine == 0 && styleDb.m_foldRegions[0].m_lastLine == 4);
+    CHECK(styleDb.m_foldRegions[1].m_firstLine == 1 && styleDb.m_foldRegions[1].m_lastLine == 3);
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "CPPLexer: brackets are paired", testBracketsArePaired },
+    { "CPPLexer: brackets in comments and strings are skipped", testBracketsInCommentsAndStringsAreSkipped },
+    { "CPPLexer: nested parentheses", testNestedParentheses },
+    { "CPPLexer: unmatched brackets", testUnmatchedBrackets },
+    { "CPPLexer: fold regions of scopes", testFoldRegions },
+    { "CPPLexer: relexing from an edit matches lexing everything", testRelexingMatchesLexing },
+    { "CPPLexer: relexing stops once back in sync", testRelexingStopsInSync },
+  });
+}
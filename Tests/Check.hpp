@@ -0,0 +1,47 @@
+#ifndef VARCO_TESTS_CHECK_HPP
+#define VARCO_TESTS_CHECK_HPP
+
+#include <cstdio>
+#include <vector>
+
+// A minimal test harness: every test executable lists its cases and runs them. A failed CHECK reports the
+// expression and carries on with the case, the executable fails if any did (see Tests/CMakeLists.txt)
+
+namespace varco {
+
+  namespace Tests {
+
+    struct TestCase {
+      const char *m_name;
+      void (*m_function)();
+    };
+
+    inline int& getFailureCount() {
+      static int failures = 0;
+      return failures;
+    }
+
+    inline bool check(bool passed, const char *expression, const char *file, int line) {
+      if (!passed) {
+        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+        ++getFailureCount();
+      }
+      return passed;
+    }
+
+    inline int run(const std::vector<TestCase>& cases) {
+      for (const auto& test : cases) {
+        int failures = getFailureCount();
+        test.m_function();
+        std::printf("%s %s\n", (getFailureCount() == failures) ? "[ OK ]" : "[FAIL]", test.m_name);
+      }
+      return getFailureCount() == 0 ? 0 : 1;
+    }
+
+  }
+
+}
+
+#define CHECK(expression) ::varco::Tests::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+#endif // VARCO_TESTS_CHECK_HPP
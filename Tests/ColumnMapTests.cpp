@@ -0,0 +1,47 @@
+#include <Check.hpp>
+#include <Document/ColumnMap.hpp>
+#include <string>
+
+using namespace varco;
+
+namespace {
+
+  size_t columns(const std::string& text, int tabWidth = 4) {
+    return getColumnCount(text.data(), text.size(), tabWidth);
+  }
+
+  void testPlainText() {
+    CHECK(isPlainText("int main() { return 0; }", 24));
+    CHECK(!isPlainText("int\tmain", 8));
+    CHECK(!isPlainText("caf\xC3\xA9 au lait, long enough for a block", 38));
+    CHECK(columns("hello") == 5);
+  }
+
+  void testTabStops() {
+    CHECK(columns("\t") == 4);
+    CHECK(columns("ab\tc") == 5);
+    CHECK(columns("abcd\tc") == 9);
+    CHECK(columns("a\tb", 8) == 9);
+    int width;
+    CHECK(getNextCell("a\tb", 3, 1, 1, 4, width) == 2 && width == 3);
+    CHECK(getOffsetAtColumn("a\tb", 3, 2, 4) == 1); // Inside the tab: the tab itself
+    CHECK(getOffsetAtColumn("a\tb", 3, 4, 4) == 2);
+    CHECK(getOffsetAtColumn("a\tb", 3, 10, 4) == 3);
+  }
+
+  void testWideAndCombiningCharacters() {
+    CHECK(columns("\xE4\xB8\xAD\xE6\x96\x87") == 4); // Two CJK ideographs
+    CHECK(columns("e\xCC\x81x") == 2); // e + combining acute accent, then x
+    CHECK(columns("\xE4\xB8\xAD\tx") == 5); // Tab stops count the wide character's two columns
+    CHECK(columns("a\xFF" "b") == 3); // An invalid byte takes a column
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "ColumnMap: plain text has a column per byte", testPlainText },
+    { "ColumnMap: tabs stop at multiples of the tab width", testTabStops },
+    { "ColumnMap: wide characters and grapheme clusters", testWideAndCombiningCharacters },
+  });
+}
@@ -0,0 +1,152 @@
+#include <Check.hpp>
+#include <Document/FileCache.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <unistd.h>
+#endif
+
+using namespace varco;
+
+namespace {
+
+  std::string s_directory; // Of the entries, also a place for test files
+
+  // Entries go in a directory of their own rather than in the user's cache
+  bool useTemporaryCacheDirectory() {
+#ifdef _WIN32
+    char directory[MAX_PATH];
+    if (GetTempPathA(MAX_PATH, directory) == 0)
+      return false;
+    s_directory = directory;
+    return _putenv_s("LOCALAPPDATA", directory) == 0;
+#else
+    char directory[] = "/tmp/varco-tests-XXXXXX";
+    if (mkdtemp(directory) == nullptr)
+      return false;
+    s_directory = std::string(directory) + "/";
+    return setenv("XDG_CACHE_HOME", directory, 1) == 0;
+#endif
+  }
+
+  FileCache::Key makeKey(const std::string& text) {
+    FileCache::Key key;
+    key.m_path = "/some/where/file.cpp";
+    key.m_size = text.size();
+    key.m_modifiedTime = 1234567;
+    key.m_hash = FileCache::hashContents(text.data(), text.size());
+    return key;
+  }
+
+  void testHashes() {
+    std::string text(100000, 'x');
+    uint64_t hash = FileCache::hashContents(text.data(), text.size());
+    CHECK(hash == FileCache::hashContents(text.data(), text.size()));
+    text[77777] = 'y';
+    CHECK(hash != FileCache::hashContents(text.data(), text.size()));
+    CHECK(FileCache::hashContents("abc", 3) != FileCache::hashContents("abd", 3)); // Tails shorter than a block count too
+  }
+
+  void testRoundTrip() {
+    const std::string text = "int a;\nint b[2];\n\nvoid f() {}";
+    FileCache::Key key = makeKey(text);
+    FileCache::Contents contents;
+    contents.m_lineStarts = { 0, 7, 17, 18, text.size() };
+    contents.m_wrapColumns = 80;
+    contents.m_tabWidth = 4;
+    contents.m_firstBreak = { 0, 0, 2, 2, 2 }; // Line 1 was wrapped twice
+    contents.m_breaks = { 4, 7 };
+    auto styleDb = std::make_shared<StyleDatabase>();
+    styleDb->styleSegment.emplace_back(0, 0, 3, 0, Keyword);
+    styleDb->firstSegmentOnLine[0] = 0;
+    styleDb->lastSegmentOnLine[0] = 0;
+    styleDb->m_absOffsetWhereLineBegins[1] = 7;
+    styleDb->m_brackets.m_brackets.push_back({ 1, 5, 1, 0, '[' });
+    styleDb->m_brackets.m_brackets.push_back({ 1, 7, 0, 0, ']' });
+    styleDb->m_brackets.m_firstOnLine = { 0, 0, 2, 2, 2 };
+    styleDb->m_foldRegions.push_back({ 0, 3 });
+    contents.m_styleDb = styleDb;
+    contents.m_lexerType = CPPLexerType;
+    CHECK(FileCache::store(key, contents));
+
+    std::unique_ptr<FileCache> cache = FileCache::open(key, text.data());
+    if (!CHECK(cache != nullptr))
+      return;
+    CHECK(cache->getLineCount() == 4);
+    CHECK(std::memcmp(cache->getLineStarts(), contents.m_lineStarts.data(), 5 * sizeof(uint64_t)) == 0);
+    CHECK(cache->getWrapColumns() == 80 && cache->getTabWidth() == 4);
+    auto breaks = cache->getRowBreaks(1);
+    CHECK(breaks.second - breaks.first == 2 && breaks.first[0] == 4 && breaks.first[1] == 7);
+    CHECK(cache->getRowBreaks(0).first == cache->getRowBreaks(0).second);
+    CHECK(cache->getLexerType() == CPPLexerType);
+    std::shared_ptr<StyleDatabase> restored = cache->makeStyleDatabase();
+    if (!CHECK(restored != nullptr))
+      return;
+    CHECK(restored->styleSegment.size() == 1 && restored->styleSegment[0].count == 3 && restored->styleSegment[0].style == Keyword);
+    CHECK(restored->m_absOffsetWhereLineBegins.at(1) == 7);
+    CHECK(restored->m_brackets.m_brackets.size() == 2 && restored->m_brackets.m_brackets[0].m_match == 1);
+    CHECK(restored->m_brackets.find(1, 7) == 1);
+    CHECK(restored->m_foldRegions.size() == 1 && restored->m_foldRegions[0].m_lastLine == 3);
+  }
+
+  void testStaleEntriesAreIgnored() {
+    const std::string text = "a\nb";
+    FileCache::Key key = makeKey(text);
+    FileCache::Contents contents;
+    contents.m_lineStarts = { 0, 2, 3 };
+    CHECK(FileCache::store(key, contents));
+    CHECK(FileCache::open(key, text.data()) != nullptr);
+
+    FileCache::Key modified = key;
+    ++modified.m_modifiedTime;
+    modified.m_hash = 0;
+    CHECK(FileCache::open(modified, text.data()) == nullptr);
+    CHECK(modified.m_hash == 0); // Stale before the contents are even read
+    FileCache::Key resized = key;
+    ++resized.m_size;
+    CHECK(FileCache::open(resized, "a\nbc") == nullptr);
+    FileCache::Key edited = key;
+    CHECK(FileCache::open(edited, "a\nc") == nullptr);
+    FileCache::Key other = key;
+    other.m_path = "/some/where/else.cpp";
+    CHECK(FileCache::open(other, text.data()) == nullptr);
+  }
+
+  void testFilesAreHashedWhenStored() {
+    const std::string text = "int main() {}\n";
+    FileCache::Key key;
+    key.m_path = s_directory + "file.cpp";
+    std::FILE *file = std::fopen(key.m_path.c_str(), "wb");
+    if (!CHECK(file != nullptr))
+      return;
+    std::fwrite(text.data(), 1, text.size(), file);
+    std::fclose(file);
+    key.m_size = text.size();
+    key.m_modifiedTime = 42;
+    FileCache::Contents contents;
+    contents.m_lineStarts = { 0, 14, 14 };
+    CHECK(FileCache::store(key, contents)); // Not hashed: there was no entry to open
+
+    FileCache::Key reopened = key;
+    CHECK(FileCache::open(reopened, text.data()) != nullptr);
+    CHECK(reopened.m_hash == FileCache::hashContents(text.data(), text.size()));
+  }
+
+}
+
+int main() {
+  if (!useTemporaryCacheDirectory())
+    return 1;
+  return Tests::run({
+    { "FileCache: contents hashes", testHashes },
+    { "FileCache: entries read back what was stored", testRoundTrip },
+    { "FileCache: stale entries are ignored", testStaleEntriesAreIgnored },
+    { "FileCache: files are hashed when stored if they weren't when opened", testFilesAreHashedWhenStored },
+  });
+}
@@ -0,0 +1,152 @@
+#include <Check.hpp>
+#include <Utils/FoldTree.hpp>
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace varco;
+
+namespace {
+
+  void testHideAndShow() {
+    FoldTree tree;
+    tree.rebuild({ 1, 2, 3, 4, 5 });
+    CHECK(tree.visibleTotal() == 15);
+    tree.hide(1, 3);
+    CHECK(tree.visibleTotal() == 10);
+    CHECK(!tree.isVisible(1) && !tree.isVisible(2) && tree.isVisible(3));
+    CHECK(tree.visiblePrefixSum(4) == 5);
+    CHECK(tree.findVisible(0) == 0);
+    CHECK(tree.findVisible(1) == 3); // The hidden elements are skipped
+    CHECK(tree.findVisible(10) == tree.size());
+    tree.set(2, 10); // Updating a hidden element doesn't show it
+    CHECK(tree.visibleTotal() == 10);
+    tree.show(1, 3);
+    CHECK(tree.visibleTotal() == 22);
+  }
+
+  void testNestedRanges() {
+    FoldTree tree;
+    tree.rebuild(std::vector<size_t>(10, 1));
+    tree.hide(2, 8);
+    tree.hide(4, 6);
+    tree.show(2, 8); // The inner range is still hidden
+    CHECK(tree.visibleTotal() == 8);
+    CHECK(!tree.isVisible(4) && tree.isVisible(3));
+    tree.show(4, 6);
+    CHECK(tree.visibleTotal() == 10);
+  }
+
+  void testInsertAndErase() {
+    FoldTree tree;
+    tree.rebuild({ 1, 2, 3, 4, 5 });
+    tree.hide(3, 5);
+    tree.insert(1, { 10, 20 }); // Inserted elements are visible, the hidden ones move along
+    CHECK(tree.size() == 7 && tree.get(1) == 10 && tree.get(3) == 2);
+    CHECK(tree.total() == 45 && tree.prefixSum(3) == 31);
+    CHECK(tree.visibleTotal() == 36);
+    CHECK(!tree.isVisible(5) && !tree.isVisible(6) && tree.isVisible(4));
+    tree.erase(0, 3);
+    CHECK(tree.size() == 4 && tree.get(0) == 2 && tree.visibleTotal() == 5);
+    tree.show(2, 4);
+    CHECK(tree.visibleTotal() == 14);
+  }
+
+  // Random updates, insertions, erasures and (possibly overlapping) ranges against counters per element
+  void testAgainstModel() {
+    std::mt19937 random(99);
+    std::vector<size_t> values(333);
+    for (auto& value : values)
+      value = random() % 4;
+    FoldTree tree;
+    tree.rebuild(values);
+    std::vector<int> hiddenBy(values.size(), 0);
+    std::vector<std::pair<size_t, size_t>> ranges;
+    bool agrees = true;
+    for (int step = 0; step < 4000; ++step) {
+      size_t count = values.size();
+      switch (count == 0 ? 3 : random() % 5) { // Inserts when there's nothing left
+        case 0: {
+          size_t index = random() % count;
+          values[index] = random() % 4;
+          tree.set(index, values[index]);
+        } break;
+        case 1: {
+          size_t first = random() % count, last = first + 1 + random() % (count - first);
+          tree.hide(first, last);
+          ranges.emplace_back(first, last);
+          for (size_t i = first; i < last; ++i)
+            ++hiddenBy[i];
+        } break;
+        case 2: {
+          if (ranges.empty())
+            break;
+          size_t which = random() % ranges.size();
+          tree.show(ranges[which].first, ranges[which].second);
+          for (size_t i = ranges[which].first; i < ranges[which].second; ++i)
+            --hiddenBy[i];
+          ranges.erase(ranges.begin() + which);
+        } break;
+        case 3: { // Ranges grow over the inserted elements, like folds around edited lines
+          size_t index = random() % (count + 1), inserted = random() % 5;
+          std::vector<size_t> newValues(inserted);
+          for (auto& value : newValues)
+            value = random() % 4;
+          tree.insert(index, newValues);
+          values.insert(values.begin() + index, newValues.begin(), newValues.end());
+          hiddenBy.insert(hiddenBy.begin() + index, inserted, 0);
+          for (auto& range : ranges) {
+            range.first += (range.first >= index) ? inserted : 0;
+            range.second += (range.second > index) ? inserted : 0;
+            if (range.first < index && index < range.second)
+              tree.hide(index, index + inserted);
+            for (size_t i = index; i < index + inserted && range.first <= i && i < range.second; ++i)
+              ++hiddenBy[i];
+          }
+        } break;
+        case 4: { // Erased elements leave the ranges which covered them
+          size_t index = random() % count, erased = std::min<size_t>(1 + random() % 5, count - index);
+          tree.erase(index, erased);
+          values.erase(values.begin() + index, values.begin() + index + erased);
+          hiddenBy.erase(hiddenBy.begin() + index, hiddenBy.begin() + index + erased);
+          for (auto it = ranges.begin(); it != ranges.end();) {
+            it->first = (it->first >= index + erased) ? it->first - erased : std::min(it->first, index);
+            it->second = (it->second >= index + erased) ? it->second - erased : std::min(it->second, index);
+            if (it->first == it->second)
+              it = ranges.erase(it);
+            else
+              ++it;
+          }
+        } break;
+      }
+      count = values.size();
+      agrees = agrees && tree.size() == count;
+      size_t sum = 0, total = 0, probe = random() % (count + 1), prefix = 0, visiblePrefix = 0;
+      for (size_t i = 0; i < count; ++i) {
+        agrees = agrees && tree.isVisible(i) == (hiddenBy[i] == 0) && tree.get(i) == values[i];
+        sum += hiddenBy[i] == 0 ? values[i] : 0;
+        total += values[i];
+        if (i + 1 == probe)
+          visiblePrefix = sum, prefix = total;
+      }
+      agrees = agrees && tree.visibleTotal() == sum && tree.visiblePrefixSum(probe) == visiblePrefix;
+      agrees = agrees && tree.total() == total && tree.prefixSum(probe) == prefix;
+      if (sum > 0) {
+        size_t unit = random() % sum, found = tree.findVisible(unit), before = tree.visiblePrefixSum(found);
+        agrees = agrees && found < count && hiddenBy[found] == 0 && before <= unit && unit < before + values[found];
+      }
+    }
+    CHECK(agrees);
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "FoldTree: hiding and showing a range", testHideAndShow },
+    { "FoldTree: nested ranges are counted", testNestedRanges },
+    { "FoldTree: inserting and erasing elements", testInsertAndErase },
+    { "FoldTree: random updates and ranges", testAgainstModel },
+  });
+}
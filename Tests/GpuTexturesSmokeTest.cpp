@@ -0,0 +1,151 @@
+#include <Check.hpp>
+#include <UI/CodeView/CodeView.hpp>
+#include <Document/Document.hpp>
+#include <Utils/AnimationScheduler.hpp>
+#include <config.hpp>
+#include <GrContext.h>
+#include <gl/GrGLInterface.h>
+#include <SkCanvas.h>
+#include <SkSurface.h>
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Loads a document in each strip mode (GpuTextures, DisplayList) and draws it through a GPU surface until
+// text shows up. Run with LIBGL_ALWAYS_SOFTWARE=1 it goes through Mesa's llvmpipe and needs no GPU, only an
+// X display (e.g. Xvfb)
+
+using namespace varco;
+
+namespace {
+
+  const int SKIP_TEST = 77; // See SKIP_RETURN_CODE in Tests/CMakeLists.txt
+  const int VIEW_WIDTH = 640;
+  const int VIEW_HEIGHT = 480;
+  GrContext *s_context = nullptr; // Of the GL context created by main()
+
+  class TestWindow : public UIElement<ui_container_tag> { // Stands in for the main window
+  public:
+    void repaint() override {}
+    AnimationScheduler& getAnimationScheduler() override {
+      return m_animationScheduler;
+    }
+
+  private:
+    AnimationScheduler m_animationScheduler;
+  };
+
+  // Pixels far enough from the background color, i.e. drawn text
+  size_t countInkPixels(const std::vector<uint32_t>& pixels, uint32_t background) {
+    size_t count = 0;
+    for (uint32_t pixel : pixels) {
+      int difference = 0;
+      for (int shift = 0; shift < 24; shift += 8)
+        difference += std::abs(static_cast<int>((pixel >> shift) & 0xFF) - static_cast<int>((background >> shift) & 0xFF));
+      if (difference > 96)
+        ++count;
+    }
+    return count;
+  }
+
+  void drawDocument(RenderMode mode, SkScalar zoom) {
+    sk_sp<SkSurface> surface = SkSurface::MakeRenderTarget(s_context, SkBudgeted::kNo,
+      SkImageInfo::MakeN32Premul(VIEW_WIDTH, VIEW_HEIGHT));
+    if (!CHECK(surface != nullptr))
+      return;
+
+    TestWindow window;
+    size_t inkPixels = 0;
+    {
+      CodeView codeView(window);
+      codeView.setRenderMode(mode);
+      codeView.setZoom(zoom);
+      codeView.resize(SkRect::MakeWH(VIEW_WIDTH, VIEW_HEIGHT));
+      Document document(codeView);
+      if (!CHECK(document.loadFromFile(TestData::BasicBlockFile)))
+        return;
+      document.applySyntaxHighlight(CPP);
+      codeView.loadDocument(document);
+
+      // Strips are rendered by worker threads and show up in a later frame
+      std::vector<uint32_t> pixels(VIEW_WIDTH * VIEW_HEIGHT);
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+      while (std::chrono::steady_clock::now() < deadline) {
+        codeView.paint();
+        SkCanvas *canvas = surface->getCanvas();
+        canvas->clear(SK_ColorBLACK);
+        canvas->drawBitmap(codeView.getBitmap(), 0, 0);
+        codeView.paintOverlay(*canvas);
+        canvas->flush();
+        canvas->readPixels(SkImageInfo::MakeN32Premul(VIEW_WIDTH, VIEW_HEIGHT), pixels.data(),
+                           VIEW_WIDTH * sizeof(uint32_t), 0, 0);
+        inkPixels = countInkPixels(pixels, pixels[VIEW_WIDTH * (VIEW_HEIGHT - 1) + 1]); // Bottom-left: past the text
+        if (inkPixels > 1000) // BasicBlock.cpp fills the view with several thousands
+          break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      }
+      window.getAnimationScheduler().shutdown();
+    }
+    std::printf("%zu pixels of text drawn\n", inkPixels);
+    CHECK(inkPixels > 1000);
+  }
+
+  void testGpuTexturesDocumentIsDrawn() {
+    drawDocument(RenderMode::GpuTextures, 1.f);
+  }
+
+  // Strips recorded as SkPictures and played back magnified on the window canvas
+  void testDisplayListDocumentIsDrawn() {
+    drawDocument(RenderMode::DisplayList, 1.5f);
+  }
+
+}
+
+int main() {
+  Display *display = XOpenDisplay(nullptr);
+  if (display == nullptr) {
+    std::printf("No X display, skipped\n");
+    return SKIP_TEST;
+  }
+
+  int attributes[] = { GLX_RGBA, GLX_DOUBLEBUFFER, GLX_STENCIL_SIZE, 8, None };
+  XVisualInfo *visual = glXChooseVisual(display, DefaultScreen(display), attributes);
+  if (visual == nullptr) {
+    std::printf("No OpenGL visual, skipped\n");
+    XCloseDisplay(display);
+    return SKIP_TEST;
+  }
+  XSetWindowAttributes windowAttributes = {};
+  windowAttributes.colormap = XCreateColormap(display, RootWindow(display, visual->screen), visual->visual, AllocNone);
+  Window window = XCreateWindow(display, RootWindow(display, visual->screen), 0, 0, VIEW_WIDTH, VIEW_HEIGHT, 0,
+                                visual->depth, InputOutput, visual->visual, CWColormap, &windowAttributes);
+  GLXContext glContext = glXCreateContext(display, visual, nullptr, GL_TRUE);
+  if (glContext == nullptr || !glXMakeCurrent(display, window, glContext)) {
+    std::printf("No OpenGL context, skipped\n");
+    XCloseDisplay(display);
+    return SKIP_TEST;
+  }
+  std::printf("Renderer: %s\n", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+
+  const GrGLInterface *glInterface = GrGLCreateNativeInterface();
+  s_context = glInterface ? GrContext::Create(kOpenGL_GrBackend, (GrBackendContext)glInterface) : nullptr;
+  int result = 1;
+  if (CHECK(s_context != nullptr)) {
+    result = Tests::run({
+      { "GpuTextures: a document is drawn from GPU strips", testGpuTexturesDocumentIsDrawn },
+      { "DisplayList: a document is drawn from recorded strips", testDisplayListDocumentIsDrawn },
+    });
+    s_context->unref();
+  }
+
+  glXMakeCurrent(display, None, nullptr);
+  glXDestroyContext(display, glContext);
+  XDestroyWindow(display, window);
+  XFree(visual);
+  XCloseDisplay(display);
+  return result;
+}
@@ -0,0 +1,106 @@
+#include <Check.hpp>
+#include <Utils/LineDiff.hpp>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace varco;
+
+namespace {
+
+  // The new lines out of the old ones and the hunks, which must be sorted and apart from each other
+  bool applyHunks(const std::vector<size_t>& oldLines, const std::vector<size_t>& newLines, const std::vector<DiffHunk>& hunks) {
+    std::vector<size_t> result;
+    size_t oldLine = 0, newLine = 0;
+    for (const auto& hunk : hunks) {
+      if (hunk.m_oldStart < oldLine || hunk.m_newStart < newLine || hunk.m_oldStart - oldLine != hunk.m_newStart - newLine)
+        return false;
+      result.insert(result.end(), oldLines.begin() + oldLine, oldLines.begin() + hunk.m_oldStart);
+      result.insert(result.end(), newLines.begin() + hunk.m_newStart, newLines.begin() + hunk.m_newStart + hunk.m_newCount);
+      oldLine = hunk.m_oldStart + hunk.m_oldCount;
+      newLine = hunk.m_newStart + hunk.m_newCount;
+    }
+    result.insert(result.end(), oldLines.begin() + oldLine, oldLines.end());
+    return result == newLines;
+  }
+
+  size_t countEdits(const std::vector<DiffHunk>& hunks) {
+    size_t edits = 0;
+    for (const auto& hunk : hunks)
+      edits += hunk.m_oldCount + hunk.m_newCount;
+    return edits;
+  }
+
+  size_t shortestEdits(const std::vector<size_t>& a, const std::vector<size_t>& b) { // Through the longest common subsequence
+    std::vector<std::vector<size_t>> lcs(a.size() + 1, std::vector<size_t>(b.size() + 1, 0));
+    for (size_t i = 1; i <= a.size(); ++i) {
+      for (size_t j = 1; j <= b.size(); ++j)
+        lcs[i][j] = (a[i - 1] == b[j - 1]) ? lcs[i - 1][j - 1] + 1 : std::max(lcs[i - 1][j], lcs[i][j - 1]);
+    }
+    return a.size() + b.size() - 2 * lcs[a.size()][b.size()];
+  }
+
+  void testSimpleEdits() {
+    std::vector<size_t> oldLines = { 1, 2, 3, 4, 5 };
+    CHECK(diffLines(oldLines, oldLines, 100).empty());
+    std::vector<size_t> inserted = { 1, 2, 9, 3, 4, 5 };
+    auto hunks = diffLines(oldLines, inserted, 100);
+    CHECK(hunks.size() == 1 && hunks[0].m_oldStart == 2 && hunks[0].m_oldCount == 0 && hunks[0].m_newCount == 1);
+    std::vector<size_t> removed = { 1, 4, 5 };
+    hunks = diffLines(oldLines, removed, 100);
+    CHECK(hunks.size() == 1 && hunks[0].m_oldStart == 1 && hunks[0].m_oldCount == 2 && hunks[0].m_newCount == 0);
+  }
+
+  void testShortestScripts() {
+    std::mt19937 random(3);
+    bool applies = true, shortest = true;
+    for (int i = 0; i < 300; ++i) {
+      std::vector<size_t> a(random() % 40), b;
+      for (auto& line : a)
+        line = random() % 6;
+      for (size_t line : a) { // Small edits of 'a'
+        if (random() % 5 == 0)
+          b.push_back(random() % 6);
+        if (random() % 5 != 0)
+          b.push_back(line);
+      }
+      auto hunks = diffLines(a, b, 1000);
+      applies = applies && applyHunks(a, b, hunks);
+      shortest = shortest && countEdits(hunks) == shortestEdits(a, b);
+    }
+    CHECK(applies);
+    CHECK(shortest);
+  }
+
+  void testScatteredEdits() {
+    std::vector<size_t> a, b;
+    for (size_t i = 0; i < 50000; ++i) {
+      a.push_back(i);
+      b.push_back(i % 50 == 7 ? i + 100000 : i); // A thousand lines replaced
+    }
+    auto hunks = diffLines(a, b, 4096);
+    CHECK(hunks.size() == 1000 && countEdits(hunks) == 2000);
+    CHECK(applyHunks(a, b, hunks));
+  }
+
+  void testTooManyEdits() {
+    std::vector<size_t> a, b;
+    for (size_t i = 0; i < 1000; ++i) {
+      a.push_back(i);
+      b.push_back((i < 10 || i >= 990) ? i : i + 5000); // Everything changed but a prefix and a suffix
+    }
+    auto hunks = diffLines(a, b, 50);
+    CHECK(hunks.size() == 1 && hunks[0].m_oldStart == 10 && hunks[0].m_oldCount == 980 && hunks[0].m_newCount == 980);
+    CHECK(applyHunks(a, b, hunks));
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "LineDiff: single insertions and removals", testSimpleEdits },
+    { "LineDiff: scripts apply and are the shortest", testShortestScripts },
+    { "LineDiff: scattered edits of a long sequence", testScatteredEdits },
+    { "LineDiff: too many edits replace everything between prefix and suffix", testTooManyEdits },
+  });
+}
@@ -0,0 +1,147 @@
+#include <Check.hpp>
+#include <Utils/Regex.hpp>
+#include <chrono>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace varco;
+
+namespace {
+
+  using Matches = std::vector<std::pair<size_t, size_t>>;
+
+  Matches findAll(const std::string& pattern, const std::string& text, bool caseSensitive = true) {
+    Matches matches;
+    auto regex = Regex::compile(pattern, caseSensitive);
+    if (!CHECK(regex != nullptr))
+      return matches;
+    RegexMatcher matcher(regex);
+    matcher.findAll(text.data(), text.size(), matches);
+    return matches;
+  }
+
+  // Leftmost-longest, non overlapping, non empty matches by definition: the longest match at every start,
+  // tried one after the other. Only for patterns without anchors
+  Matches findAllSlowly(const std::shared_ptr<const Regex>& regex, const std::string& text) {
+    RegexMatcher matcher(regex);
+    Matches matches;
+    size_t position = 0;
+    while (position < text.size()) {
+      bool found = false;
+      for (size_t start = position; start < text.size() && !found; ++start) {
+        for (size_t end = text.size(); end > start && !found; --end) {
+          if (matcher.matches(text.data() + start, end - start)) {
+            matches.emplace_back(start, end);
+            position = end;
+            found = true;
+          }
+        }
+      }
+      if (!found)
+        break;
+    }
+    return matches;
+  }
+
+  void testInvalidPatterns() {
+    std::string error;
+    CHECK(Regex::compile("(ab", true, &error) == nullptr && !error.empty());
+    CHECK(Regex::compile("ab)", true) == nullptr);
+    CHECK(Regex::compile("[a-", true) == nullptr);
+    CHECK(Regex::compile("a{3,1}", true) == nullptr);
+    CHECK(Regex::compile("*a", true) == nullptr);
+  }
+
+  void testLiteralsClassesAndQuantifiers() {
+    CHECK(findAll("abc", "xxabcxabc") == Matches({ { 2, 5 }, { 6, 9 } }));
+    CHECK(findAll("a.c", "abc a-c ac") == Matches({ { 0, 3 }, { 4, 7 } }));
+    CHECK(findAll("[0-9]+", "a1b22c333") == Matches({ { 1, 2 }, { 3, 5 }, { 6, 9 } }));
+    CHECK(findAll("[^a-z ]+", "ab CD ef 12") == Matches({ { 3, 5 }, { 9, 11 } }));
+    CHECK(findAll("\\d{2,3}", "1 12 1234") == Matches({ { 2, 4 }, { 5, 8 } }));
+    CHECK(findAll("\\w+\\s*=", "x = 1, yy= 2") == Matches({ { 0, 3 }, { 7, 10 } }));
+    CHECK(findAll("colou?r", "color colour colouur") == Matches({ { 0, 5 }, { 6, 12 } }));
+    CHECK(findAll("a\\.b", "a.b axb") == Matches({ { 0, 3 } }));
+  }
+
+  void testLeftmostLongest() {
+    CHECK(findAll("a|ab", "ab") == Matches({ { 0, 2 } })); // Not the first alternative: the longest
+    CHECK(findAll("a*?", "aaa") == Matches({ { 0, 3 } })); // Lazy quantifiers are matched greedily
+    CHECK(findAll("(foo|foobar)baz", "foobarbaz") == Matches({ { 0, 9 } }));
+    CHECK(findAll("x*", "abc").empty()); // Empty matches aren't reported
+  }
+
+  void testAnchors() {
+    CHECK(findAll("^ab", "abab") == Matches({ { 0, 2 } }));
+    CHECK(findAll("ab$", "abab") == Matches({ { 2, 4 } }));
+    CHECK(findAll("^a*$", "aaaa") == Matches({ { 0, 4 } }));
+    CHECK(findAll("^a*$", "aaba").empty());
+  }
+
+  void testCaseInsensitive() {
+    CHECK(findAll("hello", "Hello HELLO hello", false) == Matches({ { 0, 5 }, { 6, 11 }, { 12, 17 } }));
+    CHECK(findAll("hello", "Hello HELLO hello", true) == Matches({ { 12, 17 } }));
+    CHECK(findAll("[a-c]+", "ABCabc", false) == Matches({ { 0, 6 } }));
+  }
+
+  void testWholeTextMatches() {
+    auto regex = Regex::compile("(ab)+c?");
+    RegexMatcher matcher(regex);
+    CHECK(matcher.matches("ababc", 5));
+    CHECK(matcher.matches("abab", 4));
+    CHECK(!matcher.matches("aba", 3));
+    CHECK(!matcher.matches("", 0));
+  }
+
+  // Random patterns of a few operators against random texts of a small alphabet
+  void testAgainstDefinition() {
+    const char *patterns[] = { "a+b", "(a|ab)(c|bcd)", "a*b*", "(ab|a)*", "[ab]c+|b", ".*c|a", "a?b?c", "(a|b)*bb",
+                               "b{2,3}a?", ".*(ab)+|d", "a(b|c)*d|b", "(a|b)*c|ba" };
+    std::mt19937 random(7);
+    bool agrees = true;
+    for (const char *pattern : patterns) {
+      auto regex = Regex::compile(pattern);
+      RegexMatcher matcher(regex); // Reused: its caches carry over from line to line
+      for (int i = 0; i < 300; ++i) {
+        std::string text;
+        for (size_t length = random() % 24; length > 0; --length)
+          text += "abcd"[random() % 4];
+        Matches matches;
+        matcher.findAll(text.data(), text.size(), matches);
+        if (matches != findAllSlowly(regex, text)) {
+          std::fprintf(stderr, "  '%s' on '%s'\n", pattern, text.c_str());
+          agrees = false;
+        }
+      }
+    }
+    CHECK(agrees);
+  }
+
+  // Every match is a single 'a' but the first branch could go on to the end of the line: runs must stop as
+  // soon as their match can't grow, or this takes minutes instead of milliseconds
+  void testLinearTime() {
+    std::string text(200000, 'a');
+    auto start = std::chrono::steady_clock::now();
+    Matches matches = findAll(".*x|a", text);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(matches.size() == text.size() && matches.back() == std::make_pair(text.size() - 1, text.size()));
+    CHECK(elapsed < std::chrono::seconds(2));
+    text.back() = 'x';
+    CHECK(findAll(".*x|a", text) == Matches({ { 0, text.size() } }));
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "Regex: invalid patterns are rejected", testInvalidPatterns },
+    { "Regex: literals, classes and quantifiers", testLiteralsClassesAndQuantifiers },
+    { "Regex: matches are leftmost-longest", testLeftmostLongest },
+    { "Regex: line anchors", testAnchors },
+    { "Regex: case insensitive patterns", testCaseInsensitive },
+    { "Regex: whole text matches", testWholeTextMatches },
+    { "Regex: matches agree with their definition", testAgainstDefinition },
+    { "Regex: lines are searched in linear time", testLinearTime },
+  });
+}
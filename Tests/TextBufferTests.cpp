@@ -0,0 +1,144 @@
+#include <Check.hpp>
+#include <Document/TextBuffer.hpp>
+#include <Utils/FenwickTree.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace varco;
+
+namespace {
+
+  std::vector<std::string> makeLines(size_t count) {
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < count; ++i)
+      lines.push_back("line " + std::to_string(i) + ((i % 7 == 0) ? "\tx" : "") + ((i % 11 == 0) ? "\xC3\xA9" : ""));
+    return lines;
+  }
+
+  bool isPlainLine(const std::string& line) {
+    for (char c : line) {
+      if ((static_cast<unsigned char>(c) & 0x80) || c == '\t')
+        return false;
+    }
+    return true;
+  }
+
+  // Lines, offsets and plain flags of the buffer against a vector of lines edited the same way
+  void checkAgainstModel(const TextBuffer& buffer, const std::vector<std::string>& model) {
+    CHECK(buffer.getLineCount() == model.size());
+    size_t offset = 0;
+    bool linesMatch = true, offsetsMatch = true, plainMatch = true;
+    for (size_t i = 0; i < model.size(); ++i) {
+      linesMatch = linesMatch && buffer.getLine(i) == model[i];
+      plainMatch = plainMatch && buffer.isPlain(i) == isPlainLine(model[i]);
+      offsetsMatch = offsetsMatch && buffer.getLineStartOffset(i) == offset &&
+                     buffer.getLineAtOffset(offset) == i && buffer.getLineAtOffset(offset + model[i].size()) == i;
+      offset += model[i].size() + 1;
+    }
+    CHECK(linesMatch);
+    CHECK(plainMatch);
+    CHECK(offsetsMatch);
+    CHECK(buffer.getByteCount() == (offset > 0 ? offset - 1 : 0));
+
+    size_t visited = 0;
+    bool walkMatches = true;
+    buffer.forEachLine(0, model.size(), [&](size_t line, const std::string& text) {
+      walkMatches = walkMatches && line == visited && text == model[line];
+      ++visited;
+      return true;
+    });
+    CHECK(walkMatches && visited == model.size());
+
+    // A block at a time, from and to lines in the middle of blocks
+    const size_t first = model.size() / 3, last = 2 * model.size() / 3;
+    visited = first;
+    walkMatches = true;
+    buffer.forEachBlock(first, last, [&](size_t line, std::vector<std::string>::const_iterator begin,
+                                         std::vector<std::string>::const_iterator end) {
+      walkMatches = walkMatches && line == visited && begin != end;
+      for (auto it = begin; it != end; ++it)
+        walkMatches = walkMatches && *it == model[visited++];
+      return true;
+    });
+    CHECK(walkMatches && visited == last);
+  }
+
+  void testRandomEditsMatchModel() {
+    std::vector<std::string> model = makeLines(3000);
+    TextBuffer buffer(model);
+    std::mt19937 random(1234);
+    for (int step = 0; step < 3000; ++step) {
+      size_t line = random() % model.size();
+      switch (random() % 3) {
+        case 0: {
+          std::string text = "edited " + std::to_string(step) + ((step % 5 == 0) ? "\t" : "");
+          buffer.setLine(line, text);
+          model[line] = text;
+        } break;
+        case 1: {
+          std::vector<std::string> lines = makeLines(1 + random() % 300);
+          buffer.insertLines(line, lines);
+          model.insert(model.begin() + line, lines.begin(), lines.end());
+        } break;
+        case 2: {
+          size_t count = std::min<size_t>(1 + random() % 300, model.size() - 1);
+          if (line + count > model.size())
+            line = model.size() - count;
+          buffer.eraseLines(line, count);
+          model.erase(model.begin() + line, model.begin() + line + count);
+        } break;
+      }
+    }
+    checkAgainstModel(buffer, model);
+  }
+
+  void testSnapshotsAreCopyOnWrite() {
+    std::vector<std::string> model = makeLines(1000);
+    TextBuffer buffer(model);
+    TextBuffer snapshot = buffer;
+    buffer.setLine(500, "changed");
+    buffer.insertLines(0, { "first" });
+    buffer.eraseLines(900, 50);
+    checkAgainstModel(snapshot, model); // The snapshot still sees the text it was taken from
+    CHECK(buffer.getLine(0) == "first");
+    CHECK(buffer.getLine(501) == "changed");
+  }
+
+  void testTextRanges() {
+    TextBuffer buffer({ "abc", "def", "ghi" });
+    CHECK(buffer.getText() == "abc\ndef\nghi");
+    DocumentPosition from, to;
+    from.x = 1, from.y = 0;
+    to.x = 2, to.y = 2;
+    CHECK(buffer.getText(from, to) == "bc\ndef\ngh");
+    to.x = 3, to.y = 0;
+    CHECK(buffer.getText(from, to) == "bc");
+  }
+
+  void testFenwickTree() {
+    std::vector<size_t> values = { 3, 0, 5, 1, 0, 0, 7, 2 };
+    FenwickTree<size_t> tree(values);
+    CHECK(tree.size() == values.size());
+    CHECK(tree.total() == 18);
+    CHECK(tree.prefixSum(3) == 8);
+    CHECK(tree.upperBound(0) == 0);
+    CHECK(tree.upperBound(3) == 2); // Skips the empty element
+    CHECK(tree.upperBound(8) == 3);
+    CHECK(tree.upperBound(9) == 6);
+    CHECK(tree.upperBound(18) == values.size());
+    tree.add(1, 4);
+    CHECK(tree.prefixSum(2) == 7);
+    CHECK(tree.upperBound(3) == 1);
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "TextBuffer: random edits match a vector of lines", testRandomEditsMatchModel },
+    { "TextBuffer: snapshots don't see later edits", testSnapshotsAreCopyOnWrite },
+    { "TextBuffer: text of a range", testTextRanges },
+    { "FenwickTree: prefix sums and searches", testFenwickTree },
+  });
+}
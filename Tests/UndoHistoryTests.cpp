@@ -0,0 +1,156 @@
+#include <Check.hpp>
+#include <Document/UndoHistory.hpp>
+#include <string>
+#include <vector>
+
+using namespace varco;
+
+namespace {
+
+  DocumentPosition at(int x, int y) {
+    DocumentPosition position;
+    position.x = x;
+    position.y = y;
+    return position;
+  }
+
+  UndoHistory::Operation typing(int x, const std::string& text, UndoHistory::Clock::time_point time) {
+    UndoHistory::Operation operation;
+    operation.m_from = operation.m_to = at(x, 0);
+    operation.m_end = at(x + static_cast<int>(text.size()), 0);
+    operation.m_inserted = text;
+    operation.m_time = time;
+    return operation;
+  }
+
+  void testKeystrokesCoalesce() {
+    UndoHistory history;
+    TextBuffer buffer({ "" });
+    auto now = UndoHistory::Clock::now();
+    history.record(typing(0, "a", now), buffer);
+    history.record(typing(1, "b", now), buffer);
+    history.record(typing(2, "c", now), buffer);
+    CHECK(history.getUndoCount() == 1);
+    std::vector<UndoHistory::Operation> step = history.undo();
+    CHECK(step.size() == 1 && step[0].m_inserted == "abc");
+    CHECK(!history.canUndo() && history.canRedo());
+  }
+
+  void testWordsAndPausesSplitOperations() {
+    UndoHistory history;
+    TextBuffer buffer({ "" });
+    auto now = UndoHistory::Clock::now();
+    history.record(typing(0, "ab", now), buffer);
+    history.record(typing(2, " ", now), buffer); // A space after a word begins a new operation
+    history.record(typing(3, "c", now + std::chrono::seconds(5)), buffer); // So does a pause
+    CHECK(history.getUndoCount() == 3);
+  }
+
+  void testBatchesAreOneStep() {
+    UndoHistory history;
+    TextBuffer buffer({ "", "", "" });
+    auto now = UndoHistory::Clock::now();
+    std::vector<UndoHistory::Operation> batch;
+    for (int line = 0; line < 3; ++line) {
+      UndoHistory::Operation operation = typing(0, "x", now);
+      operation.m_from = operation.m_to = at(0, line);
+      operation.m_end = at(1, line);
+      batch.push_back(operation);
+    }
+    history.recordBatch(batch, buffer);
+    history.record(typing(1, "y", now), buffer); // Never coalesced with the batch
+    CHECK(history.getUndoCount() == 4);
+    CHECK(history.undo().size() == 1);
+    std::vector<UndoHistory::Operation> undone = history.undo();
+    CHECK(undone.size() == 3 && undone[0].m_from.y == 0 && undone[2].m_from.y == 2);
+    CHECK(!history.canUndo());
+    CHECK(history.redo().size() == 3);
+  }
+
+  void testNewEditsDiscardRedo() {
+    UndoHistory history;
+    TextBuffer buffer({ "" });
+    auto now = UndoHistory::Clock::now();
+    history.record(typing(0, "a", now), buffer);
+    history.undo();
+    history.record(typing(0, "b", now), buffer);
+    CHECK(!history.canRedo());
+    CHECK(history.undo()[0].m_inserted == "b");
+  }
+
+  void testMemoryBudgetDropsOldestSteps() {
+    UndoHistory history;
+    TextBuffer buffer({ "" });
+    auto now = UndoHistory::Clock::now();
+    history.setMemoryBudget(64 * 1024);
+    for (int i = 0; i < 100; ++i) {
+      history.record(typing(0, std::string(4096, 'x'), now), buffer);
+      history.seal();
+    }
+    CHECK(history.getUndoCount() < 20);
+    CHECK(history.getUndoCount() > 0);
+    history.setMemoryBudget(0); // The last step is always kept
+    CHECK(history.getUndoCount() == 1);
+  }
+
+  void testCheckpointsRestoreText() {
+    UndoHistory history;
+    TextBuffer buffer({ "" });
+    auto now = UndoHistory::Clock::now();
+    for (int i = 0; i < 600; ++i) { // A line inserted at every step
+      UndoHistory::Operation operation;
+      operation.m_from = operation.m_to = at(0, 0);
+      operation.m_end = at(0, 1);
+      operation.m_inserted = std::to_string(i) + "\n";
+      operation.m_time = now;
+      history.record(operation, buffer);
+      buffer.insertLines(0, { std::to_string(i) });
+    }
+    CHECK(history.rewindToCheckpoint(10, buffer) == 0); // Few steps are replayed instead
+    size_t rewound = history.rewindToCheckpoint(300, buffer);
+    CHECK(rewound > 0 && rewound <= 300);
+    CHECK(history.getUndoCount() == 600 - rewound);
+    CHECK(buffer.getLineCount() == 1 + history.getUndoCount()); // The text as it was after the remaining steps
+    CHECK(buffer.getLine(0) == std::to_string(history.getUndoCount() - 1));
+  }
+
+  // Steps to undo from the 600th to the 250th, over lines spread across the whole text: the checkpoint at the
+  // 256th step keeps a copy of most blocks
+  size_t rewindAfterEditingEveryBlock(size_t memoryBudget) {
+    UndoHistory history;
+    history.setMemoryBudget(memoryBudget);
+    TextBuffer buffer(std::vector<std::string>(5000, std::string(100, 'x')));
+    auto now = UndoHistory::Clock::now();
+    for (int i = 0; i < 600; ++i) {
+      const int line = (i * 997) % 5000;
+      UndoHistory::Operation operation;
+      operation.m_from = operation.m_to = at(0, line);
+      operation.m_end = at(1, line);
+      operation.m_inserted = "y";
+      operation.m_time = now;
+      history.record(operation, buffer);
+      history.seal();
+      buffer.setLine(line, "y" + buffer.getLine(line));
+    }
+    return history.rewindToCheckpoint(350, buffer);
+  }
+
+  void testCheckpointsCountInBudget() {
+    CHECK(rewindAfterEditingEveryBlock(64 * 1024 * 1024) == 600 - 256); // The closest checkpoint to the target
+    // The same blocks are well over the budget: the checkpoint is dropped, undoing goes through the next one
+    CHECK(rewindAfterEditingEveryBlock(256 * 1024) == 600 - 512);
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "UndoHistory: keystrokes coalesce", testKeystrokesCoalesce },
+    { "UndoHistory: words and pauses split operations", testWordsAndPausesSplitOperations },
+    { "UndoHistory: batches are undone and redone as one step", testBatchesAreOneStep },
+    { "UndoHistory: new edits discard what could be redone", testNewEditsDiscardRedo },
+    { "UndoHistory: the memory budget drops the oldest steps", testMemoryBudgetDropsOldestSteps },
+    { "UndoHistory: checkpoints restore the text", testCheckpointsRestoreText },
+    { "UndoHistory: checkpoints count in the memory budget", testCheckpointsCountInBudget },
+  });
+}
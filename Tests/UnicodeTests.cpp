@@ -0,0 +1,56 @@
+#include <Check.hpp>
+#include <Utils/Unicode.hpp>
+#include <string>
+
+using namespace varco;
+
+namespace {
+
+  void testAscii() {
+    CHECK(isAscii("0123456789abcdef0123", 20));
+    CHECK(!isAscii("0123456789abcdef012\xC3\xA9", 21));
+    CHECK(isAscii("", 0));
+  }
+
+  void testGraphemeClusters() {
+    const std::string cjk = "\xE4\xB8\xAD\xE6\x96\x87"; // Two CJK ideographs
+    int width = 0;
+    CHECK(getNextCluster(cjk.data(), cjk.size(), 0, &width) == 3 && width == 2);
+    const std::string combining = "e\xCC\x81x"; // e + combining acute accent, then x
+    CHECK(getNextCluster(combining.data(), combining.size(), 0, &width) == 3 && width == 1);
+    CHECK(getPreviousCluster(combining.data(), combining.size(), 3) == 0);
+    const std::string flags = "\xF0\x9F\x87\xAE\xF0\x9F\x87\xB9\xF0\x9F\x87\xAB\xF0\x9F\x87\xB7"; // Two flags
+    CHECK(getNextCluster(flags.data(), flags.size(), 0, &width) == 8 && width == 2);
+    CHECK(getPreviousCluster(flags.data(), flags.size(), 16) == 8);
+    const std::string family = "\xF0\x9F\x91\xA8\xE2\x80\x8D\xF0\x9F\x91\xA9"; // Man, ZWJ, woman
+    CHECK(getNextCluster(family.data(), family.size(), 0) == family.size());
+  }
+
+  void testUtf8Decoding() {
+    std::string text;
+    for (char32_t codePoint : { char32_t(0x41), char32_t(0xE9), char32_t(0x4E2D), char32_t(0x1F600) })
+      appendUtf8(codePoint, text);
+    CHECK(text.size() == 1 + 2 + 3 + 4);
+    size_t offset = 0;
+    CHECK(decodeUtf8(text.data(), text.size(), offset) == 0x41);
+    CHECK(decodeUtf8(text.data(), text.size(), offset) == 0xE9);
+    CHECK(decodeUtf8(text.data(), text.size(), offset) == 0x4E2D);
+    CHECK(decodeUtf8(text.data(), text.size(), offset) == 0x1F600 && offset == text.size());
+    CHECK(isValidUtf8(text.data(), text.size()));
+
+    const char overlong[] = "\xC0\xAF";
+    offset = 0;
+    CHECK(decodeUtf8(overlong, 2, offset) == 0xFFFD && offset == 1); // Invalid bytes decode one at a time
+    CHECK(!isValidUtf8(overlong, 2));
+    CHECK(!isValidUtf8("ab\xE4\xB8", 4)); // Truncated
+  }
+
+}
+
+int main() {
+  return Tests::run({
+    { "Unicode: ASCII detection", testAscii },
+    { "Unicode: grapheme clusters and their widths", testGraphemeClusters },
+    { "Unicode: UTF-8 encoding and decoding", testUtf8Decoding },
+  });
+}
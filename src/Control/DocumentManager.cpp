@@ -3,26 +3,46 @@
 #include <config.hpp>
 
 namespace varco {
-  DocumentManager::DocumentManager(CodeView& codeEditCtrl, TabBar& tabCtrl) :
+  DocumentManager::DocumentManager(CodeView& codeEditCtrl, TabBar& tabCtrl, FindResultsView& findResultsCtrl) :
     m_codeEditCtrl(codeEditCtrl),
-    m_tabCtrl(tabCtrl)
+    m_tabCtrl(tabCtrl),
+    m_findResultsCtrl(findResultsCtrl),
+    m_findInFiles([this]() { m_findResultsCtrl.invalidate(); }),
+    m_fileWatcher([this](const std::string& path) { onFileChanged(path); })
   {
-    // DEBUG - Add some debug tabs
-    int id = m_tabCtrl.addNewTab("BasicBlock.cpp");
-    auto it = m_tabDocumentMap.emplace(id, std::make_unique<Document>(m_codeEditCtrl));
-    Document *document = it.first->second.get();
-    document->loadFromFile(TestData::BasicBlockFile);
-    document->applySyntaxHighlight(CPP);
-    m_codeEditCtrl.loadDocument(*document);
+    restoreSession();
 
-    // Register callback for tab selection change - do this AFTER any debug tab addition
+    // Register callback for tab selection change - do this AFTER the tabs are restored
     tabCtrl.signalDocumentChange = [this](int id) {
       this->changeSelectedDocument(id);
       return true;
     };
+
+    findResultsCtrl.setSource(&m_findInFiles);
+    findResultsCtrl.signalResultSelected = [this](const FileMatch& match) {
+      this->openFindResult(match);
+    };
+  }
+
+  DocumentManager::~DocumentManager() {
+    {
+      std::lock_guard<std::mutex> lock(m_tabDocumentMapMutex);
+      m_stopRestoring = true;
+    }
+    if (m_restoreThread.joinable())
+      m_restoreThread.join();
+    storeSession();
   }
 
   namespace {
+    std::string stripDirectory(const std::string& filePath) {
+      for (int i = static_cast<int>(filePath.size() - 1); i >= 0; --i) {
+        if (filePath[i] == '\\' || filePath[i] == '/')
+          return filePath.substr(0, i == 0 ? 1 : i);
+      }
+      return ".";
+    }
+
     std::string stripFileName(const std::string& filePath) {
       for (int i = static_cast<int>(filePath.size() - 1); i >= 0; --i) {
         if (filePath[i] == '\\' || filePath[i] == '/')
@@ -42,13 +62,152 @@ namespace varco {
     auto fileName = stripFileName(filePath);
     int id = m_tabCtrl.addNewTab(fileName);
 
-    auto it = m_tabDocumentMap.emplace(id, std::make_unique<Document>(m_codeEditCtrl));
-    Document *document = it.first->second.get();
-    document->loadFromFile(filePath);
+    Document& document = addDocument(id);
+    if (document.loadFromFile(filePath))
+      m_fileWatcher.watch(filePath);
 
     if (extensionEndsIn(fileName, "cpp"))
-      document->applySyntaxHighlight(CPP);
-    m_codeEditCtrl.loadDocument(*document);
+      document.applySyntaxHighlight(CPP);
+    m_codeEditCtrl.loadDocument(document);
+  }
+
+  Document& DocumentManager::addDocument(int id) {
+    std::lock_guard<std::mutex> lock(m_tabDocumentMapMutex);
+    auto it = m_tabDocumentMap.emplace(id, std::make_unique<Document>(m_codeEditCtrl));
+    return *it.first->second;
+  }
+
+  // A restored tab which isn't being loaded is loaded right here, otherwise the restore thread is waited for
+  Document& DocumentManager::getDocument(int id) {
+    std::unique_lock<std::mutex> lock(m_tabDocumentMapMutex);
+    while (true) {
+      auto it = m_tabDocumentMap.find(id);
+      if (it != m_tabDocumentMap.end())
+        return *it->second;
+      auto restored = m_restoredTabs.find(id);
+      if (restored == m_restoredTabs.end()) // Every tab has a document
+        return *m_tabDocumentMap.emplace(id, std::make_unique<Document>(m_codeEditCtrl)).first->second;
+      if (!restored->second.m_loading) {
+        SessionTab tab = std::move(restored->second.m_tab);
+        m_restoredTabs.erase(restored);
+        lock.unlock();
+        std::unique_ptr<Document> document = openSessionDocument(tab);
+        lock.lock();
+        return *m_tabDocumentMap.emplace(id, std::move(document)).first->second;
+      }
+      m_restoredTabLoaded.wait(lock);
+    }
+  }
+
+  // Without a session (the first run) the test file is opened
+  void DocumentManager::restoreSession() {
+    Session session;
+    if (!loadSession(session) || session.m_tabs.empty()) {
+      int id = m_tabCtrl.addNewTab("BasicBlock.cpp");
+      Document& document = addDocument(id);
+      if (document.loadFromFile(TestData::BasicBlockFile))
+        m_fileWatcher.watch(TestData::BasicBlockFile);
+      document.applySyntaxHighlight(CPP);
+      m_codeEditCtrl.loadDocument(document);
+      return;
+    }
+
+    int selectedId = -1;
+    {
+      std::lock_guard<std::mutex> lock(m_tabDocumentMapMutex);
+      for (size_t i = 0; i < session.m_tabs.size(); ++i) {
+        const bool selected = (static_cast<int>(i) == session.m_selected);
+        int id = m_tabCtrl.addNewTab(stripFileName(session.m_tabs[i].m_path), selected);
+        m_tabDocumentVScrollPos[id] = session.m_tabs[i].m_scrollPosition;
+        m_restoredTabs[id].m_tab = std::move(session.m_tabs[i]);
+        if (selected)
+          selectedId = id;
+      }
+    }
+    if (selectedId != -1) {
+      SkScalar scrollPosition = m_tabDocumentVScrollPos[selectedId];
+      m_codeEditCtrl.loadDocument(getDocument(selectedId), scrollPosition);
+    }
+    if (!m_restoredTabs.empty())
+      m_restoreThread = std::thread(&DocumentManager::restoreTabs, this);
+  }
+
+  std::unique_ptr<Document> DocumentManager::openSessionDocument(const SessionTab& tab) {
+    auto document = std::make_unique<Document>(m_codeEditCtrl);
+    if (document->loadFromFile(tab.m_path))
+      m_fileWatcher.watch(tab.m_path);
+    if (extensionEndsIn(stripFileName(tab.m_path), "cpp"))
+      document->applySyntaxHighlight(CPP); // Not rendered yet: only sets the lexer up
+    if (!document->isStreaming()) // Carets of streamed documents are in the window, which starts at the top
+      document->setCursorPosition(tab.m_caret);
+    return document;
+  }
+
+  // Tabs are loaded in their order, each one in a document nobody else sees until it's added to the map
+  void DocumentManager::restoreTabs() {
+    std::unique_lock<std::mutex> lock(m_tabDocumentMapMutex);
+    while (!m_stopRestoring && !m_restoredTabs.empty()) {
+      auto restored = m_restoredTabs.begin(); // Tabs selected meanwhile are taken out of the map
+      restored->second.m_loading = true;
+      const int id = restored->first;
+      const SessionTab tab = restored->second.m_tab;
+      lock.unlock();
+      std::unique_ptr<Document> document = openSessionDocument(tab);
+      lock.lock();
+      m_restoredTabs.erase(id);
+      m_tabDocumentMap.emplace(id, std::move(document));
+      m_restoredTabLoaded.notify_all();
+    }
+  }
+
+  // Tabs which weren't loaded keep what the last session had for them. Documents which weren't loaded from a
+  // file aren't restored
+  void DocumentManager::storeSession() {
+    Session session;
+    const int selectedId = getSelectedDocumentId();
+    for (const auto& tab : m_tabCtrl.tabs) {
+      SessionTab sessionTab;
+      auto restored = m_restoredTabs.find(tab.uniqueId);
+      auto it = m_tabDocumentMap.find(tab.uniqueId);
+      if (restored != m_restoredTabs.end())
+        sessionTab = restored->second.m_tab;
+      else if (it != m_tabDocumentMap.end() && !it->second->getFilePath().empty()) {
+        sessionTab.m_path = it->second->getFilePath();
+        sessionTab.m_caret = it->second->getCursorPosition();
+        auto scroll = m_tabDocumentVScrollPos.find(tab.uniqueId);
+        if (tab.uniqueId == selectedId)
+          sessionTab.m_scrollPosition = m_codeEditCtrl.getVScrollbarValue();
+        else if (scroll != m_tabDocumentVScrollPos.end())
+          sessionTab.m_scrollPosition = scroll->second;
+      } else
+        continue;
+      if (tab.uniqueId == selectedId)
+        session.m_selected = static_cast<int>(session.m_tabs.size());
+      session.m_tabs.emplace_back(std::move(sessionTab));
+    }
+    saveSession(session);
+  }
+
+  // Documents are never removed: the ones loaded from the file are reloaded outside of the lock
+  void DocumentManager::onFileChanged(const std::string& path) {
+    std::vector<Document*> documents;
+    {
+      std::lock_guard<std::mutex> lock(m_tabDocumentMapMutex);
+      for (auto& pair : m_tabDocumentMap) {
+        if (pair.second->getFilePath() == path)
+          documents.push_back(pair.second.get());
+      }
+    }
+    for (Document *document : documents)
+      document->reloadFromDisk();
+  }
+
+  void DocumentManager::toggleFollowTail() {
+    if (getSelectedDocumentId() == -1)
+      return;
+    Document& document = getDocument(getSelectedDocumentId());
+    document.setFollowTail(!document.isFollowingTail());
+    m_codeEditCtrl.repaint();
   }
 
   void DocumentManager::changeSelectedDocument(int id) {
@@ -62,6 +221,78 @@ namespace varco {
     if (it != m_tabDocumentVScrollPos.end())
       vScrollbarPos = it->second;
     // And load the document
-    m_codeEditCtrl.loadDocument(*m_tabDocumentMap[id], vScrollbarPos); // The document MUST be present
+    m_codeEditCtrl.loadDocument(getDocument(id), vScrollbarPos);
+  }
+
+  int DocumentManager::getSelectedDocumentId() {
+    if (m_tabCtrl.selectedTabIndex < 0)
+      return -1;
+    return m_tabCtrl.tabs[m_tabCtrl.selectedTabIndex].uniqueId;
+  }
+
+  bool DocumentManager::findInFiles(const std::string& needle, bool regex, const std::string& directory) {
+    std::vector<FindInFiles::OpenBuffer> openBuffers;
+    std::unique_lock<std::mutex> lock(m_tabDocumentMapMutex); // Tabs which aren't loaded yet are searched on disk
+    for (auto& pair : m_tabDocumentMap) {
+      // Streamed documents are read-only and only hold a window of their file: the file is searched instead
+      if (!pair.second->getFilePath().empty() && !pair.second->isStreaming())
+        openBuffers.push_back({ pair.second->getFilePath(), pair.second->getSnapshot() });
+    }
+    lock.unlock();
+
+    m_findResultsCtrl.setSource(&m_findInFiles);
+    bool valid = m_findInFiles.start(needle, regex, std::move(openBuffers), directory);
+    m_findResultsCtrl.setVisible(true); // Also shows why an expression is invalid
+    return valid;
+  }
+
+  bool DocumentManager::findWordAtCaretInFiles() {
+    if (getSelectedDocumentId() == -1)
+      return false;
+    Document& document = getDocument(getSelectedDocumentId());
+    std::string word = document.getWordAt(document.getCursorPosition());
+    if (word.empty())
+      return false;
+    std::string directory = document.getFilePath().empty() ? "." : stripDirectory(document.getFilePath());
+    return findInFiles(word, false, directory);
+  }
+
+  void DocumentManager::openFindResult(const FileMatch& match) {
+    // Open documents are recognized by the path they were loaded from (as it was written)
+    int id = -1;
+    {
+      std::lock_guard<std::mutex> lock(m_tabDocumentMapMutex);
+      for (auto& pair : m_tabDocumentMap) {
+        if (pair.second->getFilePath() == match.m_path) {
+          id = pair.first;
+          break;
+        }
+      }
+      for (auto& pair : m_restoredTabs) {
+        if (id == -1 && pair.second.m_tab.m_path == match.m_path)
+          id = pair.first;
+      }
+    }
+
+    if (id == -1) {
+      addNewFileDocument(match.m_path); // Also selects it
+      id = getSelectedDocumentId();
+    } else if (id != getSelectedDocumentId()) {
+      changeSelectedDocument(id);
+      m_tabCtrl.tabs[m_tabCtrl.selectedTabIndex].setSelected(false);
+      m_tabCtrl.selectedTabIndex = m_tabCtrl.tabId2tabIndexMap[id];
+      m_tabCtrl.tabs[m_tabCtrl.selectedTabIndex].setSelected(true);
+    }
+
+    Document& document = getDocument(id);
+    size_t line = match.m_line;
+    if (document.isStreaming()) { // A line of the file: the window is moved there first
+      m_codeEditCtrl.scrollStreamTo(static_cast<SkScalar>(match.m_line));
+      bool moved;
+      line = document.moveStreamWindow(match.m_line, moved);
+    }
+    document.setCursorPosition({ static_cast<int>(match.m_column), static_cast<int>(line) });
+    m_codeEditCtrl.ensureCaretVisible();
+    m_codeEditCtrl.repaint();
   }
 }
@@ -4,26 +4,69 @@
 #include <Document/Document.hpp>
 #include <UI/CodeView/CodeView.hpp>
 #include <UI/TabBar/TabBar.hpp>
+#include <UI/FindResults/FindResultsView.hpp>
+#include <Control/FindInFiles.hpp>
+#include <Control/Session.hpp>
+#include <Utils/FileWatcher.hpp>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <map>
 
 namespace varco {
 
   class DocumentManager {
   public:
-    DocumentManager(CodeView& codeEditCtrl, TabBar& tabCtrl);
+    // The tabs of the last session are restored (see Session): only the selected one is loaded right away, the
+    // others are loaded in the background one after the other (or as soon as they're selected)
+    DocumentManager(CodeView& codeEditCtrl, TabBar& tabCtrl, FindResultsView& findResultsCtrl);
+    ~DocumentManager(); // Saves the session
 
     void addNewFileDocument(std::string filePath);
     void changeSelectedDocument(int id /* Document id, also tab id in m_tabDocumentMap */);
 
+    // Searches all the open documents (as they are now) and the files in 'directory' and its subdirectories
+    // (as they are on disk), results are shown in the find results control. Returns false if the regex is invalid
+    bool findInFiles(const std::string& needle, bool regex, const std::string& directory);
+    // Searches the word at the caret in the directory of the selected document
+    bool findWordAtCaretInFiles();
+    void openFindResult(const FileMatch& match); // Selects (or opens) the document and moves the caret there
+    void toggleFollowTail(); // Tail mode for the selected document (see Document::setFollowTail)
+
   private:
     CodeView& m_codeEditCtrl;
     TabBar& m_tabCtrl;    
+    FindResultsView& m_findResultsCtrl;
+    FindInFiles m_findInFiles;
+
+    int getSelectedDocumentId();
+    Document& addDocument(int id);
+    Document& getDocument(int id); // Loads the document of a restored tab if it's not loaded yet
+    void onFileChanged(const std::string& path); // File watcher thread
+
+    void restoreSession();
+    std::unique_ptr<Document> openSessionDocument(const SessionTab& tab); // Any thread
+    void restoreTabs(); // Restore thread
+    void storeSession();
 
     // A map that stores the association between a tab and a document
     std::map<int, std::unique_ptr<Document>> m_tabDocumentMap;
+    // Held to add documents (the restore thread adds them too) and to look them up outside of the UI thread.
+    // Documents are never removed: their addresses can be used without it
+    std::mutex m_tabDocumentMapMutex;
+    struct RestoredTab { // A tab of the last session whose document isn't loaded yet
+      SessionTab m_tab;
+      bool m_loading = false; // By the restore thread
+    };
+    std::map<int, RestoredTab> m_restoredTabs; // Protected by m_tabDocumentMapMutex
+    std::condition_variable m_restoredTabLoaded;
+    bool m_stopRestoring = false; // Protected by m_tabDocumentMapMutex
+    std::thread m_restoreThread;
     // A map that stores the vertical scrollbar position for each document (to remember it)
     std::map<int, SkScalar> m_tabDocumentVScrollPos;
+
+    FileWatcher m_fileWatcher; // Last: its thread is stopped before the documents are destroyed
   };
 
 }
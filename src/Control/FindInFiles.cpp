@@ -0,0 +1,537 @@
+#include <Control/FindInFiles.hpp>
+#include <Utils/MappedFile.hpp>
+#include <Utils/SubstringSearch.hpp>
+#include <Utils/WorkerPool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <unordered_set>
+#ifdef _WIN32
+  #include <windows.h>
+#elif defined __linux__
+  #include <dirent.h>
+  #include <sys/stat.h>
+#endif
+
+namespace varco {
+
+#define FILES_PER_JOB 32 // Files searched by a single job
+#define PROGRESS_INTERVAL_MS 50 // Minimum time between two progress notifications
+#define MAX_RESULTS 100000 // The search stops when this many matches have been found
+#define MAX_PREVIEW_LENGTH 200
+#define BINARY_PROBE_BYTES 8000 // Files with a NUL byte among these are considered binary and skipped
+#define CANCEL_CHECK_LINES 65536 // Lines searched between two cancellation checks
+
+  namespace {
+
+    // A .gitignore line. Patterns are matched against paths relative to the directory of their file
+    struct IgnoreRule {
+      std::string m_base; // Directory the rule was read in, relative to the searched one ("" or "dir/")
+      std::string m_pattern;
+      bool m_negate = false;
+      bool m_directoryOnly = false;
+      bool m_hasSlash = false; // Matched against the whole relative path rather than just the name
+    };
+    using IgnoreRules = std::vector<IgnoreRule>;
+
+    // Glob matching: '*' and '?' don't cross '/', '**' does, [...] classes
+    bool globMatch(const char *pattern, const char *text) {
+      while (*pattern != '\0') {
+        if (pattern[0] == '*' && pattern[1] == '*') {
+          pattern += 2;
+          if (*pattern == '/')
+            ++pattern; // "**/" also matches no directory at all
+          for (const char *t = text;; ++t) {
+            if (globMatch(pattern, t))
+              return true;
+            if (*t == '\0')
+              return false;
+          }
+        }
+        if (*pattern == '*') {
+          ++pattern;
+          for (const char *t = text;; ++t) {
+            if (globMatch(pattern, t))
+              return true;
+            if (*t == '\0' || *t == '/')
+              return false;
+          }
+        }
+        if (*text == '\0')
+          return false;
+        if (*pattern == '[') {
+          const char *p = pattern + 1;
+          bool negate = (*p == '!' || *p == '^');
+          if (negate)
+            ++p;
+          bool matched = false;
+          for (bool first = true; *p != '\0' && (*p != ']' || first); first = false) {
+            char low = *p++, high = low;
+            if (*p == '-' && p[1] != ']' && p[1] != '\0') {
+              high = p[1];
+              p += 2;
+            }
+            if (*text >= low && *text <= high)
+              matched = true;
+          }
+          if (*p != ']') { // Not a class after all
+            if (*text != '[')
+              return false;
+            ++pattern;
+          } else {
+            if (matched == negate || *text == '/')
+              return false;
+            pattern = p + 1;
+          }
+          ++text;
+          continue;
+        }
+        if (*pattern == '\\' && pattern[1] != '\0')
+          ++pattern;
+        if ((*pattern == '?' && *text == '/') || (*pattern != '?' && *pattern != *text))
+          return false;
+        ++pattern;
+        ++text;
+      }
+      return *text == '\0';
+    }
+
+    void loadIgnoreFile(const std::string& path, const std::string& base, IgnoreRules& rules) {
+      std::ifstream file(path);
+      std::string line;
+      while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        while (!line.empty() && line.back() == ' ')
+          line.pop_back();
+        if (line.empty() || line[0] == '#')
+          continue;
+        IgnoreRule rule;
+        rule.m_base = base;
+        if (line[0] == '!') {
+          rule.m_negate = true;
+          line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+          rule.m_directoryOnly = true;
+          line.pop_back();
+        }
+        rule.m_hasSlash = (line.find('/') != std::string::npos);
+        if (!line.empty() && line[0] == '/')
+          line.erase(0, 1);
+        if (line.empty())
+          continue;
+        rule.m_pattern = std::move(line);
+        rules.emplace_back(std::move(rule));
+      }
+    }
+
+    // The last matching rule wins
+    bool isIgnored(const IgnoreRules& rules, const std::string& relativePath, const std::string& name, bool isDirectory) {
+      bool ignored = false;
+      for (const auto& rule : rules) {
+        if (rule.m_directoryOnly && !isDirectory)
+          continue;
+        if (relativePath.compare(0, rule.m_base.size(), rule.m_base) != 0)
+          continue;
+        const char *subject = rule.m_hasSlash ? relativePath.c_str() + rule.m_base.size() : name.c_str();
+        if (globMatch(rule.m_pattern.c_str(), subject))
+          ignored = !rule.m_negate;
+      }
+      return ignored;
+    }
+
+    struct DirectoryEntry {
+      std::string m_name;
+      bool m_isDirectory;
+    };
+
+    bool listDirectory(const std::string& path, std::vector<DirectoryEntry>& entries) {
+#ifdef _WIN32
+      WIN32_FIND_DATAA data;
+      HANDLE find = FindFirstFileA((path + "/*").c_str(), &data);
+      if (find == INVALID_HANDLE_VALUE)
+        return false;
+      do {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+          continue; // Don't follow links (cycles)
+        entries.push_back({ data.cFileName, (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 });
+      } while (FindNextFileA(find, &data));
+      FindClose(find);
+      return true;
+#elif defined __linux__
+      DIR *directory = opendir(path.c_str());
+      if (directory == nullptr)
+        return false;
+      while (dirent *entry = readdir(directory)) {
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) { // Some filesystems don't report types
+          struct stat info;
+          if (lstat((path + '/' + entry->d_name).c_str(), &info) != 0)
+            continue;
+          type = S_ISDIR(info.st_mode) ? DT_DIR : (S_ISREG(info.st_mode) ? DT_REG : DT_LNK);
+        }
+        if (type == DT_DIR || type == DT_REG) // Links aren't followed (cycles)
+          entries.push_back({ entry->d_name, type == DT_DIR });
+      }
+      closedir(directory);
+      return true;
+#endif
+    }
+
+    std::string makePreview(const char *begin, const char *end) {
+      if (end > begin && end[-1] == '\r')
+        --end;
+      return std::string(begin, std::min<size_t>(end - begin, MAX_PREVIEW_LENGTH));
+    }
+  }
+
+  struct FindInFiles::Jobs {
+    std::mutex m_mutex;
+    std::condition_variable m_allDone;
+    size_t m_running = 0;
+  };
+
+  struct FindInFiles::Search {
+    std::function<void()> m_onProgress;
+    std::shared_ptr<Jobs> m_jobs;
+    std::string m_needle;
+    std::shared_ptr<const Regex> m_regex; // Null for literal searches
+    std::string m_directory;
+    std::unordered_set<std::string> m_openPaths; // Searched in their documents instead
+
+    std::atomic<bool> m_cancel{ false };
+    std::atomic<bool> m_full{ false }; // MAX_RESULTS reached
+    std::atomic<size_t> m_pendingJobs{ 0 };
+    std::atomic<std::chrono::steady_clock::rep> m_lastProgress{ 0 };
+
+    std::mutex m_mutex; // Protects the following
+    std::vector<FileMatch> m_results;
+    size_t m_fileCount = 0;
+    size_t m_filesSearched = 0;
+    bool m_finished = false;
+
+    bool stopped() const { return m_cancel || m_full; }
+  };
+
+  FindInFiles::FindInFiles(std::function<void()> onProgress) :
+    m_onProgress(std::move(onProgress)),
+    m_jobs(std::make_shared<Jobs>())
+  {}
+
+  FindInFiles::~FindInFiles() {
+    cancel();
+    std::unique_lock<std::mutex> lock(m_jobs->m_mutex);
+    m_jobs->m_allDone.wait(lock, [this]() { return m_jobs->m_running == 0; });
+  }
+
+  void FindInFiles::cancel() {
+    auto search = getSearch();
+    if (search)
+      search->m_cancel = true;
+  }
+
+  std::shared_ptr<FindInFiles::Search> FindInFiles::getSearch() {
+    std::unique_lock<std::mutex> lock(m_searchMutex);
+    return m_search;
+  }
+
+  bool FindInFiles::start(const std::string& needle, bool regex, std::vector<OpenBuffer> openBuffers, const std::string& directory) {
+    cancel();
+    auto search = std::make_shared<Search>();
+    m_error.clear();
+    search->m_onProgress = m_onProgress;
+    search->m_jobs = m_jobs;
+    search->m_needle = needle;
+    search->m_directory = directory;
+    bool valid = true;
+    if (regex) {
+      search->m_regex = Regex::compile(needle, true, &m_error);
+      valid = (search->m_regex != nullptr);
+    }
+    {
+      std::unique_lock<std::mutex> lock(m_searchMutex);
+      m_search = search;
+    }
+    if (!valid || needle.empty() || needle.find('\n') != std::string::npos) { // Matches never span lines
+      std::unique_lock<std::mutex> lock(search->m_mutex);
+      search->m_finished = true;
+      return valid;
+    }
+
+    for (auto& buffer : openBuffers)
+      search->m_openPaths.insert(buffer.m_path);
+    ++search->m_pendingJobs; // Held until everything has been posted: the search can't finish before
+    for (auto& buffer : openBuffers) {
+      auto shared = std::make_shared<OpenBuffer>(std::move(buffer));
+      post(search, [search, shared]() { searchBuffer(search, *shared); });
+    }
+    if (!directory.empty())
+      post(search, [search]() { walkDirectory(search); });
+    finishJob(search); // Releases the hold
+    return true;
+  }
+
+  void FindInFiles::finishJob(std::shared_ptr<Search> search) {
+    if (--search->m_pendingJobs != 0)
+      return;
+    {
+      std::unique_lock<std::mutex> lock(search->m_mutex);
+      search->m_finished = true;
+    }
+    if (!search->m_cancel)
+      search->m_onProgress();
+  }
+
+  // Every job goes through here: the last one to complete marks the search as finished
+  void FindInFiles::post(std::shared_ptr<Search> search, std::function<void()> job) {
+    ++search->m_pendingJobs;
+    {
+      std::unique_lock<std::mutex> lock(search->m_jobs->m_mutex);
+      ++search->m_jobs->m_running;
+    }
+    WorkerPool::get().post([search, job]() {
+      if (!search->m_cancel)
+        job();
+      finishJob(search);
+
+      auto jobs = search->m_jobs;
+      std::unique_lock<std::mutex> lock(jobs->m_mutex);
+      if (--jobs->m_running == 0)
+        jobs->m_allDone.notify_all();
+    });
+  }
+
+  // Depth-first walk of the directory tree. The .gitignore files found on the way apply to the directory
+  // they're in and to everything below it
+  void FindInFiles::walkDirectory(std::shared_ptr<Search> search) {
+    struct PendingDirectory {
+      std::string m_path;
+      std::string m_relativePath; // "" or "dir/subdir/"
+      std::shared_ptr<const IgnoreRules> m_rules;
+    };
+    std::vector<PendingDirectory> stack;
+    stack.push_back({ search->m_directory, std::string(), std::make_shared<IgnoreRules>() });
+
+    std::vector<std::string> batch;
+    std::vector<DirectoryEntry> entries;
+    while (!stack.empty() && !search->stopped()) {
+      PendingDirectory directory = std::move(stack.back());
+      stack.pop_back();
+
+      entries.clear();
+      if (!listDirectory(directory.m_path, entries))
+        continue;
+      for (const auto& entry : entries) {
+        if (entry.m_name == ".gitignore") {
+          auto rules = std::make_shared<IgnoreRules>(*directory.m_rules);
+          loadIgnoreFile(directory.m_path + "/.gitignore", directory.m_relativePath, *rules);
+          directory.m_rules = std::move(rules);
+          break;
+        }
+      }
+
+      for (const auto& entry : entries) {
+        if (entry.m_name == "." || entry.m_name == ".." || entry.m_name == ".git")
+          continue;
+        std::string relativePath = directory.m_relativePath + entry.m_name;
+        if (isIgnored(*directory.m_rules, relativePath, entry.m_name, entry.m_isDirectory))
+          continue;
+        std::string path = directory.m_path + '/' + entry.m_name;
+        if (entry.m_isDirectory)
+          stack.push_back({ std::move(path), relativePath + '/', directory.m_rules });
+        else if (search->m_openPaths.count(path) == 0) {
+          batch.emplace_back(std::move(path));
+          if (batch.size() == FILES_PER_JOB) {
+            auto files = std::make_shared<std::vector<std::string>>(std::move(batch));
+            post(search, [search, files]() { searchFiles(search, *files); });
+            batch.clear();
+          }
+        }
+      }
+    }
+    if (!batch.empty()) {
+      auto files = std::make_shared<std::vector<std::string>>(std::move(batch));
+      post(search, [search, files]() { searchFiles(search, *files); });
+    }
+  }
+
+  void FindInFiles::searchFiles(std::shared_ptr<Search> search, const std::vector<std::string>& paths) {
+    const std::string& needle = search->m_needle;
+    std::unique_ptr<RegexMatcher> matcher;
+    if (search->m_regex)
+      matcher.reset(new RegexMatcher(search->m_regex));
+
+    MappedFile file;
+    std::vector<FileMatch> results;
+    std::vector<std::pair<size_t, size_t>> spans;
+    size_t searched = 0;
+    for (const auto& path : paths) {
+      if (search->stopped())
+        break;
+      if (!file.open(path))
+        continue;
+      ++searched;
+      const char *data = file.getData();
+      const char *end = data + file.getSize();
+      if (data == nullptr || std::memchr(data, '\0', std::min<size_t>(file.getSize(), BINARY_PROBE_BYTES)) != nullptr)
+        continue; // Empty or binary
+
+      auto addMatch = [&](size_t line, const char *lineStart, const char *begin, const char *matchEnd) {
+        const char *lineEnd = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        results.push_back({ path, line, static_cast<size_t>(begin - lineStart), static_cast<size_t>(matchEnd - begin),
+                            makePreview(lineStart, lineEnd ? lineEnd : end) });
+      };
+
+      if (!matcher) {
+        // The whole mapping is scanned at once, lines are only counted up to the matches
+        size_t line = 0;
+        const char *lineStart = data;
+        const char *position = data;
+        const char *match;
+        while ((match = findSubstring(position, end - position, needle.data(), needle.size())) != nullptr) {
+          const char *newline;
+          while ((newline = static_cast<const char*>(std::memchr(lineStart, '\n', match - lineStart))) != nullptr) {
+            ++line;
+            lineStart = newline + 1;
+          }
+          addMatch(line, lineStart, match, match + needle.size());
+          position = match + needle.size();
+          if (search->stopped())
+            break;
+        }
+      } else {
+        size_t line = 0;
+        for (const char *lineStart = data; lineStart < end && !(line % CANCEL_CHECK_LINES == 0 && search->stopped()); ++line) {
+          const char *lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', end - lineStart));
+          if (lineEnd == nullptr)
+            lineEnd = end;
+          size_t length = lineEnd - lineStart;
+          if (length > 0 && lineStart[length - 1] == '\r')
+            --length;
+          spans.clear();
+          matcher->findAll(lineStart, length, spans);
+          for (const auto& span : spans)
+            addMatch(line, lineStart, lineStart + span.first, lineStart + span.second);
+          lineStart = lineEnd + 1;
+        }
+      }
+      file.close();
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(search->m_mutex);
+      search->m_filesSearched += searched;
+    }
+    addResults(*search, results);
+  }
+
+  void FindInFiles::searchBuffer(std::shared_ptr<Search> search, const OpenBuffer& buffer) {
+    const std::string& needle = search->m_needle;
+    std::unique_ptr<RegexMatcher> matcher;
+    if (search->m_regex)
+      matcher.reset(new RegexMatcher(search->m_regex));
+
+    std::vector<FileMatch> results;
+    std::vector<std::pair<size_t, size_t>> spans;
+    buffer.m_snapshot.forEachLine(0, buffer.m_snapshot.getLineCount(), [&](size_t line, const std::string& text) {
+      spans.clear();
+      if (matcher)
+        matcher->findAll(text.data(), text.size(), spans);
+      else {
+        const char *position = text.data();
+        const char *end = position + text.size();
+        while ((position = findSubstring(position, end - position, needle.data(), needle.size())) != nullptr) {
+          spans.emplace_back(position - text.data(), position - text.data() + needle.size());
+          position += needle.size();
+        }
+      }
+      for (const auto& span : spans) {
+        results.push_back({ buffer.m_path, line, span.first, span.second - span.first,
+                            text.substr(0, MAX_PREVIEW_LENGTH) });
+      }
+      return !(line % CANCEL_CHECK_LINES == 0 && search->stopped());
+    });
+
+    {
+      std::unique_lock<std::mutex> lock(search->m_mutex);
+      ++search->m_filesSearched;
+    }
+    addResults(*search, results);
+  }
+
+  void FindInFiles::addResults(Search& search, std::vector<FileMatch>& results) {
+    if (!results.empty()) {
+      std::unique_lock<std::mutex> lock(search.m_mutex);
+      size_t room = MAX_RESULTS - std::min<size_t>(MAX_RESULTS, search.m_results.size());
+      if (results.size() >= room)
+        search.m_full = true;
+      results.resize(std::min(results.size(), room));
+      for (size_t i = 0; i < results.size(); ++i) { // Results are grouped by file
+        if (i == 0 || results[i].m_path != results[i - 1].m_path)
+          ++search.m_fileCount;
+      }
+      std::move(results.begin(), results.end(), std::back_inserter(search.m_results));
+    }
+
+    // Throttled: a view showing the results shouldn't repaint for every job
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto last = search.m_lastProgress.load();
+    auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::milliseconds(PROGRESS_INTERVAL_MS)).count();
+    if (now - last >= interval && search.m_lastProgress.compare_exchange_strong(last, now) && !search.m_cancel)
+      search.m_onProgress();
+  }
+
+  const std::string& FindInFiles::getError() const {
+    return m_error;
+  }
+
+  bool FindInFiles::isFinished() {
+    auto search = getSearch();
+    if (!search)
+      return true;
+    std::unique_lock<std::mutex> lock(search->m_mutex);
+    return search->m_finished;
+  }
+
+  size_t FindInFiles::getResultCount() {
+    auto search = getSearch();
+    if (!search)
+      return 0;
+    std::unique_lock<std::mutex> lock(search->m_mutex);
+    return search->m_results.size();
+  }
+
+  size_t FindInFiles::getFileCount() {
+    auto search = getSearch();
+    if (!search)
+      return 0;
+    std::unique_lock<std::mutex> lock(search->m_mutex);
+    return search->m_fileCount;
+  }
+
+  size_t FindInFiles::getFilesSearched() {
+    auto search = getSearch();
+    if (!search)
+      return 0;
+    std::unique_lock<std::mutex> lock(search->m_mutex);
+    return search->m_filesSearched;
+  }
+
+  std::vector<FileMatch> FindInFiles::getResults(size_t first, size_t count) {
+    std::vector<FileMatch> results;
+    auto search = getSearch();
+    if (!search)
+      return results;
+    std::unique_lock<std::mutex> lock(search->m_mutex);
+    const auto& all = search->m_results;
+    for (size_t i = first; i < all.size() && i < first + count; ++i)
+      results.push_back(all[i]);
+    return results;
+  }
+
+}
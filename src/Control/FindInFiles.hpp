@@ -0,0 +1,73 @@
+#ifndef VARCO_FINDINFILES_HPP
+#define VARCO_FINDINFILES_HPP
+
+#include <Document/TextBuffer.hpp>
+#include <Utils/Regex.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace varco {
+
+  struct FileMatch {
+    std::string m_path;
+    size_t m_line;
+    size_t m_column; // In bytes: a position on the line of a Document
+    size_t m_length;
+    std::string m_preview; // The line the match is on (possibly truncated)
+  };
+
+  // Searches a literal needle (or a regular expression) in all the open documents and in every file of a
+  // directory tree. Everything runs on the WorkerPool: one job walks the tree (honoring .gitignore files)
+  // and posts the files it finds in batches, the other workers search them through read-only memory
+  // mappings. Open documents are searched in their current state instead of their files on disk.
+  //
+  // Results are appended as files are completed and can be read while the search goes on. Starting a new
+  // search cancels the previous one: its jobs notice and return at the next file
+  class FindInFiles {
+  public:
+    struct OpenBuffer {
+      std::string m_path;
+      TextBuffer m_snapshot;
+    };
+
+    // 'onProgress' is called on a worker thread when new results are available (throttled) and at the end
+    explicit FindInFiles(std::function<void()> onProgress);
+    ~FindInFiles(); // Cancels and waits for the jobs to return
+
+    // Returns false if 'regex' is set and the needle isn't a valid pattern (see getError())
+    bool start(const std::string& needle, bool regex, std::vector<OpenBuffer> openBuffers, const std::string& directory);
+    void cancel();
+
+    const std::string& getError() const;
+    bool isFinished();
+    size_t getResultCount();
+    size_t getFileCount(); // Files containing at least a match
+    size_t getFilesSearched();
+    std::vector<FileMatch> getResults(size_t first, size_t count);
+
+  private:
+    struct Jobs; // Jobs in flight, of all the searches started by this object
+    struct Search;
+
+    // Worker threads
+    static void post(std::shared_ptr<Search> search, std::function<void()> job);
+    static void finishJob(std::shared_ptr<Search> search);
+    static void walkDirectory(std::shared_ptr<Search> search);
+    static void searchFiles(std::shared_ptr<Search> search, const std::vector<std::string>& paths);
+    static void searchBuffer(std::shared_ptr<Search> search, const OpenBuffer& buffer);
+    static void addResults(Search& search, std::vector<FileMatch>& results);
+
+    std::function<void()> m_onProgress;
+    std::shared_ptr<Jobs> m_jobs;
+    std::mutex m_searchMutex; // Results might be read by the rendering thread while a new search starts
+    std::shared_ptr<Search> m_search; // Current search, jobs of the previous ones hold on to their own
+    std::shared_ptr<Search> getSearch();
+    std::string m_error;
+  };
+
+}
+
+#endif // VARCO_FINDINFILES_HPP
@@ -0,0 +1,93 @@
+#include <Control/Session.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/stat.h>
+#endif
+
+namespace varco {
+
+#define SESSION_HEADER "varco-session 1" // Sessions written by another version are ignored
+
+  namespace {
+    std::string getSessionPath() { // The configuration directory is created if missing
+#ifdef _WIN32
+      const char *base = std::getenv("APPDATA");
+      if (base == nullptr || *base == '\0')
+        return std::string();
+      std::string directory = std::string(base) + "\\varco";
+      CreateDirectoryA(directory.c_str(), nullptr);
+      return directory + "\\session";
+#else
+      std::string directory;
+      const char *base = std::getenv("XDG_CONFIG_HOME");
+      if (base != nullptr && *base != '\0')
+        directory = base;
+      else if ((base = std::getenv("HOME")) != nullptr && *base != '\0') {
+        directory = std::string(base) + "/.config";
+        mkdir(directory.c_str(), 0755);
+      } else
+        return std::string();
+      directory += "/varco";
+      mkdir(directory.c_str(), 0755);
+      return directory + "/session";
+#endif
+    }
+  }
+
+  bool loadSession(Session& session) {
+    const std::string path = getSessionPath();
+    std::ifstream file(path);
+    std::string line;
+    if (path.empty() || !file || !std::getline(file, line) || line != SESSION_HEADER)
+      return false;
+
+    session = Session();
+    while (std::getline(file, line)) {
+      std::istringstream fields(line);
+      std::string kind;
+      fields >> kind;
+      if (kind == "selected")
+        fields >> session.m_selected;
+      else if (kind == "tab") {
+        SessionTab tab;
+        fields >> tab.m_scrollPosition >> tab.m_caret.y >> tab.m_caret.x;
+        fields.get(); // The space before the path
+        if (!fields || !std::getline(fields, tab.m_path) || tab.m_path.empty())
+          continue;
+        session.m_tabs.emplace_back(std::move(tab));
+      }
+    }
+    if (session.m_selected < 0 || session.m_selected >= static_cast<int>(session.m_tabs.size()))
+      session.m_selected = session.m_tabs.empty() ? -1 : 0;
+    return true;
+  }
+
+  bool saveSession(const Session& session) {
+    const std::string path = getSessionPath();
+    if (path.empty())
+      return false;
+    const std::string temporary = path + ".tmp";
+    {
+      std::ofstream file(temporary, std::ios::trunc);
+      file.precision(10); // Scroll positions of long documents need more than the default six digits
+      file << SESSION_HEADER << '\n' << "selected " << session.m_selected << '\n';
+      for (const auto& tab : session.m_tabs)
+        file << "tab " << tab.m_scrollPosition << ' ' << tab.m_caret.y << ' ' << tab.m_caret.x << ' ' << tab.m_path << '\n';
+      if (!file.flush()) {
+        file.close();
+        std::remove(temporary.c_str());
+        return false;
+      }
+    }
+#ifdef _WIN32
+    std::remove(path.c_str()); // rename() doesn't replace files on Windows
+#endif
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+  }
+
+}
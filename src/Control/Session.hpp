@@ -0,0 +1,30 @@
+#ifndef VARCO_SESSION_HPP
+#define VARCO_SESSION_HPP
+
+#include <Document/TextBuffer.hpp>
+#include <SkScalar.h>
+#include <string>
+#include <vector>
+
+namespace varco {
+
+  struct SessionTab { // A tab as it was when the editor was closed
+    std::string m_path;
+    SkScalar m_scrollPosition = 0; // Vertical scrollbar value (a line of the file for streamed documents)
+    DocumentPosition m_caret;
+  };
+
+  // The tabs open when the editor was closed, in the order they were in, and the selected one. Kept in
+  // the user's configuration directory as a small text file: a header with the format version, then a line
+  // per tab (the path last, so it can contain spaces)
+  struct Session {
+    std::vector<SessionTab> m_tabs;
+    int m_selected = -1; // Index in m_tabs
+  };
+
+  bool loadSession(Session& session); // False if there's no session (or it's from another version)
+  bool saveSession(const Session& session); // Written aside first, then renamed over the old one
+
+}
+
+#endif // VARCO_SESSION_HPP
@@ -0,0 +1,46 @@
+#include <Document/ColumnMap.hpp>
+#include <algorithm>
+
+namespace varco {
+
+  size_t getNextCell(const char *text, size_t size, size_t offset, size_t column, int tabWidth, int& width) {
+    const unsigned char c = static_cast<unsigned char>(text[offset]);
+    if (c == '\t') {
+      width = tabWidth - static_cast<int>(column % tabWidth);
+      return offset + 1;
+    }
+    if (c < 0x80 && (offset + 1 == size || !(static_cast<unsigned char>(text[offset + 1]) & 0x80))) {
+      width = 1; // ASCII not followed by a combining mark
+      return offset + 1;
+    }
+    return getNextCluster(text, size, offset, &width);
+  }
+
+  size_t getColumnCount(const char *text, size_t size, int tabWidth) {
+    if (isPlainText(text, size))
+      return size;
+    size_t columns = 0;
+    for (size_t offset = 0; offset < size;) {
+      int width;
+      offset = getNextCell(text, size, offset, columns, tabWidth, width);
+      columns += width;
+    }
+    return columns;
+  }
+
+  size_t getOffsetAtColumn(const char *text, size_t size, size_t column, int tabWidth) {
+    if (isPlainText(text, size))
+      return std::min(column, size);
+    size_t columns = 0, offset = 0;
+    while (offset < size) {
+      int width;
+      size_t next = getNextCell(text, size, offset, columns, tabWidth, width);
+      if (columns + width > column)
+        break;
+      columns += width;
+      offset = next;
+    }
+    return offset;
+  }
+
+}
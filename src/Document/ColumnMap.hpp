@@ -0,0 +1,52 @@
+#ifndef VARCO_COLUMNMAP_HPP
+#define VARCO_COLUMNMAP_HPP
+
+#include <Utils/Unicode.hpp>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+namespace varco {
+
+  // Maps the bytes of a line to the columns where they're shown. A character (grapheme cluster, see
+  // Unicode.hpp) takes a column, two if it's wide, and a tab takes the columns up to the next multiple of
+  // the tab width. Tabs are kept in the text as they are: only the layout expands them. Columns are counted
+  // from the beginning of the text given (the rows a line is wrapped into restart from the first tab stop).
+  //
+  // Plain text (ASCII without tabs: most lines of code) has a column per byte. The text buffer knows which
+  // lines are plain (see TextBuffer::isPlain()): layouts skip the mapping altogether for those
+
+  // 16 bytes at a time with SSE2 (8 at a time otherwise)
+  inline bool isPlainText(const char *text, size_t size) {
+    size_t i = 0;
+#ifdef VARCO_SSE2
+    const __m128i tab = _mm_set1_epi8('\t');
+    for (; i + 16 <= size; i += 16) {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+      if (_mm_movemask_epi8(_mm_or_si128(block, _mm_cmpeq_epi8(block, tab))) != 0) // High bits or tabs
+        return false;
+    }
+#else
+    for (; i + 8 <= size; i += 8) {
+      uint64_t block;
+      std::memcpy(&block, text + i, 8);
+      uint64_t tabs = block ^ 0x0909090909090909ULL; // Zero bytes where the tabs were
+      if ((block & 0x8080808080808080ULL) || ((tabs - 0x0101010101010101ULL) & ~tabs & 0x8080808080808080ULL))
+        return false;
+    }
+#endif
+    for (; i < size; ++i) {
+      if ((static_cast<unsigned char>(text[i]) & 0x80) || text[i] == '\t')
+        return false;
+    }
+    return true;
+  }
+
+  // The character at 'offset', shown at 'column': returns where it ends and sets the columns it takes
+  size_t getNextCell(const char *text, size_t size, size_t offset, size_t column, int tabWidth, int& width);
+  size_t getColumnCount(const char *text, size_t size, int tabWidth);
+  size_t getOffsetAtColumn(const char *text, size_t size, size_t column, int tabWidth); // The character shown at a column (or 'size')
+
+}
+
+#endif // VARCO_COLUMNMAP_HPP
@@ -1,11 +1,21 @@
 #include <Document/Document.hpp>
 #include <UI/CodeView/CodeView.hpp>
 #include <Utils/Concurrent.hpp>
+#include <Utils/MappedFile.hpp>
+#include <Utils/WorkerPool.hpp>
+#include <Utils/LineDiff.hpp>
+#include <Document/ColumnMap.hpp>
+#include <Utils/Unicode.hpp>
 #include <SkCanvas.h>
 #include <SkTypeface.h>
-#include <fstream>
-#include <regex>
+#include <SkPictureRecorder.h>
+#include <algorithm>
 #include <functional>
+#include <climits>
+#include <cctype>
+#include <cstring>
+#include <chrono>
+#include <sys/stat.h>
 
 // DEBUG
 // #include "timerClass.h"
@@ -23,6 +33,210 @@ namespace {
       src.clear();
     }
   }
+
+  // Splits some text into lines. Line endings are normalized (\r\n and \r too), tabs are kept as they are
+  // (the layout expands them, see ColumnMap.hpp). 'lineStarts' (if given) gets where every line begins in
+  // the text and the size of the text after them
+  std::vector<std::string> splitIntoLines(const char *text, size_t size, std::vector<uint64_t> *lineStarts = nullptr) {
+    std::vector<std::string> lines(1);
+    if (lineStarts)
+      lineStarts->assign(1, 0);
+    size_t i = 0;
+    while (i < size) {
+      size_t run = i; // Characters which are copied as they are
+      while (run < size && text[run] != '\r' && text[run] != '\n')
+        ++run;
+      lines.back().append(text + i, run - i);
+      if (run == size)
+        break;
+      if (text[run] == '\r' && run + 1 < size && text[run + 1] == '\n')
+        ++run;
+      lines.emplace_back();
+      i = run + 1;
+      if (lineStarts)
+        lineStarts->push_back(i);
+    }
+    if (lineStarts)
+      lineStarts->push_back(size);
+    return lines;
+  }
+
+  std::vector<std::string> splitIntoLines(const std::string& text) {
+    return splitIntoLines(text.data(), text.size());
+  }
+
+  // The lines of a file as a document shows them: the line ending at the end of the file doesn't begin
+  // another line
+  std::vector<std::string> splitFileIntoLines(const char *data, size_t size, std::vector<uint64_t> *lineStarts = nullptr) {
+    std::vector<std::string> lines = splitIntoLines(data, size, lineStarts);
+    if (size > 0 && (data[size - 1] == '\n' || data[size - 1] == '\r') && lines.size() > 1) {
+      lines.pop_back();
+      if (lineStarts)
+        lineStarts->pop_back(); // The empty line began at the end of the text
+    }
+    return lines;
+  }
+
+  // The lines of a file at the starts found the last time it was read (see FileCache): the line endings
+  // aren't looked for. Empty if the starts don't fit the text
+  std::vector<std::string> splitAtLineStarts(const char *text, size_t size, const uint64_t *starts, size_t count) {
+    std::vector<std::string> lines;
+    if (starts[count] != size)
+      return lines;
+    lines.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      size_t begin = static_cast<size_t>(starts[i]), end = static_cast<size_t>(starts[i + 1]);
+      if (begin > end || end > size)
+        return std::vector<std::string>();
+      if (end > begin && text[end - 1] == '\n')
+        --end;
+      if (end > begin && text[end - 1] == '\r') // Line contents never end with one
+        --end;
+      lines[i].assign(text + begin, end - begin);
+    }
+    return lines;
+  }
+
+  // A line of a streamed file as a document shows it: a lone \r doesn't break the line as it does in
+  // splitIntoLines() (the window's lines must match the file's lines one to one)
+  std::string expandStreamLine(const char *text, size_t size) {
+    std::string line(text, size);
+    std::replace(line.begin(), line.end(), '\r', ' ');
+    return line;
+  }
+
+  // Splits a line into rows of at most 'maxColumns' columns: after the last blank which fits in a row or,
+  // without one, after the last character which does. Characters are grapheme clusters and tabs (see
+  // ColumnMap.hpp), bytes for plain lines. Where the rows begin is found first (in scratch memory): the rows
+  // are then allocated at once
+  std::vector<varco::EditorLine> wrapLine(const char *text, size_t size, size_t maxColumns, bool plain, int tabWidth,
+                                          varco::MonotonicArena& scratch) {
+    varco::ArenaVector<size_t> rowStarts{ varco::ArenaAllocator<size_t>(scratch) };
+    size_t rowStart = 0;
+    while (true) {
+      rowStarts.push_back(rowStart);
+      size_t offset = rowStart, columns = 0, lastSpace = std::string::npos;
+      int width = 1;
+      size_t next = rowStart;
+      while (offset < size) {
+        next = plain ? offset + 1 : varco::getNextCell(text, size, offset, columns, tabWidth, width);
+        if (columns + width > maxColumns)
+          break;
+        if ((text[offset] == ' ' || text[offset] == '\t') && offset != rowStart) // Doesn't make sense to split at the beginning
+          lastSpace = offset;
+        columns += width;
+        offset = next;
+      }
+      if (offset == size) // The rest fits
+        break;
+      if ((text[offset] == ' ' || text[offset] == '\t') && offset != rowStart) // A space right past the row can go to the next one
+        lastSpace = offset;
+      size_t split = (lastSpace != std::string::npos) ? lastSpace : offset;
+      if (split == rowStart)
+        split = next; // A character wider than a row
+      rowStart = split;
+    }
+
+    std::vector<varco::EditorLine> rows;
+    rows.reserve(rowStarts.size());
+    for (size_t i = 0; i < rowStarts.size(); ++i) {
+      size_t rowEnd = (i + 1 < rowStarts.size()) ? rowStarts[i + 1] : size;
+      rows.emplace_back(text + rowStarts[i], rowEnd - rowStarts[i]);
+    }
+    return rows;
+  }
+
+  int getMaxColumns(const varco::ThreadRequest& request) { // Allowed number of characters per editor line
+    int maxChars = static_cast<int>(request.m_wrapWidthPixels / request.m_characterWidthPixels);
+    return std::max(maxChars, 10); // Keep it to a minimum
+  }
+
+  // Where the character (grapheme cluster) after or before a column of a line begins. Bytes between ASCII
+  // characters are a character each
+  int stepCharacter(const std::string& line, int x, bool forward) {
+    auto ascii = [&line](int i) { return i < 0 || i >= static_cast<int>(line.size()) || !(line[i] & 0x80); };
+    if (forward)
+      return (ascii(x) && ascii(x + 1)) ? x + 1 : static_cast<int>(varco::getNextCluster(line.data(), line.size(), x));
+    return (ascii(x - 1) && ascii(x - 2)) ? x - 1 : static_cast<int>(varco::getPreviousCluster(line.data(), line.size(), x));
+  }
+
+  void mergeStyleRuns(std::vector<varco::StyleRun>& runs) { // Joins adjacent runs with the same style
+    size_t last = 0;
+    for (size_t i = 1; i < runs.size(); ++i) {
+      if (runs[i].m_style == runs[last].m_style && runs[last].m_start + runs[last].m_count == runs[i].m_start)
+        runs[last].m_count += runs[i].m_count;
+      else
+        runs[++last] = runs[i];
+    }
+    if (!runs.empty())
+      runs.resize(last + 1);
+  }
+
+  // Appends the parts of the runs within the columns [begin, end) moved to start at column 'offset'. Runs are
+  // sorted: the ones past 'end' aren't looked at, the ones before 'first' are known to end before 'begin'
+  void copyStyleRuns(const std::vector<varco::StyleRun>& runs, size_t begin, size_t end, size_t offset,
+                     std::vector<varco::StyleRun>& result, size_t first = 0) {
+    for (size_t i = first; i < runs.size() && runs[i].m_start < end; ++i) {
+      size_t start = std::max(runs[i].m_start, begin);
+      size_t stop = std::min(runs[i].m_start + runs[i].m_count, end);
+      if (start < stop)
+        result.push_back({ offset + start - begin, stop - start, runs[i].m_style });
+    }
+  }
+
+  // A style database for some lines alone out of their style runs (e.g. to render them on their own)
+  std::shared_ptr<varco::StyleDatabase> makeStyleDatabase(const std::vector<std::string>& lines,
+                                                          const std::vector<std::vector<varco::StyleRun>>& styleRuns) {
+    auto styleDb = std::make_shared<varco::StyleDatabase>();
+    size_t offset = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+      styleDb->m_absOffsetWhereLineBegins[i] = offset;
+      styleDb->previousSegment[i] = styleDb->styleSegment.empty() ? static_cast<size_t>(-1) : styleDb->styleSegment.size() - 1;
+      for (const auto& run : styleRuns[i]) {
+        if (run.m_start + run.m_count > lines[i].size())
+          break;
+        if (styleDb->firstSegmentOnLine.count(i) == 0)
+          styleDb->firstSegmentOnLine[i] = styleDb->styleSegment.size();
+        styleDb->lastSegmentOnLine[i] = styleDb->styleSegment.size();
+        styleDb->styleSegment.emplace_back(i, run.m_start, run.m_count, offset + run.m_start, run.m_style);
+      }
+      offset += lines[i].size() + 1;
+    }
+    return styleDb;
+  }
+
+  // The style runs of the bytes [from, to) of a line as the lexer found them. Segments are sorted by their
+  // position: the one found with a binary search is the only one before 'from' which might reach into it
+  std::vector<varco::StyleRun> collectStyleRuns(const varco::StyleDatabase& styleDb, size_t line, size_t from, size_t to) {
+    std::vector<varco::StyleRun> runs;
+    auto lineStart = styleDb.m_absOffsetWhereLineBegins.find(line);
+    if (lineStart == styleDb.m_absOffsetWhereLineBegins.end())
+      return runs; // Not lexed
+    const size_t begin = lineStart->second + from, end = lineStart->second + to;
+    const auto& segments = styleDb.styleSegment;
+    auto it = std::upper_bound(segments.begin(), segments.end(), begin,
+                               [](size_t position, const varco::StyleDatabase::StyleSegment& segment) {
+      return position < segment.absStartPos;
+    });
+    if (it != segments.begin())
+      --it;
+    for (; it != segments.end() && it->absStartPos < end; ++it) {
+      size_t start = std::max(it->absStartPos, begin);
+      size_t stop = std::min(it->absStartPos + it->count, end);
+      if (start < stop && it->style != varco::Normal)
+        runs.push_back({ start - lineStart->second, stop - start, it->style });
+    }
+    return runs;
+  }
+
+  // Where the character (grapheme cluster) containing the byte at 'offset' begins
+  size_t findCharacterStart(const std::string& line, size_t offset, bool plain) {
+    if (plain || offset >= line.size())
+      return offset;
+    while (offset > 0 && varco::isUtf8Continuation(line[offset]))
+      --offset;
+    return varco::getPreviousCluster(line.data(), line.size(), varco::getNextCluster(line.data(), line.size(), offset));
+  }
 }
 
 namespace varco {
@@ -34,35 +248,1491 @@ namespace varco {
     std::copy(str.begin(), str.end(), m_characters.begin());
   }
 
-  Document::Document(CodeView& codeView)
-    : UIElement(static_cast<UIElement<ui_container_tag>&>(codeView)), m_codeView(codeView)
+  EditorLine::EditorLine(const char *text, size_t size) :
+    m_characters(text, text + size)
   {}
 
+  Document::Document(CodeView& codeView)
+    : UIElement(static_cast<UIElement<ui_container_tag>&>(codeView)),
+      m_deferredJobs(std::make_shared<DeferredJobs>()), m_codeView(codeView),
+      m_styleDb(std::make_shared<StyleDatabase>()),
+      m_buffer(std::vector<std::string>(1)), // Even an empty document has a line to type on
+      m_minimapTiles([this]() {
+        m_codeView.repaintIfShowing(this); // A minimap tile is ready
+      }),
+      m_saver([this]() {
+        m_codeView.repaintIfShowing(this); // The progress bar grows
+      }, [this](const FileSaver::Request& request, const FileSaver::Result& result) {
+        onSaved(request, result);
+      }),
+      m_search([this]() {
+        m_codeView.repaintIfShowing(this); // New matches to highlight
+      })
+  {
+    m_deferredJobs->m_onReady = [this]() {
+      m_codeView.repaintIfShowing(this); // Rows of a long line are ready
+    };
+  }
+
+  Document::~Document() {
+    std::unique_lock<std::mutex> lock(m_deferredJobs->m_mutex);
+    m_deferredJobs->m_onReady = nullptr;
+    m_deferredJobs->m_idle.wait(lock, [this]() { return m_deferredJobs->m_count == 0; });
+  }
+
+#define STREAMING_THRESHOLD (1ULL << 30) // Larger files are streamed rather than loaded
+#define WINDOW_LINES 4096 // Lines of a streamed file held by its document
+#define WINDOW_MARGIN 512 // The window moves when the view gets closer than this to one of its edges
+#define MAX_WINDOW_LINE_BYTES (1 << 20) // Longer lines of a streamed file are cut (the lines below are off by one)
+#define MAX_WINDOW_SCAN_BYTES (8 << 20) // Furthest a window looks back for where lines begin
+
+#define FILE_CACHE_MIN_BYTES (4 << 20) // Smaller files are read and lexed again faster than a cache entry pays off
+
   // The following function loads the contents of a text file into memory.
   // This is a memory-expensive operation but documents need to be available at any time
   // Returns true on success
   bool Document::loadFromFile(std::string file) {
-    
-    std::ifstream f(file);
-    if (!f.is_open())
+
+    MappedFile mapped;
+    if (!mapped.open(file))
+      return false;
+    if (mapped.getSize() > STREAMING_THRESHOLD) {
+      mapped.close();
+      return openStreaming(file);
+    }
+
+    // Load the entire file into memory as UTF-8, line endings normalized to \n (Unix-style). Large files
+    // are looked up in the cache first: where their lines begin and their styles are read from it if the
+    // file didn't change since it was written
+    DiskState disk = readDiskState(file, mapped);
+    FileCache::Key cacheKey;
+    std::unique_ptr<FileCache> cache;
+    std::vector<uint64_t> lineStarts;
+    if (mapped.getSize() >= FILE_CACHE_MIN_BYTES) {
+      cacheKey.m_path = file;
+      cacheKey.m_size = mapped.getSize();
+      cacheKey.m_modifiedTime = disk.m_modifiedTime;
+      cache = FileCache::open(cacheKey, mapped.getData());
+    }
+    std::vector<std::string> lines = readLines(mapped, disk, cache.get(), cacheKey.m_path.empty() ? nullptr : &lineStarts);
+    mapped.close();
+    if (cache && cache->getLineCount() != lines.size())
+      cache.reset(); // The starts didn't fit: the entry is of no use
+
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    m_filePath = file;
+    m_buffer = TextBuffer(std::move(lines));
+    m_selections.assign(1, Selection());
+    m_primarySelection = 0;
+    m_undoHistory.clear();
+    m_folds.clear();
+    ++m_revision;
+    m_layoutValid = false;
+    m_needReLexing = (m_lexer != nullptr);
+    m_unlexedLines.m_replaced = true;
+    m_dirty = true;
+    m_minimapTiles.invalidate();
+    m_disk = std::move(disk);
+    m_disk.m_revision = m_revision;
+    m_cacheKey = std::move(cacheKey);
+    m_fileCache = std::move(cache);
+    m_cacheLineStarts = std::move(lineStarts);
+    m_cacheRevision = m_revision;
+    m_cacheStored = false;
+    lock.unlock();
+
+    restartSearch();
+    return true;
+  }
+
+  void Document::releaseFileCache() {
+    m_cacheKey = FileCache::Key();
+    m_fileCache.reset();
+    m_cacheLineStarts = std::vector<uint64_t>();
+  }
+
+  // The first window is shown right away, the file is indexed in the background
+  bool Document::openStreaming(const std::string& file) {
+    auto stream = std::make_unique<StreamingFile>([this]() {
+      m_codeView.repaintIfShowing(this); // The scrollbar follows the lines found so far
+    });
+    if (!stream->open(file))
+      return false;
+
+    m_search.cancel(); // It might be reading the mapping of the previous file
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    m_filePath = file;
+    m_stream = std::move(stream);
+    releaseFileCache();
+    m_selections.assign(1, Selection());
+    m_primarySelection = 0;
+    m_undoHistory.clear();
+    loadStreamWindow(0);
+    m_windowFirstLine = 0;
+    m_windowFirstLineExact = true;
+    lock.unlock();
+
+    restartSearch();
+    return true;
+  }
+
+  bool Document::isStreaming() const {
+    return m_stream != nullptr;
+  }
+
+  void Document::loadStreamWindow(size_t offset) {
+    const char *data = m_stream->getData();
+    const size_t size = m_stream->getSize();
+    std::vector<std::string> lines;
+    m_windowOffsets.clear();
+    while (lines.size() < WINDOW_LINES && offset < size) {
+      const size_t limit = std::min(size, offset + MAX_WINDOW_LINE_BYTES);
+      const void *newline = std::memchr(data + offset, '\n', limit - offset);
+      const size_t end = (newline != nullptr) ? static_cast<const char*>(newline) - data : limit;
+      const size_t length = (newline != nullptr && end > offset && data[end - 1] == '\r') ? end - offset - 1 : end - offset;
+      m_windowOffsets.push_back(offset);
+      lines.emplace_back(expandStreamLine(data + offset, length));
+      offset = (newline != nullptr) ? end + 1 : end;
+    }
+    if (lines.empty()) { // An empty file, or the end of one
+      m_windowOffsets.push_back(offset);
+      lines.emplace_back();
+    }
+    m_windowOffsets.push_back(offset);
+
+    m_buffer = TextBuffer(std::move(lines));
+    m_folds.clear();
+    ++m_revision;
+    m_layoutValid = false;
+    m_needReLexing = (m_lexer != nullptr);
+    m_unlexedLines.m_replaced = true;
+    m_dirty = true;
+    m_minimapTiles.invalidate();
+  }
+
+  void Document::updateWindowFirstLine() {
+    if (m_windowFirstLineExact)
+      return;
+    size_t line = m_stream->getLineAtOffset(m_windowOffsets.front());
+    if (line != StreamingFile::npos) {
+      m_windowFirstLine = line;
+      m_windowFirstLineExact = true;
+    }
+  }
+
+  size_t Document::getStreamLineCount() {
+    return m_stream ? m_stream->getLineCount() : 0;
+  }
+
+  size_t Document::getStreamLine(size_t windowLine) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    if (!m_stream)
+      return windowLine;
+    updateWindowFirstLine();
+    return m_windowFirstLine + windowLine;
+  }
+
+  size_t Document::moveStreamWindow(size_t line, bool& moved) {
+    moved = false;
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    if (!m_stream)
+      return line;
+    updateWindowFirstLine();
+    const size_t count = m_buffer.getLineCount();
+    const bool inWindow = line >= m_windowFirstLine && line < m_windowFirstLine + count;
+    if (inWindow) {
+      const size_t windowLine = line - m_windowFirstLine;
+      const bool nearTop = m_windowOffsets.front() > 0 && windowLine < WINDOW_MARGIN;
+      const bool nearBottom = m_windowOffsets.back() < m_stream->getSize() && windowLine + WINDOW_MARGIN >= count;
+      if (!nearTop && !nearBottom)
+        return windowLine;
+    }
+
+    // Where the line begins: as found in the window or in the index, else by its estimated position
+    size_t offset = inWindow ? m_windowOffsets[line - m_windowFirstLine] : m_stream->getLineOffset(line);
+    if (offset == StreamingFile::npos) {
+      const double fraction = std::min(1.0, static_cast<double>(line) / m_stream->getLineCount());
+      offset = m_stream->findLineStart(static_cast<size_t>(fraction * m_stream->getSize()), MAX_WINDOW_SCAN_BYTES);
+    }
+    moved = true;
+    return moveStreamWindowTo(offset, line);
+  }
+
+  // The search keeps its matches: they're on the lines of the file, not of the window
+  size_t Document::moveStreamWindowTo(size_t offset, size_t line) {
+    const size_t start = m_stream->skipLinesBackward(offset, WINDOW_LINES / 2, MAX_WINDOW_SCAN_BYTES);
+
+    const std::vector<size_t> oldOffsets = std::move(m_windowOffsets);
+    loadStreamWindow(start);
+    auto windowLineAt = [&](size_t fileOffset) { // fileOffset must be within the window
+      auto it = std::upper_bound(m_windowOffsets.begin(), m_windowOffsets.end() - 1, fileOffset);
+      return static_cast<size_t>(it - m_windowOffsets.begin()) - 1;
+    };
+    const size_t windowLine = (offset < m_windowOffsets.back()) ? windowLineAt(offset) : m_buffer.getLineCount() - 1;
+
+    // Carets stay where they are in the file if it's still in the window, the others go to the line
+    auto move = [&](DocumentPosition position) {
+      const size_t fileOffset = oldOffsets[position.y];
+      if (fileOffset >= m_windowOffsets.front() && fileOffset < m_windowOffsets.back())
+        return clampPosition({ position.x, static_cast<int>(windowLineAt(fileOffset)) });
+      return DocumentPosition{ 0, static_cast<int>(windowLine) };
+    };
+    for (auto& selection : m_selections) {
+      selection.m_anchor = move(selection.m_anchor);
+      selection.m_caret = move(selection.m_caret);
+    }
+    normalizeSelections();
+
+    m_windowFirstLineExact = false;
+    updateWindowFirstLine();
+    if (!m_windowFirstLineExact) // Consistent with the line asked for
+      m_windowFirstLine = line >= windowLine ? line - windowLine : 0;
+    return windowLine;
+  }
+
+#define DISK_TAIL_BYTES 4096 // Bytes at the end of a file compared to tell appends apart from other changes
+
+  Document::DiskState Document::readDiskState(const std::string& path, const MappedFile& file) {
+    DiskState state;
+    state.m_size = file.getSize();
+    size_t tail = std::min<size_t>(state.m_size, DISK_TAIL_BYTES);
+    if (tail > 0)
+      state.m_tail.assign(file.getData() + state.m_size - tail, tail);
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) {
+#ifdef __linux__
+      state.m_modifiedTime = static_cast<long long>(info.st_mtim.tv_sec) * 1000000000LL + info.st_mtim.tv_nsec;
+#else
+      state.m_modifiedTime = static_cast<long long>(info.st_mtime);
+#endif
+    }
+    return state;
+  }
+
+  // UTF-8 files (most of them) are split as they are, only other encodings are converted first
+  std::vector<std::string> Document::readLines(const MappedFile& file, DiskState& state, const FileCache *cache,
+                                               std::vector<uint64_t> *lineStarts) {
+    state.m_encoding = detectEncoding(file.getData(), file.getSize());
+    std::string converted;
+    const char *text = file.getData();
+    size_t size = file.getSize();
+    if (!isPlainUtf8(state.m_encoding)) {
+      converted = decodeText(text, size, state.m_encoding);
+      text = converted.data();
+      size = converted.size();
+    }
+    const char *newline = (size > 0) ? static_cast<const char *>(memchr(text, '\n', size)) : nullptr;
+    state.m_newline = (newline != nullptr && newline > text && newline[-1] == '\r') ? "\r\n" : "\n";
+    state.m_finalNewline = size > 0 && (text[size - 1] == '\n' || text[size - 1] == '\r');
+    if (cache) {
+      std::vector<std::string> lines = splitAtLineStarts(text, size, cache->getLineStarts(), cache->getLineCount());
+      if (!lines.empty()) {
+        if (lineStarts)
+          lineStarts->assign(cache->getLineStarts(), cache->getLineStarts() + cache->getLineCount() + 1);
+        return lines;
+      }
+    }
+    return splitFileIntoLines(text, size, lineStarts);
+  }
+
+  const std::string& Document::getFilePath() const {
+    return m_filePath;
+  }
+
+  TextBuffer Document::getSnapshot() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    return m_buffer;
+  }
+
+  std::string Document::getWordAt(DocumentPosition position) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    position = clampPosition(position);
+    const std::string& line = m_buffer.getLine(position.y);
+    auto isWordCharacter = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    size_t begin = position.x, end = position.x;
+    while (begin > 0 && isWordCharacter(line[begin - 1]))
+      --begin;
+    while (end < line.size() && isWordCharacter(line[end]))
+      ++end;
+    return line.substr(begin, end - begin);
+  }
+
+  DocumentPosition Document::clampPosition(DocumentPosition position) {
+    int lastLine = static_cast<int>(m_buffer.getLineCount()) - 1;
+    position.y = std::max(0, std::min(position.y, lastLine));
+    const std::string& line = m_buffer.getLine(position.y);
+    position.x = std::max(0, std::min(position.x, static_cast<int>(line.size())));
+    while (position.x > 0 && position.x < static_cast<int>(line.size()) && isUtf8Continuation(line[position.x]))
+      --position.x; // Never inside a UTF-8 sequence
+    return position;
+  }
+
+  void Document::setCursorPosition(DocumentPosition position) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    position = clampPosition(position);
+    m_selections.assign(1, { position, position });
+    m_primarySelection = 0;
+    revealLine(position.y); // E.g. a search result in a folded region
+    m_undoHistory.seal(); // Typing somewhere else is a new operation
+  }
+
+  DocumentPosition Document::getCursorPosition() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    return m_selections[m_primarySelection].m_caret;
+  }
+
+  std::vector<Selection> Document::getSelections() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    return m_selections;
+  }
+
+  size_t Document::getPrimarySelection() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    return m_primarySelection;
+  }
+
+  void Document::setSelections(std::vector<Selection> selections, size_t primary) {
+    if (selections.empty())
+      return;
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    for (auto& selection : selections) {
+      selection.m_anchor = clampPosition(selection.m_anchor);
+      selection.m_caret = clampPosition(selection.m_caret);
+    }
+    m_selections = std::move(selections);
+    m_primarySelection = std::min(primary, m_selections.size() - 1);
+    normalizeSelections();
+    revealLine(m_selections[m_primarySelection].m_caret.y);
+    m_undoHistory.seal();
+  }
+
+  bool Document::addCaretOnAdjacentLine(bool below) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    const DocumentPosition edge = below ? m_selections.back().m_caret : m_selections.front().m_caret;
+    int line = edge.y + (below ? 1 : -1);
+    if (line < 0 || line >= static_cast<int>(m_buffer.getLineCount()))
+      return false;
+    DocumentPosition caret = clampPosition({ edge.x, line });
+    m_selections.push_back({ caret, caret });
+    m_primarySelection = m_selections.size() - 1; // The view follows the new one
+    normalizeSelections();
+    revealLine(line);
+    m_undoHistory.seal();
+    return true;
+  }
+
+  // The matches found so far are sorted already. The primary selection is the first match after the caret
+  size_t Document::selectAllMatches() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    std::vector<SearchMatch> matches = getSearchMatches(0, m_buffer.getLineCount());
+    if (matches.empty())
+      return 0;
+
+    const DocumentPosition caret = m_selections[m_primarySelection].m_caret;
+    std::vector<Selection> selections;
+    selections.reserve(matches.size());
+    size_t primary = matches.size() - 1;
+    for (const auto& match : matches) {
+      DocumentPosition begin = { static_cast<int>(match.m_column), static_cast<int>(match.m_line) };
+      DocumentPosition end = { static_cast<int>(match.m_column + match.m_length), begin.y };
+      if (primary == matches.size() - 1 && !(begin < caret))
+        primary = selections.size();
+      selections.push_back({ clampPosition(begin), clampPosition(end) });
+    }
+    m_selections = std::move(selections);
+    m_primarySelection = primary;
+    normalizeSelections();
+    m_undoHistory.seal();
+    return m_selections.size();
+  }
+
+  void Document::clearSecondaryCarets() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    m_selections.assign(1, m_selections[m_primarySelection]);
+    m_primarySelection = 0;
+  }
+
+  // Selections overlapping (or carets in the same place) are merged, the primary one is the one which ends
+  // up containing the primary caret
+  void Document::normalizeSelections() {
+    auto begin = [](const Selection& selection) { return std::min(selection.m_anchor, selection.m_caret); };
+    auto end = [](const Selection& selection) { return std::max(selection.m_anchor, selection.m_caret); };
+    auto byBegin = [&](const Selection& a, const Selection& b) { return begin(a) < begin(b); };
+
+    const DocumentPosition primaryCaret = m_selections[m_primarySelection].m_caret;
+    if (!std::is_sorted(m_selections.begin(), m_selections.end(), byBegin))
+      std::stable_sort(m_selections.begin(), m_selections.end(), byBegin);
+    size_t last = 0;
+    for (size_t i = 1; i < m_selections.size(); ++i) {
+      Selection& kept = m_selections[last];
+      if (begin(m_selections[i]) < end(kept) || begin(m_selections[i]) == begin(kept)) {
+        DocumentPosition first = begin(kept), second = std::max(end(kept), end(m_selections[i]));
+        kept = (kept.m_caret < kept.m_anchor) ? Selection{ second, first } : Selection{ first, second };
+      } else if (++last != i)
+        m_selections[last] = m_selections[i];
+    }
+    m_selections.resize(last + 1);
+
+    auto it = std::upper_bound(m_selections.begin(), m_selections.end(), Selection{ primaryCaret, primaryCaret }, byBegin);
+    m_primarySelection = (it == m_selections.begin()) ? 0 : static_cast<size_t>(it - m_selections.begin()) - 1;
+  }
+
+  int Document::getLineCount() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    return static_cast<int>(m_buffer.getLineCount());
+  }
+
+  int Document::getLineLength(int line) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    if (line < 0 || line >= static_cast<int>(m_buffer.getLineCount()))
+      return 0;
+    return static_cast<int>(m_buffer.getLine(line).size());
+  }
+
+  int Document::getColumn(DocumentPosition position) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    position = clampPosition(position);
+    if (m_buffer.isPlain(position.y))
+      return position.x;
+    return static_cast<int>(getColumnCount(m_buffer.getLine(position.y).data(), position.x, m_tabWidth));
+  }
+
+  int Document::getPositionAtColumn(int line, int column) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    if (line < 0 || line >= static_cast<int>(m_buffer.getLineCount()))
+      return 0;
+    const std::string& text = m_buffer.getLine(line);
+    if (m_buffer.isPlain(line))
+      return std::min(std::max(column, 0), static_cast<int>(text.size()));
+    return static_cast<int>(getOffsetAtColumn(text.data(), text.size(), std::max(column, 0), m_tabWidth));
+  }
+
+  int Document::getAdjacentCharacter(DocumentPosition position, bool forward) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    position = clampPosition(position);
+    const std::string& line = m_buffer.getLine(position.y);
+    if (forward ? position.x >= static_cast<int>(line.size()) : position.x == 0)
+      return position.x;
+    return stepCharacter(line, position.x, forward);
+  }
+
+  void Document::insertText(const std::string& text) {
+    std::vector<TextEdit> edits;
+    {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      edits.reserve(m_selections.size());
+      for (const auto& selection : m_selections)
+        edits.push_back({ std::min(selection.m_anchor, selection.m_caret), std::max(selection.m_anchor, selection.m_caret), text });
+    }
+    applyEdits(std::move(edits), true);
+  }
+
+  void Document::deleteBackward() {
+    std::vector<TextEdit> edits;
+    {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      edits.reserve(m_selections.size());
+      for (const auto& selection : m_selections) {
+        DocumentPosition from = std::min(selection.m_anchor, selection.m_caret);
+        DocumentPosition to = std::max(selection.m_anchor, selection.m_caret);
+        if (from == to) { // Nothing selected: the character before the caret
+          if (from.x > 0)
+            from.x = stepCharacter(m_buffer.getLine(from.y), from.x, false);
+          else if (from.y > 0) { // Join with the previous line
+            --from.y;
+            from.x = static_cast<int>(m_buffer.getLine(from.y).size());
+          }
+        }
+        edits.push_back({ from, to, std::string() });
+      }
+    }
+    applyEdits(std::move(edits), true);
+  }
+
+  void Document::deleteForward() {
+    std::vector<TextEdit> edits;
+    {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      edits.reserve(m_selections.size());
+      for (const auto& selection : m_selections) {
+        DocumentPosition from = std::min(selection.m_anchor, selection.m_caret);
+        DocumentPosition to = std::max(selection.m_anchor, selection.m_caret);
+        if (from == to) { // Nothing selected: the character after the caret
+          if (to.x < static_cast<int>(m_buffer.getLine(to.y).size()))
+            to.x = stepCharacter(m_buffer.getLine(to.y), to.x, true);
+          else if (to.y + 1 < static_cast<int>(m_buffer.getLineCount())) { // Join with the next line
+            ++to.y;
+            to.x = 0;
+          }
+        }
+        edits.push_back({ from, to, std::string() });
+      }
+    }
+    applyEdits(std::move(edits), true);
+  }
+
+  // The text buffer is edited in O(log n). If a layout of the document exists, only the edited lines are
+  // wrapped and rendered again and their rows are patched into the rendered document: the cost of an edit
+  // doesn't depend on the size of the document. The caret is moved right after the new text
+  DocumentPosition Document::replaceText(DocumentPosition from, DocumentPosition to, const std::string& text) {
+    return editText(from, to, text, true);
+  }
+
+  DocumentPosition Document::editText(DocumentPosition from, DocumentPosition to, const std::string& text, bool record) {
+    std::vector<TextEdit> edits;
+    edits.push_back({ from, to, text });
+    return applyEdits(std::move(edits), record).front();
+  }
+
+#define MAX_PATCHED_LINES 1024 // Edits at several carets spread over more lines render the whole document again
+
+  // All the edits are applied in a single pass over the text: the lines of every run of edits sharing lines
+  // (a cluster) are built once, the edits are recorded as a single undo step, the lines from the first to the
+  // last edited one are wrapped and rendered as a single patch and the document is lexed and searched again
+  // once. The carets are moved right after the new text of every edit
+  std::vector<DocumentPosition> Document::applyEdits(std::vector<TextEdit> edits, bool record) {
+    std::vector<DocumentPosition> ends;
+    bool changed;
+    {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      changed = applyEditsLocked(std::move(edits), record, false, ends);
+    }
+    if (changed) {
+      if (m_lexer)
+        scheduleRelex();
+      restartSearch();
+    }
+    return ends;
+  }
+
+  bool Document::applyEditsLocked(std::vector<TextEdit> edits, bool record, bool keepCarets, std::vector<DocumentPosition>& ends) {
+    ends.clear();
+    if (edits.empty() || m_stream)
+      return false; // Streamed documents are read-only
+    for (auto& edit : edits) {
+      edit.m_from = clampPosition(edit.m_from);
+      edit.m_to = clampPosition(edit.m_to);
+      if (edit.m_to < edit.m_from)
+        std::swap(edit.m_from, edit.m_to);
+    }
+    auto byStart = [](const TextEdit& a, const TextEdit& b) { return a.m_from < b.m_from; };
+    if (!std::is_sorted(edits.begin(), edits.end(), byStart))
+      std::stable_sort(edits.begin(), edits.end(), byStart);
+    size_t last = 0;
+    for (size_t i = 1; i < edits.size(); ++i) {
+      if (edits[i].m_from < edits[last].m_to) { // Overlapping, e.g. two carets deleting the same newline
+        edits[last].m_to = std::max(edits[last].m_to, edits[i].m_to);
+        edits[last].m_text += edits[i].m_text;
+      } else if (++last != i)
+        edits[last] = std::move(edits[i]);
+    }
+    edits.resize(last + 1);
+
+    const bool incremental = (m_renderMode != RenderMode::Raster && !m_dirty && m_layoutValid && hasLayout());
+    // Until the document is lexed again the new lines keep the colors of the text around the edits
+    const std::vector<StyleRun> noRuns;
+    auto styleRunsOf = [&](int line) -> const std::vector<StyleRun>& {
+      return incremental ? m_physicalLines[line].m_styleRuns : noRuns;
+    };
+
+    struct Cluster {
+      size_t m_firstLine;
+      size_t m_oldCount;
+      std::vector<std::string> m_lines;
+      std::vector<std::vector<StyleRun>> m_styleRuns;
+    };
+    std::vector<Cluster> clusters;
+    std::vector<UndoHistory::Operation> operations;
+    const DocumentPosition caretBefore = m_selections[m_primarySelection].m_caret;
+    long long lineShift = 0; // Lines added (or removed) by the clusters so far
+    bool changed = false;
+    ends.reserve(edits.size());
+
+    for (size_t i = 0; i < edits.size(); ++i) {
+      Cluster cluster;
+      cluster.m_firstLine = edits[i].m_from.y;
+      const long long firstNewLine = static_cast<long long>(cluster.m_firstLine) + lineShift;
+      std::string current = m_buffer.getLine(edits[i].m_from.y).substr(0, edits[i].m_from.x); // The line being built
+      std::vector<StyleRun> currentRuns;
+      copyStyleRuns(styleRunsOf(edits[i].m_from.y), 0, edits[i].m_from.x, 0, currentRuns);
+
+      for (;; ++i) {
+        const TextEdit& edit = edits[i];
+        const DocumentPosition start = { static_cast<int>(current.size()), static_cast<int>(firstNewLine + cluster.m_lines.size()) };
+        std::vector<std::string> newLines = splitIntoLines(edit.m_text);
+        if (newLines.size() == 1 && !newLines.front().empty() && edit.m_from.y == edit.m_to.y) {
+          for (const auto& run : styleRunsOf(edit.m_from.y)) { // Typing inside a styled run extends it
+            if (run.m_start < static_cast<size_t>(edit.m_from.x) && static_cast<size_t>(edit.m_to.x) < run.m_start + run.m_count)
+              currentRuns.push_back({ current.size(), newLines.front().size(), run.m_style });
+          }
+        }
+
+        UndoHistory::Operation operation;
+        if (record) { // Only the normalized text which is inserted, not the whole lines
+          for (size_t j = 0; j < newLines.size(); ++j) {
+            if (j > 0)
+              operation.m_inserted += '\n';
+            operation.m_inserted.append(newLines[j]);
+          }
+        }
+        for (size_t j = 0; j < newLines.size(); ++j) {
+          if (j > 0) {
+            mergeStyleRuns(currentRuns);
+            cluster.m_lines.push_back(std::move(current));
+            cluster.m_styleRuns.push_back(std::move(currentRuns));
+            current = std::string();
+            currentRuns = std::vector<StyleRun>();
+          }
+          current.append(newLines[j]);
+        }
+        const DocumentPosition end = { static_cast<int>(current.size()), static_cast<int>(firstNewLine + cluster.m_lines.size()) };
+        ends.push_back(end);
+
+        const bool noop = (edit.m_from == edit.m_to && edit.m_text.empty());
+        changed = changed || !noop;
+        if (record && !noop) { // As if the edits were applied one after the other: the previous ones moved this one
+          operation.m_from = start;
+          operation.m_to = (edit.m_to.y == edit.m_from.y) ?
+                           DocumentPosition{ start.x + edit.m_to.x - edit.m_from.x, start.y } :
+                           DocumentPosition{ edit.m_to.x, start.y + edit.m_to.y - edit.m_from.y };
+          operation.m_end = end;
+          operation.m_removed = m_buffer.getText(edit.m_from, edit.m_to);
+          operation.m_caretBefore = caretBefore;
+          operation.m_time = UndoHistory::Clock::now();
+          operations.emplace_back(std::move(operation));
+        }
+
+        const std::string& lastLine = m_buffer.getLine(edit.m_to.y);
+        if (i + 1 < edits.size() && edits[i + 1].m_from.y == edit.m_to.y) { // The next edit shares the line
+          size_t next = edits[i + 1].m_from.x;
+          copyStyleRuns(styleRunsOf(edit.m_to.y), edit.m_to.x, next, current.size(), currentRuns);
+          current.append(lastLine, edit.m_to.x, next - edit.m_to.x);
+          continue;
+        }
+        copyStyleRuns(styleRunsOf(edit.m_to.y), edit.m_to.x, lastLine.size(), current.size(), currentRuns);
+        current.append(lastLine, edit.m_to.x, std::string::npos);
+        mergeStyleRuns(currentRuns);
+        cluster.m_lines.push_back(std::move(current));
+        cluster.m_styleRuns.push_back(std::move(currentRuns));
+        cluster.m_oldCount = edit.m_to.y - cluster.m_firstLine + 1;
+        break;
+      }
+      lineShift += static_cast<long long>(cluster.m_lines.size()) - static_cast<long long>(cluster.m_oldCount);
+      clusters.emplace_back(std::move(cluster));
+    }
+
+    if (!changed) { // E.g. backspace at the beginning of the document
+      if (!keepCarets) {
+        m_selections.clear();
+        for (const auto& end : ends)
+          m_selections.push_back({ end, end });
+        m_primarySelection = std::min(m_primarySelection, m_selections.size() - 1);
+        normalizeSelections();
+      }
+      return false;
+    }
+
+    if (operations.size() == 1)
+      m_undoHistory.record(std::move(operations.front()), m_buffer);
+    else if (!operations.empty())
+      m_undoHistory.recordBatch(std::move(operations), m_buffer);
+
+    // Last cluster first: the line numbers of the ones before it don't change. For each one overwrite the
+    // lines in common, then insert or erase the difference
+    for (auto it = clusters.rbegin(); it != clusters.rend(); ++it) {
+      const size_t newCount = it->m_lines.size();
+      const size_t common = std::min(it->m_oldCount, newCount);
+      for (size_t j = 0; j < common; ++j)
+        m_buffer.setLine(it->m_firstLine + j, std::move(it->m_lines[j]));
+      if (newCount > it->m_oldCount)
+        m_buffer.insertLines(it->m_firstLine + it->m_oldCount,
+                             std::vector<std::string>(std::make_move_iterator(it->m_lines.begin() + common),
+                                                      std::make_move_iterator(it->m_lines.end())));
+      else if (newCount < it->m_oldCount)
+        m_buffer.eraseLines(it->m_firstLine + newCount, it->m_oldCount - newCount);
+      updateFoldsForEdit(it->m_firstLine, it->m_oldCount, newCount);
+      addUnlexedLines(it->m_firstLine, it->m_oldCount, newCount);
+    }
+
+    if (keepCarets) {
+      // A position after an edit (and before the next one) is shifted by the lines the edit added and, on
+      // the line where the edit ends, by the columns. Positions inside an edit go to where it begins
+      auto shiftAfter = [&](DocumentPosition position, size_t i) {
+        if (position.y == edits[i].m_to.y)
+          return DocumentPosition{ ends[i].x + position.x - edits[i].m_to.x, ends[i].y };
+        return DocumentPosition{ position.x, position.y + ends[i].y - edits[i].m_to.y };
+      };
+      auto move = [&](DocumentPosition position) {
+        auto it = std::lower_bound(edits.begin(), edits.end(), position, [](const TextEdit& edit, DocumentPosition p) {
+          return edit.m_from < p;
+        });
+        if (it == edits.begin())
+          return position; // Before all the edits (or where the first one inserts)
+        size_t i = static_cast<size_t>(it - edits.begin()) - 1;
+        if (!(position < edits[i].m_to))
+          return shiftAfter(position, i);
+        return i == 0 ? edits[0].m_from : shiftAfter(edits[i].m_from, i - 1);
+      };
+      for (auto& selection : m_selections) {
+        selection.m_anchor = move(selection.m_anchor);
+        selection.m_caret = move(selection.m_caret);
+      }
+    } else {
+      m_selections.clear();
+      m_selections.reserve(ends.size());
+      for (const auto& end : ends)
+        m_selections.push_back({ end, end });
+      m_primarySelection = std::min(m_primarySelection, m_selections.size() - 1);
+    }
+    normalizeSelections(); // Carets of touching edits might end up in the same place
+    ++m_revision;
+
+    // Lines from the first to the last edited one
+    const size_t firstLine = clusters.front().m_firstLine;
+    const size_t oldCount = clusters.back().m_firstLine + clusters.back().m_oldCount - firstLine;
+    const size_t newCount = static_cast<size_t>(static_cast<long long>(oldCount) + lineShift);
+    m_minimapTiles.invalidateLines(firstLine, oldCount, newCount);
+
+    if (incremental && (clusters.size() == 1 || newCount <= MAX_PATCHED_LINES)) {
+      std::vector<std::vector<StyleRun>> styleRuns;
+      styleRuns.reserve(newCount);
+      size_t oldLine = firstLine;
+      for (auto& cluster : clusters) {
+        for (; oldLine < cluster.m_firstLine; ++oldLine) // Lines between two clusters are only moved
+          styleRuns.push_back(m_physicalLines[oldLine].m_styleRuns);
+        for (auto& runs : cluster.m_styleRuns)
+          styleRuns.emplace_back(std::move(runs));
+        oldLine = cluster.m_firstLine + cluster.m_oldCount;
+      }
+      renderEditedLines(firstLine, oldCount, std::move(styleRuns));
+    } else {
+      m_layoutValid = false;
+      m_dirty = true; // Nothing to patch: render everything (Raster mode always does)
+    }
+    return true;
+  }
+
+  // Reverts the last 'steps' operations. Each one costs as much as the text it changed; if there are many
+  // to undo, the text is restored from the closest checkpoint and only the remaining ones are replayed.
+  // A batch (the edits at several carets) is a single step and is reverted at once
+  bool Document::undo(size_t steps) {
+    std::vector<std::vector<UndoHistory::Operation>> undone;
+    DocumentPosition caret;
+    {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      if (!m_undoHistory.canUndo())
+        return false;
+      caret = m_selections[m_primarySelection].m_caret;
+      size_t rewound = m_undoHistory.rewindToCheckpoint(steps, m_buffer);
+      if (rewound > 0) { // The text was replaced entirely: it has to be rendered again
+        steps -= std::min(steps, rewound);
+        ++m_revision;
+        m_layoutValid = false;
+        m_needReLexing = (m_lexer != nullptr);
+        m_unlexedLines.m_replaced = true;
+        m_dirty = true;
+        m_minimapTiles.invalidate();
+        m_folds.clear();
+        caret = clampPosition(caret);
+        m_selections.assign(1, { caret, caret });
+        m_primarySelection = 0;
+      }
+      while (steps-- > 0 && m_undoHistory.canUndo())
+        undone.emplace_back(m_undoHistory.undo());
+    }
+
+    for (const auto& operations : undone) {
+      // The batch's operations were recorded one after the other, first to last: where each one ends is
+      // where it is in the text after all of them
+      std::vector<TextEdit> edits;
+      edits.reserve(operations.size());
+      for (const auto& operation : operations)
+        edits.push_back({ operation.m_from, operation.m_end, operation.m_removed });
+      applyEdits(std::move(edits), false);
+      caret = operations.front().m_caretBefore;
+    }
+    if (undone.empty() || undone.back().size() == 1)
+      setCursorPosition(caret);
+    else { // The carets stay where the batch was reverted
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      m_undoHistory.seal();
+    }
+    if (undone.empty() && m_lexer)
+      scheduleRelex();
+    return true;
+  }
+
+  bool Document::redo() {
+    std::vector<UndoHistory::Operation> operations;
+    {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      if (!m_undoHistory.canRedo())
+        return false;
+      operations = m_undoHistory.redo();
+    }
+
+    // Move the operations of a batch back to the text before all of them (they were recorded as if they
+    // were applied one after the other): a position after an operation is shifted by the lines it added and,
+    // on the line where it ends, by the columns
+    std::vector<TextEdit> edits;
+    edits.reserve(operations.size());
+    int lineDelta = 0, columnDelta = 0, shiftedLine = -1;
+    for (const auto& operation : operations) {
+      auto restore = [&](DocumentPosition position) {
+        if (position.y == shiftedLine)
+          position.x += columnDelta;
+        position.y += lineDelta;
+        return position;
+      };
+      edits.push_back({ restore(operation.m_from), restore(operation.m_to), operation.m_inserted });
+      columnDelta = operation.m_to.x - operation.m_end.x + (operation.m_to.y == shiftedLine ? columnDelta : 0);
+      lineDelta += operation.m_to.y - operation.m_end.y;
+      shiftedLine = operation.m_end.y;
+    }
+    std::vector<DocumentPosition> ends = applyEdits(std::move(edits), false);
+    if (ends.size() == 1)
+      setCursorPosition(ends.front());
+    else {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      m_undoHistory.seal();
+    }
+    return true;
+  }
+
+  void Document::setUndoMemoryBudget(size_t bytes) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    m_undoHistory.setMemoryBudget(bytes);
+  }
+
+#define MAX_DIFF_EDITS 4096 // Reloads changing more lines than this replace everything between the unchanged ends
+
+  // The file is read and compared outside of the lock on a snapshot of the text: only applying the edits
+  // blocks the UI. Appends (the file is longer and ends with the bytes it ended with before) cost as much as
+  // the appended data
+  bool Document::reloadFromDisk() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    if (m_filePath.empty() || m_stream || m_revision != m_disk.m_revision)
+      return false; // Changes which weren't saved are never overwritten
+    const std::string path = m_filePath;
+    const DiskState disk = m_disk;
+    const TextBuffer snapshot = m_buffer;
+    lock.unlock();
+
+    MappedFile file;
+    if (!file.open(path))
+      return false; // E.g. deleted, or being replaced right now (the rename is reported too)
+    DiskState current = readDiskState(path, file);
+    const char *data = file.getData();
+    const size_t size = file.getSize();
+    const bool sameTail = size >= disk.m_size &&
+                          std::equal(disk.m_tail.begin(), disk.m_tail.end(), data + disk.m_size - disk.m_tail.size());
+    if (sameTail && size == disk.m_size && current.m_modifiedTime == disk.m_modifiedTime)
+      return false; // Nothing changed (e.g. another file in the same directory did)
+    // Appended data is only read alone from files which need no conversion (bar a BOM at their beginning)
+    const bool appended = sameTail && size > disk.m_size && disk.m_encoding.m_encoding == Encoding::Utf8;
+
+    std::vector<TextEdit> edits;
+    if (appended) {
+      // The new data goes after the last line. The line ending the file ended with (dropped when it was read)
+      // separates it from the old text, the one it ends with now is dropped in turn
+      std::string text(data + disk.m_size, size - disk.m_size);
+      current.m_encoding = disk.m_encoding;
+      current.m_newline = disk.m_newline;
+      current.m_finalNewline = (text.back() == '\n' || text.back() == '\r');
+      const char previous = disk.m_tail.empty() ? '\0' : disk.m_tail.back();
+      if (previous == '\r' && text.front() == '\n')
+        text.erase(0, 1); // Completes a \r\n line ending
+      if (previous == '\r' || previous == '\n')
+        text.insert(0, 1, '\n');
+      if (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+        text.erase(text.size() - ((text.size() > 1 && text.compare(text.size() - 2, 2, "\r\n") == 0) ? 2 : 1));
+      DocumentPosition end = { static_cast<int>(snapshot.getLine(snapshot.getLineCount() - 1).size()),
+                               static_cast<int>(snapshot.getLineCount()) - 1 };
+      edits.push_back({ end, end, std::move(text) });
+    } else {
+      // Lines are compared by hash. Every hunk replaces whole lines: up to the beginning of the line after
+      // it or, at the end of the document, from the end of the line before it
+      std::vector<std::string> lines = readLines(file, current);
+      std::hash<std::string> hash;
+      std::vector<size_t> oldHashes, newHashes;
+      oldHashes.reserve(snapshot.getLineCount());
+      snapshot.forEachLine(0, snapshot.getLineCount(), [&](size_t, const std::string& line) {
+        oldHashes.push_back(hash(line));
+        return true;
+      });
+      newHashes.reserve(lines.size());
+      for (const auto& line : lines)
+        newHashes.push_back(hash(line));
+
+      const size_t oldCount = snapshot.getLineCount();
+      for (const auto& hunk : diffLines(oldHashes, newHashes, MAX_DIFF_EDITS)) {
+        const size_t oldEnd = hunk.m_oldStart + hunk.m_oldCount;
+        TextEdit edit;
+        if (oldEnd < oldCount) {
+          edit.m_from = { 0, static_cast<int>(hunk.m_oldStart) };
+          edit.m_to = { 0, static_cast<int>(oldEnd) };
+          for (size_t i = hunk.m_newStart; i < hunk.m_newStart + hunk.m_newCount; ++i)
+            edit.m_text.append(lines[i]).append(1, '\n');
+        } else {
+          edit.m_to = { static_cast<int>(snapshot.getLine(oldCount - 1).size()), static_cast<int>(oldCount) - 1 };
+          if (hunk.m_oldStart > 0) {
+            edit.m_from = { static_cast<int>(snapshot.getLine(hunk.m_oldStart - 1).size()), static_cast<int>(hunk.m_oldStart) - 1 };
+            for (size_t i = hunk.m_newStart; i < hunk.m_newStart + hunk.m_newCount; ++i)
+              edit.m_text.append(1, '\n').append(lines[i]);
+          } else { // The whole document
+            for (size_t i = hunk.m_newStart; i < hunk.m_newStart + hunk.m_newCount; ++i)
+              edit.m_text.append(i > hunk.m_newStart ? "\n" : "").append(lines[i]);
+          }
+        }
+        edits.emplace_back(std::move(edit));
+      }
+    }
+    file.close();
+
+    lock.lock();
+    if (m_revision != disk.m_revision)
+      return false; // Edited meanwhile
+    std::vector<DocumentPosition> ends;
+    const bool changed = applyEditsLocked(std::move(edits), false, true, ends);
+    if (changed) {
+      m_undoHistory.clear(); // Its positions refer to the text before the reload
+      if (m_followTail && appended) {
+        DocumentPosition end = clampPosition({ INT_MAX, INT_MAX });
+        m_selections.assign(1, { end, end });
+        m_primarySelection = 0;
+        revealLine(end.y);
+        m_revealCaret = true;
+      }
+    }
+    current.m_revision = m_revision;
+    m_disk = std::move(current);
+    lock.unlock();
+
+    if (changed) {
+      if (m_lexer)
+        scheduleRelex();
+      restartSearch();
+      m_codeView.repaintIfShowing(this); // Edited rows are patched in at the next draw
+    }
+    return changed;
+  }
+
+  void Document::setFollowTail(bool follow) {
+    m_followTail = follow;
+    if (follow) {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      DocumentPosition end = clampPosition({ INT_MAX, INT_MAX });
+      m_selections.assign(1, { end, end });
+      m_primarySelection = 0;
+      revealLine(end.y);
+      m_revealCaret = true;
+    }
+  }
+
+  bool Document::isFollowingTail() const {
+    return m_followTail;
+  }
+
+  // The snapshot shares its blocks with the text: taking it is cheap and edits made while it's written only
+  // clone the blocks they touch
+  bool Document::save(FsyncPolicy policy) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    if (m_filePath.empty() || m_stream)
+      return false;
+    FileSaver::Request request = { m_buffer, m_revision, m_filePath, m_disk.m_encoding, m_disk.m_newline,
+                                   m_disk.m_finalNewline, policy };
+    lock.unlock();
+
+    m_saver.save(std::move(request));
+    m_codeView.repaintIfShowing(this); // Shows the progress bar
+    return true;
+  }
+
+  bool Document::isSaving() {
+    return m_saver.isSaving();
+  }
+
+  float Document::getSaveProgress() const {
+    return m_saver.getProgress();
+  }
+
+  std::string Document::getSaveError() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    return m_saveError;
+  }
+
+  // The saved file is read back as if it had been loaded: the file watcher reports it as changed and
+  // reloadFromDisk() then finds it matching the saved revision. If the text was edited during the save the
+  // revisions differ and the document stays modified
+  void Document::onSaved(const FileSaver::Request& request, const FileSaver::Result& result) {
+    DiskState disk;
+    MappedFile file;
+    const bool read = result.m_success && file.open(request.m_path);
+    if (read)
+      disk = readDiskState(request.m_path, file);
+    file.close();
+
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    m_saveError = result.m_error;
+    if (read && request.m_path == m_filePath) {
+      disk.m_encoding = request.m_encoding;
+      disk.m_newline = request.m_newline;
+      disk.m_finalNewline = request.m_finalNewline;
+      disk.m_revision = request.m_revision;
+      m_disk = std::move(disk);
+    }
+    lock.unlock();
+
+    m_codeView.repaintIfShowing(this); // The progress bar goes away
+  }
+
+#define LONG_LINE_BYTES (256 << 10) // Longer lines are wrapped by all the threads and rendered as they come into view
+#define LONG_LINE_SEGMENT_BYTES (256 << 10) // Shortest segment a long line is cut into
+
+  void Document::renderEditedLines(size_t line, size_t oldCount, std::vector<std::vector<StyleRun>> styleRuns) {
+    const size_t newCount = styleRuns.size();
+
+    std::vector<std::string> lines;
+    lines.reserve(newCount);
+    for (size_t i = 0; i < newCount; ++i) {
+      lines.push_back(m_buffer.getLine(line + i));
+      if (lines.back().size() > LONG_LINE_BYTES) {
+        m_layoutValid = false;
+        m_dirty = true; // Long lines are wrapped by all the threads together
+        return;
+      }
+    }
+    auto styleDb = makeStyleDatabase(lines, styleRuns); // The edited lines alone
+
+    auto request = makeRequest();
+    if (request->m_characterHeightPixels != m_characterHeightPixels) {
+      m_dirty = true; // The theme changed since the last render, rows can't be patched
+      return;
+    }
+    request->m_buffer = TextBuffer(std::move(lines));
+    request->m_styleDb = std::move(styleDb);
+    request->m_fileCache.reset(); // Its rows are those of the lines of the file
+    RenderedChunk chunk = renderLines(request, 0, newCount); // Sized for the rows the lines wrap into
+
+    // Rows of the edited lines in the current layout
+    const size_t firstRow = m_rowIndex.prefixSum(line);
+    const size_t oldRows = m_rowIndex.prefixSum(line + oldCount) - firstRow;
+
+    StripPatch patch;
+    patch.m_top = firstRow * m_characterHeightPixels;
+    patch.m_oldHeight = oldRows * m_characterHeightPixels;
+    patch.m_newHeight = chunk.m_height;
+    appendStrips(patch.m_strips, chunk, patch.m_top);
+    m_pendingPatches.emplace_back(std::move(patch));
+
+    // The edited lines are replaced in place, O(log n) per line in the index. Lines after them keep their
+    // hidden counters; those of the replaced lines are lost, the folds over them are hidden again
+    std::vector<size_t> rows(newCount);
+    for (size_t i = 0; i < newCount; ++i)
+      rows[i] = chunk.m_physicalLines[i].m_editorLines.size();
+    m_physicalLines.erase(line, oldCount);
+    m_physicalLines.insert(line, chunk.m_physicalLines);
+    m_rowIndex.erase(line, oldCount);
+    m_rowIndex.insert(line, rows);
+    for (const auto& fold : m_folds) { // Already moved by updateFoldsForEdit()
+      size_t first = std::max(fold.first + 1, line), last = std::min(fold.second + 1, line + newCount);
+      if (first < last)
+        m_rowIndex.hide(first, last);
+    }
+    m_numberOfEditorLines = static_cast<int>(m_rowIndex.total());
+    m_numberOfVisibleRows = static_cast<int>(m_rowIndex.visibleTotal());
+    m_maximumCharactersLine = std::max(m_maximumCharactersLine, request->m_maximumCharactersLine);
+  }
+
+  void Document::rebuildRowIndex() {
+    std::vector<size_t> editorLines;
+    editorLines.reserve(m_physicalLines.size());
+    for (const auto& line : m_physicalLines)
+      editorLines.push_back(line.m_editorLines.size());
+    m_rowIndex.rebuild(editorLines);
+    for (auto it = m_folds.begin(); it != m_folds.end();) {
+      if (it->second >= editorLines.size()) { // The text was replaced under it
+        it = m_folds.erase(it);
+        continue;
+      }
+      m_rowIndex.hide(it->first + 1, it->second + 1);
+      ++it;
+    }
+  }
+
+  bool Document::hasLayout() const {
+    return m_physicalLines.size() == m_buffer.getLineCount() && m_rowIndex.size() == m_physicalLines.size();
+  }
+
+  // Folds before the edited lines stay, folds after them are moved along and folds with hidden lines among the
+  // edited ones are dropped. Editing the first line of a folded region alone keeps it folded
+  void Document::updateFoldsForEdit(size_t line, size_t oldCount, size_t newCount) {
+    const size_t lastEdited = line + oldCount - 1;
+    std::map<size_t, size_t> folds;
+    for (const auto& fold : m_folds) {
+      if (fold.second < line || (fold.first == line && oldCount == 1 && newCount == 1))
+        folds.insert(fold);
+      else if (fold.first > lastEdited)
+        folds.emplace(fold.first + newCount - oldCount, fold.second + newCount - oldCount); // Wraps around if negative
+      else if (m_rowIndex.size() > fold.second) // Still in the lines the index was built for
+        m_rowIndex.show(fold.first + 1, fold.second + 1);
+    }
+    m_folds = std::move(folds);
+    m_numberOfVisibleRows = static_cast<int>(m_rowIndex.visibleTotal());
+  }
+
+  void Document::revealLine(size_t line) {
+    for (auto it = m_folds.begin(); it != m_folds.end() && it->first < line;) {
+      if (it->second < line) {
+        ++it;
+        continue;
+      }
+      if (m_rowIndex.size() > it->second)
+        m_rowIndex.show(it->first + 1, it->second + 1);
+      it = m_folds.erase(it);
+    }
+    m_numberOfVisibleRows = static_cast<int>(m_rowIndex.visibleTotal());
+  }
+
+  bool Document::toggleFold(int line) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    if (!hasLayout() || line < 0 || static_cast<size_t>(line) >= m_physicalLines.size())
       return false;
 
-    // Load the entire file into memory
-    std::string line;
-    while (getline(f, line)) {
+    auto folded = m_folds.find(line);
+    if (folded != m_folds.end()) {
+      m_rowIndex.show(folded->first + 1, folded->second + 1);
+      m_folds.erase(folded);
+      m_numberOfVisibleRows = static_cast<int>(m_rowIndex.visibleTotal());
+      return true;
+    }
 
-      // This is also necessary: normalize all line endings to \n (Unix-style)
-      std::regex invalidEndings("\r\n|\r");
-      line = std::regex_replace(line, invalidEndings, "\n");
+    size_t lexedLine;
+    if (!toLexedLine(static_cast<size_t>(line), lexedLine))
+      return false; // Edited since the regions were found
+
+    // Regions are sorted by first line (outer ones first): the innermost region around the line is the last
+    // one beginning at or before it which also ends after it. Regions are lexed ones, the lines they begin
+    // and end on must not have been edited since
+    const auto& regions = m_styleDb->m_foldRegions;
+    auto it = std::upper_bound(regions.begin(), regions.end(), static_cast<uint32_t>(lexedLine),
+                               [](uint32_t value, const FoldRegion& region) { return value < region.m_firstLine; });
+    while (it != regions.begin()) {
+      --it;
+      size_t firstLine, lastLine;
+      if (it->m_lastLine < static_cast<uint32_t>(lexedLine) || !fromLexedLine(it->m_firstLine, firstLine) ||
+          !fromLexedLine(it->m_lastLine, lastLine) || lastLine >= m_physicalLines.size() || m_folds.count(firstLine) > 0)
+        continue;
+
+      m_folds.emplace(firstLine, lastLine);
+      m_rowIndex.hide(firstLine + 1, lastLine + 1);
+      m_numberOfVisibleRows = static_cast<int>(m_rowIndex.visibleTotal());
+      for (auto& selection : m_selections) { // Hidden carets move to the end of the first line of the region
+        if (selection.m_caret.y > static_cast<int>(firstLine) && selection.m_caret.y <= static_cast<int>(lastLine)) {
+          selection.m_caret = { static_cast<int>(m_buffer.getLine(firstLine).size()), static_cast<int>(firstLine) };
+          selection.m_anchor = selection.m_caret;
+        }
+      }
+      normalizeSelections();
+      return true;
+    }
+    return false;
+  }
+
+  void Document::unfoldAll() {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    for (const auto& fold : m_folds) {
+      if (m_rowIndex.size() > fold.second)
+        m_rowIndex.show(fold.first + 1, fold.second + 1);
+    }
+    m_folds.clear();
+    m_numberOfVisibleRows = static_cast<int>(m_rowIndex.visibleTotal());
+  }
+
+  int Document::skipFoldedLines(int line, bool forward) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    for (const auto& fold : m_folds) { // The first fold around the line is the outermost one
+      if (static_cast<int>(fold.first) >= line)
+        break;
+      if (static_cast<int>(fold.second) >= line) {
+        size_t target = forward ? fold.second + 1 : fold.first;
+        return static_cast<int>(target < m_buffer.getLineCount() ? target : fold.first);
+      }
+    }
+    return line;
+  }
 
-      // For simplicity convert all tabs into 4 spaces and just deal with those
-      std::regex tabs("\t");
-      line = std::regex_replace(line, tabs, "    ");
+  // Splits the view rows [firstViewRow, firstViewRow + rowCount) where folded lines are skipped. Each segment is
+  // a run of rows which are contiguous in the rendered document too
+  std::vector<Document::RowSegment> Document::getVisibleSegments(size_t firstViewRow, size_t rowCount) {
+    std::vector<RowSegment> segments;
+    if (m_folds.empty() || !hasLayout()) {
+      segments.push_back({ firstViewRow, firstViewRow, rowCount });
+      return segments;
+    }
 
-      m_plainTextLines.push_back(std::move(line));
+    const size_t lineCount = m_physicalLines.size();
+    size_t row = firstViewRow;
+    const size_t end = firstViewRow + rowCount;
+    while (row < end) {
+      size_t line = m_rowIndex.findVisible(row);
+      if (line >= lineCount)
+        break; // Past the end of the document
+      size_t documentRow = m_rowIndex.prefixSum(line) + (row - m_rowIndex.visiblePrefixSum(line));
+      auto fold = m_folds.lower_bound(line); // The run ends with the first line of the next fold
+      size_t runEnd = (fold == m_folds.end()) ? lineCount : fold->first + 1;
+      size_t count = std::min(m_rowIndex.prefixSum(runEnd) - documentRow, end - row);
+      segments.push_back({ row, documentRow, count });
+      row += count;
     }
-    f.close();
+    return segments;
+  }
 
+#define RELEX_DELAY_MS 300 // Typing pause after which the document is lexed again
+
+  void Document::scheduleRelex() {
+    auto deadline = AnimationScheduler::Clock::now() + std::chrono::milliseconds(RELEX_DELAY_MS);
+    m_relexDeadline = deadline.time_since_epoch().count();
+
+    if (m_relexPending.exchange(true))
+      return; // Already waiting, the deadline update is enough
+
+    m_codeView.getAnimationScheduler().addAnimation([this](AnimationScheduler::Clock::time_point now) {
+      if (now.time_since_epoch().count() < m_relexDeadline)
+        return true;
+      m_relexPending = false;
+      m_relexRequested = true;
+      m_codeView.repaintIfShowing(this);
+      return false;
+    });
+  }
+
+  // Merges an edit of the lines [line, line + oldCount) of the current text, now newCount lines, with the
+  // ones before it: the lines edited since the last lexing are those from the first edited one to the last
+  void Document::addUnlexedLines(size_t line, size_t oldCount, size_t newCount) {
+    UnlexedLines& unlexed = m_unlexedLines;
+    const long long added = static_cast<long long>(newCount) - static_cast<long long>(oldCount);
+    if (!unlexed.m_edited) {
+      unlexed = { true, line, line + oldCount, added };
+      return;
+    }
+    // Where the edit ends in the lexed text: the lines after the edited ones moved by m_shift
+    const size_t end = line + oldCount;
+    const size_t currentEnd = static_cast<size_t>(static_cast<long long>(unlexed.m_end) + unlexed.m_shift);
+    size_t lexedEnd = unlexed.m_end;
+    if (end <= unlexed.m_first)
+      lexedEnd = end;
+    else if (end >= currentEnd)
+      lexedEnd = static_cast<size_t>(static_cast<long long>(end) - unlexed.m_shift);
+    unlexed.m_first = std::min(unlexed.m_first, line);
+    unlexed.m_end = std::max(unlexed.m_end, lexedEnd);
+    unlexed.m_shift += added;
+  }
+
+  bool Document::toLexedLine(size_t line, size_t& lexedLine) const {
+    const UnlexedLines& unlexed = m_unlexedLines;
+    if (m_styleDbRevision != m_revision && (!unlexed.m_edited || unlexed.m_replaced))
+      return false;
+    if (!unlexed.m_edited || line < unlexed.m_first) {
+      lexedLine = line;
+      return true;
+    }
+    const long long lexed = static_cast<long long>(line) - unlexed.m_shift; // Lines after the edited ones moved
+    if (lexed < static_cast<long long>(unlexed.m_end))
+      return false;
+    lexedLine = static_cast<size_t>(lexed);
+    return true;
+  }
+
+  bool Document::fromLexedLine(size_t lexedLine, size_t& line) const {
+    const UnlexedLines& unlexed = m_unlexedLines;
+    if (m_styleDbRevision != m_revision && (!unlexed.m_edited || unlexed.m_replaced))
+      return false;
+    if (!unlexed.m_edited || lexedLine < unlexed.m_first) {
+      line = lexedLine;
+      return true;
+    }
+    if (lexedLine < unlexed.m_end)
+      return false;
+    line = static_cast<size_t>(static_cast<long long>(lexedLine) + unlexed.m_shift);
+    return true;
+  }
+
+  // Lexing resumes before the edited lines and stops when it gets back in sync with the previous result (see
+  // LexerBase::relexInput()): only the lines in between are compared with the styles they were rendered with,
+  // and the ones which changed are rendered again as a patch. Runs on the UI thread, like scheduleRender()
+  void Document::relexEditedLines() {
+    if (!m_lexer || m_needReLexing)
+      return; // Everything will be lexed at the next render anyway
+
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    const UnlexedLines unlexed = m_unlexedLines;
+    if (!unlexed.m_edited)
+      return;
+    const TextBuffer buffer = m_buffer; // Cheap: blocks are shared until modified
+    const unsigned int revision = m_revision;
+    std::shared_ptr<const StyleDatabase> previous = m_styleDb;
+    const bool sameLexer = (m_styleDbLexer == static_cast<int32_t>(m_lexer->getLexerType()));
+    lock.unlock();
+
+    auto styleDb = std::make_shared<StyleDatabase>();
+    size_t firstLexed = 0, endLexed = 0;
+    const size_t newEnd = static_cast<size_t>(static_cast<long long>(unlexed.m_end) + unlexed.m_shift);
+    auto lines = [&buffer](size_t line) { return line < buffer.getLineCount() ? &buffer.getLine(line) : nullptr; };
+    m_lexer->reset();
+    if (!sameLexer || !m_lexer->relexInput(lines, *previous, unlexed.m_first, unlexed.m_end - unlexed.m_first,
+                                           newEnd - unlexed.m_first, *styleDb, firstLexed, endLexed)) {
+      m_needReLexing = true; // E.g. the styles were read from a FileCache: lex and render everything
+      m_dirty = true;
+      return;
+    }
+
+    lock.lock();
+    if (m_revision != revision)
+      return; // Edited in the meantime: lexed again at the next pause
+    m_styleDb = styleDb;
+    m_styleDbRevision = revision;
+    m_unlexedLines = UnlexedLines();
+    m_bracketLookup = BracketLookup();
+
+    const bool incremental = (m_renderMode != RenderMode::Raster && !m_dirty && m_layoutValid && hasLayout());
+    if (!incremental) {
+      m_dirty = true;
+      return;
+    }
+    endLexed = std::min(endLexed, m_buffer.getLineCount());
+    auto sameRuns = [](const std::vector<StyleRun>& a, const std::vector<StyleRun>& b) {
+      return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const StyleRun& x, const StyleRun& y) {
+        return x.m_start == y.m_start && x.m_count == y.m_count && x.m_style == y.m_style;
+      });
+    };
+    std::vector<std::vector<StyleRun>> styleRuns;
+    size_t firstChanged = endLexed, endChanged = endLexed;
+    for (size_t line = firstLexed; line < endLexed; ++line) {
+      std::vector<StyleRun> runs = collectStyleRuns(*styleDb, line, 0, m_buffer.getLine(line).size());
+      mergeStyleRuns(runs);
+      if (!sameRuns(runs, m_physicalLines[line].m_styleRuns)) {
+        if (firstChanged == endLexed)
+          firstChanged = line;
+        endChanged = line + 1;
+      }
+      if (firstChanged != endLexed)
+        styleRuns.emplace_back(std::move(runs));
+      if (endChanged - firstChanged > MAX_PATCHED_LINES) {
+        m_dirty = true; // E.g. a comment was opened: render everything with the new styles
+        return;
+      }
+    }
+    if (firstChanged == endLexed)
+      return; // Same colors as guessed while typing
+    styleRuns.resize(endChanged - firstChanged);
+    renderEditedLines(firstChanged, endChanged - firstChanged, std::move(styleRuns));
+    lock.unlock();
+    m_codeView.repaintIfShowing(this);
+  }
+
+  bool Document::setSearchQuery(const std::string& needle, bool regex) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    size_t startLine = m_selections[m_primarySelection].m_caret.y;
+    if (m_stream) { // The whole file is searched, not just the window
+      const size_t startOffset = m_windowOffsets[startLine];
+      updateWindowFirstLine();
+      startLine = m_windowFirstLineExact ? m_windowFirstLine + startLine : StreamingFile::npos;
+      lock.unlock();
+      return m_search.start(m_stream->getData(), m_stream->getSize(), needle, startOffset, startLine, regex);
+    }
+    TextBuffer snapshot = m_buffer; // Cheap: blocks are shared until modified
+    lock.unlock();
+    return m_search.start(std::move(snapshot), needle, startLine, regex);
+  }
+
+  // The matches of a streamed file are on its lines: those on the window's lines are found by where the
+  // lines begin, and numbered as the window's lines
+  std::vector<SearchMatch> Document::getSearchMatches(size_t firstLine, size_t lastLine) {
+    if (!m_stream)
+      return m_search.getMatches(firstLine, lastLine);
+    lastLine = std::min(lastLine, m_windowOffsets.size() - 1);
+    if (firstLine >= lastLine)
+      return {};
+    auto lineBegin = m_windowOffsets.begin();
+    std::vector<SearchMatch> matches = m_search.getMatchesAt(lineBegin[firstLine], lineBegin[lastLine]);
+    for (auto& match : matches) {
+      auto it = std::upper_bound(lineBegin + firstLine, lineBegin + lastLine, match.m_lineOffset);
+      match.m_line = static_cast<size_t>(it - lineBegin) - 1;
+    }
+    return matches;
+  }
+
+  void Document::restartSearch() {
+    std::string needle = m_search.getNeedle();
+    if (!needle.empty())
+      setSearchQuery(needle, m_search.isRegex());
+  }
+
+  bool Document::findNext(bool forward, bool& windowMoved) {
+    windowMoved = false;
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    DocumentPosition caret = m_selections[m_primarySelection].m_caret;
+    SearchMatch match;
+    const size_t lineOffset = m_stream ? m_windowOffsets[caret.y] : 0;
+    if (!m_search.findNext({ static_cast<size_t>(caret.y), static_cast<size_t>(caret.x), 0, lineOffset }, forward, match))
+      return false;
+    if (m_stream) { // A line of the file: in the window, or a window is loaded around it
+      if (match.m_lineOffset >= m_windowOffsets.front() && match.m_lineOffset < m_windowOffsets.back()) {
+        auto it = std::upper_bound(m_windowOffsets.begin(), m_windowOffsets.end() - 1, match.m_lineOffset);
+        match.m_line = static_cast<size_t>(it - m_windowOffsets.begin()) - 1;
+      } else {
+        const size_t line = match.m_line;
+        match.m_line = moveStreamWindowTo(match.m_lineOffset, line);
+        m_windowFirstLine = line - match.m_line; // Counted by the search from the beginning of the file
+        m_windowFirstLineExact = true;
+        windowMoved = true;
+      }
+    }
+    lock.unlock();
+    setCursorPosition({ static_cast<int>(match.m_column), static_cast<int>(match.m_line) });
+    return true;
+  }
+
+  // Edited lines aren't in m_styleDb until the typing pauses, the others are only moved: their brackets are
+  // looked up where they were lexed and still shown in the meantime
+  bool Document::findMatchingBracket(DocumentPosition position, DocumentPosition& bracket, DocumentPosition& match) {
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    size_t line;
+    if (position.y < 0 || position.x < 0 || !toLexedLine(static_cast<size_t>(position.y), line))
+      return false; // Edited since the brackets were found
+    const BracketIndex& index = m_styleDb->m_brackets;
+    const size_t column = static_cast<size_t>(position.x);
+
+    BracketLookup& lookup = m_bracketLookup;
+    if (lookup.m_styleDb != m_styleDb.get() || lookup.m_line != line || lookup.m_column != column) {
+      uint32_t found = index.find(line, column);
+      if ((found == BracketIndex::NO_MATCH || index.m_brackets[found].m_match == BracketIndex::NO_MATCH) && column > 0)
+        found = index.find(line, column - 1);
+      lookup = { m_styleDb.get(), line, column, found };
+    }
+    if (lookup.m_found == BracketIndex::NO_MATCH || index.m_brackets[lookup.m_found].m_match == BracketIndex::NO_MATCH)
+      return false;
+
+    const auto& first = index.m_brackets[lookup.m_found];
+    const auto& second = index.m_brackets[first.m_match];
+    size_t firstLine, secondLine;
+    if (!fromLexedLine(first.m_line, firstLine) || !fromLexedLine(second.m_line, secondLine))
+      return false; // The matching bracket is on an edited line
+    bracket = { static_cast<int>(first.m_column), static_cast<int>(firstLine) };
+    match = { static_cast<int>(second.m_column), static_cast<int>(secondLine) };
+    return true;
+  }
+
+  bool Document::jumpToMatchingBracket() {
+    DocumentPosition caret = getCursorPosition();
+    DocumentPosition bracket, match;
+    if (!findMatchingBracket(caret, bracket, match))
+      return false;
+    // Keep the caret on the same side of the bracket: before it if it was before the first one
+    if (!(bracket == caret))
+      ++match.x;
+    setCursorPosition(match);
     return true;
   }
 
@@ -72,12 +1742,22 @@ namespace varco {
     m_wrapWidthPixels = width;
   }
 
+  void Document::setTabWidth(int width) {
+    width = std::max(width, 1);
+    std::unique_lock<std::mutex> lock(m_documentMutex);
+    if (m_tabWidth == width)
+      return;
+    m_tabWidth = width;
+    m_layoutValid = false; // Rows and columns of the lines with tabs changed: no incremental render until the next one
+    m_dirty = true;
+  }
+
   void Document::applySyntaxHighlight(SyntaxHighlight s) {
     m_needReLexing = false;
     switch (s) {
     case NONE: {
       if (m_lexer) { // Check if there were a lexer before (i.e. the smart pointer was set)
-        m_lexer.release();
+        m_lexer.reset();
         m_needReLexing = true; // Syntax has been changed, re-lex the document at the next recalculate
       }
     } break;
@@ -96,28 +1776,71 @@ namespace varco {
   }
 
 
-#define MAX_WRAPS_PER_LINE 10
+  namespace {
+    // The rows of a line where they began when it was wrapped the last time (see FileCache). Empty if the
+    // line wasn't wrapped or the breaks don't fit it
+    std::vector<EditorLine> splitAtRowBreaks(const std::string& line, std::pair<const uint32_t*, const uint32_t*> breaks) {
+      std::vector<EditorLine> rows;
+      if (breaks.first == breaks.second)
+        return rows;
+      rows.reserve(breaks.second - breaks.first + 1);
+      size_t rowStart = 0;
+      for (const uint32_t *it = breaks.first; it != breaks.second; ++it) {
+        if (*it <= rowStart || *it >= line.size())
+          return std::vector<EditorLine>();
+        rows.emplace_back(line.data() + rowStart, *it - rowStart);
+        rowStart = *it;
+      }
+      rows.emplace_back(line.data() + rowStart, line.size() - rowStart);
+      return rows;
+    }
+
+    void copyRenderSettings(const ThreadRequest& from, ThreadRequest& to) {
+      to.m_characterWidthPixels = from.m_characterWidthPixels;
+      to.m_characterHeightPixels = from.m_characterHeightPixels;
+      to.m_wrapWidthPixels = from.m_wrapWidthPixels;
+      to.m_tabWidth = from.m_tabWidth;
+      to.m_maximumCharactersLine = 0;
+      to.m_renderMode = from.m_renderMode;
+      to.m_theme = from.m_theme;
+      to.m_revision = from.m_revision;
+    }
+  }
 
   void Document::threadProcessChunk(size_t threadIdx, std::shared_ptr<ThreadRequest> data) {
 
-      // Process a chunk of data
       if (threadIdx >= data->m_numThreads)
         return;
 
-      // Calculate per-thread work bounds
-      size_t start = threadIdx * data->m_linesPerThread;
-      size_t end;
-      if (data->m_numThreads == 1)
-        end = data->m_plainTextLines.size();
-      else
-        end = std::min(data->m_plainTextLines.size(), start + data->m_linesPerThread);
+      // Scratch data of the chunks goes in the thread's arena, the pool resets it once the request is done
+      MonotonicArena& scratch = m_codeView.m_threadPool.getScratchArena(threadIdx);
 
-      // Precalculate the allowed number of characters per editor line
-      int maxChars = static_cast<int>(data->m_wrapWidthPixels / m_codeView.getCharacterWidthPixels());
-      if (maxChars < 10)
-        maxChars = 10; // Keep it to a minimum
+      // Take chunks until there are none left: threads given cheaper chunks take more of them
+      for (size_t i; (i = data->m_nextChunk++) < data->m_chunks.size();) {
+        const ThreadRequest::Chunk& work = data->m_chunks[i];
+        RenderedChunk chunk = (work.m_to > work.m_from) ? wrapLongLine(data, work.m_start, work.m_from, work.m_to, scratch) :
+                                                          renderLines(data, work.m_start, work.m_end, &scratch);
+
+        // Time to fulfill the promise
+        {
+          std::unique_lock<std::mutex> lock(data->m_syncBarrier);
+          data->m_totalBitmapHeight += chunk.m_height;
+          data->m_maxBitmapWidth = std::max(data->m_maxBitmapWidth, chunk.m_width);
+          data->m_partials[i].set_value(std::move(chunk));
+        }
+      }
+  }
 
-      const SkScalar fontDescent = m_codeView.getFontMetrics().fDescent; // Relative to baseline (see CodeView ctor)      
+  // Wraps and renders the physical lines [start; end) of a request. Also used on its own to render
+  // the lines touched by an edit
+  RenderedChunk Document::renderLines(std::shared_ptr<ThreadRequest> data, size_t start, size_t end,
+                                      MonotonicArena *scratch) {
+
+      const int maxChars = getMaxColumns(*data);
+      MonotonicArena ownScratch; // Doesn't allocate unless it's used
+      MonotonicArena& arena = scratch ? *scratch : ownScratch;
+
+      const SkScalar fontDescent = data->m_theme->getFontMetrics().fDescent; // Relative to baseline (see CodeView ctor)      
 
       SkScalar bitmapEffectiveHeight = 0; // This is NOT know before the computation
       SkScalar bitmapEffectiveWidth = 0;
@@ -128,98 +1851,125 @@ namespace varco {
       } startpoint = { BITMAP_OFFSET_X, BITMAP_OFFSET_Y }; // Start point where to start rendering      
       bitmapEffectiveHeight += startpoint.y;
 
-      SkBitmap bitmap; // Allocate partial rendering result (maximum size)
-      bitmap.allocPixels(SkImageInfo::Make((int)(data->m_wrapWidthPixels + startpoint.x),
-        (int)((end - start) * MAX_WRAPS_PER_LINE * m_codeView.getCharacterHeightPixels() + startpoint.y),
-        kN32_SkColorType, kPremul_SkAlphaType));
+      // Lines are wrapped first: the partial has room for exactly their rows, however many a line wraps into
+      std::vector<PhysicalLine> phLineVec;
+      phLineVec.reserve(end - start);
+      size_t rows = 0;
+      for (size_t i = start; i < end; ++i) {
+
+        const std::string& line = data->m_buffer.getLine(i); // The snapshot's own, not a copy
+
+        // Plain lines (almost all of them in code) have a column per byte: they skip the column mapping
+        const bool plainLine = data->m_buffer.isPlain(i);
+        const size_t lineColumns = plainLine ? line.size() : getColumnCount(line.data(), line.size(), data->m_tabWidth);
+
+                                             // Check if the monospace'd width isn't exceeding the viewport
+        if (lineColumns * data->m_characterWidthPixels > data->m_wrapWidthPixels) {
+          // We have a wrap and the line is too big - WRAP IT: at spaces if possible, or else anywhere
+          std::vector<EditorLine> edLines = data->m_fileCache ? splitAtRowBreaks(line, data->m_fileCache->getRowBreaks(i)) :
+                                                                std::vector<EditorLine>();
+          if (edLines.empty())
+            edLines = wrapLine(line.data(), line.size(), maxChars, plainLine, data->m_tabWidth, arena);
+          phLineVec.emplace_back(std::move(edLines));
+        } else // No wrap or the line fits perfectly within the wrap limits
+          phLineVec.emplace_back(EditorLine(line.data(), line.size()));
+        rows += phLineVec.back().m_editorLines.size();
+      }
+
+      // Partial rendering result
+      SkRect rect = SkRect::MakeIWH((int)(data->m_wrapWidthPixels + startpoint.x),
+        (int)(rows * data->m_characterHeightPixels + startpoint.y));
 
       bitmapEffectiveWidth = data->m_wrapWidthPixels + startpoint.x;
 
-      SkCanvas canvas(bitmap);
-      SkRect rect = SkRect::MakeIWH(bitmap.width(), bitmap.height()); // Drawing is performed on the bitmap - absolute rect      
+      SkBitmap bitmap;
+      std::unique_ptr<SkCanvas> bitmapCanvas;
+      SkPictureRecorder recorder;
+      SkRTreeFactory rtreeFactory; // Lets the playback skip all the lines outside of the clip
+      SkCanvas *canvasPtr;
+      if (data->m_renderMode == RenderMode::DisplayList) {
+        canvasPtr = recorder.beginRecording(rect, &rtreeFactory);
+      } else {
+        // Pooled: the pixels go back once the partial is composited (or its strips are uploaded)
+        PixelBufferPool::get().allocPixels(bitmap, SkImageInfo::Make((int)rect.width(), (int)rect.height(), kN32_SkColorType, kPremul_SkAlphaType));
+        bitmapCanvas = std::make_unique<SkCanvas>(bitmap);
+        canvasPtr = bitmapCanvas.get();
+      }
+      SkCanvas& canvas = *canvasPtr;
 
       { // Draw partial bitmap background
         SkPaint background;
-        background.setColor(SkColorSetARGB(255, 39, 40, 34));
+        background.setColor(data->m_theme->getBackgroundColor());
         canvas.drawRect(rect, background);
       }
 
-      // Set up thread-only painter
-      SkPaint painter;
-      painter.setTextSize(SkIntToScalar(m_codeView.m_textSize));
-      painter.setAntiAlias(true);
-      painter.setLCDRenderText(true);
-      painter.setAutohinted(true);
-      painter.setTypeface(m_codeView.m_typeface);
-      painter.setColor(SK_ColorWHITE);
-
-      auto setColor = [&painter](Style s) {
-        switch (s) {
-          case Comment: {
-            painter.setColor(SkColorSetARGB(255, 117, 113, 94)); // Gray-ish 
-          } break;
-          case Keyword: {
-            painter.setColor(SkColorSetARGB(255, 249, 38, 114)); // Pink-ish
-          } break;
-          case QuotedString: {
-            painter.setColor(SkColorSetARGB(255, 230, 219, 88)); // Yellow-ish
-          } break;
-          case Identifier: {
-            painter.setColor(SkColorSetARGB(255, 166, 226, 46)); // Green-ish
-          } break;
-          case KeywordInnerScope:
-          case FunctionCall: {
-            painter.setColor(SkColorSetARGB(255, 102, 217, 239)); // Light blue
-          } break;
-          case Literal: {
-            painter.setColor(SkColorSetARGB(255, 174, 129, 255)); // Purple-ish
-          } break;
-          default: {
-            painter.setColor(SK_ColorWHITE);
-          } break;
-        };
+      // Paints are prebuilt in the shared theme: just pick the one for the current style
+      const Theme& theme = *data->m_theme;
+      const SkPaint *painter = &theme.getStylePaint(Normal);
+      Style currentStyle = Normal;
+      auto setStyle = [&painter, &theme, &currentStyle](Style s) {
+        painter = &theme.getStylePaint(s);
+        currentStyle = s;
+      };
+
+      // The database is shared by all the threads: only look up, never insert
+      const StyleDatabase& styleDb = *data->m_styleDb;
+      auto lookup = [](const std::map<size_t, size_t>& map, size_t line, size_t notFound) {
+        auto it = map.find(line);
+        return (it == map.end()) ? notFound : it->second;
       };
 
-      auto styleEnd = data->m_styleDb.styleSegment.end();
-      auto currentStyleIt = data->m_styleDb.styleSegment.begin();
+      auto styleEnd = styleDb.styleSegment.end();
+      auto currentStyleIt = styleDb.styleSegment.begin();
       bool currentlyInSegment = false;
 
       // Find first style for the first line to process (if any)
       {
-        auto previousSegmentIndex = (data->m_styleDb.previousSegment.size() > 0) ? data->m_styleDb.previousSegment[start] : -1;
-        if (previousSegmentIndex == -1) {
+        auto previousSegmentIndex = lookup(styleDb.previousSegment, start, static_cast<size_t>(-1));
+        if (previousSegmentIndex == static_cast<size_t>(-1) || previousSegmentIndex >= styleDb.styleSegment.size()) {
           // There was no segment before this line, check if there's one beginning right here at character 0,
           // otherwise it means no segment was *ever* present and we switch to normal style
-          auto firstIt = data->m_styleDb.styleSegment.begin();
+          auto firstIt = styleDb.styleSegment.begin();
           if (firstIt != styleEnd && firstIt->line == start && firstIt->start == 0) {
             // A segment begins right at the first line (pos == 0) that we have to process, get it
-            setColor(firstIt->style);
+            setStyle(firstIt->style);
             currentlyInSegment = true;
             currentStyleIt = firstIt;
           } else
-            setColor(Normal);
+            setStyle(Normal);
         } else {
           // There was a previous segment, that doesn't mean its style still lasts here, we have to check
-          auto previousStyle = data->m_styleDb.styleSegment.begin() + previousSegmentIndex;
-          if (previousStyle->absStartPos + previousStyle->count > data->m_styleDb.m_absOffsetWhereLineBegins[start]) {
+          auto previousStyle = styleDb.styleSegment.begin() + previousSegmentIndex;
+          if (previousStyle->absStartPos + previousStyle->count > lookup(styleDb.m_absOffsetWhereLineBegins, start, 0)) {
             // Yes, it still lasts
             currentStyleIt = previousStyle;
             currentlyInSegment = true;
-            setColor(previousStyle->style);
+            setStyle(previousStyle->style);
           } else 
-            setColor(Normal);
+            setStyle(Normal);
         }
       }
 
       auto getFirstSegmentOnLine = [&](size_t line) {
-        auto res = data->m_styleDb.firstSegmentOnLine.find(line);
-        if (res == data->m_styleDb.firstSegmentOnLine.end())
+        auto res = styleDb.firstSegmentOnLine.find(line);
+        if (res == styleDb.firstSegmentOnLine.end())
           return styleEnd;
         else
-          return data->m_styleDb.styleSegment.begin() + res->second;
+          return styleDb.styleSegment.begin() + res->second;
+      };
+
+      ArenaVector<StyleRun> styleRuns{ ArenaAllocator<StyleRun>(arena) }; // Of the physical line being rendered
+      auto recordStyleRun = [&styleRuns, &currentStyle](size_t offset, size_t count) {
+        if (currentStyle == Normal || count == 0)
+          return;
+        if (!styleRuns.empty() && styleRuns.back().m_style == currentStyle &&
+            styleRuns.back().m_start + styleRuns.back().m_count == offset)
+          styleRuns.back().m_count += count; // Same style continuing (e.g. across a wrap)
+        else
+          styleRuns.push_back({ offset, count, currentStyle });
       };
 
-      auto renderEditorLine = [&](EditorLine& el, size_t currentPhysicalLine, size_t physicalLineOffset)
+      auto renderEditorLine = [&](EditorLine& el, size_t currentPhysicalLine, size_t physicalLineOffset, bool plain)
       {
         startpoint.y += data->m_characterHeightPixels;  // Do the carriage return here, reason: drawText works with
                                                   // the left-BOTTOM corner of a cell
@@ -231,15 +1981,17 @@ namespace varco {
           return;
 
         {
+          const size_t editorLineColumns = plain ? editorLineSize : getColumnCount(el.m_characters.data(), editorLineSize, data->m_tabWidth);
           std::unique_lock<std::mutex> lock(data->m_syncBarrier);
-          if (editorLineSize > data->m_maximumCharactersLine) // Check if this is the longest line found ever
-            data->m_maximumCharactersLine = (int)editorLineSize;
+          if (editorLineColumns > data->m_maximumCharactersLine) // Check if this is the longest line found ever
+            data->m_maximumCharactersLine = (int)editorLineColumns;
         }
 
         startpoint.x = BITMAP_OFFSET_X; // Reset the offset        
 
         size_t charsRendered = 0;
-        size_t absPosition = data->m_styleDb.m_absOffsetWhereLineBegins[currentPhysicalLine] + physicalLineOffset;
+        size_t rowColumns = 0; // Tab stops are counted from the beginning of the row
+        size_t absPosition = lookup(styleDb.m_absOffsetWhereLineBegins, currentPhysicalLine, 0) + physicalLineOffset;
 
         do {
 
@@ -255,14 +2007,14 @@ namespace varco {
                 currentStyleIt->start + currentStyleIt->count > physicalLineOffset + charsRendered) 
             {
               currentlyInSegment = true;
-              setColor(currentStyleIt->style);
+              setStyle(currentStyleIt->style);
             } else
               currentlyInSegment = false;
             // Is there a segment which starts exactly where we are or do we stick with the previous one already set?
             auto nextSegment = currentStyleIt + 1;
             while (nextSegment != styleEnd && nextSegment->absStartPos == absPosition) {
               currentStyleIt = nextSegment; // Set this as the active one
-              setColor(currentStyleIt->style);
+              setStyle(currentStyleIt->style);
               currentlyInSegment = true;
               ++nextSegment;
             }
@@ -296,7 +2048,7 @@ namespace varco {
                   // Segment starts right here, get it
                   currentlyInSegment = true;
                   currentStyleIt = seg;
-                  setColor(seg->style);
+                  setStyle(seg->style);
                   continue; // We will still have to find a valid goal position..
                 } else {
                   nextPosToReach = std::min(editorLineSize, seg->absStartPos - absPosition);
@@ -308,14 +2060,26 @@ namespace varco {
           //
           // Finally draw the text
           //
-          std::string ts(el.m_characters.data() + charsRendered, nextPosToReach - charsRendered);
-
-          //if (ts.find("breakpoint") != std::string::npos)
-          //  printf("breakpoint");
-
-          canvas.drawText(ts.data(), ts.size(), startpoint.x, startpoint.y - fontDescent, painter); // Notice the fontDescent!
-          charsRendered += ts.size();
-          startpoint.x += data->m_characterWidthPixels * ts.size();
+          // Drawn right out of the row's characters: no copy of the run
+          const char *runText = el.m_characters.data() + charsRendered;
+          const size_t runSize = nextPosToReach - charsRendered;
+
+          if (plain) {
+            canvas.drawText(runText, runSize, startpoint.x, startpoint.y - fontDescent, *painter); // Notice the fontDescent!
+            startpoint.x += data->m_characterWidthPixels * runSize;
+          } else { // Every character gets its own cells: glyph advances don't always match them
+            for (size_t offset = 0; offset < runSize;) {
+              int width;
+              size_t next = getNextCell(runText, runSize, offset, rowColumns, data->m_tabWidth, width);
+              if (runText[offset] != '\t') // Tabs are just blank cells
+                canvas.drawText(runText + offset, next - offset, startpoint.x, startpoint.y - fontDescent, *painter);
+              startpoint.x += data->m_characterWidthPixels * width;
+              rowColumns += width;
+              offset = next;
+            }
+          }
+          recordStyleRun(physicalLineOffset + charsRendered, runSize);
+          charsRendered += runSize;
 
           //
           // Update the state before continuing
@@ -323,93 +2087,133 @@ namespace varco {
           if (currentlyInSegment && nextPosToReach == currentStyleIt->start + currentStyleIt->count) {
             ++currentStyleIt; // Segment has been exhausted
             currentlyInSegment = false;
-            setColor(Normal);
+            setStyle(Normal);
           }
 
         } while (true);
       };
 
-      std::vector<PhysicalLine> phLineVec;
-      std::string line;
       for (size_t i = start; i < end; ++i) {
 
-        line = data->m_plainTextLines[i];
+        PhysicalLine& physicalLine = phLineVec[i - start];
+        const bool plainLine = data->m_buffer.isPlain(i);
+        styleRuns.clear();
 
-        std::string restOfLine;
-        std::vector<EditorLine> edLines;
-        edLines.reserve(MAX_WRAPS_PER_LINE); // Should be enough for every splitting
-
-                                             // Check if the monospace'd width isn't exceeding the viewport
-        if (line.size() * m_codeView.getCharacterWidthPixels() > m_wrapWidthPixels) {
-          // We have a wrap and the line is too big - WRAP IT
-
-          edLines.clear();
-          restOfLine = line;
-
-          // Start the wrap-splitting algorithm or resort to a brute-force character splitting one if
-          // no suitable spaces could be found to split the line
-          while (restOfLine.size() > maxChars) {
-
-            int bestSplittingPointFound = -1;
-            for (int i = 0; i < restOfLine.size(); ++i) {
-              if (i > maxChars)
-                break; // We couldn't find a suitable space split point for restOfLine
-              if (restOfLine[i] == ' ' && i != 0 /* Doesn't make sense to split at 0 pos */)
-                bestSplittingPointFound = i;
-            }
-
-            if (bestSplittingPointFound != -1) { // We found a suitable space point to split this line
-              edLines.push_back(restOfLine.substr(0, bestSplittingPointFound));
-              restOfLine = restOfLine.substr(bestSplittingPointFound);
-            }
-            else {
-              // No space found, brutally split characters (last resort)
-              edLines.push_back(restOfLine.substr(0, maxChars));
-              restOfLine = restOfLine.substr(maxChars);
-            }
-          }
-          edLines.push_back(restOfLine); // Insert the last part and proceed
+        size_t physicalLineOffset = 0;
+        for (auto& el : physicalLine.m_editorLines) {
+          renderEditorLine(el, i, physicalLineOffset, plainLine);
+          physicalLineOffset += el.m_characters.size();
+        }
+        physicalLine.m_styleRuns.assign(styleRuns.begin(), styleRuns.end());
+      }
 
-          // No need to do anything special for tabs - they're automatically converted into spaces
+      RenderedChunk chunk;
+      chunk.m_physicalLines = std::move(phLineVec);
+      chunk.m_width = bitmapEffectiveWidth;
+      chunk.m_height = bitmapEffectiveHeight;
+      if (data->m_renderMode == RenderMode::DisplayList)
+        chunk.m_picture = recorder.finishRecordingAsPicture();
+      else
+        chunk.m_bitmap = std::move(bitmap);
+      return chunk;
+  }
 
-          size_t physicalLineOffset = 0;
-          for (auto& el : edLines) {
-            renderEditorLine(el, i, physicalLineOffset);
-            physicalLineOffset += el.m_characters.size();
+  // A segment of a long line: wrapped in a single pass, its rows are left to be rendered as they come into
+  // view in groups of a strip each (see drawStrips())
+  RenderedChunk Document::wrapLongLine(std::shared_ptr<ThreadRequest> data, size_t line, size_t from, size_t to,
+                                       MonotonicArena& scratch) {
+    const std::string& text = data->m_buffer.getLine(line);
+    const bool plain = data->m_buffer.isPlain(line);
+    const int maxChars = getMaxColumns(*data);
+    std::vector<EditorLine> rows = wrapLine(text.data() + from, to - from, maxChars, plain, data->m_tabWidth, scratch);
+    std::vector<StyleRun> styleRuns = collectStyleRuns(*data->m_styleDb, line, from, to);
 
-            // Move the rendering cursor (carriage-return)
-            //startpoint.y += m_characterHeightPixels;
-            //bitmapEffectiveHeight += m_characterHeightPixels;
-          }
+    {
+      // Rows which were wrapped take (nearly) the whole width, no need to measure them
+      size_t columns = (rows.size() > 1) ? maxChars :
+        (plain ? to - from : getColumnCount(text.data() + from, to - from, data->m_tabWidth));
+      std::unique_lock<std::mutex> lock(data->m_syncBarrier);
+      data->m_maximumCharactersLine = std::max(data->m_maximumCharactersLine, static_cast<int>(columns));
+    }
 
-          phLineVec.emplace_back(std::move(edLines));
+    RenderedChunk chunk;
+    chunk.m_continuation = (from > 0);
+    chunk.m_width = data->m_wrapWidthPixels + BITMAP_OFFSET_X;
+    chunk.m_height = BITMAP_OFFSET_Y + rows.size() * data->m_characterHeightPixels;
+
+    auto settings = std::make_shared<ThreadRequest>();
+    copyRenderSettings(*data, *settings);
+    auto segment = std::make_shared<const std::string>(text, from, to - from);
+
+    // Raster mode composites everything into the document bitmap: all the rows are rendered right away
+    const bool raster = (data->m_renderMode == RenderMode::Raster);
+    const size_t rowsPerGroup = raster ? rows.size() :
+      std::max<size_t>(1, static_cast<size_t>(MAX_STRIP_HEIGHT / data->m_characterHeightPixels));
+    size_t offset = 0, firstRun = 0;
+    for (size_t first = 0; first < rows.size(); first += rowsPerGroup) {
+      auto group = std::make_shared<DeferredRows>();
+      group->m_settings = settings;
+      group->m_text = segment;
+      group->m_from = offset;
+      group->m_rows = std::min(rowsPerGroup, rows.size() - first);
+      for (size_t i = first; i < first + group->m_rows; ++i)
+        offset += rows[i].m_characters.size();
+      group->m_to = offset;
+      group->m_height = group->m_rows * data->m_characterHeightPixels;
+
+      // The runs of the line within the group's bytes, both sorted: a single pass over them for all the groups
+      const size_t begin = from + group->m_from, end = from + group->m_to;
+      while (firstRun < styleRuns.size() && styleRuns[firstRun].m_start + styleRuns[firstRun].m_count <= begin)
+        ++firstRun;
+      copyStyleRuns(styleRuns, begin, end, 0, group->m_styleRuns, firstRun);
+      chunk.m_deferredRows.push_back(std::move(group));
+    }
+    if (raster && !chunk.m_deferredRows.empty()) {
+      chunk.m_bitmap = renderDeferredRows(*chunk.m_deferredRows.front()).m_bitmap;
+      chunk.m_deferredRows.clear();
+    }
 
-        } else { // No wrap or the line fits perfectly within the wrap limits
+    PhysicalLine physicalLine(std::move(rows));
+    physicalLine.m_styleRuns = std::move(styleRuns);
+    chunk.m_physicalLines.push_back(std::move(physicalLine));
+    return chunk;
+  }
 
-          EditorLine el(line);
+  // The rows are wrapped again on their own: rows begin at the same characters whatever text follows them
+  RenderedChunk Document::renderDeferredRows(const DeferredRows& rows) {
+    auto request = std::make_shared<ThreadRequest>();
+    copyRenderSettings(*rows.m_settings, *request);
+    std::vector<std::string> lines(1, rows.m_text->substr(rows.m_from, rows.m_to - rows.m_from));
+    request->m_styleDb = makeStyleDatabase(lines, { rows.m_styleRuns });
+    request->m_buffer = TextBuffer(std::move(lines));
+    return renderLines(request, 0, 1);
+  }
 
-          renderEditorLine(el, i, 0);
 
-          phLineVec.emplace_back(std::move(el)); // Save it
-        }
+  std::shared_ptr<ThreadRequest> Document::makeRequest() {
+    auto request = std::make_shared<ThreadRequest>();
+    request->m_buffer = m_buffer;
+    request->m_revision = m_revision;
+    request->m_renderMode = m_renderMode;
+    request->m_styleDb = m_styleDb;
 
-        // Move the rendering cursor (carriage-return)
-        //startpoint.y += m_characterHeightPixels;
-        //bitmapEffectiveHeight += m_characterHeightPixels;
-      }
+    // Load parameters from codeview parent and this window
+    request->m_theme = m_codeView.m_theme; // Immutable: shared by all the threads without copies
+    request->m_characterWidthPixels = request->m_theme->getCharacterWidthPixels();
+    request->m_characterHeightPixels = request->m_theme->getCharacterHeightPixels();
+    request->m_wrapWidthPixels = this->m_wrapWidthPixels;
+    request->m_tabWidth = this->m_tabWidth;
+    request->m_maximumCharactersLine = 0;
 
-      // Time to fulfill the promise
-      {
-        std::unique_lock<std::mutex> lock(data->m_syncBarrier);
-        data->m_totalBitmapHeight += bitmapEffectiveHeight;
-        data->m_maxBitmapWidth = std::max(data->m_maxBitmapWidth, bitmapEffectiveWidth);
-        data->m_partials[threadIdx].set_value(
-          std::make_tuple<std::vector<PhysicalLine>, SkBitmap, SkScalar, SkScalar>(
-            std::move(phLineVec), std::move(bitmap), std::move(bitmapEffectiveWidth), std::move(bitmapEffectiveHeight))
-        );
-      }
+    // The rows of the lines as cached if the text is the file's and they're wrapped the same way
+    if (m_fileCache && m_revision == m_cacheRevision && m_fileCache->getTabWidth() == static_cast<uint32_t>(m_tabWidth) &&
+        m_fileCache->getWrapColumns() == static_cast<uint32_t>(getMaxColumns(*request)))
+      request->m_fileCache = m_fileCache;
+    return request;
   }
 
+#define MIN_CHUNK_BYTES (4 << 10) // Smaller documents are rendered by fewer threads
+#define CHUNKS_PER_THREAD 4 // Render chunks per thread of the pool: the threads finishing early take more
 
   void Document::scheduleRender() {
 
@@ -422,55 +2226,100 @@ namespace varco {
     m_firstDocumentRecalculate = false;
 
     // Generate a workload request for the threadpool
-    std::shared_ptr<ThreadRequest> request = std::make_shared<ThreadRequest>();
-
+    std::shared_ptr<ThreadRequest> request;
     {
       std::unique_lock<std::mutex> lock(m_documentMutex);
-      request->m_plainTextLines = m_plainTextLines;
-      request->m_physicalLines = m_physicalLines;
+      request = makeRequest(); // Only takes a snapshot of the text, cheap enough to do under the lock
     }
 
     if (m_needReLexing) {
-      std::string m_plainText;
-      for (auto& line : request->m_plainTextLines) { // Expensive, hopefully this doesn't happen too often - LEX DIRECTLY FROM VECTOR
-        m_plainText.append(line);
-        m_plainText += '\n';
+      // Lex the snapshot: edits can go on in the meantime, they will be lexed again at the next pause. The
+      // text of a file which wasn't edited since it was read might have been lexed already (see FileCache)
+      const int32_t lexerType = m_lexer ? static_cast<int32_t>(m_lexer->getLexerType()) : FileCache::NO_LEXER;
+      std::shared_ptr<const FileCache> cache;
+      {
+        std::unique_lock<std::mutex> lock(m_documentMutex);
+        if (m_fileCache && request->m_revision == m_cacheRevision && lexerType != FileCache::NO_LEXER &&
+            m_fileCache->getLexerType() == lexerType)
+          cache = m_fileCache;
+      }
+      std::shared_ptr<StyleDatabase> styleDb = cache ? cache->makeStyleDatabase() : nullptr;
+      if (!styleDb) {
+        styleDb = std::make_shared<StyleDatabase>();
+        if (m_lexer) {
+          m_lexer->reset();
+          m_lexer->lexInput(request->m_buffer.getText(), *styleDb); // Expensive, hopefully this doesn't happen too often
+        }
       }
-      m_lexer->lexInput(std::move(m_plainText), this->m_latestStyleDb);
       m_needReLexing = false;
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      m_styleDb = std::move(styleDb);
+      m_styleDbRevision = request->m_revision;
+      m_styleDbLexer = lexerType;
+      m_bracketLookup = BracketLookup();
+      if (m_revision == request->m_revision)
+        m_unlexedLines = UnlexedLines();
+      else {
+        m_needReLexing = true; // Edited since the snapshot: the edits aren't relative to this text
+        m_unlexedLines.m_replaced = true;
+      }
     }
-
-    // Load parameters from codeview parent and this window
-    request->m_characterWidthPixels = m_codeView.getCharacterWidthPixels();
-    request->m_characterHeightPixels = m_codeView.getCharacterHeightPixels();
-    request->m_wrapWidthPixels = this->m_wrapWidthPixels;
-    request->m_styleDb = this->m_latestStyleDb;
-
-    // Subdivide the document's lines into a suitable amount of workload per thread
-    size_t numThreads = m_codeView.m_threadPool.m_NThreads;
-    size_t minLinesPerThread = 20u;
-
-    while (true) {
-      request->m_linesPerThread = static_cast<size_t>(
-        std::ceil(m_plainTextLines.size() / static_cast<float>(numThreads))
-        );
-      if (request->m_linesPerThread < minLinesPerThread) {
-        numThreads /= 2;
-        if (numThreads < 1)
-          numThreads = 1;
-        else if (numThreads > 1)
-          continue;
+    request->m_styleDb = m_styleDb;
+
+    // Subdivide the document into chunks of about the same number of bytes (lines vary too much in length for
+    // a number of lines to be a measure of the work), a few per thread so that the threads finishing first
+    // take the rest. The byte offsets of the lines are prefix sums of the buffer (see TextBuffer)
+    const size_t poolThreads = m_codeView.m_threadPool.m_NThreads;
+    const TextBuffer& buffer = request->m_buffer;
+    const size_t lineCount = buffer.getLineCount();
+    const size_t chunkBytes = std::max<size_t>(MIN_CHUNK_BYTES, buffer.getByteCount() / (poolThreads * CHUNKS_PER_THREAD));
+
+    // Long lines are taken out of the chunks they fall in and cut into segments for all the threads of the pool
+    std::vector<size_t> longLines;
+    buffer.forEachLine(0, lineCount, [&longLines](size_t line, const std::string& text) {
+      if (text.size() > LONG_LINE_BYTES)
+        longLines.push_back(line);
+      return true;
+    });
+    auto longLine = longLines.begin();
+    auto& chunks = request->m_chunks;
+    chunks.clear();
+    for (size_t start = 0; start < lineCount;) {
+      if (longLine != longLines.end() && *longLine == start) {
+        const std::string& text = buffer.getLine(start);
+        const size_t segments = std::max<size_t>(1, std::min(poolThreads, text.size() / LONG_LINE_SEGMENT_BYTES));
+        size_t from = 0;
+        for (size_t i = 1; i <= segments; ++i) {
+          size_t to = (i == segments) ? text.size() : findCharacterStart(text, text.size() / segments * i, buffer.isPlain(start));
+          if (to > from)
+            chunks.push_back({ start, start + 1, from, to });
+          from = std::max(from, to);
+        }
+        ++longLine;
+        ++start;
+        continue;
       }
-      break;
+
+      // Up to the line holding the last byte of the chunk, but not as far as the next long line
+      const size_t startOffset = buffer.getLineStartOffset(start);
+      size_t end = std::min(lineCount, buffer.getLineAtOffset(startOffset + chunkBytes - 1) + 1);
+      if (longLine != longLines.end())
+        end = std::min(end, *longLine);
+      end = std::max(end, start + 1);
+      // A line going far past the end of the chunk would make it oversized: it starts the next one instead
+      if (end - start > 1 && buffer.getLineStartOffset(end) - startOffset > 2 * chunkBytes)
+        --end;
+      chunks.push_back({ start, end });
+      start = end;
     }
 
     // Set up threadpool for this document
-    request->m_numThreads = numThreads;
+    request->m_numThreads = std::max<size_t>(1, std::min(chunks.size(), poolThreads));
     request->m_partials.clear();
     request->m_futures.clear();
-    request->m_partials.resize(numThreads);
-    request->m_futures.reserve(numThreads);
-    for (size_t i = 0; i < numThreads; ++i)
+    request->m_partials.resize(chunks.size());
+    request->m_futures.reserve(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i)
       request->m_futures.emplace_back(request->m_partials[i].get_future());
 
     request->m_totalBitmapHeight = 0;
@@ -602,6 +2451,44 @@ namespace varco {
     //		//cout << "Done in " << sec << " seconds / " << msec << " milliseconds";
   }
 
+  // Writes what the first render of a large file found (its lines, rows and styles) to its cache entry on
+  // the WorkerPool. Only once per read and only if the text is still the file's and it was lexed as it is
+  // now (or not at all): later renders only differ by their wrap width. m_documentMutex must be held
+  void Document::storeFileCache(const ThreadRequest& request) {
+    if (m_cacheKey.m_path.empty() || m_cacheStored || request.m_revision != m_cacheRevision ||
+        m_styleDbRevision != m_cacheRevision || request.m_styleDb != m_styleDb)
+      return;
+    m_cacheStored = true;
+    const uint32_t columns = static_cast<uint32_t>(getMaxColumns(request));
+    if (m_fileCache && m_fileCache->getWrapColumns() == columns && m_fileCache->getTabWidth() == static_cast<uint32_t>(m_tabWidth) &&
+        m_fileCache->getLexerType() == m_styleDbLexer) {
+      m_cacheLineStarts = std::vector<uint64_t>();
+      return; // The entry has it all already
+    }
+
+    FileCache::Contents contents;
+    contents.m_lineStarts = std::move(m_cacheLineStarts);
+    contents.m_wrapColumns = columns;
+    contents.m_tabWidth = static_cast<uint32_t>(m_tabWidth);
+    contents.m_firstBreak.reserve(m_physicalLines.size() + 1);
+    for (const auto& line : m_physicalLines) {
+      contents.m_firstBreak.push_back(static_cast<uint32_t>(contents.m_breaks.size()));
+      uint32_t offset = 0;
+      for (size_t i = 0; i + 1 < line.m_editorLines.size(); ++i) {
+        offset += static_cast<uint32_t>(line.m_editorLines[i].m_characters.size());
+        contents.m_breaks.push_back(offset);
+      }
+    }
+    contents.m_firstBreak.push_back(static_cast<uint32_t>(contents.m_breaks.size()));
+    if (m_styleDbLexer != FileCache::NO_LEXER) {
+      contents.m_styleDb = m_styleDb;
+      contents.m_lexerType = m_styleDbLexer;
+    }
+    WorkerPool::get().post([key = m_cacheKey, contents = std::move(contents)]() {
+      FileCache::store(key, contents);
+    });
+  }
+
   void Document::collectResult(std::shared_ptr<ThreadRequest> request) {
 
     //std::mutex waitWorkMutex;
@@ -636,48 +2523,297 @@ namespace varco {
       this->m_characterHeightPixels = request->m_characterHeightPixels;
       this->m_maximumCharactersLine = request->m_maximumCharactersLine;
 
-      this->resize(bitmapRect);
+      if (!m_cacheKey.m_path.empty() && m_revision != m_cacheRevision)
+        releaseFileCache(); // The text was edited, it's not the file's anymore
 
-      SkCanvas canvas(this->m_bitmap);
+      if (request->m_renderMode != m_renderMode || request->m_tabWidth != m_tabWidth)
+        return; // Stale, the render mode (or tab width) changed in the meantime and another render is on its way
+      if (request->m_revision != m_revision)
+        return; // Stale, the document was edited in the meantime (the edits were patched in already)
 
-      m_physicalLines.clear();
+      this->resize(bitmapRect);
 
-      // Draw background for the entire document
-      {
+      const bool composite = (m_renderMode == RenderMode::Raster);
+      std::unique_ptr<SkCanvas> canvas;
+      if (composite) {
+        canvas = std::make_unique<SkCanvas>(this->m_bitmap);
+
+        // Draw background for the entire document
         SkPaint background;
-        background.setColor(SkColorSetARGB(255, 39, 40, 34));
-        canvas.drawRect(bitmapRect, background);
+        background.setColor(request->m_theme->getBackgroundColor());
+        canvas->drawRect(bitmapRect, background);
       }
 
+      m_physicalLines.clear();
+      m_pendingStrips.clear();
+      m_pendingPatches.clear(); // This render already contains every edit
 
       SkScalar yOffset = 0;
-      m_numberOfEditorLines = 0;
       for (auto& fut : request->m_futures) {
 
-        auto data = std::move(fut.get());
-        std::vector<PhysicalLine>& physLines = std::get<0>(data);
-        SkBitmap& partialBmp = std::get<1>(data);
-        SkScalar& partialBmpWidth = std::get<2>(data);
-        SkScalar& partialBmpHeight = std::get<3>(data);
+        RenderedChunk data = fut.get();
+        std::vector<PhysicalLine>& physLines = data.m_physicalLines;
+        SkScalar& partialBmpWidth = data.m_width;
+        SkScalar& partialBmpHeight = data.m_height;
 
-        SkBitmap partialBitmap = std::move(partialBmp);
+        if (data.m_continuation && !m_physicalLines.empty() && !physLines.empty()) { // Next segment of a long line
+          PhysicalLine& line = m_physicalLines.back();
+          moveAppendVector<EditorLine>(line.m_editorLines, physLines.front().m_editorLines);
+          moveAppendVector<StyleRun>(line.m_styleRuns, physLines.front().m_styleRuns);
+          physLines.erase(physLines.begin());
+        }
+        m_physicalLines.append(physLines);
+
+        if (composite) {
+          SkBitmap& partialBitmap = data.m_bitmap;
+          // Calculate source and destination rect
+          SkRect partialRect = SkRect::MakeLTRB(0, 0, partialBmpWidth, partialBmpHeight);
+          SkRect documentDestRect = SkRect::MakeLTRB(0, yOffset, partialBmpWidth, (yOffset + partialBmpHeight));
+
+          canvas->drawBitmapRect(partialBitmap, partialRect, documentDestRect, nullptr,
+            SkCanvas::SrcRectConstraint::kFast_SrcRectConstraint);
+        } else
+          appendStrips(m_pendingStrips, data, yOffset);
+        yOffset += partialBmpHeight;
+      }
+      m_pendingStripsReady = !composite;
+      m_layoutValid = true;
+      m_minimapTiles.invalidate(); // Styles might have changed (e.g. after lexing)
+
+      rebuildRowIndex();
+      storeFileCache(*request);
+      m_numberOfEditorLines = static_cast<int>(m_rowIndex.total());
+      m_numberOfVisibleRows = static_cast<int>(m_rowIndex.visibleTotal());
+    }
+  }
 
-        m_numberOfEditorLines += (int)physLines.size();
+  // Turns a rendered chunk into strips placed at 'top' in the document
+  void Document::appendStrips(std::vector<Strip>& strips, RenderedChunk& chunk, SkScalar top) {
+    if (!chunk.m_deferredRows.empty()) { // Rendered once they're in view
+      SkScalar stripTop = top + BITMAP_OFFSET_Y;
+      for (auto& rows : chunk.m_deferredRows) {
+        Strip strip;
+        strip.m_top = stripTop;
+        strip.m_width = chunk.m_width;
+        strip.m_height = rows->m_height;
+        strip.m_deferred = std::move(rows);
+        stripTop += strip.m_height;
+        strips.emplace_back(std::move(strip));
+      }
+      return;
+    }
 
-        moveAppendVector<PhysicalLine>(m_physicalLines, physLines);
+    if (chunk.m_picture) {
+      Strip strip;
+      strip.m_top = top;
+      strip.m_width = chunk.m_width;
+      strip.m_height = chunk.m_height;
+      strip.m_picture = std::move(chunk.m_picture);
+      strips.emplace_back(std::move(strip));
+      return;
+    }
 
-        // Calculate source and destination rect
-        SkRect partialRect = SkRect::MakeLTRB(0, 0, partialBmpWidth, partialBmpHeight);
-        SkRect documentDestRect = SkRect::MakeLTRB(0, yOffset, partialBmpWidth, (yOffset + partialBmpHeight));
+    // Slice the partial into strips. Subsets share the partial's pixels and, being immutable,
+    // the images don't copy them either: the raster memory goes away once all are uploaded
+    SkBitmap& partialBitmap = chunk.m_bitmap;
+    partialBitmap.setImmutable();
+    for (int stripTop = 0; stripTop < (int)chunk.m_height; stripTop += MAX_STRIP_HEIGHT) {
+      int stripBottom = std::min(stripTop + MAX_STRIP_HEIGHT, (int)chunk.m_height);
+      SkBitmap stripBitmap;
+      if (!partialBitmap.extractSubset(&stripBitmap, SkIRect::MakeLTRB(0, stripTop, (int)chunk.m_width, stripBottom)))
+        continue;
+      Strip strip;
+      strip.m_top = top + stripTop;
+      strip.m_width = chunk.m_width;
+      strip.m_height = (SkScalar)(stripBottom - stripTop);
+      strip.m_image = SkImage::MakeFromBitmap(stripBitmap);
+      strips.emplace_back(std::move(strip));
+    }
+  }
 
-        canvas.drawBitmapRect(partialBitmap, partialRect, documentDestRect, nullptr,
-          SkCanvas::SrcRectConstraint::kFast_SrcRectConstraint);
-        yOffset += partialBmpHeight;
+  // Strips overlapping the edited rows are cut into the parts above and below them (which keep sharing
+  // the same image or picture), the patch strips go in between and everything below is shifted
+  void Document::applyPatch(const StripPatch& patch) {
+    const SkScalar oldBottom = patch.m_top + patch.m_oldHeight;
+    const SkScalar delta = patch.m_newHeight - patch.m_oldHeight;
+
+    std::vector<Strip> strips;
+    strips.reserve(m_strips.size() + patch.m_strips.size() + 1);
+    bool patchInserted = false;
+    for (auto& strip : m_strips) {
+      SkScalar bottom = strip.m_top + strip.m_height;
+      if (bottom <= patch.m_top) {
+        strips.emplace_back(std::move(strip));
+        continue;
+      }
+      if (strip.m_top < patch.m_top) { // Part above the patch
+        Strip above = strip;
+        above.m_height = patch.m_top - strip.m_top;
+        strips.emplace_back(std::move(above));
+      }
+      if (!patchInserted) {
+        strips.insert(strips.end(), patch.m_strips.begin(), patch.m_strips.end());
+        patchInserted = true;
+      }
+      if (bottom > oldBottom) { // Part below the patch
+        SkScalar cut = std::max(0.f, oldBottom - strip.m_top);
+        Strip below = std::move(strip);
+        below.m_srcTop += cut;
+        below.m_top += cut + delta;
+        below.m_height -= cut;
+        strips.emplace_back(std::move(below));
+      }
+    }
+    if (!patchInserted) // Edit at the end of the document
+      strips.insert(strips.end(), patch.m_strips.begin(), patch.m_strips.end());
+    m_strips = std::move(strips);
+  }
+
+  void Document::resize(SkRect rect) {
+    if (m_renderMode == RenderMode::Raster) {
+      UIElement::resize(rect);
+      return;
+    }
+    // Strips are the only storage for the rendered document, no document-sized bitmap is needed
+    if (m_rect != rect && rect.fTop < rect.fBottom && rect.fLeft < rect.fRight) {
+      m_rect = rect;
+      m_bitmap.reset();
+      m_dirty = true;
+    }
+  }
+
+#define DEFERRED_MARGIN_STRIPS 2 // Rows of long lines are rendered (and kept) this far beyond the view
+
+  // Called by the rendering thread with the window canvas. Texture strips are uploaded only the first time
+  // they come into view, afterwards they stay on the GPU until the document is rendered again. Display lists
+  // are replayed at every draw but only the operations intersecting the clip are executed
+  void Document::drawStrips(SkCanvas& canvas, const SkRect& documentRect, const SkRect& destRect, SkScalar scale) {
+    {
+      std::unique_lock<std::mutex> lock(m_documentMutex);
+      if (m_pendingStripsReady) { // Textures of the previous render are released here, on the GL thread
+        m_strips = std::move(m_pendingStrips);
+        m_pendingStrips.clear();
+        m_pendingStripsReady = false;
       }
+      for (auto& patch : m_pendingPatches)
+        applyPatch(patch);
+      m_pendingPatches.clear();
     }
+
+    canvas.save();
+    canvas.clipRect(destRect);
+    // From now on draw in document coordinates
+    canvas.translate(destRect.fLeft, destRect.fTop);
+    canvas.scale(scale, scale);
+    canvas.translate(-documentRect.fLeft, -documentRect.fTop);
+
+    SkPaint imagePaint;
+    imagePaint.setFilterQuality(kLow_SkFilterQuality); // Only matters when scaled
+    GrContext *context = canvas.getGrContext(); // Null for raster canvases: strips are drawn from memory
+    // Rows of long lines are rendered for the view and a margin around it, farther ones are released: all the
+    // strips are looked at, not just the visible ones
+    SkRect keepRect = documentRect;
+    keepRect.outset(0, static_cast<SkScalar>(MAX_STRIP_HEIGHT * DEFERRED_MARGIN_STRIPS));
+    for (auto& strip : m_strips) {
+      SkRect stripRect = SkRect::MakeXYWH(0, strip.m_top, strip.m_width, strip.m_height);
+      if (strip.m_deferred) {
+        if (!SkRect::Intersects(stripRect, keepRect)) {
+          releaseDeferredRows(strip);
+          continue;
+        }
+        if (!requestDeferredRows(strip))
+          continue; // Being rendered, the background shows meanwhile
+      }
+      if (!SkRect::Intersects(stripRect, documentRect))
+        continue;
+
+      if (strip.m_picture) {
+        canvas.save();
+        canvas.clipRect(stripRect); // The recording bounds are larger than the effective content
+        canvas.translate(0, strip.m_top - strip.m_srcTop);
+        canvas.drawPicture(strip.m_picture);
+        canvas.restore();
+        continue;
+      }
+
+      if (!strip.m_uploaded && context != nullptr) {
+        auto texture = strip.m_image->makeTextureImage(context);
+        if (texture) // Keep the raster image if the upload failed, it will be drawn anyway
+          strip.m_image = std::move(texture);
+        strip.m_uploaded = true; // Don't try again at every frame
+        if (strip.m_deferred) { // The texture replaces the raster image for the other parts of the rows too
+          std::unique_lock<std::mutex> lock(strip.m_deferred->m_mutex);
+          strip.m_deferred->m_image = strip.m_image;
+        }
+      }
+
+      canvas.drawImageRect(strip.m_image, SkRect::MakeXYWH(0, strip.m_srcTop, strip.m_width, strip.m_height), stripRect,
+                           scale != 1.f ? &imagePaint : nullptr, SkCanvas::kFast_SrcRectConstraint);
+    }
+    canvas.restore();
+  }
+
+  // Strips of deferred rows share their image (or picture) once a job rendered it
+  bool Document::requestDeferredRows(Strip& strip) {
+    if (strip.m_image || strip.m_picture)
+      return true;
+    std::shared_ptr<DeferredRows> rows = strip.m_deferred;
+    {
+      std::unique_lock<std::mutex> lock(rows->m_mutex);
+      if (rows->m_image || rows->m_picture) {
+        strip.m_image = rows->m_image;
+        strip.m_picture = rows->m_picture;
+        strip.m_uploaded = false;
+        return true;
+      }
+      if (rows->m_pending)
+        return false;
+      rows->m_pending = true;
+    }
+
+    auto jobs = m_deferredJobs;
+    {
+      std::unique_lock<std::mutex> lock(jobs->m_mutex);
+      ++jobs->m_count;
+    }
+    WorkerPool::get().post([jobs, rows]() {
+      RenderedChunk chunk = renderDeferredRows(*rows);
+      sk_sp<SkImage> image;
+      if (!chunk.m_picture) {
+        SkBitmap bitmap;
+        chunk.m_bitmap.setImmutable();
+        if (chunk.m_bitmap.extractSubset(&bitmap, SkIRect::MakeWH((int)chunk.m_width, (int)chunk.m_height)))
+          image = SkImage::MakeFromBitmap(bitmap);
+      }
+      {
+        std::unique_lock<std::mutex> lock(rows->m_mutex);
+        rows->m_pending = false;
+        rows->m_image = std::move(image);
+        rows->m_picture = std::move(chunk.m_picture);
+      }
+      std::unique_lock<std::mutex> lock(jobs->m_mutex);
+      if (jobs->m_onReady)
+        jobs->m_onReady();
+      if (--jobs->m_count == 0)
+        jobs->m_idle.notify_all();
+    });
+    return false;
+  }
+
+  void Document::releaseDeferredRows(Strip& strip) {
+    if (!strip.m_image && !strip.m_picture)
+      return;
+    strip.m_image.reset();
+    strip.m_picture.reset();
+    strip.m_uploaded = false;
+    std::unique_lock<std::mutex> lock(strip.m_deferred->m_mutex);
+    strip.m_deferred->m_image.reset();
+    strip.m_deferred->m_picture.reset();
   }
 
   void Document::paint() {
+    if (m_relexRequested.exchange(false))
+      relexEditedLines();
     if (!m_dirty)
       return;
 
@@ -3,58 +3,337 @@
 
 #include <UI/UIElement.hpp>
 #include <Lexers/Lexer.hpp>
+#include <Document/TextBuffer.hpp>
+#include <Document/UndoHistory.hpp>
+#include <Document/DocumentSearch.hpp>
+#include <Document/MinimapTiles.hpp>
+#include <Document/StreamingFile.hpp>
+#include <Document/FileSaver.hpp>
+#include <Document/FileCache.hpp>
 #include <Utils/Concurrent.hpp>
+#include <Utils/Arena.hpp>
+#include <Utils/FoldTree.hpp>
+#include <Utils/BlockVector.hpp>
+#include <Utils/Encoding.hpp>
+#include <Utils/AnimationScheduler.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <vector>
 #include <string>
 #include <future>
+#include <map>
+#include <SkImage.h>
+#include <SkPicture.h>
+
+class SkCanvas;
 
 namespace varco {
 
   class CodeView;
+  class MappedFile;
+
+  struct Selection { // A caret and where its selection begins (the same position if nothing is selected)
+    DocumentPosition m_anchor;
+    DocumentPosition m_caret;
+  };
 
   class Document : public UIElement<ui_control_tag> {
   public:
     Document(CodeView& codeView);    
+    ~Document(); // Waits for the rows of long lines being rendered
 
+    // Files larger than STREAMING_THRESHOLD are opened in streaming mode: they're never loaded, the text only
+    // holds a window of their lines around the view (see StreamingFile). Streamed documents are read-only
     bool loadFromFile(std::string file);
+    bool isStreaming() const;
+    size_t getStreamLineCount(); // Lines of the streamed file (estimated until it's indexed)
+    size_t getStreamLine(size_t windowLine); // Line of the file at a line of the window (estimated until indexed)
+    // Moves the window (if the line isn't in it, or too close to its edges) so that it contains a line of the
+    // file and returns where the line is in the window. Carets keep their place in the file if the windows
+    // overlap. Lines beyond the indexed part of the file are found by their estimated position
+    size_t moveStreamWindow(size_t line, bool& moved);
+    const std::string& getFilePath() const; // Empty if the document wasn't loaded from a file
+    TextBuffer getSnapshot(); // A copy of the text which shares the lines with the document (cheap)
+    std::string getWordAt(DocumentPosition position); // Identifier under (or right before) a position
     void applySyntaxHighlight(SyntaxHighlight s);
 
+    // Editing at the carets (selections are replaced). Only the edited physical lines are wrapped and rendered
+    // again (the rest of the rendered document is shifted), the document is lexed again once typing pauses
+    void insertText(const std::string& text);
+    void deleteBackward();
+    void deleteForward();
+    // Replaces the text between two positions, returns the position right after the new text
+    DocumentPosition replaceText(DocumentPosition from, DocumentPosition to, const std::string& text);
+    bool undo(size_t steps = 1);
+    bool redo();
+    void setUndoMemoryBudget(size_t bytes);
+    void setCursorPosition(DocumentPosition position); // Clamped to the document, other carets are removed
+    DocumentPosition getCursorPosition(); // The primary caret
+
+    // Multiple carets, each one with its own selection. An edit at the carets is applied to all of them in a
+    // single pass over the text: one undo step, one render of the edited lines and one lexing, whatever the
+    // number of carets
+    std::vector<Selection> getSelections(); // Sorted
+    size_t getPrimarySelection(); // Index of the selection the view follows
+    // Clamped, sorted and merged where they overlap. 'primary' indexes 'selections'
+    void setSelections(std::vector<Selection> selections, size_t primary);
+    bool addCaretOnAdjacentLine(bool below); // Below the last caret (or above the first one)
+    size_t selectAllMatches(); // A selection on every search match found so far, returns how many
+    void clearSecondaryCarets();
+    int getLineCount();
+    int getLineLength(int line); // In bytes
+
+    // Positions are in bytes of UTF-8 text while the text is shown in columns of characters (grapheme
+    // clusters), which can take more than a byte and more than a column, and tabs, which take the columns up
+    // to the next tab stop. These convert between the two
+    int getColumn(DocumentPosition position); // Columns before a position on its line
+    int getPositionAtColumn(int line, int column); // Where the character shown at a column of a line begins
+    int getAdjacentCharacter(DocumentPosition position, bool forward); // The x of the next (or previous) character
+
+    // Highlights all the occurrences of a literal needle or of a regular expression (an empty one clears the
+    // search). Matches are found in the background starting from the caret line and show up as they're
+    // found. Returns false if the regular expression isn't valid
+    bool setSearchQuery(const std::string& needle, bool regex = false);
+    // Moves the caret to the next (or previous) match, wrapping around. Streamed files: the window is moved if the
+    // match isn't in it
+    bool findNext(bool forward, bool& windowMoved);
+
+    // The bracket right after (or else right before) a position and its matching one, as found by the lexer.
+    // Until edits are lexed the brackets on the lines they didn't touch are still found
+    bool findMatchingBracket(DocumentPosition position, DocumentPosition& bracket, DocumentPosition& match);
+    bool jumpToMatchingBracket(); // Moves the caret to the other side of the bracket pair it's next to
+
+    // Code folding: the lines of a region (a scope, a #if block or a comment found by the lexer) but the first
+    // one are hidden. Folding only updates the row index of the view, the document is not rendered again
+    bool toggleFold(int line); // Unfolds the region folded at 'line' or folds the innermost one around it
+    void unfoldAll();
+    int skipFoldedLines(int line, bool forward); // The closest visible line in a direction
+
+    // Brings the text up to date with its file after the file changed on disk (called by the file watcher).
+    // Data appended to the file is read alone and appended to the text; any other change is found with a
+    // line diff and only the changed lines are edited, wrapped, rendered and lexed again. Documents with
+    // changes which weren't saved are left alone. Carets keep their place in the text around them. The undo
+    // history is dropped. Returns false if the text didn't change
+    bool reloadFromDisk();
+    // Tail mode: the caret jumps (and the view scrolls) to the end of the document whenever data is appended
+    // to the file
+    void setFollowTail(bool follow);
+    bool isFollowingTail() const;
+
+    // Writes a snapshot of the text to its file on a background thread (see FileSaver): editing can go on
+    // meanwhile. Lines end as they did in the file when it was read. Returns false if there's no file to save
+    // to (or it's streamed)
+    bool save(FsyncPolicy policy = FsyncPolicy::Data);
+    bool isSaving();
+    float getSaveProgress() const;
+    std::string getSaveError(); // Why the last save failed, empty if it didn't
+
   private:
     friend class CodeView;
+    friend class Minimap;
 
     void setWrapWidthInPixels(int width);    
+    void setTabWidth(int width); // Wraps and renders the document again if it changes
     void scheduleRender();
     void collectResult(std::shared_ptr<ThreadRequest> request);
+    std::shared_ptr<ThreadRequest> makeRequest(); // m_documentMutex must be held
+    // Lines are wrapped before the bitmap (or the picture) is sized for their rows. Scratch data is taken from
+    // 'scratch' (the thread's arena when rendering in the pool) or from an arena of its own
+    static RenderedChunk renderLines(std::shared_ptr<ThreadRequest> data, size_t start, size_t end,
+                                     MonotonicArena *scratch = nullptr);
+
+    // Long-line mode: lines longer than LONG_LINE_BYTES (minified files) are cut in segments which are wrapped
+    // by different threads in a single pass, each segment begins a new row. Their rows are only rendered when
+    // they come into view (Raster mode renders them right away into the document bitmap)
+    static RenderedChunk wrapLongLine(std::shared_ptr<ThreadRequest> data, size_t line, size_t from, size_t to,
+                                      MonotonicArena& scratch);
+    static RenderedChunk renderDeferredRows(const DeferredRows& rows);
+    struct DeferredJobs { // Shared with the WorkerPool jobs rendering deferred rows
+      std::mutex m_mutex;
+      std::condition_variable m_idle;
+      size_t m_count = 0;
+      std::function<void()> m_onReady; // Reset when the document is destroyed
+    };
+    std::shared_ptr<DeferredJobs> m_deferredJobs;
 
     void paint() override; // Renders the entire document on its bitmap
+    void resize(SkRect rect) override;
+    // Draws the strips of the document region 'documentRect' into 'destRect' magnified by 'scale'
+    // (GpuTextures and DisplayList modes)
+    void drawStrips(SkCanvas& canvas, const SkRect& documentRect, const SkRect& destRect, SkScalar scale = 1.f);
 
     // The document is offset by these amounts when rendered to avoid
     // having it too attached to the borders
     static constexpr const float BITMAP_OFFSET_X = 5.f;
     static constexpr const float BITMAP_OFFSET_Y = 0.f;
+    // Strips never exceed this height: well below GL_MAX_TEXTURE_SIZE also on software implementations
+    static constexpr const int MAX_STRIP_HEIGHT = 2048;
+    static constexpr const int DEFAULT_TAB_WIDTH = 4;
 
     CodeView& m_codeView;
+    std::string m_filePath;
     int m_wrapWidthPixels = -1;
-    int m_numberOfEditorLines;
-    int m_maximumCharactersLine; // According to wrapWidth
+    int m_tabWidth = DEFAULT_TAB_WIDTH; // Columns between tab stops. Protected by m_documentMutex
+    int m_numberOfEditorLines = 0;
+    int m_maximumCharactersLine = 0; // According to wrapWidth
     SkScalar m_characterWidthPixels;
     SkScalar m_characterHeightPixels;
 
     std::mutex m_documentMutex;
-    StyleDatabase m_latestStyleDb;
-    std::vector<std::string> m_plainTextLines;
-    std::vector<PhysicalLine> m_physicalLines;
+    std::shared_ptr<const StyleDatabase> m_styleDb; // Latest lexing result, shared with the render requests
+    unsigned int m_styleDbRevision = 0; // Revision of the text m_styleDb was lexed from
+    int32_t m_styleDbLexer = FileCache::NO_LEXER; // LexerType it was lexed with
+    TextBuffer m_buffer;
+    unsigned int m_revision = 0; // Incremented at every edit, renders of older revisions are dropped
+    UndoHistory m_undoHistory;
+    BlockVector<PhysicalLine> m_physicalLines; // In blocks: edits which add or remove lines move a single block
+    bool m_layoutValid = false; // m_physicalLines describe m_buffer (false until a full render after the text is replaced)
+    // Editor lines per physical line, the folded ones hidden: maps physical lines to document rows (prefixSum) and
+    // to view rows (visiblePrefixSum). Edited lines are inserted and erased in place, the folds after them move along
+    FoldTree m_rowIndex;
+    std::map<size_t, size_t> m_folds; // Folded regions: first line (still visible) -> last line
+    int m_numberOfVisibleRows = 0;
+    bool hasLayout() const; // m_physicalLines and the row indices describe m_buffer. m_documentMutex must be held
+
+    struct RowSegment { // Rows shown contiguously in the view and where they are in the rendered document
+      size_t m_viewRow;
+      size_t m_documentRow;
+      size_t m_count;
+    };
+    std::vector<RowSegment> getVisibleSegments(size_t firstViewRow, size_t rowCount); // m_documentMutex must be held
+
+    RenderMode m_renderMode = RenderMode::GpuTextures;
+    struct Strip { // A horizontal slice of the rendered document
+      SkScalar m_top; // Document-relative
+      SkScalar m_width;
+      SkScalar m_height;
+      sk_sp<SkImage> m_image; // Raster-backed until uploaded, texture-backed afterwards
+      bool m_uploaded = false;
+      sk_sp<SkPicture> m_picture; // DisplayList mode only (m_image is null)
+      SkScalar m_srcTop = 0; // Strips split by an edit show only a part of their image or picture
+      std::shared_ptr<DeferredRows> m_deferred; // Rows of a long line: no image nor picture until they're in view
+    };
+    // Gives a strip of deferred rows their image (or picture), rendering them on the WorkerPool the first time.
+    // False until they're ready. Rendering thread only
+    bool requestDeferredRows(Strip& strip);
+    void releaseDeferredRows(Strip& strip);
+    struct StripPatch { // Replaces the rows of some edited lines, the strips below are shifted
+      SkScalar m_top;
+      SkScalar m_oldHeight;
+      SkScalar m_newHeight;
+      std::vector<Strip> m_strips;
+    };
+    std::vector<Strip> m_strips; // Only touched by the rendering thread (which owns the GL context)
+    std::vector<Strip> m_pendingStrips; // Latest render, swapped in at the next draw. Protected by m_documentMutex
+    bool m_pendingStripsReady = false;
+    std::vector<StripPatch> m_pendingPatches; // Applied in order after the pending strips. Protected by m_documentMutex
+    void appendStrips(std::vector<Strip>& strips, RenderedChunk& chunk, SkScalar top);
+    void applyPatch(const StripPatch& patch); // Rendering thread only
+
+    struct TextEdit { // Replaces the text between two positions
+      DocumentPosition m_from;
+      DocumentPosition m_to;
+      std::string m_text;
+    };
+    DocumentPosition editText(DocumentPosition from, DocumentPosition to, const std::string& text, bool record);
+    // Positions refer to the text before all the edits. Returns where the new text of every edit ends
+    std::vector<DocumentPosition> applyEdits(std::vector<TextEdit> edits, bool record);
+    // Same as applyEdits() without lexing and searching again (left to the caller, if it returns true: nothing
+    // changed otherwise). m_documentMutex must be held. Carets are moved after the new text of every edit
+    // or, with 'keepCarets', along with the text around them
+    bool applyEditsLocked(std::vector<TextEdit> edits, bool record, bool keepCarets, std::vector<DocumentPosition>& ends);
+
+    // Editing helpers, m_documentMutex must be held
+    DocumentPosition clampPosition(DocumentPosition position);
+    void normalizeSelections(); // Sorts and merges m_selections, keeps track of the primary one
+    void renderEditedLines(size_t line, size_t oldCount, std::vector<std::vector<StyleRun>> styleRuns);
+    void rebuildRowIndex(); // Also applies the folds again
+    void updateFoldsForEdit(size_t line, size_t oldCount, size_t newCount);
+    void revealLine(size_t line); // Unfolds the regions hiding a line
+    void scheduleRelex(); // Lexes the edited lines again once the edits pause
+    struct UnlexedLines { // Lines edited since m_styleDb was lexed: its lines [m_first, m_end) are now m_shift more
+      bool m_edited = false;
+      size_t m_first = 0;
+      size_t m_end = 0;
+      long long m_shift = 0;
+      bool m_replaced = false; // The text was replaced since (or lexed from an older one): no line maps to m_styleDb
+    };
+    UnlexedLines m_unlexedLines; // Protected by m_documentMutex
+    void addUnlexedLines(size_t line, size_t oldCount, size_t newCount); // m_documentMutex must be held
+    // A line of the text in m_styleDb and back: false for the lines edited since it was lexed. m_documentMutex must be held
+    bool toLexedLine(size_t line, size_t& lexedLine) const;
+    bool fromLexedLine(size_t lexedLine, size_t& line) const;
+    // The bracket found last at a caret position of m_styleDb: the caret is looked up again at every paint
+    struct BracketLookup {
+      const StyleDatabase *m_styleDb = nullptr; // Reset whenever m_styleDb is replaced
+      size_t m_line = 0;
+      size_t m_column = 0;
+      uint32_t m_found = BracketIndex::NO_MATCH;
+    };
+    BracketLookup m_bracketLookup; // Protected by m_documentMutex
+    void relexEditedLines(); // And renders again the lines whose styles changed
+    void restartSearch(); // Searches the current text again (if there's a query)
+    // Matches on lines [firstLine, lastLine) of the text (the window of a streamed file). m_documentMutex must be held
+    std::vector<SearchMatch> getSearchMatches(size_t firstLine, size_t lastLine);
 
     std::unique_ptr<LexerBase> m_lexer;
     bool m_needReLexing = false;
     bool m_firstDocumentRecalculate = true;
+    std::atomic<AnimationScheduler::Clock::rep> m_relexDeadline{ 0 }; // Lexing waits for the typing to pause
+    std::atomic<bool> m_relexPending{ false };
+    std::atomic<bool> m_relexRequested{ false }; // The typing paused: relexEditedLines() at the next paint
 
-    struct {
-      int x = 0;
-      int y = 0;
-    } m_cursorPos; // Latest known cursor position
+    std::vector<Selection> m_selections{ 1 }; // Sorted and disjoint, never empty. Protected by m_documentMutex
+    size_t m_primarySelection = 0;
+
+    struct DiskState { // The file as the text was last read from it. Protected by m_documentMutex
+      size_t m_size = 0;
+      long long m_modifiedTime = 0;
+      std::string m_tail; // Its last bytes: if they're still there, data was only appended to the file
+      FileEncoding m_encoding; // The text is converted from it when read and back to it when saved
+      std::string m_newline = "\n"; // Its first line ending, the text is saved with it
+      bool m_finalNewline = false; // It ends with a line ending
+      unsigned int m_revision = 0; // m_revision when the text matched the file
+    };
+    static DiskState readDiskState(const std::string& path, const MappedFile& file); // Size, time and tail
+    // The lines of a file converted to UTF-8, its encoding and line endings are recorded in 'state'. Lines
+    // begin where 'cache' says they do if it's given, 'lineStarts' gets where they begin (see FileCache)
+    static std::vector<std::string> readLines(const MappedFile& file, DiskState& state, const FileCache *cache = nullptr,
+                                              std::vector<uint64_t> *lineStarts = nullptr);
+    DiskState m_disk;
+    void onSaved(const FileSaver::Request& request, const FileSaver::Result& result); // Saving thread
+
+    // The cache entry of a large file (see FileCache) applies to the text as it was read, m_cacheRevision.
+    // Protected by m_documentMutex
+    FileCache::Key m_cacheKey; // Empty path if the file isn't cached
+    std::shared_ptr<const FileCache> m_fileCache; // Null if there was no entry for the file as it is
+    std::vector<uint64_t> m_cacheLineStarts; // Until the entry is written
+    unsigned int m_cacheRevision = 0;
+    bool m_cacheStored = false; // The entry was written (or was up to date) after the first render
+    void storeFileCache(const ThreadRequest& request);
+    void releaseFileCache();
+    std::string m_saveError; // Protected by m_documentMutex
+
+    std::unique_ptr<StreamingFile> m_stream; // Streaming mode only
+    std::vector<size_t> m_windowOffsets; // Where every line of the window begins in the file and where it ends
+    size_t m_windowFirstLine = 0; // Line of the file at the top of the window
+    bool m_windowFirstLineExact = false; // Otherwise estimated: the index didn't get there yet
+    bool openStreaming(const std::string& file);
+    void loadStreamWindow(size_t offset); // Replaces the text with the lines from 'offset' on. m_documentMutex must be held
+    void updateWindowFirstLine(); // m_documentMutex must be held
+    // Loads a window around the line of the file beginning at 'offset' and returns where it is in the window.
+    // m_documentMutex must be held
+    size_t moveStreamWindowTo(size_t offset, size_t line);
+    std::atomic<bool> m_followTail{ false };
+    std::atomic<bool> m_revealCaret{ false }; // The caret moved on another thread, the view scrolls to it when painted
     
     void threadProcessChunk(size_t threadIdx, std::shared_ptr<ThreadRequest> data);
+
+    MinimapTiles m_minimapTiles; // Downsampled image of the document, built on demand
+
+    FileSaver m_saver; // Destroyed right after the search: pending saves are written before anything else goes
+    DocumentSearch m_search; // Last: its thread must be stopped before anything else is destroyed
   };
 
 }
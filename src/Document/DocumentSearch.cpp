@@ -0,0 +1,371 @@
+#include <Document/DocumentSearch.hpp>
+#include <Document/RegexSearch.hpp>
+#include <Utils/SubstringSearch.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace varco {
+
+#define PUBLISH_INTERVAL_LINES 16384 // Lines scanned between two batches of published matches (checked per block)
+#define PUBLISH_INTERVAL_MS 50 // Regular expressions: time between two batches of published matches
+#define SCAN_CHUNK_BYTES (8 << 20) // Streamed files: bytes scanned between two cancellation checks (and batches)
+
+  DocumentSearch::DocumentSearch(std::function<void()> onProgress) :
+    m_onProgress(std::move(onProgress))
+  {}
+
+  DocumentSearch::~DocumentSearch() {
+    cancel();
+  }
+
+  void DocumentSearch::cancel() {
+    m_cancel = true;
+    if (m_thread.joinable())
+      m_thread.join();
+    m_cancel = false;
+  }
+
+  bool DocumentSearch::start(TextBuffer snapshot, std::string needle, size_t startLine, bool regex) {
+    if (!prepare(std::move(needle), regex, false))
+      return m_error.empty();
+    if (m_regex)
+      m_thread = std::thread(&DocumentSearch::runRegex, this, std::move(snapshot), startLine);
+    else
+      m_thread = std::thread(&DocumentSearch::run, this, std::move(snapshot), startLine);
+    return true;
+  }
+
+  bool DocumentSearch::start(const char *data, size_t size, std::string needle, size_t startOffset, size_t startLine,
+                             bool regex) {
+    if (!prepare(std::move(needle), regex, true))
+      return m_error.empty();
+    m_thread = std::thread(&DocumentSearch::runMapped, this, data, size, startOffset, startLine);
+    return true;
+  }
+
+  bool DocumentSearch::prepare(std::string needle, bool regex, bool streamed) {
+    cancel();
+    m_regex.reset();
+    m_error.clear();
+    if (regex && !needle.empty()) {
+      m_regex = Regex::compile(needle, true, &m_error);
+      if (!m_regex)
+        needle.clear(); // Nothing to highlight
+    }
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_needle = std::move(needle);
+      m_isRegex = regex;
+      m_streamed = streamed;
+      m_matchesAfterStart.clear();
+      m_matchesBeforeStart.clear();
+      m_finished = m_needle.empty();
+    }
+    return !m_needle.empty();
+  }
+
+  bool DocumentSearch::isRegex() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_isRegex;
+  }
+
+  const std::string& DocumentSearch::getError() const {
+    return m_error;
+  }
+
+  std::string DocumentSearch::getNeedle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_needle;
+  }
+
+  void DocumentSearch::run(TextBuffer snapshot, size_t startLine) {
+    const size_t lineCount = snapshot.getLineCount();
+    startLine = std::min(startLine, lineCount);
+
+    std::vector<SearchMatch> batch;
+    bool published = false; // The first match is published as soon as it's found
+    size_t linesSinceLastPublish = 0;
+    std::string scratch; // The lines of a block joined by '\n'
+    std::vector<size_t> lineStarts; // Where each of them begins in scratch, and where the last one ends
+
+    auto publish = [&](std::vector<SearchMatch>& destination) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        destination.insert(destination.end(), batch.begin(), batch.end());
+      }
+      batch.clear();
+      linesSinceLastPublish = 0;
+      published = true;
+      m_onProgress();
+    };
+
+    // A block's lines are stored apart: they are joined in a scratch buffer and scanned at once, like a file by
+    // FindInFiles, the offsets of the matches are then mapped to the lines (walked forward, matches are sorted)
+    auto scan = [&](size_t first, size_t last, std::vector<SearchMatch>& destination) {
+      using LineIterator = std::vector<std::string>::const_iterator;
+      snapshot.forEachBlock(first, last, [&](size_t firstLine, LineIterator begin, LineIterator end) {
+        scratch.clear();
+        lineStarts.clear();
+        for (auto it = begin; it != end; ++it) {
+          lineStarts.push_back(scratch.size());
+          scratch += *it;
+          scratch += '\n';
+        }
+        lineStarts.push_back(scratch.size());
+
+        const char *data = scratch.data();
+        const char *dataEnd = data + scratch.size();
+        const char *position = data;
+        size_t index = 0;
+        while ((position = findSubstring(position, dataEnd - position, m_needle.data(), m_needle.size())) != nullptr) {
+          const size_t offset = static_cast<size_t>(position - data);
+          while (lineStarts[index + 1] <= offset)
+            ++index;
+          if (offset + m_needle.size() < lineStarts[index + 1]) { // Not across a line end
+            batch.push_back({ firstLine + index, offset - lineStarts[index], m_needle.size() });
+            position += m_needle.size(); // Matches don't overlap
+          } else
+            ++position;
+        }
+        linesSinceLastPublish += static_cast<size_t>(end - begin);
+        if ((!batch.empty() && !published) || linesSinceLastPublish >= PUBLISH_INTERVAL_LINES) {
+          if (m_cancel)
+            return false;
+          if (!batch.empty())
+            publish(destination);
+          linesSinceLastPublish = 0;
+        }
+        return true;
+      });
+      if (!batch.empty() && !m_cancel)
+        publish(destination);
+    };
+
+    scan(startLine, lineCount, m_matchesAfterStart);
+    scan(0, startLine, m_matchesBeforeStart);
+    if (m_cancel)
+      return;
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_finished = true;
+    }
+    m_onProgress();
+  }
+
+  // Same as run() but the matching is done by the workers, this thread just publishes what they find
+  void DocumentSearch::runRegex(TextBuffer snapshot, size_t startLine) {
+    startLine = std::min(startLine, snapshot.getLineCount());
+    RegexSearch search(m_regex, std::move(snapshot), startLine);
+
+    std::vector<SearchMatch> batch;
+    bool batchWrapped = false; // Matches found after wrapping around go in m_matchesBeforeStart
+    bool published = false;
+    auto lastPublish = std::chrono::steady_clock::now();
+    auto publish = [&]() {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto& destination = batchWrapped ? m_matchesBeforeStart : m_matchesAfterStart;
+        destination.insert(destination.end(), batch.begin(), batch.end());
+      }
+      batch.clear();
+      published = true;
+      lastPublish = std::chrono::steady_clock::now();
+      m_onProgress();
+    };
+
+    SearchMatch match;
+    while (!m_cancel && search.next(match)) {
+      bool wrapped = match.m_line < startLine;
+      if (wrapped != batchWrapped && !batch.empty())
+        publish();
+      batchWrapped = wrapped;
+      batch.push_back(match);
+      if (!published || std::chrono::steady_clock::now() - lastPublish > std::chrono::milliseconds(PUBLISH_INTERVAL_MS))
+        publish();
+    }
+    if (m_cancel)
+      return; // The RegexSearch destructor cancels the pending chunks
+    if (!batch.empty())
+      publish();
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_finished = true;
+    }
+    m_onProgress();
+  }
+
+  // Like FindInFiles::searchFiles(): literals are looked for in the whole mapping at once and lines are only
+  // counted up to the matches, regular expressions are matched line by line. Both stop at every chunk to
+  // publish what they found and to check whether they were cancelled
+  void DocumentSearch::runMapped(const char *data, size_t size, size_t startOffset, size_t startLine) {
+    startOffset = std::min(startOffset, size);
+    if (startLine == static_cast<size_t>(-1)) {
+      startLine = 0;
+      for (size_t offset = 0; offset < startOffset; offset += SCAN_CHUNK_BYTES) {
+        if (m_cancel)
+          return;
+        const size_t end = std::min(startOffset, offset + SCAN_CHUNK_BYTES);
+        startLine += static_cast<size_t>(std::count(data + offset, data + end, '\n'));
+      }
+    }
+
+    std::unique_ptr<RegexMatcher> matcher;
+    if (m_regex)
+      matcher.reset(new RegexMatcher(m_regex));
+    std::vector<std::pair<size_t, size_t>> spans;
+    std::vector<SearchMatch> batch;
+    bool published = false;
+
+    auto publish = [&](std::vector<SearchMatch>& destination) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        destination.insert(destination.end(), batch.begin(), batch.end());
+      }
+      batch.clear();
+      published = true;
+      m_onProgress();
+    };
+
+    // Lines beginning in [from, to), the first one being 'line'
+    auto scan = [&](size_t from, size_t to, size_t line, std::vector<SearchMatch>& destination) {
+      const char *end = data + to;
+      const char *lineStart = data + from;
+      if (!matcher) {
+        const char *position = lineStart;
+        while (position < end && !m_cancel) {
+          const char *chunkEnd = position + std::min<size_t>(SCAN_CHUNK_BYTES, end - position);
+          const char *limit = std::min(data + size, chunkEnd + m_needle.size() - 1); // Matches beginning in the chunk
+          const char *match;
+          while ((match = findSubstring(position, limit - position, m_needle.data(), m_needle.size())) != nullptr &&
+                 match < chunkEnd) {
+            const char *newline;
+            while ((newline = static_cast<const char*>(std::memchr(lineStart, '\n', match - lineStart))) != nullptr) {
+              ++line;
+              lineStart = newline + 1;
+            }
+            if (std::memchr(match, '\n', m_needle.size()) == nullptr) // Matches don't span multiple lines
+              batch.push_back({ line, static_cast<size_t>(match - lineStart), m_needle.size(), static_cast<size_t>(lineStart - data) });
+            position = match + m_needle.size(); // Matches don't overlap
+            if (!published)
+              publish(destination);
+          }
+          position = std::max(position, chunkEnd);
+          if (!batch.empty())
+            publish(destination);
+        }
+        return;
+      }
+
+      size_t scanned = 0;
+      for (; lineStart < end; ++line) {
+        if (scanned >= SCAN_CHUNK_BYTES) {
+          if (m_cancel)
+            return;
+          if (!batch.empty())
+            publish(destination);
+          scanned = 0;
+        }
+        const char *lineEnd = static_cast<const char*>(std::memchr(lineStart, '\n', (data + size) - lineStart));
+        if (lineEnd == nullptr)
+          lineEnd = data + size;
+        size_t length = lineEnd - lineStart;
+        if (length > 0 && lineStart[length - 1] == '\r')
+          --length;
+        spans.clear();
+        matcher->findAll(lineStart, length, spans);
+        for (const auto& span : spans)
+          batch.push_back({ line, span.first, span.second - span.first, static_cast<size_t>(lineStart - data) });
+        if (!published && !batch.empty())
+          publish(destination);
+        scanned += lineEnd - lineStart + 1;
+        lineStart = (lineEnd < data + size) ? lineEnd + 1 : lineEnd;
+      }
+      if (!batch.empty())
+        publish(destination);
+    };
+
+    scan(startOffset, size, startLine, m_matchesAfterStart);
+    scan(0, startOffset, 0, m_matchesBeforeStart);
+    if (m_cancel)
+      return;
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_finished = true;
+    }
+    m_onProgress();
+  }
+
+  bool DocumentSearch::isFinished() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_finished;
+  }
+
+  size_t DocumentSearch::getMatchCount() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_matchesAfterStart.size() + m_matchesBeforeStart.size();
+  }
+
+  std::vector<SearchMatch> DocumentSearch::getMatches(size_t firstLine, size_t lastLine) {
+    std::vector<SearchMatch> result;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (const auto *matches : { &m_matchesBeforeStart, &m_matchesAfterStart }) {
+      auto begin = std::lower_bound(matches->begin(), matches->end(), SearchMatch{ firstLine, 0, 0 });
+      auto end = std::lower_bound(begin, matches->end(), SearchMatch{ lastLine, 0, 0 });
+      result.insert(result.end(), begin, end);
+    }
+    return result;
+  }
+
+  std::vector<SearchMatch> DocumentSearch::getMatchesAt(size_t firstOffset, size_t lastOffset) {
+    std::vector<SearchMatch> result;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto before = [](const SearchMatch& match, size_t offset) { return match.m_lineOffset < offset; };
+    for (const auto *matches : { &m_matchesBeforeStart, &m_matchesAfterStart }) {
+      auto begin = std::lower_bound(matches->begin(), matches->end(), firstOffset, before);
+      auto end = std::lower_bound(begin, matches->end(), lastOffset, before);
+      result.insert(result.end(), begin, end);
+    }
+    return result;
+  }
+
+  bool DocumentSearch::findNext(SearchMatch from, bool forward, SearchMatch& result) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const bool streamed = m_streamed;
+    auto less = [streamed](const SearchMatch& a, const SearchMatch& b) {
+      if (streamed)
+        return a.m_lineOffset < b.m_lineOffset || (a.m_lineOffset == b.m_lineOffset && a.m_column < b.m_column);
+      return a < b;
+    };
+    // Concatenated the two lists are sorted
+    const auto& first = m_matchesBeforeStart;
+    const auto& second = m_matchesAfterStart;
+    if (first.empty() && second.empty())
+      return false;
+
+    if (forward) {
+      for (const auto *matches : { &first, &second }) {
+        auto it = std::upper_bound(matches->begin(), matches->end(), from, less);
+        if (it != matches->end()) {
+          result = *it;
+          return true;
+        }
+      }
+      result = first.empty() ? second.front() : first.front(); // Wrap around
+    } else {
+      for (const auto *matches : { &second, &first }) {
+        auto it = std::lower_bound(matches->begin(), matches->end(), from, less);
+        if (it != matches->begin()) {
+          result = *std::prev(it);
+          return true;
+        }
+      }
+      result = second.empty() ? first.back() : second.back();
+    }
+    return true;
+  }
+
+}
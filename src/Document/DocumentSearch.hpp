@@ -0,0 +1,86 @@
+#ifndef VARCO_DOCUMENTSEARCH_HPP
+#define VARCO_DOCUMENTSEARCH_HPP
+
+#include <Document/TextBuffer.hpp>
+#include <Utils/Regex.hpp>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+
+namespace varco {
+
+  struct SearchMatch {
+    size_t m_line;
+    size_t m_column;
+    size_t m_length;
+    size_t m_lineOffset; // Streamed files only: where the line begins in the file
+  };
+
+  inline bool operator<(const SearchMatch& a, const SearchMatch& b) {
+    return a.m_line < b.m_line || (a.m_line == b.m_line && a.m_column < b.m_column);
+  }
+
+  // Looks for a literal needle (or a regular expression) in a snapshot of the document on a background
+  // thread. The scan starts from a given line (the caret's), goes to the end of the document and wraps
+  // around: matches are published in batches while the scan proceeds (the first one right away) so the ones
+  // the user is looking at show up immediately, whatever the size of the document. Matches don't span
+  // multiple lines. Regular expressions are matched in parallel on the WorkerPool (see RegexSearch).
+  //
+  // A streamed file is searched in its mapping rather than in a snapshot, matches are then on the lines of the
+  // file and sorted by where their lines begin
+  class DocumentSearch {
+  public:
+    // 'onProgress' is called on the search thread every time new matches are published and at the end
+    explicit DocumentSearch(std::function<void()> onProgress);
+    ~DocumentSearch();
+
+    // Cancels the running search (if any) and starts a new one. An empty needle just clears the matches.
+    // Returns false (and clears the matches) if 'regex' is set and the needle isn't a valid pattern
+    bool start(TextBuffer snapshot, std::string needle, size_t startLine, bool regex = false);
+    // Same for the mapping of a streamed file, which must outlive the search. The scan starts from the line
+    // beginning at 'startOffset': 'startLine' is its number, npos if unknown (the lines before it are counted)
+    bool start(const char *data, size_t size, std::string needle, size_t startOffset, size_t startLine, bool regex = false);
+    void cancel();
+
+    std::string getNeedle();
+    bool isRegex();
+    const std::string& getError() const; // Why the last pattern was rejected
+    bool isFinished();
+    size_t getMatchCount();
+    // Matches found so far on lines [firstLine, lastLine), sorted
+    std::vector<SearchMatch> getMatches(size_t firstLine, size_t lastLine);
+    // Streamed files: matches found so far on the lines beginning in [firstOffset, lastOffset), sorted
+    std::vector<SearchMatch> getMatchesAt(size_t firstOffset, size_t lastOffset);
+    // The first match found so far strictly after (or before) a position, wrapping around the document. Streamed
+    // files compare where the lines begin rather than their numbers
+    bool findNext(SearchMatch from, bool forward, SearchMatch& result);
+
+  private:
+    bool prepare(std::string needle, bool regex, bool streamed); // False if there's nothing to search
+    void run(TextBuffer snapshot, size_t startLine); // Search thread
+    void runRegex(TextBuffer snapshot, size_t startLine); // Search thread
+    void runMapped(const char *data, size_t size, size_t startOffset, size_t startLine); // Search thread
+
+    std::function<void()> m_onProgress;
+    std::thread m_thread;
+    std::atomic<bool> m_cancel{ false };
+    std::shared_ptr<const Regex> m_regex; // Only set for regular expression searches
+    std::string m_error;
+
+    std::mutex m_mutex; // Protects the following (the search thread only reads the needle)
+    std::string m_needle;
+    bool m_isRegex = false;
+    bool m_streamed = false; // Matches are sorted by m_lineOffset
+    // Matches on lines >= the start line, then matches on lines before it (found after wrapping around).
+    // Both sorted: the wrapped ones all come before the others in the document
+    std::vector<SearchMatch> m_matchesAfterStart;
+    std::vector<SearchMatch> m_matchesBeforeStart;
+    bool m_finished = true;
+  };
+
+}
+
+#endif // VARCO_DOCUMENTSEARCH_HPP
@@ -0,0 +1,374 @@
+#include <Document/FileCache.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/stat.h>
+#endif
+
+namespace varco {
+
+#define CACHE_MAGIC 0x43435256 // "VRCC"
+#define CACHE_VERSION 1 // Bumped whenever the layout of an entry (or what's in it) changes
+#define WRITE_BATCH_RECORDS 4096 // Records converted and written at a time
+
+  namespace {
+    enum Section {
+      PathSection, // The path of the file (hashes of paths can collide)
+      LineStartsSection,
+      FirstBreakSection,
+      BreaksSection,
+      SegmentsSection,
+      FirstSegmentSection, // The maps of the style database as sorted (key, value) pairs
+      LastSegmentSection,
+      PreviousSegmentSection,
+      LineBeginsSection,
+      BracketsSection,
+      BracketLinesSection,
+      FoldsSection,
+      SECTION_COUNT
+    };
+
+    struct SegmentRecord {
+      uint64_t m_absStart;
+      uint32_t m_line;
+      uint32_t m_start;
+      uint32_t m_count;
+      uint32_t m_style;
+    };
+
+    struct PairRecord {
+      uint64_t m_key;
+      uint64_t m_value;
+    };
+
+    struct BracketRecord {
+      uint32_t m_line;
+      uint32_t m_column;
+      uint32_t m_match;
+      uint16_t m_depth;
+      uint8_t m_character;
+      uint8_t m_padding;
+    };
+
+    const size_t SECTION_RECORD_BYTES[SECTION_COUNT] = {
+      1, sizeof(uint64_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(SegmentRecord), sizeof(PairRecord),
+      sizeof(PairRecord), sizeof(PairRecord), sizeof(PairRecord), sizeof(BracketRecord), sizeof(uint32_t),
+      sizeof(FoldRegion)
+    };
+
+    size_t alignTo8(size_t offset) {
+      return (offset + 7) & ~size_t(7);
+    }
+
+    uint64_t rotateLeft(uint64_t value, int bits) {
+      return (value << bits) | (value >> (64 - bits));
+    }
+
+    std::string getCacheDirectory() { // Created if missing, empty if there's nowhere to put it
+#ifdef _WIN32
+      const char *base = std::getenv("LOCALAPPDATA");
+      if (base == nullptr || *base == '\0')
+        return std::string();
+      std::string directory = std::string(base) + "\\varco";
+      CreateDirectoryA(directory.c_str(), nullptr);
+      directory += "\\cache";
+      CreateDirectoryA(directory.c_str(), nullptr);
+      return directory + "\\";
+#else
+      std::string directory;
+      const char *base = std::getenv("XDG_CACHE_HOME");
+      if (base != nullptr && *base != '\0')
+        directory = base;
+      else if ((base = std::getenv("HOME")) != nullptr && *base != '\0') {
+        directory = std::string(base) + "/.cache";
+        mkdir(directory.c_str(), 0755);
+      } else
+        return std::string();
+      directory += "/varco";
+      mkdir(directory.c_str(), 0755);
+      return directory + "/";
+#endif
+    }
+
+    std::string getEntryPath(const std::string& file) {
+      std::string directory = getCacheDirectory();
+      if (directory.empty())
+        return directory;
+      char name[32];
+      std::snprintf(name, sizeof(name), "%016llx.vcache",
+                    static_cast<unsigned long long>(FileCache::hashContents(file.data(), file.size())));
+      return directory + name;
+    }
+
+    template <typename Map>
+    void toPairs(const Map& map, std::vector<PairRecord>& pairs) {
+      pairs.clear();
+      pairs.reserve(map.size());
+      for (const auto& entry : map)
+        pairs.push_back({ static_cast<uint64_t>(entry.first), static_cast<uint64_t>(entry.second) });
+    }
+
+    template <typename Map>
+    void fromPairs(const PairRecord *pairs, size_t count, Map& map) {
+      for (size_t i = 0; i < count; ++i) // Sorted: every insertion goes at the end
+        map.emplace_hint(map.end(), static_cast<size_t>(pairs[i].m_key), static_cast<size_t>(pairs[i].m_value));
+    }
+  }
+
+  struct FileCache::Header {
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint64_t m_fileSize;
+    int64_t m_modifiedTime;
+    uint64_t m_hash;
+    uint32_t m_wrapColumns;
+    uint32_t m_tabWidth;
+    int32_t m_lexerType;
+    uint32_t m_padding;
+    struct {
+      uint64_t m_offset; // From the beginning of the entry, aligned to 8 bytes
+      uint64_t m_count; // Records
+    } m_sections[SECTION_COUNT];
+  };
+
+  // Four lanes of 8 bytes each are mixed independently so their multiplications overlap, then folded together
+  uint64_t FileCache::hashContents(const char *data, size_t size) {
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL, PRIME2 = 0xC2B2AE3D27D4EB4FULL, PRIME3 = 0x165667B19E3779F9ULL;
+    uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      for (int lane = 0; lane < 4; ++lane) {
+        uint64_t word;
+        std::memcpy(&word, data + i + lane * 8, 8);
+        lanes[lane] = rotateLeft(lanes[lane] + word * PRIME2, 31) * PRIME1;
+      }
+    }
+    uint64_t hash = static_cast<uint64_t>(size) * PRIME3;
+    for (int lane = 0; lane < 4; ++lane)
+      hash = rotateLeft(hash ^ (rotateLeft(lanes[lane] * PRIME2, 31) * PRIME1), 27) * PRIME1 + PRIME3;
+    for (; i < size; ++i)
+      hash = rotateLeft(hash ^ (static_cast<unsigned char>(data[i]) * PRIME3), 11) * PRIME1;
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    return hash ^ (hash >> 32);
+  }
+
+  std::unique_ptr<FileCache> FileCache::open(Key& key, const char *contents) {
+    const std::string path = getEntryPath(key.m_path);
+    std::unique_ptr<FileCache> cache(new FileCache());
+    if (path.empty() || !cache->m_file.open(path) || cache->m_file.getSize() < sizeof(Header))
+      return nullptr;
+
+    const char *data = cache->m_file.getData();
+    const size_t size = cache->m_file.getSize();
+    const Header *header = reinterpret_cast<const Header*>(data);
+    if (header->m_magic != CACHE_MAGIC || header->m_version != CACHE_VERSION || header->m_fileSize != key.m_size ||
+        header->m_modifiedTime != key.m_modifiedTime)
+      return nullptr;
+    for (size_t i = 0; i < SECTION_COUNT; ++i) { // Every section must be within the entry
+      const uint64_t offset = header->m_sections[i].m_offset, count = header->m_sections[i].m_count;
+      if (offset % 8 != 0 || offset > size || count > (size - offset) / SECTION_RECORD_BYTES[i])
+        return nullptr;
+    }
+    const auto& pathSection = header->m_sections[PathSection];
+    if (key.m_path.compare(0, std::string::npos, data + pathSection.m_offset, pathSection.m_count) != 0)
+      return nullptr;
+    const auto& lineStarts = header->m_sections[LineStartsSection];
+    const auto& firstBreak = header->m_sections[FirstBreakSection];
+    if (lineStarts.m_count < 2 || (firstBreak.m_count != 0 && firstBreak.m_count != lineStarts.m_count))
+      return nullptr; // A text has at least a line
+    key.m_hash = hashContents(contents, static_cast<size_t>(key.m_size)); // Last: it reads the whole file
+    if (header->m_hash != key.m_hash)
+      return nullptr;
+
+    cache->m_header = header;
+    return cache;
+  }
+
+  template <typename T>
+  const T *FileCache::getSection(size_t section, size_t& count) const {
+    count = static_cast<size_t>(m_header->m_sections[section].m_count);
+    return reinterpret_cast<const T*>(m_file.getData() + m_header->m_sections[section].m_offset);
+  }
+
+  size_t FileCache::getLineCount() const {
+    return static_cast<size_t>(m_header->m_sections[LineStartsSection].m_count) - 1;
+  }
+
+  const uint64_t *FileCache::getLineStarts() const {
+    size_t count;
+    return getSection<uint64_t>(LineStartsSection, count);
+  }
+
+  uint32_t FileCache::getWrapColumns() const {
+    return m_header->m_sections[FirstBreakSection].m_count > 0 ? m_header->m_wrapColumns : 0;
+  }
+
+  uint32_t FileCache::getTabWidth() const {
+    return m_header->m_tabWidth;
+  }
+
+  std::pair<const uint32_t*, const uint32_t*> FileCache::getRowBreaks(size_t line) const {
+    size_t lines, count;
+    const uint32_t *first = getSection<uint32_t>(FirstBreakSection, lines);
+    const uint32_t *breaks = getSection<uint32_t>(BreaksSection, count);
+    if (line + 1 >= lines || first[line] > first[line + 1] || first[line + 1] > count)
+      return { breaks, breaks };
+    return { breaks + first[line], breaks + first[line + 1] };
+  }
+
+  int32_t FileCache::getLexerType() const {
+    return m_header->m_lexerType;
+  }
+
+  std::shared_ptr<StyleDatabase> FileCache::makeStyleDatabase() const {
+    if (m_header->m_lexerType == NO_LEXER)
+      return nullptr;
+    auto styleDb = std::make_shared<StyleDatabase>();
+    size_t count;
+    const SegmentRecord *segments = getSection<SegmentRecord>(SegmentsSection, count);
+    styleDb->styleSegment.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      const SegmentRecord& segment = segments[i];
+      styleDb->styleSegment.emplace_back(segment.m_line, segment.m_start, segment.m_count,
+                                         static_cast<size_t>(segment.m_absStart), static_cast<Style>(segment.m_style));
+    }
+    const PairRecord *pairs = getSection<PairRecord>(FirstSegmentSection, count);
+    fromPairs(pairs, count, styleDb->firstSegmentOnLine);
+    pairs = getSection<PairRecord>(LastSegmentSection, count);
+    fromPairs(pairs, count, styleDb->lastSegmentOnLine);
+    pairs = getSection<PairRecord>(PreviousSegmentSection, count);
+    fromPairs(pairs, count, styleDb->previousSegment);
+    pairs = getSection<PairRecord>(LineBeginsSection, count);
+    fromPairs(pairs, count, styleDb->m_absOffsetWhereLineBegins);
+
+    const BracketRecord *brackets = getSection<BracketRecord>(BracketsSection, count);
+    styleDb->m_brackets.m_brackets.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      const BracketRecord& bracket = brackets[i];
+      styleDb->m_brackets.m_brackets.push_back({ bracket.m_line, bracket.m_column, bracket.m_match, bracket.m_depth,
+                                                  static_cast<char>(bracket.m_character) });
+    }
+    const uint32_t *firstOnLine = getSection<uint32_t>(BracketLinesSection, count);
+    styleDb->m_brackets.m_firstOnLine.assign(firstOnLine, firstOnLine + count);
+    const FoldRegion *folds = getSection<FoldRegion>(FoldsSection, count);
+    styleDb->m_foldRegions.assign(folds, folds + count);
+    return styleDb;
+  }
+
+  bool FileCache::store(const Key& key, const Contents& contents) {
+    const std::string path = getEntryPath(key.m_path);
+    if (path.empty())
+      return false;
+    uint64_t hash = key.m_hash;
+    if (hash == 0) { // There was no entry when the file was opened
+      MappedFile mapped;
+      if (!mapped.open(key.m_path) || mapped.getSize() != key.m_size)
+        return false;
+      hash = hashContents(mapped.getData(), mapped.getSize());
+    }
+    const std::string temporary = path + ".tmp";
+    std::FILE *file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+      return false;
+
+    const StyleDatabase *styleDb = contents.m_styleDb.get();
+    const bool styled = (styleDb != nullptr && contents.m_lexerType != NO_LEXER);
+    const bool wrapped = (contents.m_wrapColumns > 0 && contents.m_firstBreak.size() == contents.m_lineStarts.size());
+    std::vector<PairRecord> maps[4];
+    if (styled) {
+      toPairs(styleDb->firstSegmentOnLine, maps[0]);
+      toPairs(styleDb->lastSegmentOnLine, maps[1]);
+      toPairs(styleDb->previousSegment, maps[2]);
+      toPairs(styleDb->m_absOffsetWhereLineBegins, maps[3]);
+    }
+
+    Header header = {};
+    header.m_magic = CACHE_MAGIC;
+    header.m_version = CACHE_VERSION;
+    header.m_fileSize = key.m_size;
+    header.m_modifiedTime = key.m_modifiedTime;
+    header.m_hash = hash;
+    header.m_wrapColumns = wrapped ? contents.m_wrapColumns : 0;
+    header.m_tabWidth = contents.m_tabWidth;
+    header.m_lexerType = styled ? contents.m_lexerType : NO_LEXER;
+    const size_t counts[SECTION_COUNT] = {
+      key.m_path.size(), contents.m_lineStarts.size(), wrapped ? contents.m_firstBreak.size() : 0,
+      wrapped ? contents.m_breaks.size() : 0, styled ? styleDb->styleSegment.size() : 0, maps[0].size(),
+      maps[1].size(), maps[2].size(), maps[3].size(), styled ? styleDb->m_brackets.m_brackets.size() : 0,
+      styled ? styleDb->m_brackets.m_firstOnLine.size() : 0, styled ? styleDb->m_foldRegions.size() : 0
+    };
+    size_t offset = alignTo8(sizeof(Header));
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+      header.m_sections[i].m_offset = offset;
+      header.m_sections[i].m_count = counts[i];
+      offset = alignTo8(offset + counts[i] * SECTION_RECORD_BYTES[i]);
+    }
+
+    size_t written = 0;
+    auto write = [&](const void *data, size_t bytes) {
+      if (bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes)
+        return false;
+      written += bytes;
+      return true;
+    };
+    auto pad = [&]() {
+      static const char zeros[8] = {};
+      return write(zeros, alignTo8(written) - written);
+    };
+    // Records which aren't stored as they are in memory are converted a batch at a time
+    auto writeConverted = [&](size_t count, auto convert) {
+      using Record = decltype(convert(size_t(0)));
+      std::vector<Record> batch;
+      batch.reserve(std::min<size_t>(count, WRITE_BATCH_RECORDS));
+      for (size_t i = 0; i < count; i += WRITE_BATCH_RECORDS) {
+        batch.clear();
+        for (size_t j = i; j < std::min(count, i + WRITE_BATCH_RECORDS); ++j)
+          batch.push_back(convert(j));
+        if (!write(batch.data(), batch.size() * sizeof(Record)))
+          return false;
+      }
+      return true;
+    };
+
+    bool success = write(&header, sizeof(header)) && pad() &&
+                   write(key.m_path.data(), counts[PathSection]) && pad() &&
+                   write(contents.m_lineStarts.data(), counts[LineStartsSection] * sizeof(uint64_t)) && pad() &&
+                   write(contents.m_firstBreak.data(), counts[FirstBreakSection] * sizeof(uint32_t)) && pad() &&
+                   write(contents.m_breaks.data(), counts[BreaksSection] * sizeof(uint32_t)) && pad();
+    success = success && writeConverted(counts[SegmentsSection], [styleDb](size_t i) {
+      const auto& segment = styleDb->styleSegment[i];
+      return SegmentRecord{ segment.absStartPos, static_cast<uint32_t>(segment.line), static_cast<uint32_t>(segment.start),
+                            static_cast<uint32_t>(segment.count), static_cast<uint32_t>(segment.style) };
+    }) && pad();
+    for (const auto& pairs : maps)
+      success = success && write(pairs.data(), pairs.size() * sizeof(PairRecord)) && pad();
+    success = success && writeConverted(counts[BracketsSection], [styleDb](size_t i) {
+      const auto& bracket = styleDb->m_brackets.m_brackets[i];
+      return BracketRecord{ bracket.m_line, bracket.m_column, bracket.m_match, bracket.m_depth,
+                            static_cast<uint8_t>(bracket.m_character), 0 };
+    }) && pad();
+    if (styled) {
+      success = success && write(styleDb->m_brackets.m_firstOnLine.data(), counts[BracketLinesSection] * sizeof(uint32_t)) &&
+                pad() && write(styleDb->m_foldRegions.data(), counts[FoldsSection] * sizeof(FoldRegion)) && pad();
+    }
+    success = (std::fclose(file) == 0) && success;
+
+#ifdef _WIN32
+    if (success)
+      std::remove(path.c_str()); // rename() doesn't replace files on Windows
+#endif
+    if (!success || std::rename(temporary.c_str(), path.c_str()) != 0) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+    return true;
+  }
+
+}
@@ -0,0 +1,73 @@
+#ifndef VARCO_FILECACHE_HPP
+#define VARCO_FILECACHE_HPP
+
+#include <Lexers/Lexer.hpp>
+#include <Utils/MappedFile.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace varco {
+
+  // What takes long to compute again when a large file is opened: where its lines begin, where they were
+  // wrapped the last time and what the lexer found in them. Entries live in the user's cache directory, one
+  // per file (named after a hash of its path), and are only used if the file still has the size, modification
+  // time and contents hash it had when they were written.
+  //
+  // An entry is a header followed by arrays of fixed-size records aligned to 8 bytes: it's mapped and the
+  // line starts and row breaks are read in place. Only the style database is copied out, its maps can't be
+  // read from a mapping. Entries written by another version of the format are ignored (and replaced)
+  class FileCache {
+  public:
+    static constexpr const int32_t NO_LEXER = -1;
+
+    struct Key {
+      std::string m_path; // Empty if the file isn't cached
+      uint64_t m_size = 0;
+      int64_t m_modifiedTime = 0;
+      uint64_t m_hash = 0; // See hashContents(), 0 until the contents are hashed (see open())
+    };
+
+    struct Contents { // What an entry is written from
+      std::vector<uint64_t> m_lineStarts; // Of every line in the (UTF-8) text, then the size of the text
+      uint32_t m_wrapColumns = 0; // The rows are those of lines wrapped at this many columns (0 if none)
+      uint32_t m_tabWidth = 0;
+      std::vector<uint32_t> m_firstBreak; // Of every line in m_breaks, then the number of breaks
+      std::vector<uint32_t> m_breaks; // Where the rows of a line begin after its first one, in bytes of the line
+      std::shared_ptr<const StyleDatabase> m_styleDb; // Null if the text wasn't lexed
+      int32_t m_lexerType = NO_LEXER;
+    };
+
+    // 64 bits of the contents of a file, 32 bytes at a time (several GB/s: it's bound by memory bandwidth)
+    static uint64_t hashContents(const char *data, size_t size);
+    // Null if there's no entry for the file or it's stale. The contents (key.m_size bytes) are hashed into
+    // key.m_hash only once the entry's path, size and modification time match: most opens have no entry
+    static std::unique_ptr<FileCache> open(Key& key, const char *contents);
+    // Written aside first, then renamed over the entry. A key which wasn't hashed by open() gets the hash of
+    // the file as it is on disk now
+    static bool store(const Key& key, const Contents& contents);
+
+    size_t getLineCount() const;
+    const uint64_t *getLineStarts() const; // getLineCount() + 1 of them
+    uint32_t getWrapColumns() const;
+    uint32_t getTabWidth() const;
+    std::pair<const uint32_t*, const uint32_t*> getRowBreaks(size_t line) const; // Empty if the line wasn't wrapped
+    int32_t getLexerType() const;
+    std::shared_ptr<StyleDatabase> makeStyleDatabase() const; // Null if the entry has none
+
+  private:
+    struct Header;
+    FileCache() = default;
+    template <typename T>
+    const T *getSection(size_t section, size_t& count) const;
+
+    MappedFile m_file;
+    const Header *m_header = nullptr;
+  };
+
+}
+
+#endif // VARCO_FILECACHE_HPP
@@ -0,0 +1,278 @@
+#include <Document/FileSaver.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <vector>
+#include <deque>
+#ifdef _WIN32
+  #include <windows.h>
+#elif defined __linux__
+  #include <sys/stat.h>
+  #include <sys/uio.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <cstdlib>
+  #include <cerrno>
+#endif
+
+namespace varco {
+
+#define TEMPORARY_SUFFIX ".varco~" // The new file is written next to the target with this name
+#define PROGRESS_INTERVAL_MS 100 // Minimum time between two progress notifications
+
+  namespace {
+    // Calls f(data, size) for every piece of the file in order: the lines of the snapshot and the line endings
+    // between them. Stops early (and returns false) if f returns false
+    template <typename Function>
+    bool forEachPiece(const FileSaver::Request& request, Function f) {
+      const size_t count = request.m_snapshot.getLineCount();
+      const std::string& newline = request.m_newline;
+      bool success = true;
+      request.m_snapshot.forEachLine(0, count, [&](size_t line, const std::string& text) {
+        if (!text.empty())
+          success = f(text.data(), text.size());
+        if (success && (line + 1 < count || request.m_finalNewline))
+          success = f(newline.data(), newline.size());
+        return success;
+      });
+      return success;
+    }
+
+    // Same as forEachPiece() with the pieces converted to the encoding of the file, after its byte order mark
+    // (if it has one). Converted pieces are kept in 'storage' until the caller clears it
+    template <typename Function>
+    bool forEachEncodedPiece(const FileSaver::Request& request, std::deque<std::string>& storage, Function f) {
+      const Encoding encoding = request.m_encoding.m_encoding;
+      if (request.m_encoding.m_bom) {
+        storage.push_back(getByteOrderMark(encoding));
+        if (!f(storage.back().data(), storage.back().size()))
+          return false;
+      }
+      if (encoding == Encoding::Utf8)
+        return forEachPiece(request, f);
+      return forEachPiece(request, [&](const char *data, size_t size) {
+        storage.push_back(encodeText(data, size, encoding));
+        return f(storage.back().data(), storage.back().size());
+      });
+    }
+
+    size_t getFileSize(const FileSaver::Request& request) { // Exact for UTF-8 and Latin-1 text
+      const size_t count = request.m_snapshot.getLineCount();
+      if (count == 0)
+        return 0;
+      // getByteCount() counts a single '\n' between lines
+      size_t size = request.m_snapshot.getByteCount() + (count - 1) * (request.m_newline.size() - 1) +
+                    (request.m_finalNewline ? request.m_newline.size() : 0);
+      const Encoding encoding = request.m_encoding.m_encoding;
+      if (encoding == Encoding::Utf16LE || encoding == Encoding::Utf16BE)
+        size *= 2;
+      return size + (request.m_encoding.m_bom ? getByteOrderMark(encoding).size() : 0);
+    }
+  }
+
+  FileSaver::FileSaver(std::function<void()> onProgress, std::function<void(const Request&, const Result&)> onDone) :
+    m_onProgress(std::move(onProgress)),
+    m_onDone(std::move(onDone))
+  {}
+
+  FileSaver::~FileSaver() {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wakeUp.notify_one();
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  void FileSaver::save(Request request) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_queued = std::make_unique<Request>(std::move(request)); // Replaces an older one still waiting
+      if (!m_thread.joinable())
+        m_thread = std::thread(&FileSaver::run, this);
+    }
+    m_wakeUp.notify_one();
+  }
+
+  bool FileSaver::isSaving() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_saving || m_queued;
+  }
+
+  float FileSaver::getProgress() const {
+    const size_t total = m_total;
+    return total > 0 ? std::min(1.f, static_cast<float>(m_written) / total) : 0.f;
+  }
+
+  // Queued requests are still written when stopping: the thread only exits with nothing left to save
+  void FileSaver::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_wakeUp.wait(lock, [this]() { return m_queued || m_stop; });
+      if (!m_queued)
+        return;
+      std::unique_ptr<Request> request = std::move(m_queued);
+      m_saving = true;
+      lock.unlock();
+
+      m_written = 0;
+      m_total = getFileSize(*request);
+      Result result = write(*request);
+      lock.lock();
+      m_saving = false;
+      lock.unlock();
+      m_onDone(*request, result);
+      lock.lock();
+    }
+  }
+
+#ifdef _WIN32
+
+#define WRITE_BUFFER_BYTES (1 << 20) // Pieces are gathered into writes of this size
+
+  FileSaver::Result FileSaver::write(const Request& request) {
+    auto error = [](const char *what) {
+      return Result{ false, std::string(what) + " failed (error " + std::to_string(GetLastError()) + ")" };
+    };
+    const std::string temporary = request.m_path + TEMPORARY_SUFFIX;
+    HANDLE file = CreateFileA(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return error("CreateFile");
+
+    std::vector<char> buffer;
+    buffer.reserve(WRITE_BUFFER_BYTES);
+    std::deque<std::string> encoded;
+    auto lastProgress = std::chrono::steady_clock::now();
+    auto flush = [&]() {
+      DWORD written;
+      if (!buffer.empty() && (!WriteFile(file, buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr) ||
+                              written != buffer.size()))
+        return false;
+      m_written += buffer.size();
+      buffer.clear();
+      auto now = std::chrono::steady_clock::now();
+      if (now - lastProgress >= std::chrono::milliseconds(PROGRESS_INTERVAL_MS)) {
+        lastProgress = now;
+        m_onProgress();
+      }
+      return true;
+    };
+    bool success = forEachEncodedPiece(request, encoded, [&](const char *data, size_t size) {
+      while (size > 0) {
+        size_t chunk = std::min(size, WRITE_BUFFER_BYTES - buffer.size());
+        buffer.insert(buffer.end(), data, data + chunk);
+        data += chunk;
+        size -= chunk;
+        if (buffer.size() == WRITE_BUFFER_BYTES && !flush())
+          return false;
+      }
+      encoded.clear(); // Copied
+      return true;
+    });
+    success = success && flush();
+    if (success && request.m_policy != FsyncPolicy::Never)
+      success = FlushFileBuffers(file) != 0;
+    Result result = success ? Result{ true, std::string() } : error("WriteFile");
+    CloseHandle(file);
+
+    // Write-through makes the rename itself durable before returning
+    const DWORD flags = MOVEFILE_REPLACE_EXISTING | (request.m_policy == FsyncPolicy::Full ? MOVEFILE_WRITE_THROUGH : 0);
+    if (result.m_success && !MoveFileExA(temporary.c_str(), request.m_path.c_str(), flags))
+      result = error("MoveFileEx");
+    if (!result.m_success)
+      DeleteFileA(temporary.c_str());
+    return result;
+  }
+
+#elif defined __linux__
+
+#define MAX_WRITE_VECTORS 1024 // Pieces written by a single writev() call (capped to IOV_MAX)
+
+  FileSaver::Result FileSaver::write(const Request& request) {
+    auto error = [](const char *what) {
+      return Result{ false, std::string(what) + ": " + strerror(errno) };
+    };
+    // Saving through a symlink replaces the file it points to, not the link
+    std::string path = request.m_path;
+    if (char *resolved = realpath(path.c_str(), nullptr)) {
+      path = resolved;
+      free(resolved);
+    }
+    const std::string temporary = path + TEMPORARY_SUFFIX;
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+      return error("open");
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) { // The new file replaces the old one: it gets its permissions
+      fchmod(fd, info.st_mode & 07777);
+      if (fchown(fd, info.st_uid, info.st_gid) != 0) {} // Only allowed to root, the file is just ours otherwise
+    }
+
+    std::vector<iovec> vectors;
+    const size_t maxVectors = std::min<size_t>(MAX_WRITE_VECTORS, IOV_MAX);
+    vectors.reserve(maxVectors);
+    std::deque<std::string> encoded; // Pieces converted from UTF-8, until they're written
+    auto lastProgress = std::chrono::steady_clock::now();
+    auto flush = [&]() { // Writes the batch, resuming after partial writes
+      size_t first = 0;
+      while (first < vectors.size()) {
+        ssize_t written = writev(fd, vectors.data() + first, static_cast<int>(vectors.size() - first));
+        if (written < 0) {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+        m_written += written;
+        size_t bytes = static_cast<size_t>(written);
+        for (; first < vectors.size() && bytes >= vectors[first].iov_len; ++first)
+          bytes -= vectors[first].iov_len;
+        if (bytes > 0) { // Part of a piece went through
+          vectors[first].iov_base = static_cast<char *>(vectors[first].iov_base) + bytes;
+          vectors[first].iov_len -= bytes;
+        }
+      }
+      vectors.clear();
+      encoded.clear();
+      auto now = std::chrono::steady_clock::now();
+      if (now - lastProgress >= std::chrono::milliseconds(PROGRESS_INTERVAL_MS)) {
+        lastProgress = now;
+        m_onProgress();
+      }
+      return true;
+    };
+    bool success = forEachEncodedPiece(request, encoded, [&](const char *data, size_t size) {
+      vectors.push_back({ const_cast<char *>(data), size });
+      return vectors.size() < maxVectors || flush();
+    });
+    success = success && flush();
+    if (success && request.m_policy != FsyncPolicy::Never)
+      success = fdatasync(fd) == 0;
+    Result result = success ? Result{ true, std::string() } : error("write");
+    if (::close(fd) != 0 && result.m_success)
+      result = error("close"); // E.g. a quota exceeded on a network filesystem
+
+    if (result.m_success && rename(temporary.c_str(), path.c_str()) != 0)
+      result = error("rename");
+    if (!result.m_success) {
+      unlink(temporary.c_str());
+      return result;
+    }
+    if (request.m_policy == FsyncPolicy::Full) { // The rename is only durable once the directory is flushed
+      size_t separator = path.find_last_of('/');
+      const std::string directory = (separator == std::string::npos) ? "." : path.substr(0, std::max<size_t>(separator, 1));
+      int directoryFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (directoryFd >= 0) {
+        if (fsync(directoryFd) != 0)
+          result = error("fsync");
+        ::close(directoryFd);
+      }
+    }
+    return result;
+  }
+
+#endif
+
+}
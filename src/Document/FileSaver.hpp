@@ -0,0 +1,74 @@
+#ifndef VARCO_FILESAVER_HPP
+#define VARCO_FILESAVER_HPP
+
+#include <Document/TextBuffer.hpp>
+#include <Utils/Encoding.hpp>
+#include <functional>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <string>
+
+namespace varco {
+
+  enum class FsyncPolicy {
+    Never, // The OS writes the file back when it sees fit: a crash soon after saving might leave it empty
+    Data, // The new file is flushed before it replaces the old one: a crash leaves one of the two, whole
+    Full  // The directory is flushed too: the replacement itself survives a crash
+  };
+
+  // Writes snapshots of a document to disk on a background thread. The text goes to a temporary file next
+  // to the target which then replaces it with a rename: the file is always either the old one or the new
+  // one, never a partial write. Lines are written straight from the blocks of the snapshot with writev(),
+  // batched to IOV_MAX vectors per call: no copy of the text is made unless it's converted to another encoding.
+  //
+  // Saving while a save is running queues the new snapshot; if more saves are requested meanwhile only the
+  // latest one is written
+  class FileSaver {
+  public:
+    struct Request {
+      TextBuffer m_snapshot;
+      unsigned int m_revision; // Of the document when the snapshot was taken, reported back when it's saved
+      std::string m_path;
+      FileEncoding m_encoding; // The text is converted from UTF-8 to it
+      std::string m_newline; // Written between lines ("\n" or "\r\n")
+      bool m_finalNewline; // Also written after the last line
+      FsyncPolicy m_policy;
+    };
+    struct Result {
+      bool m_success;
+      std::string m_error; // Why it failed
+    };
+
+    // 'onProgress' is called on the saving thread as data is written (throttled), 'onDone' when a save ends
+    FileSaver(std::function<void()> onProgress, std::function<void(const Request&, const Result&)> onDone);
+    ~FileSaver(); // Waits for the running and queued saves to be written
+    FileSaver(const FileSaver&) = delete;
+    FileSaver& operator=(const FileSaver&) = delete;
+
+    void save(Request request);
+    bool isSaving();
+    float getProgress() const; // Of the running save, in [0, 1]
+
+  private:
+    void run(); // Saving thread
+    Result write(const Request& request);
+
+    std::function<void()> m_onProgress;
+    std::function<void(const Request&, const Result&)> m_onDone;
+    std::atomic<size_t> m_written{ 0 };
+    std::atomic<size_t> m_total{ 0 };
+
+    std::mutex m_mutex; // Protects the following
+    std::condition_variable m_wakeUp;
+    std::unique_ptr<Request> m_queued;
+    bool m_saving = false; // A request is being written
+    bool m_stop = false;
+    std::thread m_thread; // Started by the first save
+  };
+
+}
+
+#endif // VARCO_FILESAVER_HPP
@@ -0,0 +1,163 @@
+#include <Document/MinimapTiles.hpp>
+#include <Utils/WorkerPool.hpp>
+#include <Utils/Unicode.hpp>
+#include <SkCanvas.h>
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+namespace varco {
+
+#define MAX_CACHED_TILES 32 // Tiles farthest from the drawn ones are dropped beyond this
+#define TEXT_OPACITY 160 // Out of 255, characters are blended with the background
+
+  constexpr const int MinimapTiles::TILE_LINES;
+  constexpr const int MinimapTiles::COLUMNS;
+
+  struct MinimapTiles::State {
+    struct Tile {
+      SkBitmap m_bitmap; // Null until the first build completes
+      unsigned int m_version = 0; // Version shown by m_bitmap
+      unsigned int m_wanted = 1; // Incremented when the tile's lines change
+      bool m_pending = false; // A build is in flight
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::map<size_t, Tile> m_tiles;
+    std::shared_ptr<const Theme> m_theme; // The tiles were built with this one
+    int m_tabWidth = 0; // And with this one
+    size_t m_jobs = 0;
+    std::function<void()> m_onTileReady; // Reset when the owner is destroyed
+  };
+
+  MinimapTiles::MinimapTiles(std::function<void()> onTileReady) :
+    m_state(std::make_shared<State>())
+  {
+    m_state->m_onTileReady = std::move(onTileReady);
+  }
+
+  MinimapTiles::~MinimapTiles() {
+    std::unique_lock<std::mutex> lock(m_state->m_mutex);
+    m_state->m_onTileReady = nullptr;
+    m_state->m_idle.wait(lock, [this]() { return m_state->m_jobs == 0; });
+  }
+
+  void MinimapTiles::invalidate() {
+    std::unique_lock<std::mutex> lock(m_state->m_mutex);
+    for (auto& pair : m_state->m_tiles)
+      ++pair.second.m_wanted;
+  }
+
+  void MinimapTiles::invalidateLines(size_t line, size_t oldCount, size_t newCount) {
+    std::unique_lock<std::mutex> lock(m_state->m_mutex);
+    size_t firstTile = line / TILE_LINES;
+    size_t lastTile = (line + std::max<size_t>(oldCount, 1) - 1) / TILE_LINES;
+    for (auto it = m_state->m_tiles.lower_bound(firstTile); it != m_state->m_tiles.end(); ++it) {
+      if (oldCount == newCount && it->first > lastTile)
+        break; // The lines below didn't move
+      ++it->second.m_wanted;
+    }
+  }
+
+  SkBitmap MinimapTiles::buildTile(const std::vector<Line>& lines, const Theme& theme, int tabWidth) {
+    SkBitmap bitmap;
+    bitmap.allocPixels(SkImageInfo::Make(COLUMNS, TILE_LINES, kN32_SkColorType, kPremul_SkAlphaType));
+    SkColor background = theme.getBackgroundColor();
+    bitmap.eraseColor(background);
+
+    // Every character's color is blended once per style, not per pixel
+    std::array<SkPMColor, STYLES_COUNT> colors;
+    for (size_t i = 0; i < STYLES_COUNT; ++i) {
+      SkColor color = theme.getStylePaint(static_cast<Style>(i)).getColor();
+      auto blend = [](U8CPU from, U8CPU to) { return (from * (255 - TEXT_OPACITY) + to * TEXT_OPACITY) / 255; };
+      colors[i] = SkPreMultiplyColor(SkColorSetARGB(255, blend(SkColorGetR(background), SkColorGetR(color)),
+                                                    blend(SkColorGetG(background), SkColorGetG(color)),
+                                                    blend(SkColorGetB(background), SkColorGetB(color))));
+    }
+
+    for (size_t y = 0; y < lines.size() && y < TILE_LINES; ++y) {
+      const std::string& text = lines[y].m_text;
+      uint32_t *row = bitmap.getAddr32(0, static_cast<int>(y));
+      auto run = lines[y].m_styleRuns.begin();
+      size_t column = 0; // A pixel per column: the bytes of a UTF-8 sequence after the first take none
+      for (size_t x = 0; x < text.size() && column < COLUMNS; ++x) {
+        if (isUtf8Continuation(text[x]))
+          continue;
+        if (text[x] == ' ' || text[x] == '\t') {
+          column += (text[x] == '\t') ? tabWidth - column % tabWidth : 1;
+          continue;
+        }
+        while (run != lines[y].m_styleRuns.end() && run->m_start + run->m_count <= x)
+          ++run;
+        bool styled = (run != lines[y].m_styleRuns.end() && run->m_start <= x);
+        row[column++] = colors[styled ? run->m_style : Normal];
+      }
+    }
+    bitmap.notifyPixelsChanged();
+    return bitmap;
+  }
+
+  void MinimapTiles::draw(SkCanvas& canvas, size_t firstLine, size_t count, SkScalar x, SkScalar y, SkScalar lineHeight,
+                          const std::shared_ptr<const Theme>& theme, int tabWidth, const LineSource& source) {
+    if (count == 0)
+      return;
+    size_t firstTile = firstLine / TILE_LINES;
+    size_t lastTile = (firstLine + count - 1) / TILE_LINES;
+
+    std::unique_lock<std::mutex> lock(m_state->m_mutex);
+    if (m_state->m_theme != theme || m_state->m_tabWidth != tabWidth) { // Colors (or columns) might have changed
+      m_state->m_theme = theme;
+      m_state->m_tabWidth = tabWidth;
+      for (auto& pair : m_state->m_tiles)
+        ++pair.second.m_wanted;
+    }
+
+    for (size_t index = firstTile; index <= lastTile; ++index) {
+      State::Tile& tile = m_state->m_tiles[index];
+
+      if (tile.m_version != tile.m_wanted && !tile.m_pending) {
+        tile.m_pending = true;
+        ++m_state->m_jobs;
+        auto state = m_state;
+        unsigned int version = tile.m_wanted;
+        auto lines = std::make_shared<std::vector<Line>>(source(index * TILE_LINES, TILE_LINES));
+        WorkerPool::get().post([state, index, version, lines, theme, tabWidth]() {
+          SkBitmap bitmap = buildTile(*lines, *theme, tabWidth);
+          std::unique_lock<std::mutex> lock(state->m_mutex);
+          auto it = state->m_tiles.find(index);
+          if (it != state->m_tiles.end()) { // It might have been evicted meanwhile
+            it->second.m_pending = false;
+            it->second.m_bitmap = std::move(bitmap); // Even if outdated already: closer than the previous one
+            it->second.m_version = version;
+          }
+          if (state->m_onTileReady)
+            state->m_onTileReady();
+          if (--state->m_jobs == 0)
+            state->m_idle.notify_all();
+        });
+      }
+
+      if (tile.m_bitmap.isNull())
+        continue; // Not ready yet, the background shows through
+      size_t tileTop = index * TILE_LINES;
+      size_t from = std::max(tileTop, firstLine);
+      size_t to = std::min(tileTop + TILE_LINES, firstLine + count);
+      SkRect srcRect = SkRect::MakeLTRB(0, static_cast<SkScalar>(from - tileTop), COLUMNS, static_cast<SkScalar>(to - tileTop));
+      SkRect destRect = SkRect::MakeXYWH(x, y + (from - firstLine) * lineHeight, COLUMNS, (to - from) * lineHeight);
+      canvas.drawBitmapRect(tile.m_bitmap, srcRect, destRect, nullptr, SkCanvas::SrcRectConstraint::kFast_SrcRectConstraint);
+    }
+
+    // Keep the cache bounded: drop the tiles farthest from the ones just drawn (not the pending ones)
+    while (m_state->m_tiles.size() > MAX_CACHED_TILES) {
+      auto front = m_state->m_tiles.begin();
+      auto back = std::prev(m_state->m_tiles.end());
+      auto victim = (firstTile - std::min(firstTile, front->first) >= back->first - std::min(back->first, lastTile)) ? front : back;
+      if (victim->first >= firstTile && victim->first <= lastTile)
+        break; // Everything left is visible
+      m_state->m_tiles.erase(victim);
+    }
+  }
+
+}
@@ -0,0 +1,53 @@
+#ifndef VARCO_MINIMAPTILES_HPP
+#define VARCO_MINIMAPTILES_HPP
+
+#include <Lexers/Lexer.hpp>
+#include <UI/Theme/Theme.hpp>
+#include <SkBitmap.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class SkCanvas;
+
+namespace varco {
+
+  // The downsampled image of a document shown by the minimap: one pixel per character cell, colored by the
+  // style of the character. The image is split into tiles of a fixed number of physical lines which are
+  // built on the WorkerPool when they're first needed. An edit only invalidates the tiles of the lines it
+  // changed (or all the tiles after it if lines were added or removed); invalidated tiles keep being drawn
+  // until their replacement is ready
+  class MinimapTiles {
+  public:
+    static constexpr const int TILE_LINES = 256;
+    static constexpr const int COLUMNS = 120; // Characters after this column are not shown
+
+    struct Line {
+      std::string m_text; // Up to COLUMNS characters
+      std::vector<StyleRun> m_styleRuns;
+    };
+    // Returns the lines [first, first + count) as they are now (called with the document locked)
+    using LineSource = std::function<std::vector<Line>(size_t first, size_t count)>;
+
+    explicit MinimapTiles(std::function<void()> onTileReady); // Called on a worker thread
+    ~MinimapTiles(); // Waits for the tiles in progress
+
+    void invalidate();
+    void invalidateLines(size_t line, size_t oldCount, size_t newCount);
+
+    // Draws 'count' lines starting at 'firstLine' with their top-left corner at (x, y), 'lineHeight' pixels
+    // per line. Tiles which are missing or outdated are requested
+    void draw(SkCanvas& canvas, size_t firstLine, size_t count, SkScalar x, SkScalar y, SkScalar lineHeight,
+              const std::shared_ptr<const Theme>& theme, int tabWidth, const LineSource& source);
+
+  private:
+    struct State; // Shared with the jobs in flight
+    static SkBitmap buildTile(const std::vector<Line>& lines, const Theme& theme, int tabWidth);
+
+    std::shared_ptr<State> m_state;
+  };
+
+}
+
+#endif // VARCO_MINIMAPTILES_HPP
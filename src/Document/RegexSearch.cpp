@@ -0,0 +1,94 @@
+#include <Document/RegexSearch.hpp>
+#include <Utils/WorkerPool.hpp>
+
+namespace varco {
+
+#define CHUNK_LINES 4096 // Lines searched by a single job
+#define CHUNKS_AHEAD_PER_THREAD 4 // Chunks queued ahead of the consumer, per worker thread
+
+  RegexSearch::RegexSearch(std::shared_ptr<const Regex> regex, TextBuffer snapshot, size_t startLine) :
+    m_shared(std::make_shared<Shared>())
+  {
+    m_shared->m_regex = std::move(regex);
+    m_shared->m_snapshot = std::move(snapshot);
+
+    // Line-aligned chunks from the start line to the end, then from the beginning to the start line
+    const size_t lineCount = m_shared->m_snapshot.getLineCount();
+    startLine = std::min(startLine, lineCount);
+    auto split = [&](size_t first, size_t last) {
+      for (size_t line = first; line < last; line += CHUNK_LINES) {
+        Chunk chunk;
+        chunk.m_firstLine = line;
+        chunk.m_lastLine = std::min(last, line + CHUNK_LINES);
+        m_shared->m_chunks.emplace_back(std::move(chunk));
+      }
+    };
+    split(startLine, lineCount);
+    split(0, startLine);
+
+    std::unique_lock<std::mutex> lock(m_shared->m_mutex);
+    postChunks();
+  }
+
+  RegexSearch::~RegexSearch() {
+    cancel(); // Queued jobs only hold the shared state, they return right away
+  }
+
+  void RegexSearch::cancel() {
+    m_shared->m_cancel = true;
+    m_shared->m_chunkDone.notify_all();
+  }
+
+  // m_shared->m_mutex must be held
+  void RegexSearch::postChunks() {
+    const size_t ahead = CHUNKS_AHEAD_PER_THREAD * WorkerPool::get().getThreadCount();
+    while (m_nextToPost < m_shared->m_chunks.size() && m_nextToPost < m_chunk + ahead) {
+      auto shared = m_shared;
+      size_t chunk = m_nextToPost++;
+      WorkerPool::get().post([shared, chunk]() { searchChunk(shared, chunk); });
+    }
+  }
+
+  void RegexSearch::searchChunk(std::shared_ptr<Shared> shared, size_t index) {
+    std::vector<SearchMatch> matches;
+    if (!shared->m_cancel) {
+      Chunk& chunk = shared->m_chunks[index]; // The vector itself is never resized after construction
+      RegexMatcher matcher(shared->m_regex); // DFA states are cached per job
+      std::vector<std::pair<size_t, size_t>> spans;
+      shared->m_snapshot.forEachLine(chunk.m_firstLine, chunk.m_lastLine, [&](size_t line, const std::string& text) {
+        spans.clear();
+        matcher.findAll(text.data(), text.size(), spans);
+        for (const auto& span : spans)
+          matches.push_back({ line, span.first, span.second - span.first });
+        return !shared->m_cancel;
+      });
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(shared->m_mutex);
+      shared->m_chunks[index].m_matches = std::move(matches);
+      shared->m_chunks[index].m_done = true;
+    }
+    shared->m_chunkDone.notify_all();
+  }
+
+  bool RegexSearch::next(SearchMatch& match) {
+    std::unique_lock<std::mutex> lock(m_shared->m_mutex);
+    while (m_chunk < m_shared->m_chunks.size()) {
+      Chunk& chunk = m_shared->m_chunks[m_chunk];
+      m_shared->m_chunkDone.wait(lock, [&]() { return chunk.m_done || m_shared->m_cancel; });
+      if (m_shared->m_cancel)
+        return false;
+      if (m_index < chunk.m_matches.size()) {
+        match = chunk.m_matches[m_index++];
+        return true;
+      }
+      std::vector<SearchMatch>().swap(chunk.m_matches); // Consumed
+      ++m_chunk;
+      m_index = 0;
+      postChunks();
+    }
+    return false;
+  }
+
+}
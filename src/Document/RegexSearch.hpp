@@ -0,0 +1,55 @@
+#ifndef VARCO_REGEXSEARCH_HPP
+#define VARCO_REGEXSEARCH_HPP
+
+#include <Document/TextBuffer.hpp>
+#include <Document/DocumentSearch.hpp>
+#include <Utils/Regex.hpp>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace varco {
+
+  // Matches a Regex against a snapshot of a document in parallel: the lines are split in chunks searched by
+  // the WorkerPool, a few chunks ahead of the consumer. Matches are read in document order (from the start
+  // line to the end, then wrapping around) through next(), while the following chunks are still being
+  // searched. Destroying the cursor cancels the chunks not yet searched
+  class RegexSearch {
+  public:
+    RegexSearch(std::shared_ptr<const Regex> regex, TextBuffer snapshot, size_t startLine = 0);
+    ~RegexSearch();
+
+    // Waits for the next match. Returns false when there are no more matches (or the search was cancelled)
+    bool next(SearchMatch& match);
+    void cancel(); // Thread safe
+
+  private:
+    struct Chunk {
+      size_t m_firstLine;
+      size_t m_lastLine; // Exclusive
+      std::vector<SearchMatch> m_matches;
+      bool m_done = false;
+    };
+    struct Shared { // Outlives the cursor until the last job has finished
+      std::shared_ptr<const Regex> m_regex;
+      TextBuffer m_snapshot;
+      std::vector<Chunk> m_chunks;
+      std::atomic<bool> m_cancel{ false };
+      std::mutex m_mutex;
+      std::condition_variable m_chunkDone;
+    };
+
+    static void searchChunk(std::shared_ptr<Shared> shared, size_t chunk); // Worker thread
+    void postChunks();
+
+    std::shared_ptr<Shared> m_shared;
+    size_t m_nextToPost = 0;
+    size_t m_chunk = 0; // Cursor position
+    size_t m_index = 0;
+  };
+
+}
+
+#endif // VARCO_REGEXSEARCH_HPP
@@ -0,0 +1,134 @@
+#include <Document/StreamingFile.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace varco {
+
+#define INDEX_BLOCK_BYTES (4 << 20) // Scanned between two updates of the published index
+#define PROGRESS_INTERVAL std::chrono::milliseconds(200) // Progress is reported at most this often
+#define DEFAULT_LINE_BYTES 64 // Line length assumed before anything was indexed
+
+  StreamingFile::StreamingFile(std::function<void()> onProgress) :
+    m_onProgress(std::move(onProgress))
+  {}
+
+  StreamingFile::~StreamingFile() {
+    m_stop = true;
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  bool StreamingFile::open(const std::string& path) {
+    if (!m_file.open(path))
+      return false;
+    m_lineOffsets.assign(1, 0);
+    m_thread = std::thread(&StreamingFile::index, this);
+    return true;
+  }
+
+  size_t StreamingFile::countNewlines(size_t from, size_t to) const {
+    size_t count = 0;
+    const char *data = getData();
+    while (from < to) {
+      const void *newline = std::memchr(data + from, '\n', to - from);
+      if (newline == nullptr)
+        break;
+      from = static_cast<const char*>(newline) - data + 1;
+      ++count;
+    }
+    return count;
+  }
+
+  // The index is published in blocks: readers never wait for more than a block to be scanned
+  void StreamingFile::index() {
+    const char *data = getData();
+    const size_t size = getSize();
+    size_t offset = 0, newlines = 0;
+    std::vector<size_t> found;
+    auto lastProgress = std::chrono::steady_clock::now();
+    while (offset < size && !m_stop) {
+      const size_t end = std::min(size, offset + INDEX_BLOCK_BYTES);
+      while (offset < end) {
+        const void *newline = std::memchr(data + offset, '\n', end - offset);
+        if (newline == nullptr) {
+          offset = end;
+          break;
+        }
+        offset = static_cast<const char*>(newline) - data + 1;
+        if (++newlines % LINE_INDEX_STRIDE == 0)
+          found.push_back(offset);
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_lineOffsets.insert(m_lineOffsets.end(), found.begin(), found.end());
+        m_indexedBytes = offset;
+        m_indexedNewlines = newlines;
+      }
+      found.clear();
+      auto now = std::chrono::steady_clock::now();
+      if (now - lastProgress >= PROGRESS_INTERVAL) {
+        lastProgress = now;
+        m_onProgress();
+      }
+    }
+    if (m_stop)
+      return;
+    m_indexed = true;
+    m_onProgress();
+  }
+
+  size_t StreamingFile::getLineCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const size_t size = getSize();
+    if (m_indexed) // The line ending at the end of the file doesn't begin another line
+      return std::max<size_t>(1, m_indexedNewlines + ((size > 0 && getData()[size - 1] != '\n') ? 1 : 0));
+    if (m_indexedBytes == 0)
+      return size / DEFAULT_LINE_BYTES + 1;
+    double average = static_cast<double>(m_indexedBytes) / std::max<size_t>(m_indexedNewlines, 1);
+    return std::max(m_indexedNewlines + 1, static_cast<size_t>(size / average));
+  }
+
+  size_t StreamingFile::getLineOffset(size_t line) {
+    size_t offset;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (line > m_indexedNewlines) // Line n begins after the n-th newline
+        return npos;
+      offset = m_lineOffsets[line / LINE_INDEX_STRIDE];
+    }
+    const char *data = getData();
+    for (size_t skip = line % LINE_INDEX_STRIDE; skip > 0; --skip)
+      offset = static_cast<const char*>(std::memchr(data + offset, '\n', getSize() - offset)) - data + 1;
+    return offset;
+  }
+
+  size_t StreamingFile::getLineAtOffset(size_t offset) {
+    size_t entry, start;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (offset > m_indexedBytes && !m_indexed)
+        return npos;
+      entry = static_cast<size_t>(std::upper_bound(m_lineOffsets.begin(), m_lineOffsets.end(), offset) - m_lineOffsets.begin()) - 1;
+      start = m_lineOffsets[entry];
+    }
+    return entry * LINE_INDEX_STRIDE + countNewlines(start, std::min(offset, getSize()));
+  }
+
+  size_t StreamingFile::findLineStart(size_t offset, size_t maxBytes) const {
+    const char *data = getData();
+    const size_t limit = offset > maxBytes ? offset - maxBytes : 0;
+    offset = std::min(offset, getSize());
+    while (offset > limit && data[offset - 1] != '\n')
+      --offset;
+    return offset;
+  }
+
+  size_t StreamingFile::skipLinesBackward(size_t offset, size_t count, size_t maxBytes) const {
+    const size_t limit = offset > maxBytes ? offset - maxBytes : 0;
+    for (; count > 0 && offset > limit; --count)
+      offset = findLineStart(offset - 1, offset - 1 - limit);
+    return offset;
+  }
+
+}
@@ -0,0 +1,64 @@
+#ifndef VARCO_STREAMINGFILE_HPP
+#define VARCO_STREAMINGFILE_HPP
+
+#include <Utils/MappedFile.hpp>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+
+namespace varco {
+
+  // A file too large to be loaded as text. It stays memory mapped (the OS pages in what is read and drops it
+  // again under pressure) while a background thread builds a sparse index of its lines: the offset of one
+  // line every LINE_INDEX_STRIDE, a few MB even for tens of GB of text. Any line is then found by scanning at
+  // most LINE_INDEX_STRIDE lines from an indexed one.
+  //
+  // Lines end at '\n' here. Until the index is complete, lines beyond the indexed part (and their number) can
+  // only be estimated from the average line length found so far
+  class StreamingFile {
+  public:
+    static constexpr const size_t LINE_INDEX_STRIDE = 1024;
+    static constexpr const size_t npos = static_cast<size_t>(-1);
+
+    // 'onProgress' is called on the indexing thread as the index grows (throttled) and when it's complete
+    explicit StreamingFile(std::function<void()> onProgress);
+    ~StreamingFile(); // Stops the indexing
+    StreamingFile(const StreamingFile&) = delete;
+    StreamingFile& operator=(const StreamingFile&) = delete;
+
+    bool open(const std::string& path); // Maps the file and starts indexing it
+
+    const char *getData() const { return m_file.getData(); }
+    size_t getSize() const { return m_file.getSize(); }
+    bool isIndexed() const { return m_indexed; }
+
+    size_t getLineCount(); // Exact once indexed, estimated before
+    size_t getLineOffset(size_t line); // Where a line begins, npos if it wasn't indexed yet
+    size_t getLineAtOffset(size_t offset); // The line containing an offset, npos if it wasn't indexed yet
+    // Where the line containing 'offset' begins, not looking further back than 'maxBytes'
+    size_t findLineStart(size_t offset, size_t maxBytes) const;
+    // Where the line 'count' lines before the one beginning at 'offset' begins (or the file does), not looking
+    // further back than 'maxBytes'
+    size_t skipLinesBackward(size_t offset, size_t count, size_t maxBytes) const;
+
+  private:
+    void index(); // Indexing thread
+    size_t countNewlines(size_t from, size_t to) const;
+
+    MappedFile m_file;
+    std::function<void()> m_onProgress;
+    std::mutex m_mutex;
+    std::vector<size_t> m_lineOffsets; // Of lines 0, LINE_INDEX_STRIDE, 2 * LINE_INDEX_STRIDE... Protected by m_mutex
+    size_t m_indexedBytes = 0; // Protected by m_mutex
+    size_t m_indexedNewlines = 0; // Found in the indexed bytes. Protected by m_mutex
+    std::atomic<bool> m_indexed{ false };
+    std::atomic<bool> m_stop{ false };
+    std::thread m_thread;
+  };
+
+}
+
+#endif // VARCO_STREAMINGFILE_HPP
@@ -0,0 +1,234 @@
+#include <Document/TextBuffer.hpp>
+#include <Document/ColumnMap.hpp>
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <unordered_set>
+
+namespace varco {
+
+#define BLOCK_LINES 256 // Preferred number of lines per block (blocks are split at twice this size)
+
+  void TextBuffer::Block::append(std::string line) {
+    m_bytes += line.size() + 1;
+    m_plain.push_back(isPlainText(line.data(), line.size()));
+    m_lines.emplace_back(std::move(line));
+  }
+
+  TextBuffer::TextBuffer(std::vector<std::string> lines) {
+    for (size_t i = 0; i < lines.size(); i += BLOCK_LINES) {
+      auto block = std::make_shared<Block>();
+      size_t end = std::min(lines.size(), i + BLOCK_LINES);
+      block->m_lines.reserve(end - i);
+      block->m_plain.reserve(end - i);
+      for (size_t j = i; j < end; ++j)
+        block->append(std::move(lines[j]));
+      m_blocks.emplace_back(std::move(block));
+    }
+    reindex();
+  }
+
+  size_t TextBuffer::getLineCount() const {
+    return m_blockLines.total();
+  }
+
+  size_t TextBuffer::getByteCount() const {
+    size_t bytes = m_blockBytes.total();
+    return bytes > 0 ? bytes - 1 : 0; // No newline after the last line
+  }
+
+  std::pair<size_t, size_t> TextBuffer::locate(size_t line) const {
+    size_t block = m_blockLines.upperBound(line);
+    return { block, line - m_blockLines.prefixSum(block) };
+  }
+
+  const std::string& TextBuffer::getLine(size_t line) const {
+    auto position = locate(line);
+    return m_blocks[position.first]->m_lines[position.second];
+  }
+
+  bool TextBuffer::isPlain(size_t line) const {
+    auto position = locate(line);
+    return m_blocks[position.first]->m_plain[position.second];
+  }
+
+  size_t TextBuffer::getLineStartOffset(size_t line) const {
+    if (line >= getLineCount())
+      return m_blockBytes.total();
+    auto position = locate(line);
+    size_t offset = m_blockBytes.prefixSum(position.first);
+    const auto& lines = m_blocks[position.first]->m_lines;
+    for (size_t i = 0; i < position.second; ++i)
+      offset += lines[i].size() + 1;
+    return offset;
+  }
+
+  size_t TextBuffer::getLineAtOffset(size_t offset) const {
+    size_t block = m_blockBytes.upperBound(offset);
+    if (block >= m_blocks.size())
+      return getLineCount() > 0 ? getLineCount() - 1 : 0;
+    size_t line = m_blockLines.prefixSum(block);
+    offset -= m_blockBytes.prefixSum(block);
+    for (const auto& text : m_blocks[block]->m_lines) {
+      if (offset <= text.size())
+        break;
+      offset -= text.size() + 1;
+      ++line;
+    }
+    return line;
+  }
+
+  std::string TextBuffer::getText() const {
+    std::string text;
+    text.reserve(getByteCount());
+    for (const auto& block : m_blocks) {
+      for (const auto& line : block->m_lines) {
+        text.append(line);
+        text += '\n';
+      }
+    }
+    if (!text.empty())
+      text.pop_back();
+    return text;
+  }
+
+  size_t TextBuffer::getUnsharedBytes(const TextBuffer& other) const {
+    std::unordered_set<const Block*> shared;
+    for (const auto& block : other.m_blocks)
+      shared.insert(block.get());
+    size_t bytes = 0;
+    for (const auto& block : m_blocks) {
+      if (shared.count(block.get()) == 0)
+        bytes += block->m_bytes;
+    }
+    return bytes;
+  }
+
+  std::string TextBuffer::getText(DocumentPosition from, DocumentPosition to) const {
+    if (from.y == to.y)
+      return getLine(from.y).substr(from.x, to.x - from.x);
+    std::string text = getLine(from.y).substr(from.x);
+    for (int line = from.y + 1; line < to.y; ++line) {
+      text += '\n';
+      text.append(getLine(line));
+    }
+    text += '\n';
+    text.append(getLine(to.y), 0, to.x);
+    return text;
+  }
+
+  TextBuffer::Block& TextBuffer::getMutableBlock(size_t block) {
+    if (m_blocks[block].use_count() > 1) // Somebody else (e.g. a render snapshot) is still reading it
+      m_blocks[block] = std::make_shared<Block>(*m_blocks[block]);
+    return *m_blocks[block];
+  }
+
+  void TextBuffer::setLine(size_t line, std::string text) {
+    auto position = locate(line);
+    Block& block = getMutableBlock(position.first);
+    std::string& target = block.m_lines[position.second];
+    long long delta = static_cast<long long>(text.size()) - static_cast<long long>(target.size());
+    block.m_plain[position.second] = isPlainText(text.data(), text.size());
+    target = std::move(text);
+    block.m_bytes += delta;
+    m_blockBytes.add(position.first, static_cast<size_t>(delta)); // Unsigned wrap-around adds up correctly
+  }
+
+  void TextBuffer::insertLines(size_t line, std::vector<std::string> lines) {
+    if (lines.empty())
+      return;
+
+    size_t blockIndex, indexInBlock;
+    if (m_blocks.empty()) {
+      m_blocks.emplace_back(std::make_shared<Block>());
+      blockIndex = indexInBlock = 0;
+    } else if (line >= getLineCount()) { // Append at the end of the last block
+      blockIndex = m_blocks.size() - 1;
+      indexInBlock = m_blocks.back()->m_lines.size();
+    } else {
+      std::tie(blockIndex, indexInBlock) = locate(line);
+    }
+
+    Block& block = getMutableBlock(blockIndex);
+    size_t bytes = 0;
+    std::vector<bool> plain;
+    plain.reserve(lines.size());
+    for (const auto& text : lines) {
+      bytes += text.size() + 1;
+      plain.push_back(isPlainText(text.data(), text.size()));
+    }
+    block.m_plain.insert(block.m_plain.begin() + indexInBlock, plain.begin(), plain.end());
+    block.m_lines.insert(block.m_lines.begin() + indexInBlock,
+                         std::make_move_iterator(lines.begin()), std::make_move_iterator(lines.end()));
+    block.m_bytes += bytes;
+
+    if (block.m_lines.size() > 2 * BLOCK_LINES)
+      splitBlockIfNeeded(blockIndex); // Also reindexes everything
+    else if (m_blockLines.size() != m_blocks.size())
+      reindex(); // The first block was just created
+    else {
+      m_blockLines.add(blockIndex, lines.size());
+      m_blockBytes.add(blockIndex, bytes);
+    }
+  }
+
+  void TextBuffer::eraseLines(size_t line, size_t count) {
+    while (count > 0 && line < getLineCount()) {
+      size_t blockIndex, indexInBlock;
+      std::tie(blockIndex, indexInBlock) = locate(line);
+      Block& block = getMutableBlock(blockIndex);
+
+      size_t erased = std::min(count, block.m_lines.size() - indexInBlock);
+      size_t bytes = 0;
+      for (size_t i = indexInBlock; i < indexInBlock + erased; ++i)
+        bytes += block.m_lines[i].size() + 1;
+      block.m_lines.erase(block.m_lines.begin() + indexInBlock, block.m_lines.begin() + indexInBlock + erased);
+      block.m_plain.erase(block.m_plain.begin() + indexInBlock, block.m_plain.begin() + indexInBlock + erased);
+      block.m_bytes -= bytes;
+      count -= erased;
+
+      if (block.m_lines.empty()) {
+        m_blocks.erase(m_blocks.begin() + blockIndex);
+        reindex(); // Needed by locate() at the next iteration
+      } else {
+        m_blockLines.add(blockIndex, static_cast<size_t>(0) - erased);
+        m_blockBytes.add(blockIndex, static_cast<size_t>(0) - bytes);
+      }
+    }
+  }
+
+  void TextBuffer::splitBlockIfNeeded(size_t blockIndex) {
+    std::shared_ptr<Block> block = m_blocks[blockIndex];
+    if (block->m_lines.size() <= 2 * BLOCK_LINES)
+      return;
+
+    // Split the oversized block into BLOCK_LINES-sized ones
+    std::vector<std::shared_ptr<Block>> newBlocks;
+    for (size_t i = 0; i < block->m_lines.size(); i += BLOCK_LINES) {
+      auto newBlock = std::make_shared<Block>();
+      size_t end = std::min(block->m_lines.size(), i + BLOCK_LINES);
+      for (size_t j = i; j < end; ++j) {
+        newBlock->m_bytes += block->m_lines[j].size() + 1;
+        newBlock->m_plain.push_back(block->m_plain[j]);
+        newBlock->m_lines.emplace_back(std::move(block->m_lines[j]));
+      }
+      newBlocks.emplace_back(std::move(newBlock));
+    }
+    m_blocks.erase(m_blocks.begin() + blockIndex);
+    m_blocks.insert(m_blocks.begin() + blockIndex, newBlocks.begin(), newBlocks.end());
+    reindex();
+  }
+
+  void TextBuffer::reindex() {
+    std::vector<size_t> lines, bytes;
+    lines.reserve(m_blocks.size());
+    bytes.reserve(m_blocks.size());
+    for (const auto& block : m_blocks) {
+      lines.push_back(block->m_lines.size());
+      bytes.push_back(block->m_bytes);
+    }
+    m_blockLines.rebuild(lines);
+    m_blockBytes.rebuild(bytes);
+  }
+
+}
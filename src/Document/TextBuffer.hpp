@@ -0,0 +1,107 @@
+#ifndef VARCO_TEXTBUFFER_HPP
+#define VARCO_TEXTBUFFER_HPP
+
+#include <Utils/FenwickTree.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+namespace varco {
+
+  struct DocumentPosition {
+    int x = 0; // Column (in characters) of a physical line
+    int y = 0; // Physical line
+  };
+
+  inline bool operator==(const DocumentPosition& a, const DocumentPosition& b) {
+    return a.x == b.x && a.y == b.y;
+  }
+
+  inline bool operator<(const DocumentPosition& a, const DocumentPosition& b) {
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+  }
+
+  // The lines of a document stored in blocks of a few hundreds lines each. Lines and bytes per block are
+  // indexed by Fenwick trees so finding a line (or the line at a byte offset) is O(log n) and an edit only
+  // touches the lines of a single block, regardless of the document size.
+  //
+  // Blocks are shared among copies of a buffer and cloned only when modified (copy-on-write): taking a
+  // snapshot of the document for a render request costs a pointer per block instead of a copy of the text
+  class TextBuffer {
+  public:
+    TextBuffer() = default;
+    explicit TextBuffer(std::vector<std::string> lines);
+
+    size_t getLineCount() const;
+    size_t getByteCount() const; // Lines are separated by a single '\n'
+    const std::string& getLine(size_t line) const;
+    // ASCII without tabs: a column per byte, layouts skip mapping it (see ColumnMap.hpp). Tracked for every
+    // line as it's stored, lines are never scanned again to know
+    bool isPlain(size_t line) const;
+    size_t getLineStartOffset(size_t line) const; // Absolute byte offset where a line begins
+    size_t getLineAtOffset(size_t offset) const;
+    std::string getText() const;
+    std::string getText(DocumentPosition from, DocumentPosition to) const; // Positions must be valid
+    size_t getUnsharedBytes(const TextBuffer& other) const; // Of the blocks which aren't shared with 'other'
+
+    // Calls f(line, text) for the lines in [first, last) walking the blocks directly (no lookup per line).
+    // Stops early if f returns false
+    template <typename Function>
+    void forEachLine(size_t first, size_t last, Function f) const {
+      if (first >= last || first >= getLineCount())
+        return;
+      auto position = locate(first);
+      size_t line = first;
+      for (size_t block = position.first; block < m_blocks.size(); ++block) {
+        const auto& lines = m_blocks[block]->m_lines;
+        for (size_t i = (block == position.first) ? position.second : 0; i < lines.size(); ++i, ++line) {
+          if (line >= last || !f(line, lines[i]))
+            return;
+        }
+      }
+    }
+
+    // Same as above a block at a time: calls f(firstLine, begin, end) with the lines of [first, last) in a block
+    // as a range of std::string. Stops early if f returns false
+    template <typename Function>
+    void forEachBlock(size_t first, size_t last, Function f) const {
+      if (first >= last || first >= getLineCount())
+        return;
+      auto position = locate(first);
+      size_t line = first;
+      for (size_t block = position.first; block < m_blocks.size() && line < last; ++block) {
+        const auto& lines = m_blocks[block]->m_lines;
+        auto begin = lines.begin() + ((block == position.first) ? position.second : 0);
+        auto end = begin + std::min<size_t>(lines.end() - begin, last - line);
+        if (!f(line, begin, end))
+          return;
+        line += end - begin;
+      }
+    }
+
+    void setLine(size_t line, std::string text);
+    void insertLines(size_t line, std::vector<std::string> lines); // Inserted before 'line'
+    void eraseLines(size_t line, size_t count);
+
+  private:
+    struct Block {
+      std::vector<std::string> m_lines;
+      std::vector<bool> m_plain; // A bit per line (see isPlain())
+      size_t m_bytes = 0; // Sum of the lines' sizes plus a newline for each of them
+      void append(std::string line);
+    };
+
+    std::pair<size_t, size_t> locate(size_t line) const; // { block, line index in the block }
+    Block& getMutableBlock(size_t block); // Clones the block if it's shared with another buffer
+    void splitBlockIfNeeded(size_t block);
+    void reindex(); // O(number of blocks), only needed when blocks are added or removed
+
+    std::vector<std::shared_ptr<Block>> m_blocks;
+    FenwickTree<size_t> m_blockLines;
+    FenwickTree<size_t> m_blockBytes;
+  };
+
+}
+
+#endif // VARCO_TEXTBUFFER_HPP
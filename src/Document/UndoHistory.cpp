@@ -0,0 +1,243 @@
+#include <Document/UndoHistory.hpp>
+#include <algorithm>
+#include <cctype>
+
+namespace varco {
+
+#define CHECKPOINT_INTERVAL 256 // Operations between two checkpoints
+#define MAX_CHECKPOINTS 16 // Checkpoints pin the blocks edited afterwards, don't keep too many
+#define COALESCE_TIMEOUT std::chrono::milliseconds(1000) // Keystrokes further apart are separate operations
+#define DEFAULT_MEMORY_BUDGET (64u * 1024u * 1024u)
+
+  namespace {
+    // Where the end of 'text' lands if it's inserted at 'position'
+    DocumentPosition advance(DocumentPosition position, const std::string& text) {
+      for (char c : text) {
+        if (c == '\n') {
+          ++position.y;
+          position.x = 0;
+        } else
+          ++position.x;
+      }
+      return position;
+    }
+
+    bool hasNewline(const std::string& text) {
+      return text.find('\n') != std::string::npos;
+    }
+  }
+
+  UndoHistory::UndoHistory() :
+    m_memoryBudget(DEFAULT_MEMORY_BUDGET)
+  {}
+
+  // A new edit discards whatever could have been redone
+  void UndoHistory::discardRedoable() {
+    size_t applied = m_current - m_firstIndex;
+    for (size_t i = applied; i < m_operations.size(); ++i)
+      m_bytes -= getOperationBytes(m_operations[i]);
+    m_operations.erase(m_operations.begin() + applied, m_operations.end());
+    while (!m_checkpoints.empty() && m_checkpoints.back().m_index > m_current) {
+      m_checkpointBytes -= m_checkpoints.back().m_bytes;
+      m_checkpoints.pop_back();
+      if (!m_checkpoints.empty()) { // The newest one again
+        m_checkpointBytes -= m_checkpoints.back().m_bytes;
+        m_checkpoints.back().m_bytes = 0;
+      }
+    }
+  }
+
+  // Checkpoints are only taken between two steps, never in the middle of a batch. The blocks edited since the
+  // previous one was taken are kept by it alone from now on: they're counted in the budget
+  void UndoHistory::addCheckpointIfNeeded(const TextBuffer& before) {
+    size_t lastCheckpoint = m_checkpoints.empty() ? m_firstIndex : m_checkpoints.back().m_index;
+    if (m_current - lastCheckpoint >= CHECKPOINT_INTERVAL) {
+      if (!m_checkpoints.empty()) {
+        Checkpoint& previous = m_checkpoints.back();
+        previous.m_bytes = previous.m_buffer.getUnsharedBytes(before);
+        m_checkpointBytes += previous.m_bytes;
+      }
+      m_checkpoints.push_back({ m_current, before, 0 });
+      if (m_checkpoints.size() > MAX_CHECKPOINTS)
+        dropOldestCheckpoint();
+    }
+  }
+
+  void UndoHistory::dropOldestCheckpoint() {
+    m_checkpointBytes -= m_checkpoints.front().m_bytes;
+    m_checkpoints.pop_front();
+  }
+
+  void UndoHistory::record(Operation operation, const TextBuffer& before) {
+    discardRedoable();
+
+    Operation *last = getLastApplied();
+    if (last != nullptr) {
+      size_t bytes = getOperationBytes(*last);
+      if (coalesce(*last, operation)) {
+        m_bytes += getOperationBytes(*last) - bytes;
+        trim();
+        return;
+      }
+      last->m_sealed = true;
+    }
+
+    addCheckpointIfNeeded(before);
+    operation.m_batched = false;
+    m_bytes += getOperationBytes(operation);
+    m_operations.emplace_back(std::move(operation));
+    ++m_current;
+    trim();
+  }
+
+  void UndoHistory::recordBatch(std::vector<Operation> operations, const TextBuffer& before) {
+    if (operations.empty())
+      return;
+    discardRedoable();
+    seal();
+    addCheckpointIfNeeded(before);
+    for (size_t i = 0; i < operations.size(); ++i) {
+      operations[i].m_sealed = true;
+      operations[i].m_batched = (i > 0);
+      m_bytes += getOperationBytes(operations[i]);
+      m_operations.emplace_back(std::move(operations[i]));
+    }
+    m_current += operations.size();
+    trim();
+  }
+
+  // Typing and deleting (backward or forward) characters in a row make up a single operation. Lines and
+  // words (a whitespace after some text) start new ones
+  bool UndoHistory::coalesce(Operation& last, const Operation& operation) const {
+    if (last.m_sealed || operation.m_time - last.m_time > COALESCE_TIMEOUT)
+      return false;
+
+    if (last.m_removed.empty() && operation.m_removed.empty()) { // Typing
+      if (!(operation.m_from == last.m_end) || hasNewline(last.m_inserted) || hasNewline(operation.m_inserted))
+        return false;
+      if (!last.m_inserted.empty() && !operation.m_inserted.empty() &&
+          std::isspace(static_cast<unsigned char>(operation.m_inserted.front())) &&
+          !std::isspace(static_cast<unsigned char>(last.m_inserted.back())))
+        return false;
+      last.m_inserted += operation.m_inserted;
+      last.m_end = operation.m_end;
+    } else if (last.m_inserted.empty() && operation.m_inserted.empty()) {
+      if (operation.m_to == last.m_from) { // Backspace
+        last.m_removed = operation.m_removed + last.m_removed;
+        last.m_from = operation.m_from;
+        last.m_end = operation.m_from;
+      } else if (operation.m_from == last.m_from) { // Delete: what follows in the text before 'last' is removed
+        last.m_to = advance(last.m_to, operation.m_removed);
+        last.m_removed += operation.m_removed;
+      } else
+        return false;
+    } else
+      return false;
+
+    last.m_time = operation.m_time;
+    return true;
+  }
+
+  UndoHistory::Operation* UndoHistory::getLastApplied() {
+    if (m_current == m_firstIndex)
+      return nullptr;
+    return &m_operations[m_current - m_firstIndex - 1];
+  }
+
+  void UndoHistory::seal() {
+    Operation *last = getLastApplied();
+    if (last != nullptr)
+      last->m_sealed = true;
+  }
+
+  void UndoHistory::clear() {
+    m_operations.clear();
+    m_checkpoints.clear();
+    m_firstIndex = m_current = 0;
+    m_bytes = 0;
+    m_checkpointBytes = 0;
+  }
+
+  bool UndoHistory::canUndo() const {
+    return m_current > m_firstIndex;
+  }
+
+  bool UndoHistory::canRedo() const {
+    return m_current < m_firstIndex + m_operations.size();
+  }
+
+  size_t UndoHistory::getUndoCount() const {
+    return m_current - m_firstIndex;
+  }
+
+  std::vector<UndoHistory::Operation> UndoHistory::undo() {
+    seal();
+    size_t first = getLastStepStart();
+    std::vector<Operation> operations(m_operations.begin() + (first - m_firstIndex),
+                                      m_operations.begin() + (m_current - m_firstIndex));
+    m_current = first;
+    return operations;
+  }
+
+  std::vector<UndoHistory::Operation> UndoHistory::redo() {
+    std::vector<Operation> operations;
+    do {
+      Operation& operation = m_operations[m_current - m_firstIndex];
+      operation.m_sealed = true;
+      operations.push_back(operation);
+      ++m_current;
+    } while (canRedo() && m_operations[m_current - m_firstIndex].m_batched);
+    return operations;
+  }
+
+  size_t UndoHistory::getLastStepStart() const {
+    size_t first = m_current;
+    while (first > m_firstIndex && (first == m_current || m_operations[first - m_firstIndex].m_batched))
+      --first;
+    return first;
+  }
+
+  size_t UndoHistory::rewindToCheckpoint(size_t steps, TextBuffer& buffer) {
+    if (steps <= CHECKPOINT_INTERVAL)
+      return 0; // Replaying the operations is cheaper than rendering the whole document again
+    size_t target = m_current - std::min(steps, getUndoCount());
+    for (const auto& checkpoint : m_checkpoints) { // The first one is the closest to the target
+      if (checkpoint.m_index >= target && checkpoint.m_index < m_current) {
+        size_t rewound = 0; // Steps, a batch counts as one
+        for (size_t i = checkpoint.m_index; i < m_current; ++i)
+          rewound += m_operations[i - m_firstIndex].m_batched ? 0 : 1;
+        buffer = checkpoint.m_buffer;
+        m_current = checkpoint.m_index;
+        seal();
+        return rewound;
+      }
+    }
+    return 0;
+  }
+
+  void UndoHistory::setMemoryBudget(size_t bytes) {
+    m_memoryBudget = bytes;
+    trim();
+  }
+
+  size_t UndoHistory::getOperationBytes(const Operation& operation) const {
+    return sizeof(Operation) + operation.m_removed.size() + operation.m_inserted.size();
+  }
+
+  // Drops the oldest checkpoints (they only speed up undoing many steps at once), then the oldest operations
+  // until the log fits in the budget. The latest applied step is always kept, even if it's bigger than the
+  // whole budget (e.g. a huge paste must be undoable), and batches are never dropped halfway
+  void UndoHistory::trim() {
+    while (m_bytes + m_checkpointBytes > m_memoryBudget && m_checkpointBytes > 0)
+      dropOldestCheckpoint();
+    const size_t lastStep = getLastStepStart();
+    while (m_firstIndex < lastStep && (m_bytes > m_memoryBudget || m_operations.front().m_batched)) {
+      m_bytes -= getOperationBytes(m_operations.front());
+      m_operations.pop_front();
+      ++m_firstIndex;
+    }
+    while (!m_checkpoints.empty() && m_checkpoints.front().m_index < m_firstIndex)
+      dropOldestCheckpoint();
+  }
+
+}
@@ -0,0 +1,88 @@
+#ifndef VARCO_UNDOHISTORY_HPP
+#define VARCO_UNDOHISTORY_HPP
+
+#include <Document/TextBuffer.hpp>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace varco {
+
+  // The edits of a document as a log of operations, each one storing only the text it removed and the
+  // text it inserted: undoing or redoing costs as much as the change itself, never as much as the document.
+  //
+  // Consecutive keystrokes are coalesced into a single operation. Every few operations a checkpoint of the
+  // text is kept (a TextBuffer copy, which shares all its blocks until they're edited) so that undoing many
+  // steps at once restores the closest checkpoint and replays only a handful of operations.
+  // The oldest checkpoints, then the oldest operations, are dropped when the log exceeds its memory budget. A
+  // checkpoint costs the blocks it alone keeps: those edited before the next one was taken.
+  //
+  // The edits made at several carets at once are recorded as a batch: a single step which is undone and
+  // redone as a whole. Its operations are stored as if they were applied one after the other, first to last
+  class UndoHistory {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Operation {
+      DocumentPosition m_from;
+      DocumentPosition m_to;  // End of the removed text (before the operation)
+      DocumentPosition m_end; // End of the inserted text (after the operation)
+      std::string m_removed;
+      std::string m_inserted;
+      DocumentPosition m_caretBefore;
+      Clock::time_point m_time;
+      bool m_sealed = false; // Can't be extended anymore
+      bool m_batched = false; // Undone and redone together with the operation before it
+    };
+
+    UndoHistory();
+
+    // 'before' is the text the operation is about to be applied to
+    void record(Operation operation, const TextBuffer& before);
+    void recordBatch(std::vector<Operation> operations, const TextBuffer& before); // Never coalesced
+    void seal(); // The next operation won't be coalesced with the last one (e.g. the caret was moved)
+    void clear();
+
+    bool canUndo() const;
+    bool canRedo() const;
+    // The operations of the step to revert (or to apply again), in the order they were applied
+    std::vector<Operation> undo();
+    std::vector<Operation> redo();
+
+    // Number of undoable operations
+    size_t getUndoCount() const;
+    // Finds the closest checkpoint between 'steps' undos from here and the current state. Returns how many
+    // steps it's away from the current state (0 if there's none) and moves there: the caller restores 'buffer'
+    size_t rewindToCheckpoint(size_t steps, TextBuffer& buffer);
+
+    void setMemoryBudget(size_t bytes);
+
+  private:
+    struct Checkpoint {
+      size_t m_index; // Number of operations applied to reach this text (absolute)
+      TextBuffer m_buffer;
+      size_t m_bytes; // Of its blocks not shared with the next checkpoint (0 for the newest one)
+    };
+
+    bool coalesce(Operation& last, const Operation& operation) const;
+    Operation* getLastApplied();
+    void discardRedoable();
+    void addCheckpointIfNeeded(const TextBuffer& before);
+    void dropOldestCheckpoint();
+    size_t getLastStepStart() const; // Absolute index of the first operation of the last applied step
+    size_t getOperationBytes(const Operation& operation) const;
+    void trim();
+
+    std::deque<Operation> m_operations;
+    std::deque<Checkpoint> m_checkpoints; // Sorted by index
+    size_t m_firstIndex = 0; // Absolute index of m_operations.front() (older ones were dropped)
+    size_t m_current = 0;    // Absolute index of the next operation to redo, i.e. operations applied
+    size_t m_bytes = 0;
+    size_t m_checkpointBytes = 0; // Sum of the checkpoints' m_bytes
+    size_t m_memoryBudget;
+  };
+
+}
+
+#endif // VARCO_UNDOHISTORY_HPP
@@ -1,5 +1,6 @@
 #include <Lexers/CPPLexer.hpp>
-#include <regex>
+#include <stdexcept>
+#include <algorithm>
 #include <string>
 
 namespace varco {
@@ -8,7 +9,7 @@ namespace varco {
 
     // Detects if a token is a whitespace or newline character
     bool isWhitespace(const char c) {
-      if (c == ' ' || c == '\n' || c == '\r')
+      if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
         return true;
       else
         return false;
@@ -104,12 +105,19 @@ namespace varco {
       set.emplace("nullptr");
     }
 
-
+    // Appends the entries of the lines [from, to) of a per-line map, moved by 'lineShift' lines and their values
+    // by 'valueShift' (both wrap around if negative)
+    void copyLines(const std::map<size_t, size_t>& source, size_t from, size_t to, size_t lineShift, size_t valueShift,
+                   std::map<size_t, size_t>& destination) {
+      for (auto it = source.lower_bound(from); it != source.end() && it->first < to; ++it)
+        destination.emplace_hint(destination.end(), it->first + lineShift, it->second + valueShift);
+    }
 
   }
 
   CPPLexer::CPPLexer() :
-    LexerBase(CPPLexerType)
+    LexerBase(CPPLexerType),
+    m_literalMatcher(Regex::compile("\\d+[uUlL]?[ull]?[ULL]?[UL]?[ul]?[ll]?[LL]?|0[xbX][\\da-fA-F]+"))
   {
     populateReservedKeywords(m_reservedKeywords);
     m_classKeywordActiveOnScope = -2;
@@ -121,18 +129,32 @@ namespace varco {
     std::stack<int> empty;
     std::swap(m_scopesStack, empty); // Dumb clearing mechanism
     m_adaptPreviousSegments.clear();
+    m_openBrackets.clear();
+    m_openConditionals.clear();
   }
 
   void CPPLexer::lexInput(std::string input, StyleDatabase& sdb) {
 
-    str = &input;
-    sdb.styleSegment.clear(); // Relex everything // TODO - lex from a position forward?
+    LexerInput text(std::move(input));
+    str = &text;
+    sdb.styleSegment.clear(); // Relex everything (see relexInput() to lex from a line forward)
+    sdb.firstSegmentOnLine.clear();
+    sdb.lastSegmentOnLine.clear();
+    sdb.previousSegment.clear();
+    sdb.m_absOffsetWhereLineBegins.clear();
+    sdb.m_brackets = BracketIndex();
+    sdb.m_foldRegions.clear();
+    sdb.m_checkpoints.clear();
+    sdb.m_checkpointStates.clear();
     styleDb = &sdb;
+    lastSegmentIndex = -1;
     pos = 0;
     curLine = 0;
     curLinePos = 0;
     styleDb->previousSegment[0] = -1;
     styleDb->m_absOffsetWhereLineBegins[0] = 0;
+    m_previous = nullptr;
+    addCheckpoint();
 
     try {
       globalScope();
@@ -140,6 +162,96 @@ namespace varco {
     catch (...) {
       // g_debug << "Parsing terminated!";
     }
+
+    buildBracketLineIndex();
+    std::sort(sdb.m_foldRegions.begin(), sdb.m_foldRegions.end(), [](const FoldRegion& a, const FoldRegion& b) {
+      return a.m_firstLine < b.m_firstLine || (a.m_firstLine == b.m_firstLine && a.m_lastLine > b.m_lastLine);
+    });
+    m_openConditionals.clear();
+  }
+
+  // Lexing resumes from the last checkpoint before the edit, with what was found before it. At every line of the
+  // global scope after the edit the lexer compares its state with the one it had at the same line of the old
+  // text: once they're the same (and nothing found since lexing resumed is still open) the rest of the text is
+  // lexed the same way as before and is taken from the previous result
+  bool CPPLexer::relexInput(const LexerInput::LineSource& lines, const StyleDatabase& previous, size_t firstLine,
+                            size_t oldCount, size_t newCount, StyleDatabase& sdb, size_t& firstLexed, size_t& endLexed) {
+    const auto& checkpoints = previous.m_checkpoints;
+    auto resume = std::upper_bound(checkpoints.begin(), checkpoints.end(), firstLine,
+                                   [](size_t line, const StyleDatabase::Checkpoint& checkpoint) {
+      return line < checkpoint.m_line;
+    });
+    if (resume == checkpoints.begin())
+      return false; // Not lexed by this lexer
+    --resume;
+
+    // Everything found before the checkpoint stays, except the matches of the brackets still open there
+    sdb.styleSegment.assign(previous.styleSegment.begin(), previous.styleSegment.begin() + resume->m_segments);
+    sdb.firstSegmentOnLine.clear();
+    sdb.lastSegmentOnLine.clear();
+    sdb.previousSegment.clear();
+    sdb.m_absOffsetWhereLineBegins.clear();
+    copyLines(previous.firstSegmentOnLine, 0, resume->m_line, 0, 0, sdb.firstSegmentOnLine);
+    copyLines(previous.lastSegmentOnLine, 0, resume->m_line, 0, 0, sdb.lastSegmentOnLine);
+    copyLines(previous.previousSegment, 0, resume->m_line, 0, 0, sdb.previousSegment);
+    copyLines(previous.m_absOffsetWhereLineBegins, 0, resume->m_line, 0, 0, sdb.m_absOffsetWhereLineBegins);
+    sdb.m_brackets = BracketIndex();
+    auto& brackets = sdb.m_brackets.m_brackets;
+    brackets.assign(previous.m_brackets.m_brackets.begin(), previous.m_brackets.m_brackets.begin() + resume->m_brackets);
+    for (auto& bracket : brackets) {
+      if (bracket.m_match != BracketIndex::NO_MATCH && bracket.m_match >= resume->m_brackets)
+        bracket.m_match = BracketIndex::NO_MATCH; // Paired again below
+    }
+    sdb.m_foldRegions.clear();
+    for (const auto& region : previous.m_foldRegions) {
+      if (region.m_lastLine < resume->m_line)
+        sdb.m_foldRegions.push_back(region);
+    }
+    const size_t resumeIndex = static_cast<size_t>(resume - checkpoints.begin());
+    const size_t stateEnd = (resumeIndex + 1 < checkpoints.size()) ? checkpoints[resumeIndex + 1].m_state :
+                                                                     previous.m_checkpointStates.size();
+    sdb.m_checkpoints.assign(checkpoints.begin(), resume + 1);
+    sdb.m_checkpointStates.assign(previous.m_checkpointStates.begin(), previous.m_checkpointStates.begin() + stateEnd);
+
+    reset();
+    restoreState(previous.m_checkpointStates.data() + resume->m_state);
+    LexerInput text(lines, resume->m_line, resume->m_offset);
+    str = &text;
+    styleDb = &sdb;
+    lastSegmentIndex = resume->m_segments - 1; // Wraps around if there are none
+    pos = resume->m_offset;
+    curLine = resume->m_line;
+    curLinePos = resume->m_offset;
+    styleDb->previousSegment[curLine] = lastSegmentIndex;
+    styleDb->m_absOffsetWhereLineBegins[curLine] = curLinePos;
+    m_lastCheckpointLine = curLine;
+
+    m_previous = &previous;
+    m_syncLine = firstLine + newCount;
+    m_previousSyncLine = firstLine + oldCount;
+    m_syncCheckpoint = resumeIndex + 1;
+    m_resumeLine = resume->m_line;
+    m_resumeBrackets = resume->m_brackets;
+    m_synced = false;
+
+    try {
+      globalScope();
+    }
+    catch (...) {
+      // g_debug << "Parsing terminated!";
+    }
+    m_previous = nullptr;
+
+    firstLexed = m_resumeLine;
+    endLexed = m_synced ? curLine : SIZE_MAX;
+    if (m_synced) // Up to the last line of the old text
+      curLine = std::max<size_t>(previous.m_brackets.m_firstOnLine.size(), 2) - 2 + m_syncLine - m_previousSyncLine;
+    buildBracketLineIndex();
+    std::sort(sdb.m_foldRegions.begin(), sdb.m_foldRegions.end(), [](const FoldRegion& a, const FoldRegion& b) {
+      return a.m_firstLine < b.m_firstLine || (a.m_firstLine == b.m_firstLine && a.m_lastLine > b.m_lastLine);
+    });
+    m_openConditionals.clear();
+    return true;
   }
 
 
@@ -178,6 +290,184 @@ namespace varco {
     }
   }
 
+  // Utility function: records the bracket at position pos and pairs it with the last open one if it closes it.
+  // A closing bracket which doesn't match the last open one stays unmatched (the open one keeps waiting)
+  void CPPLexer::addBracket(size_t pos) {
+    auto& brackets = styleDb->m_brackets.m_brackets;
+    char c = str->at(pos);
+    BracketIndex::Bracket bracket;
+    bracket.m_line = static_cast<uint32_t>(curLine);
+    bracket.m_column = static_cast<uint32_t>(pos - curLinePos);
+    bracket.m_match = BracketIndex::NO_MATCH;
+    bracket.m_depth = static_cast<uint16_t>(std::min<size_t>(m_openBrackets.size(), UINT16_MAX));
+    bracket.m_character = c;
+
+    uint32_t index = static_cast<uint32_t>(brackets.size());
+    if (c == '(' || c == '[' || c == '{')
+      m_openBrackets.push_back(index);
+    else if (!m_openBrackets.empty()) {
+      auto& open = brackets[m_openBrackets.back()];
+      if ((open.m_character == '(' && c == ')') || (open.m_character == '[' && c == ']') ||
+          (open.m_character == '{' && c == '}')) {
+        open.m_match = index;
+        bracket.m_match = m_openBrackets.back();
+        bracket.m_depth = open.m_depth;
+        m_openBrackets.pop_back();
+        if (c == '}')
+          addFoldRegion(open.m_line, curLine);
+      }
+    }
+    brackets.push_back(bracket);
+  }
+
+  // Groups the brackets by line once lexing is over
+  void CPPLexer::buildBracketLineIndex() {
+    auto& index = styleDb->m_brackets;
+    index.m_firstOnLine.assign(curLine + 2, 0);
+    for (const auto& bracket : index.m_brackets)
+      ++index.m_firstOnLine[bracket.m_line + 1];
+    for (size_t i = 1; i < index.m_firstOnLine.size(); ++i)
+      index.m_firstOnLine[i] += index.m_firstOnLine[i - 1];
+    m_openBrackets.clear();
+  }
+
+  void CPPLexer::addFoldRegion(size_t firstLine, size_t lastLine) {
+    if (lastLine > firstLine) // Nothing to collapse otherwise
+      styleDb->m_foldRegions.push_back({ static_cast<uint32_t>(firstLine), static_cast<uint32_t>(lastLine) });
+  }
+
+#define CHECKPOINT_LINES 16 // Lines between two checkpoints at least: fewer checkpoints, more lines lexed again
+
+  // At the beginning of a line of the global scope: lexing can resume from here later unless some segments might
+  // still change style. False if lexing is back in sync with the previous result (which was appended)
+  bool CPPLexer::lineBegins() {
+    if (!m_adaptPreviousSegments.empty())
+      return true;
+    if (m_previous && curLine >= m_syncLine) {
+      const auto& checkpoints = m_previous->m_checkpoints;
+      const size_t previousLine = curLine - m_syncLine + m_previousSyncLine;
+      while (m_syncCheckpoint < checkpoints.size() && checkpoints[m_syncCheckpoint].m_line < previousLine)
+        ++m_syncCheckpoint;
+      if (m_syncCheckpoint < checkpoints.size() && checkpoints[m_syncCheckpoint].m_line == previousLine &&
+          isInSync(checkpoints[m_syncCheckpoint])) {
+        appendPrevious(m_syncCheckpoint);
+        return false;
+      }
+    }
+    if (curLine >= m_lastCheckpointLine + CHECKPOINT_LINES)
+      addCheckpoint();
+    return true;
+  }
+
+  void CPPLexer::addCheckpoint() {
+    styleDb->m_checkpoints.push_back({ curLine, curLinePos, styleDb->styleSegment.size(), styleDb->m_brackets.m_brackets.size(),
+                                       styleDb->m_checkpointStates.size() });
+    saveState(styleDb->m_checkpointStates);
+    m_lastCheckpointLine = curLine;
+  }
+
+  // The class scope, the depth of the scopes stack (it holds 0, 1, .. depth - 1), then the open brackets and
+  // the lines of the open conditionals, each preceded by their count
+  void CPPLexer::saveState(std::vector<uint32_t>& state) const {
+    state.push_back(static_cast<uint32_t>(m_classKeywordActiveOnScope));
+    state.push_back(static_cast<uint32_t>(m_scopesStack.size()));
+    state.push_back(static_cast<uint32_t>(m_openBrackets.size()));
+    state.insert(state.end(), m_openBrackets.begin(), m_openBrackets.end());
+    state.push_back(static_cast<uint32_t>(m_openConditionals.size()));
+    state.insert(state.end(), m_openConditionals.begin(), m_openConditionals.end());
+  }
+
+  void CPPLexer::restoreState(const uint32_t *state) {
+    m_classKeywordActiveOnScope = static_cast<int>(state[0]);
+    for (uint32_t i = 0; i < state[1]; ++i)
+      m_scopesStack.push(static_cast<int>(i));
+    state += 2;
+    m_openBrackets.assign(state + 1, state + 1 + state[0]);
+    state += 1 + state[0];
+    m_openConditionals.assign(state + 1, state + 1 + state[0]);
+  }
+
+  // The lexer is in the same state as it was at a checkpoint of the previous result, and the brackets and
+  // conditionals still open were all found before lexing resumed: the same ones as back then
+  bool CPPLexer::isInSync(const StyleDatabase::Checkpoint& checkpoint) {
+    for (auto bracket : m_openBrackets) {
+      if (bracket >= m_resumeBrackets)
+        return false;
+    }
+    for (auto line : m_openConditionals) {
+      if (line >= m_resumeLine)
+        return false;
+    }
+    m_state.clear();
+    saveState(m_state);
+    const auto& states = m_previous->m_checkpointStates;
+    return states.size() - checkpoint.m_state >= m_state.size() &&
+           std::equal(m_state.begin(), m_state.end(), states.begin() + checkpoint.m_state);
+  }
+
+  // Everything the previous lexing found from a checkpoint on, moved to the current line and after what was
+  // found so far. The brackets still open at the checkpoint get their matches back
+  void CPPLexer::appendPrevious(size_t checkpoint) {
+    const StyleDatabase& previous = *m_previous;
+    const StyleDatabase::Checkpoint& from = previous.m_checkpoints[checkpoint];
+    auto& brackets = styleDb->m_brackets.m_brackets;
+    const size_t lineShift = curLine - from.m_line; // All of them wrap around if negative
+    const size_t offsetShift = curLinePos - from.m_offset;
+    const size_t segmentShift = styleDb->styleSegment.size() - from.m_segments;
+    const size_t bracketShift = brackets.size() - from.m_brackets;
+
+    for (size_t i = from.m_segments; i < previous.styleSegment.size(); ++i) {
+      const auto& segment = previous.styleSegment[i];
+      styleDb->styleSegment.emplace_back(segment.line + lineShift, segment.start, segment.count,
+                                         segment.absStartPos + offsetShift, segment.style);
+    }
+    copyLines(previous.firstSegmentOnLine, from.m_line, SIZE_MAX, lineShift, segmentShift, styleDb->firstSegmentOnLine);
+    copyLines(previous.lastSegmentOnLine, from.m_line, SIZE_MAX, lineShift, segmentShift, styleDb->lastSegmentOnLine);
+    copyLines(previous.previousSegment, from.m_line, SIZE_MAX, lineShift, segmentShift, styleDb->previousSegment);
+    copyLines(previous.m_absOffsetWhereLineBegins, from.m_line, SIZE_MAX, lineShift, offsetShift,
+              styleDb->m_absOffsetWhereLineBegins);
+
+    for (size_t i = from.m_brackets; i < previous.m_brackets.m_brackets.size(); ++i) {
+      BracketIndex::Bracket bracket = previous.m_brackets.m_brackets[i];
+      bracket.m_line = static_cast<uint32_t>(bracket.m_line + lineShift);
+      if (bracket.m_match != BracketIndex::NO_MATCH && bracket.m_match >= from.m_brackets)
+        bracket.m_match = static_cast<uint32_t>(bracket.m_match + bracketShift);
+      else if (bracket.m_match != BracketIndex::NO_MATCH) // Closes one still open at the checkpoint
+        brackets[bracket.m_match].m_match = static_cast<uint32_t>(brackets.size());
+      brackets.push_back(bracket);
+    }
+    for (const auto& region : previous.m_foldRegions) {
+      if (region.m_lastLine >= from.m_line)
+        addFoldRegion(region.m_firstLine >= from.m_line ? region.m_firstLine + lineShift : region.m_firstLine,
+                      region.m_lastLine + lineShift);
+    }
+
+    const auto& states = previous.m_checkpointStates;
+    auto& newStates = styleDb->m_checkpointStates;
+    for (size_t i = checkpoint; i < previous.m_checkpoints.size(); ++i) {
+      StyleDatabase::Checkpoint moved = previous.m_checkpoints[i];
+      const uint32_t *state = states.data() + moved.m_state;
+      moved.m_line += lineShift;
+      moved.m_offset += offsetShift;
+      moved.m_segments += segmentShift;
+      moved.m_brackets += bracketShift;
+      moved.m_state = newStates.size();
+      styleDb->m_checkpoints.push_back(moved);
+
+      newStates.push_back(state[0]);
+      newStates.push_back(state[1]);
+      const uint32_t *openBrackets = state + 2;
+      newStates.push_back(openBrackets[0]);
+      for (uint32_t j = 1; j <= openBrackets[0]; ++j)
+        newStates.push_back(static_cast<uint32_t>(openBrackets[j] >= from.m_brackets ? openBrackets[j] + bracketShift : openBrackets[j]));
+      const uint32_t *openConditionals = openBrackets + 1 + openBrackets[0];
+      newStates.push_back(openConditionals[0]);
+      for (uint32_t j = 1; j <= openConditionals[0]; ++j)
+        newStates.push_back(static_cast<uint32_t>(openConditionals[j] >= from.m_line ? openConditionals[j] + lineShift : openConditionals[j]));
+    }
+    m_synced = true;
+  }
+
   void CPPLexer::classDeclarationOrDefinition() {
     // TODO: fw decl or def
   }
@@ -186,7 +476,7 @@ namespace varco {
                                              // of a function, class (or some macro-ed stuff e.g. CALLME();) or local variables
 
     // Skip whitespaces
-    while (str->at(pos) == ' ') {
+    while (str->at(pos) == ' ' || str->at(pos) == '\t') {
       ++pos;
     }
 
@@ -223,9 +513,7 @@ namespace varco {
       else {
 
         // Or perhaps a literal (e.g. 11)
-        std::regex lit("\\d+[uUlL]?[ull]?[ULL]?[UL]?[ul]?[ll]?[LL]?");
-        std::regex lit2("0[xbX][\\da-fA-F]+");
-        if (std::regex_match(segment, lit) || std::regex_match(segment, lit2))
+        if (m_literalMatcher.matches(segment.data(), segment.size()))
           s = Literal;
 
       }
@@ -235,7 +523,7 @@ namespace varco {
       foundSegment = true;
     }
     // Skip whitespaces and stuff that we're not interested in
-    while (str->at(pos) == ' ' || str->at(pos) == '\n') {
+    while (str->at(pos) == ' ' || str->at(pos) == '\t' || str->at(pos) == '\n') {
       incrementLineNumberIfNewline(pos);
       ++pos;
     }
@@ -266,6 +554,7 @@ namespace varco {
         m_adaptPreviousSegments.clear();
       }
 
+      addBracket(pos);
       ++pos; // Eat the '('
     }
 
@@ -276,6 +565,7 @@ namespace varco {
 
     if (foundSegment == false) { // We couldn't find a normal identifier
       if (str->at(pos) == '{') { // Handle entering/exiting scopes
+        addBracket(pos);
         ++pos;
         m_scopesStack.push(static_cast<int>(m_scopesStack.size()));
 
@@ -284,6 +574,7 @@ namespace varco {
 
       }
       else if (str->at(pos) == '}') {
+        addBracket(pos);
         ++pos;
 
         if (m_scopesStack.empty())
@@ -312,6 +603,10 @@ namespace varco {
         if (str->at(pos) == ';' && m_classKeywordActiveOnScope == -1)
           m_classKeywordActiveOnScope = -2; // Deactivate the class scope override
 
+        // A '(' gets here when it directly follows another one (which was eaten above)
+        if (str->at(pos) == '(' || str->at(pos) == ')' || str->at(pos) == '[' || str->at(pos) == ']')
+          addBracket(pos);
+
         ++pos;
       }
     }
@@ -438,7 +733,7 @@ namespace varco {
     pos += 7;
 
     // Skip whitespaces
-    while (str->at(pos) == ' ') {
+    while (str->at(pos) == ' ' || str->at(pos) == '\t') {
       ++pos;
     }
 
@@ -452,7 +747,7 @@ namespace varco {
     //
 
     size_t startSegment = pos;
-    while (str->at(pos) != '(' && str->at(pos) != ' ') {
+    while (str->at(pos) != '(' && str->at(pos) != ' ' && str->at(pos) != '\t') {
       ++pos;
     }
     addSegment(curLine, startSegment - curLinePos, pos - startSegment, startSegment, Identifier);
@@ -489,9 +784,17 @@ namespace varco {
     
     // Find a preprocessor keyword after the #
     for (auto& token : preprocessorTokens) {
-      if (str->size() > pos + token.length() && (str->substr(pos, token.length()).compare(token) == 0)) {
+      if (str->has(pos + token.length()) && (str->substr(pos, token.length()).compare(token) == 0)) {
         addSegment(curLine, startSharp - curLinePos, 1 + token.length(), startSharp, Keyword);
         pos += token.length();
+
+        // Conditional blocks can be collapsed from their #if to their #endif
+        if (token.compare(0, 2, "if") == 0)
+          m_openConditionals.push_back(static_cast<uint32_t>(curLine));
+        else if (token == "endif" && !m_openConditionals.empty()) {
+          addFoldRegion(m_openConditionals.back(), curLine);
+          m_openConditionals.pop_back();
+        }
         break;
       }
     }
@@ -519,7 +822,7 @@ namespace varco {
     pos += 5;
 
     // Skip whitespaces
-    while (str->at(pos) == ' ') {
+    while (str->at(pos) == ' ' || str->at(pos) == '\t') {
       ++pos;
     }
 
@@ -529,7 +832,7 @@ namespace varco {
     }
 
     // Skip whitespaces
-    while (str->at(pos) == ' ') {
+    while (str->at(pos) == ' ' || str->at(pos) == '\t') {
       ++pos;
     }
 
@@ -548,7 +851,7 @@ namespace varco {
     pos += 8;
 
     // Skip whitespaces, a quoted string is expected
-    while (str->at(pos) == ' ') {
+    while (str->at(pos) == ' ' || str->at(pos) == '\t') {
       ++pos;
     }
 
@@ -603,6 +906,7 @@ namespace varco {
     pos += 2;
 
     addSegment(firstCurLine, segmentStart - firstCurLinePos, pos - segmentStart, segmentStart, Comment);
+    addFoldRegion(firstCurLine, curLine);
 
     return; // Return to whatever scope we were in
   }
@@ -613,10 +917,13 @@ namespace varco {
     while (true) {
 
       // Skip newlines and whitespaces
-      while (str->at(pos) == ' ' || str->at(pos) == '\r' || str->at(pos) == '\n') {
+      while (str->at(pos) == ' ' || str->at(pos) == '\t' || str->at(pos) == '\r' || str->at(pos) == '\n') {
         // addSegment(curLine, pos- curLinePos, 1, Normal); // This is not needed
+        const bool newline = (str->at(pos) == '\n');
         incrementLineNumberIfNewline(pos);
         ++pos;
+        if (newline && !lineBegins())
+          return; // The rest was lexed already (see relexInput())
       }
 
       if (str->at(pos) == '/' && str->at(pos + 1) == '*') { // Multiline C-style string
@@ -2,6 +2,7 @@
 #define VARCO_CPPLEXER_H
 
 #include <Lexers/Lexer.hpp>
+#include <Utils/Regex.hpp>
 #include <unordered_set>
 #include <string>
 #include <stack>
@@ -14,6 +15,8 @@ namespace varco {
 
     void reset() override;
     void lexInput(std::string input, StyleDatabase& sdb) override;
+    bool relexInput(const LexerInput::LineSource& lines, const StyleDatabase& previous, size_t firstLine, size_t oldCount,
+                    size_t newCount, StyleDatabase& sdb, size_t& firstLexed, size_t& endLexed) override;
 
   private:
     //// States the lexer can find itself into
@@ -21,11 +24,14 @@ namespace varco {
     //LexerStates m_state;
     std::unordered_set<std::string> m_reservedKeywords;
     std::stack<int> m_scopesStack;
+    std::vector<uint32_t> m_openBrackets; // Indices of the brackets still waiting for their match
+    std::vector<uint32_t> m_openConditionals; // Lines of the #if directives still waiting for their #endif
     int m_classKeywordActiveOnScope; // This signals that there's a 'class' keyword pending
     std::vector<int> m_adaptPreviousSegments;
+    RegexMatcher m_literalMatcher; // Numeric literals (e.g. 11, 42ul, 0xFF)
 
     // The contents of the document and the position we're lexing at
-    std::string *str;
+    LexerInput *str;
     size_t pos;
     size_t curLine, curLinePos;
     StyleDatabase *styleDb;
@@ -33,6 +39,26 @@ namespace varco {
 
     void addSegment(size_t line, size_t pos, size_t len, size_t absPos, Style style);
     void incrementLineNumberIfNewline(size_t pos);
+    void addBracket(size_t pos);
+    void buildBracketLineIndex();
+    void addFoldRegion(size_t firstLine, size_t lastLine);
+
+    // Resuming a previous lexing (see relexInput()): the result being resumed, the first line after the edit
+    // in the new text and in the old one, the checkpoint to look at next and where lexing resumed
+    const StyleDatabase *m_previous = nullptr;
+    size_t m_syncLine, m_previousSyncLine;
+    size_t m_syncCheckpoint;
+    size_t m_resumeLine, m_resumeBrackets;
+    bool m_synced;
+    size_t m_lastCheckpointLine;
+    std::vector<uint32_t> m_state; // Scratch space to compare states
+
+    bool lineBegins();
+    void addCheckpoint();
+    void saveState(std::vector<uint32_t>& state) const;
+    void restoreState(const uint32_t *state);
+    bool isInSync(const StyleDatabase::Checkpoint& checkpoint);
+    void appendPrevious(size_t checkpoint);
 
     void classDeclarationOrDefinition();
     void declarationOrDefinition();
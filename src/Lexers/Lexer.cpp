@@ -1,8 +1,65 @@
 #include <Lexers/Lexer.hpp>
 #include <Lexers/CPPLexer.hpp>
+#include <algorithm>
 
 namespace varco {
 
+  constexpr const uint32_t BracketIndex::NO_MATCH;
+
+  LexerInput::LexerInput(std::string text) : m_text(std::move(text)) {}
+
+  LexerInput::LexerInput(LineSource source, size_t firstLine, size_t offset) :
+    m_source(std::move(source)), m_nextLine(firstLine), m_offset(offset)
+  {
+    if (const std::string *line = m_source(m_nextLine)) {
+      m_text = *line;
+      ++m_nextLine;
+    } else
+      m_source = nullptr;
+  }
+
+  bool LexerInput::readUpTo(size_t pos) {
+    while (m_source && pos - m_offset >= m_text.size()) {
+      const std::string *line = m_source(m_nextLine);
+      if (line == nullptr) {
+        m_source = nullptr;
+        break;
+      }
+      m_text += '\n';
+      m_text += *line;
+      ++m_nextLine;
+    }
+    return pos - m_offset < m_text.size();
+  }
+
+  std::string LexerInput::substr(size_t pos, size_t count) {
+    if (count > 0)
+      has(pos + count - 1);
+    return m_text.substr(pos - m_offset, count);
+  }
+
+  bool LexerInput::has(size_t pos) {
+    return pos - m_offset < m_text.size() || readUpTo(pos);
+  }
+
+  uint32_t BracketIndex::find(size_t line, size_t column) const {
+    if (line + 1 >= m_firstOnLine.size())
+      return NO_MATCH;
+    auto first = m_brackets.begin() + m_firstOnLine[line];
+    auto last = m_brackets.begin() + m_firstOnLine[line + 1];
+    auto it = std::lower_bound(first, last, column, [](const Bracket& bracket, size_t column) {
+      return bracket.m_column < column;
+    });
+    if (it == last || it->m_column != column)
+      return NO_MATCH;
+    return static_cast<uint32_t>(it - m_brackets.begin());
+  }
+
+  bool LexerBase::relexInput(const LexerInput::LineSource&, const StyleDatabase&, size_t, size_t, size_t, StyleDatabase&,
+                             size_t&, size_t&) {
+    return false; // Not supported
+  }
+
   LexerBase* LexerBase::createLexerOfType(LexerType t) {
     switch (t) {
     case CPPLexerType: {
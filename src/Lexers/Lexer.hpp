@@ -3,6 +3,11 @@
 
 #include <vector>
 #include <map>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <functional>
+#include <stdexcept>
 
 namespace varco {
 
@@ -28,6 +33,31 @@ namespace varco {
     CPP_include
   };
 
+  // The ()[]{} brackets found by a lexer (not the ones in comments or strings) with their matching bracket
+  // and nesting depth. Brackets are stored in document order and grouped by line: finding the bracket at a
+  // position only searches the brackets of its line and its match is read directly
+  struct BracketIndex {
+    static constexpr const uint32_t NO_MATCH = UINT32_MAX;
+
+    struct Bracket {
+      uint32_t m_line;
+      uint32_t m_column;
+      uint32_t m_match; // Index of the matching bracket or NO_MATCH
+      uint16_t m_depth; // Nesting level, 0 for the outermost brackets (saturates)
+      char m_character;
+    };
+
+    std::vector<Bracket> m_brackets;
+    std::vector<uint32_t> m_firstOnLine; // Index of the first bracket of every line (one more for the end)
+
+    uint32_t find(size_t line, size_t column) const; // Index of the bracket at a position or NO_MATCH
+  };
+
+  struct FoldRegion { // Lines which can be collapsed under their first one (a scope, a #if block, a comment..)
+    uint32_t m_firstLine;
+    uint32_t m_lastLine;
+  };
+
   struct StyleDatabase {
     struct StyleSegment {
       StyleSegment(size_t l, size_t s, size_t c, size_t ap, Style st) {
@@ -52,6 +82,53 @@ namespace varco {
     std::map<size_t, size_t> lastSegmentOnLine;
     std::map<size_t, size_t> previousSegment;
     std::map<size_t, size_t> m_absOffsetWhereLineBegins;
+    BracketIndex m_brackets;
+    std::vector<FoldRegion> m_foldRegions; // Sorted by first line, outer regions first
+
+    // Lines the lexer can resume lexing from (see LexerBase::relexInput) and its state there, in a format of
+    // its own. Empty if the lexer can't resume or the database wasn't lexed (e.g. it was read from a FileCache)
+    struct Checkpoint {
+      size_t m_line;
+      size_t m_offset; // Where the line begins
+      size_t m_segments; // Segments and brackets found before the line
+      size_t m_brackets;
+      size_t m_state; // Where its state begins in m_checkpointStates
+    };
+    std::vector<Checkpoint> m_checkpoints; // Sorted by line
+    std::vector<uint32_t> m_checkpointStates;
+  };
+
+  struct StyleRun { // A styled run of characters of a physical line, as it was last rendered
+    size_t m_start;
+    size_t m_count;
+    Style m_style;
+  };
+
+  // The text a lexer reads: all of it, or the lines from one on read as the lexer gets to them. Positions are
+  // offsets in the whole text, with its lines joined by '\n'
+  class LexerInput {
+  public:
+    using LineSource = std::function<const std::string*(size_t line)>; // Null past the last line
+
+    explicit LexerInput(std::string text);
+    LexerInput(LineSource source, size_t firstLine, size_t offset); // 'offset' is where the line begins
+
+    // Like std::string::at(): throws std::out_of_range past the end of the text
+    char at(size_t pos) {
+      if (pos - m_offset >= m_text.size() && !readUpTo(pos))
+        throw std::out_of_range("End of the input");
+      return m_text[pos - m_offset];
+    }
+    std::string substr(size_t pos, size_t count); // Shorter if the text ends before
+    bool has(size_t pos); // There's a character at the position
+
+  private:
+    bool readUpTo(size_t pos); // Reads more lines until the one with the position, false if there are none
+
+    LineSource m_source;
+    size_t m_nextLine = 0;
+    size_t m_offset = 0; // Of the first character of m_text
+    std::string m_text;
   };
 
   // An abstract base class for all the Lexers to implement
@@ -66,6 +143,14 @@ namespace varco {
     virtual void reset() = 0;
     virtual void lexInput(std::string input, StyleDatabase& sdb) = 0;
 
+    // Lexes a text again after an edit replaced the lines [firstLine, firstLine + oldCount) of the text
+    // 'previous' was lexed from with 'newCount' lines. Lexing resumes before the edit and stops as soon as the
+    // lexer is back in the state it was in at the same point of the old text: the rest is taken from
+    // 'previous', moved along. The lines lexed again are [firstLexed, endLexed), endLexed is SIZE_MAX if lexing
+    // went on until the end. False if 'previous' can't be resumed (the whole text has to be lexed)
+    virtual bool relexInput(const LexerInput::LineSource& lines, const StyleDatabase& previous, size_t firstLine, size_t oldCount,
+                            size_t newCount, StyleDatabase& sdb, size_t& firstLexed, size_t& endLexed);
+
   private:
     LexerType m_type;
   };
@@ -1,86 +1,52 @@
 #include <UI/CodeView/CodeView.hpp>
 #include <Utils/Utils.hpp>
+#include <Utils/AnimationScheduler.hpp>
+#include <Document/ColumnMap.hpp>
 #include <SkCanvas.h>
-#include <SkTypeface.h>
 #include <algorithm>
+#include <climits>
+#include <cmath>
 
 #include <sstream> // DEBUG
 
 namespace varco {
 
 #define VSCROLLBAR_WIDTH 15
+#define MINIMAP_MARGIN 4 // Between the document and the minimap
+#define CARET_SHOWN_MS 500 // The caret stays fully shown this long, then fades out and in again
+#define CARET_FADE_MS 250
+#define CARET_FADE_CYCLES 20 // Without input the caret stops fading (and ticking the scheduler) after ~20 seconds
+#define ZOOM_STEP 1.1f // Per Ctrl+wheel notch
 
   CodeView::CodeView(UIElement<ui_container_tag>& parentContainer)
     : UIElement(parentContainer)
   {
-    // Create a monospace typeface
-    // An alternative approach here is to ship a standard font for every/each platform
-    // e.g. SkTypeface::MakeFromFile("/home/alex/Desktop/UbuntuMono-R.ttf");
-    const char *font_family =
-#ifdef _WIN32
-      "Consolas";
-#elif defined __linux__
-      "monospace";
-#endif
-    // Try to match with the supplied font name or family name (or closest match)
-    m_typeface = SkTypeface::MakeFromName(font_family, SkFontStyle{SkFontStyle::Weight::kNormal_Weight,
-                                                                   SkFontStyle::Width::kNormal_Width,
-                                                                   SkFontStyle::Slant::kUpright_Slant});
-
-    // Stores the width of a single character in pixels with the given font (cache this value for
-    // every document to use it) and the height of a line in pixels, plus the paint used for each of them
-    m_fontPaint.setTextSize(SkIntToScalar(m_textSize));
-    m_fontPaint.setAntiAlias(true);
-    m_fontPaint.setAutohinted(true);
-    m_fontPaint.setLCDRenderText(true);
-    m_fontPaint.setTypeface(m_typeface);
-
-    // The following is a conservative approach including kerning, hinting and antialiasing (a bit too much)
-    //SkRect bounds;
-    //m_fontPaint.measureText("A", 1, &bounds);
-    //m_characterWidthPixels = static_cast<int>(bounds.width());
-    
-    SkScalar widths[1];
-    m_fontPaint.getTextWidths("A", 1, widths);
-    m_characterWidthPixels = widths[0];
-
-    /*
-     * Here is how the font metrics work
-     *
-     * ----------------------------------------- Top
-     * _________________________________ Ascent
-     *               C
-     * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Baseline
-     * _________________________________ Descent
-     *
-     * ----------------------------------------- Bottom
-     * (leading)
-     *
-     * Notice thata character should be drawn from the baseline
-     * when drawText() is called, therefore we're also storing the Descent
-     * in order to subtract it from the line spacing before rendering.
-     *
-     */
-    m_fontPaint.getFontMetrics(&m_fontMetrics);
-    m_characterHeightPixels = m_fontMetrics.fBottom - m_fontMetrics.fTop;
+    // Fonts, metrics and paints are resolved once by the theme cache
+    m_theme = ThemeCache::get().getTheme();
+    m_characterWidthPixels = m_theme->getCharacterWidthPixels();
+    m_characterHeightPixels = m_theme->getCharacterHeightPixels();
+
+    // The caret's alpha: shown, faded out and in again for a few cycles, then shown until the next input
+    for (int i = 0; i < CARET_FADE_CYCLES; ++i) {
+      m_caretFade.addInterpolator(std::make_unique<ConstantInterpolator>(255, CARET_SHOWN_MS));
+      m_caretFade.addInterpolator(std::make_unique<LinearInterpolator>(255, 0, CARET_FADE_MS));
+      m_caretFade.addInterpolator(std::make_unique<LinearInterpolator>(0, 255, CARET_FADE_MS));
+    }
+    m_caretFade.setCycle(false);
+    m_caretFade.start();
 
     // Create the vertical scrollbar
     m_verticalScrollBar = std::make_unique<ScrollBar>(*this, [&](SkScalar value) {
-      setViewportYOffset(value);
+      if (m_document != nullptr && m_document->isStreaming())
+        scrollStreamTo(value); // A line of the file
+      else
+        setViewportYOffset(value);
     });
     m_verticalScrollBar->setLineHeightPixels(m_characterHeightPixels);
 
-    // Create the caret's alpha interpolation sequence
-    // 1) Caret's alpha goes from 0 to 255 in 3 seconds
-    auto phase1 = std::make_unique<LinearInterpolator>(0, 255, 3000);
-    // 2) Caret stays the same for 2 seconds
-    auto phase2 = std::make_unique<ConstantInterpolator>(255, 3000);
-    // 3) Inverse of phase 1
-    auto phase3 = std::make_unique<LinearInterpolator>(255, 0, 3000);
-    m_caretInterpolatorSequence.addInterpolator(std::move(phase1));
-    m_caretInterpolatorSequence.addInterpolator(std::move(phase2));
-    m_caretInterpolatorSequence.addInterpolator(std::move(phase3));
-    m_caretInterpolatorSequence.start();
+    m_minimap = std::make_unique<Minimap>(*this, [&](SkScalar row) {
+      scrollToRow(row);
+    });
   }
 
   CodeView::~CodeView() {}
@@ -93,10 +59,12 @@ namespace varco {
                                             0.f, m_rect.fRight, m_rect.height());
     m_verticalScrollBar->resize(scrollBarRect);
 
+    // The minimap sits right at the left of the scrollbar
+    m_minimap->resize(SkRect::MakeLTRB(scrollBarRect.fLeft - MinimapTiles::COLUMNS, 0.f, scrollBarRect.fLeft, m_rect.height()));
+
     m_codeViewInitialized = true; // From now on we have valid buffer and size
 
-    // Calculate new wrap width (allow space for the vertical scrollbar if present)
-    m_wrapWidthInPixels = static_cast<int>(rect.width() - (m_verticalScrollBar ? (VSCROLLBAR_WIDTH * 2) : 0));
+    m_wrapWidthInPixels = computeWrapWidth();
 
     // If we have a document and we need to recalculate the wrapwidth
     if (m_document != nullptr && m_wrapWidthInPixels != m_document->m_wrapWidthPixels) {
@@ -110,21 +78,24 @@ namespace varco {
       //m_document->resize(newRect);
 
       // Emit a documentSizeChanged signal. This will trigger scrollbars 'maxViewableLines' calculations
-      m_verticalScrollBar->documentSizeChanged(m_document->m_maximumCharactersLine, 
-                                               m_document->m_numberOfEditorLines);
+      m_verticalScrollBar->documentSizeChanged(m_document->m_maximumCharactersLine, getScrollbarRows());
     }
   }
 
   void CodeView::loadDocument(Document& doc, SkScalar vScrollbarPos) {
 
     m_document = &doc; // Save this document's address as the current one
+    m_shownDocument = &doc;
+    {
+      std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+      m_document->m_renderMode = m_renderMode;
+    }
+    m_document->setTabWidth(m_tabWidth);
 
     if (isControlReady() == false)
       return; // We can't show anything if the codeview control hasn't been initialized yet    
 
-    // Calculate new wrap width (allow space for the vertical scrollbar if present)
-    auto newWrapWidth = static_cast<int>(m_rect.width() - (m_verticalScrollBar ? (VSCROLLBAR_WIDTH * 2) : 0));
-    m_document->setWrapWidthInPixels(newWrapWidth);
+    m_document->setWrapWidthInPixels(computeWrapWidth());
     // Important: do NOT recalculate document lines here! Reason being: document recalculations are to be performed
     // by the rendering thread. Modifying the wrap width and resizing the document is sufficient to trigger a complete
     // recalculation next time it will be rendered.
@@ -136,16 +107,22 @@ namespace varco {
     m_document->resize(newRect);
 
     // Emit a documentSizeChanged signal. This will trigger scrollbars 'maxViewableLines' calculations
-    m_verticalScrollBar->documentSizeChanged(m_document->m_maximumCharactersLine, 
-                                             m_document->m_numberOfEditorLines);
+    m_verticalScrollBar->documentSizeChanged(m_document->m_maximumCharactersLine, getScrollbarRows());
 
     // If there was a saved vertical scrollbar position, also restore it, otherwise just set it to 0
-    setVScrollbarValue(vScrollbarPos);
-    setViewportYOffset(vScrollbarPos); // And obviously also set our viewport Y offset
+    if (m_document->isStreaming())
+      scrollStreamTo(vScrollbarPos);
+    else {
+      m_streamAnchorPending = false;
+      setVScrollbarValue(vScrollbarPos);
+      setViewportYOffset(vScrollbarPos); // And obviously also set our viewport Y offset
+    }
 
     m_dirty = true;
 
     m_parentContainer.repaint(); // Trigger a complete repaint
+
+    restartCaretFade(); // There's a caret to fade from now on
   }
 
   SkScalar CodeView::getCharacterWidthPixels() const {
@@ -157,7 +134,45 @@ namespace varco {
   }
 
   SkPaint::FontMetrics CodeView::getFontMetrics() const {
-    return m_fontMetrics;
+    return m_theme->getFontMetrics();
+  }
+
+  void CodeView::setTextSize(int size) {
+    ThemeCache::get().setTextSize(size); // Picked up at the next paint
+    m_dirty = true;
+    m_parentContainer.repaint();
+  }
+
+  // Switches to a newer theme snapshot: metrics might have changed, thus the document has to be rendered again
+  void CodeView::applyTheme(std::shared_ptr<const Theme> theme) {
+    m_theme = std::move(theme);
+    m_characterWidthPixels = m_theme->getCharacterWidthPixels();
+    m_characterHeightPixels = m_theme->getCharacterHeightPixels();
+    m_verticalScrollBar->setLineHeightPixels(m_characterHeightPixels);
+    if (m_document != nullptr)
+      m_document->m_dirty = true;
+  }
+
+  // Calculate the wrap width (allow space for the vertical scrollbar and the minimap if present)
+  int CodeView::computeWrapWidth() const {
+    SkScalar reserved = m_verticalScrollBar ? (VSCROLLBAR_WIDTH * 2) : 0;
+    if (m_minimapVisible)
+      reserved += MinimapTiles::COLUMNS + MINIMAP_MARGIN;
+    return static_cast<int>(m_rect.width() - reserved);
+  }
+
+  void CodeView::setMinimapVisible(bool visible) {
+    if (visible == m_minimapVisible)
+      return;
+    m_minimapVisible = visible;
+    if (!isControlReady())
+      return;
+    m_wrapWidthInPixels = computeWrapWidth();
+    if (m_document != nullptr) {
+      m_document->setWrapWidthInPixels(m_wrapWidthInPixels);
+      m_document->scheduleRender();
+    }
+    repaint();
   }
 
   bool CodeView::isControlReady() const {
@@ -169,6 +184,8 @@ namespace varco {
     bool active = false;
     if (m_verticalScrollBar && m_verticalScrollBar->isTrackingActive())
       active = true;
+    if (m_minimap->isTrackingActive())
+      active = true;
     return active;
   }
 
@@ -178,9 +195,16 @@ namespace varco {
 
     if (m_verticalScrollBar && isPointInsideRect(relativeToParentCtrl.x(), relativeToParentCtrl.y(), m_verticalScrollBar->getRect(relativeToParentRect)))
       m_verticalScrollBar->onLeftMouseDown(relativeToParentCtrl.x(), relativeToParentCtrl.y());
+    else if (m_minimapVisible && isPointInsideRect(relativeToParentCtrl.x(), relativeToParentCtrl.y(), m_minimap->getRect(relativeToParentRect)))
+      m_minimap->onLeftMouseDown(relativeToParentCtrl.x(), relativeToParentCtrl.y());
   }
 
-  void CodeView::onMouseWheel(SkScalar x, SkScalar y, int direction) {
+  void CodeView::onMouseWheel(SkScalar x, SkScalar y, int direction, unsigned int modifiers) {
+    if (modifiers & MODIFIER_CTRL) { // Wheel up magnifies
+      if (direction != 0)
+        setZoom(direction < 0 ? m_zoom * ZOOM_STEP : m_zoom / ZOOM_STEP);
+      return;
+    }
     m_verticalScrollBar->onMouseWheel(x, y, direction);
   }
 
@@ -191,6 +215,8 @@ namespace varco {
         (m_verticalScrollBar->isTrackingActive() || isPointInsideRect(relativeToParentCtrl.x(), relativeToParentCtrl.y(), 
                                                                       m_verticalScrollBar->getRect(relativeToParentRect))))
       m_verticalScrollBar->onMouseMove(relativeToParentCtrl.x(), relativeToParentCtrl.y());
+    else if (m_minimap->isTrackingActive())
+      m_minimap->onMouseMove(relativeToParentCtrl.x(), relativeToParentCtrl.y());
   }
 
   void CodeView::onLeftMouseUp(SkScalar x, SkScalar y) {
@@ -200,6 +226,8 @@ namespace varco {
         (m_verticalScrollBar->isTrackingActive() || isPointInsideRect(relativeToParentCtrl.x(), relativeToParentCtrl.y(),
                                                                       m_verticalScrollBar->getRect(relativeToParentRect))))
       m_verticalScrollBar->onLeftMouseUp(relativeToParentCtrl.x(), relativeToParentCtrl.y());
+    else if (m_minimap->isTrackingActive())
+      m_minimap->onLeftMouseUp(relativeToParentCtrl.x(), relativeToParentCtrl.y());
   }
 
   // Change the Y offset to the specified one from the beginning of a document (receives an offset in the total document size)
@@ -216,6 +244,10 @@ namespace varco {
 
     m_dirty = false; // It will be false at the end of this function, unless overridden
 
+    auto latestTheme = ThemeCache::get().getTheme();
+    if (latestTheme != m_theme) // Font size or colors changed
+      applyTheme(std::move(latestTheme));
+
     SkCanvas canvas(this->m_bitmap);
     SkRect rect = getRect(absoluteRect); // Drawing is performed on the bitmap - absolute rect
 
@@ -224,7 +256,7 @@ namespace varco {
     //////////////////////////////////////////////////////////////////////
     {
       SkPaint background;
-      background.setColor(SkColorSetARGB(255, 39, 40, 34));
+      background.setColor(m_theme->getBackgroundColor());
       canvas.drawRect(rect, background);
     }
 
@@ -242,51 +274,721 @@ namespace varco {
     if (m_document == nullptr)
       return; // Nothing to display
 
+    // The document might have changed on another thread (a render completed or the file was reloaded): the
+    // scrollbar is told about new sizes here, and the view follows the caret if it was moved (tail mode)
+    if (getScrollbarRows() != m_scrollbarRows) {
+      m_scrollbarRows = getScrollbarRows();
+      m_verticalScrollBar->documentSizeChanged(m_document->m_maximumCharactersLine, m_scrollbarRows);
+    }
+    if (m_streamAnchorPending && m_document->isStreaming()) { // The window of a streamed document was laid out
+      SkScalar row = getStreamAnchorRow();
+      if (!m_streamAnchorPending)
+        m_currentYoffset = row;
+    }
+    if (m_document->m_revealCaret.exchange(false))
+      ensureCaretVisible();
+
     //////////////////////////////////////////////////////////////////////
     // Render and draw the requested portion of the document
     //////////////////////////////////////////////////////////////////////
 
     m_document->paint();
 
-    // Only draw things which intersect the current viewport region
-    auto documentYoffset = m_currentYoffset * m_document->m_characterHeightPixels;
+    //////////////////////////////////////////////////////////////////////
+    // Draw the minimap (its tiles are built in the background)
+    //////////////////////////////////////////////////////////////////////
+    if (m_minimapVisible) {
+      SkScalar visibleRows = getRect(absoluteRect).height() / (m_characterHeightPixels * getEffectiveZoom());
+      m_minimap->setView(m_document, m_currentYoffset, visibleRows);
+      m_minimap->paint();
+      canvas.drawBitmap(m_minimap->getBitmap(), m_minimap->getRect(relativeToParentRect).fLeft,
+                        m_minimap->getRect(relativeToParentRect).fTop);
+    }
+
+    // Only draw things which intersect the current viewport region (folded lines are skipped)
+    if (m_renderMode == RenderMode::Raster) { // Otherwise the document is drawn directly on the window canvas
+      auto rects = getVisibleDocumentRects(getRect(absoluteRect), 1.f);
+      std::unique_lock<std::mutex> lock(m_document->m_documentMutex); // A document's bitmap might be still in rendering by the threadpool
+      for (const auto& rect : rects)
+        canvas.drawBitmapRect(m_document->getBitmap(), rect.first, rect.second, nullptr,
+                              SkCanvas::SrcRectConstraint::kFast_SrcRectConstraint);
+    }
+
+    canvas.flush();
+  }
+
+  SkRect CodeView::getCaretRect() {
+    if (m_document == nullptr || !isControlReady())
+      return SkRect::MakeEmpty();
+
+    int row, column;
+    getCaretCell(row, column);
 
-    // Calculate source and destination rect
-    SkRect bitmapPartialRect = SkRect::MakeLTRB(0, documentYoffset, this->getRect(absoluteRect).width(), documentYoffset + this->getRect(absoluteRect).height());
-    SkRect myDestRect = SkRect::MakeLTRB(0, 0, this->getRect(absoluteRect).width(), this->getRect(absoluteRect).height());
+    // Is the cursor in sight?
+    SkScalar zoom = getEffectiveZoom();
+    SkScalar lineHeight = m_characterHeightPixels * zoom;
+    SkScalar firstViewVisibleLine = this->m_currentYoffset;
+    SkScalar lastViewVisibleLine = firstViewVisibleLine + (this->getRect(absoluteRect).height() / lineHeight);
+    if (row < firstViewVisibleLine - 1 || row >= lastViewVisibleLine + 1)
+      return SkRect::MakeEmpty();
+
+    SkScalar viewRelativeTopStart = (row - firstViewVisibleLine /* Line view-relative where the caret is at */) * lineHeight;
+    SkScalar caretX = (column * m_characterWidthPixels + Document::BITMAP_OFFSET_X) * zoom;
+    SkRect caretRect = SkRect::MakeLTRB(caretX, viewRelativeTopStart, caretX, viewRelativeTopStart + lineHeight /* Caret length */);
+    caretRect.outset(2.f, 1.f); // Antialiasing might bleed a bit outside of the line
+    return caretRect;
+  }
 
+  // The caret is stored as a physical line and column: find the editor line (i.e. the wrapped row) it's in
+  void CodeView::getCaretCell(int& row, int& column) {
+    std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+    DocumentPosition cursor = m_document->m_selections[m_document->m_primarySelection].m_caret;
+    getCell(cursor.y, cursor.x, row, column);
+  }
+
+  // The column is counted in characters and tab stops (see Document::getColumn()) from the beginning of the row
+  void CodeView::getCell(size_t line, size_t physicalColumn, int& row, int& column) {
+    row = static_cast<int>(line);
+    column = static_cast<int>(physicalColumn);
+
+    const auto& physicalLines = m_document->m_physicalLines;
+    const bool plain = line < m_document->m_buffer.getLineCount() && m_document->m_buffer.isPlain(line);
+    if (line >= physicalLines.size() || !m_document->hasLayout()) {
+      if (line < m_document->m_buffer.getLineCount() && !plain) { // No layout yet, rows and lines are the same until there's one
+        const std::string& text = m_document->m_buffer.getLine(line);
+        column = static_cast<int>(getColumnCount(text.data(), std::min(physicalColumn, text.size()), m_document->m_tabWidth));
+      }
+      return;
+    }
+
+    row = static_cast<int>(m_document->m_rowIndex.visiblePrefixSum(line)); // Folded lines take no rows
+    const auto& editorLines = physicalLines[line].m_editorLines;
+    size_t editorLine = 0;
+    for (; editorLine + 1 < editorLines.size(); ++editorLine) { // The last row also takes the end of the line
+      size_t rowLength = editorLines[editorLine].m_characters.size();
+      if (physicalColumn < rowLength)
+        break;
+      physicalColumn -= rowLength;
+      ++row;
+    }
+    const auto& characters = editorLines[editorLine].m_characters;
+    column = plain ? static_cast<int>(physicalColumn) :
+      static_cast<int>(getColumnCount(characters.data(), std::min(physicalColumn, characters.size()), m_document->m_tabWidth));
+  }
+
+  // Scrolls the least needed to have the caret's row in the view
+  void CodeView::ensureCaretVisible() {
+    int row, column;
+    getCaretCell(row, column);
+
+    SkScalar visibleRows = std::floor(getRect(absoluteRect).height() / (m_characterHeightPixels * getEffectiveZoom()));
+    SkScalar offset = m_currentYoffset;
+    if (row < offset)
+      offset = static_cast<SkScalar>(row);
+    else if (row + 1 > offset + visibleRows)
+      offset = row + 1 - std::max(visibleRows, 1.f);
+
+    if (offset != m_currentYoffset)
+      scrollToRow(offset);
+  }
+
+  void CodeView::scrollToRow(SkScalar row) {
+    if (m_document != nullptr && m_document->isStreaming()) {
+      // The window follows the view: the line at the top stays there if the window moves
+      size_t windowLine;
+      {
+        std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+        windowLine = m_document->hasLayout() ? m_document->m_rowIndex.findVisible(static_cast<size_t>(std::max(0.f, row)))
+                                             : static_cast<size_t>(std::max(0.f, row));
+      }
+      size_t line = m_document->getStreamLine(windowLine);
+      bool moved;
+      windowLine = m_document->moveStreamWindow(line, moved);
+      setVScrollbarValue(static_cast<SkScalar>(line));
+      m_verticalScrollBar->m_dirty = true;
+      if (moved)
+        showStreamLine(windowLine, 0);
+      else {
+        m_streamAnchorPending = false;
+        setViewportYOffset(row);
+      }
+      return;
+    }
+    setVScrollbarValue(row);
+    m_verticalScrollBar->m_dirty = true;
+    setViewportYOffset(row);
+  }
+
+  // Streamed documents: the scrollbar moves through the lines of the file, the view through the rows of the
+  // window of lines the document holds (which follows it)
+  void CodeView::scrollStreamTo(SkScalar line) {
+    line = std::max(0.f, line);
+    bool moved;
+    size_t windowLine = m_document->moveStreamWindow(static_cast<size_t>(line), moved);
+    setVScrollbarValue(line);
+    showStreamLine(windowLine, line - std::floor(line));
+  }
+
+  // Until a new window is laid out its rows are its lines: the view goes back to the line once it is
+  void CodeView::showStreamLine(size_t windowLine, SkScalar fraction) {
+    m_streamAnchorLine = windowLine;
+    m_streamAnchorFraction = fraction;
+    m_streamAnchorPending = true;
+    setViewportYOffset(getStreamAnchorRow());
+  }
+
+  SkScalar CodeView::getStreamAnchorRow() {
+    std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+    int row, column;
+    getCell(m_streamAnchorLine, 0, row, column);
+    if (m_document->m_layoutValid && m_document->hasLayout())
+      m_streamAnchorPending = false;
+    return row + m_streamAnchorFraction;
+  }
+
+  int CodeView::getScrollbarRows() {
+    if (m_document->isStreaming()) // Lines of the file
+      return static_cast<int>(std::min<size_t>(m_document->getStreamLineCount(), INT_MAX));
+    return m_document->m_numberOfVisibleRows;
+  }
+
+  void CodeView::onDocumentEdited() {
+    m_verticalScrollBar->documentSizeChanged(m_document->m_maximumCharactersLine, getScrollbarRows());
+    ensureCaretVisible();
+    repaint(); // Edited rows are patched in at the next draw (or the whole document is rendered again)
+  }
+
+  void CodeView::onKeyDown(VirtualKeycode key, unsigned int modifiers) {
+    if (m_document == nullptr)
+      return;
+    restartCaretFade(); // Fully shown while typing
+
+    if (modifiers & MODIFIER_CTRL) {
+      bool edited = false;
+      if (key == VirtualKeycode::VK_Z)
+        edited = (modifiers & MODIFIER_SHIFT) ? m_document->redo() : m_document->undo();
+      else if (key == VirtualKeycode::VK_S)
+        m_document->save();
+      else if (key == VirtualKeycode::VK_Y)
+        edited = m_document->redo();
+      else if (key == VirtualKeycode::VK_M && m_document->jumpToMatchingBracket()) {
+        ensureCaretVisible();
+        repaint();
+      }
+      else if (key == VirtualKeycode::VK_K) { // Fold (or unfold) the region at the caret
+        bool changed = (modifiers & MODIFIER_SHIFT) ? (m_document->unfoldAll(), true) :
+                                                      m_document->toggleFold(m_document->getCursorPosition().y);
+        if (changed)
+          onDocumentEdited(); // The number of rows changed, nothing has to be rendered again
+      }
+      else if ((modifiers & MODIFIER_ALT) && (key == VirtualKeycode::VK_ARROW_UP || key == VirtualKeycode::VK_ARROW_DOWN)) {
+        if (m_document->addCaretOnAdjacentLine(key == VirtualKeycode::VK_ARROW_DOWN)) {
+          ensureCaretVisible();
+          repaint();
+        }
+      }
+      else if (key == VirtualKeycode::VK_0)
+        setZoom(1.f);
+      else if (key == VirtualKeycode::VK_R && (modifiers & MODIFIER_SHIFT)) // Raster, GpuTextures, DisplayList and again
+        setRenderMode(m_renderMode == RenderMode::Raster ? RenderMode::GpuTextures :
+                      m_renderMode == RenderMode::GpuTextures ? RenderMode::DisplayList : RenderMode::Raster);
+      else if (key == VirtualKeycode::VK_L && (modifiers & MODIFIER_SHIFT)) { // A caret on every search match
+        if (m_document->selectAllMatches() > 0) {
+          ensureCaretVisible();
+          repaint();
+        }
+      }
+      if (edited)
+        onDocumentEdited();
+      return;
+    }
+
+    switch (key) {
+      case VirtualKeycode::VK_BACKSPACE: {
+        m_document->deleteBackward();
+        onDocumentEdited();
+      } return;
+      case VirtualKeycode::VK_DEL: {
+        m_document->deleteForward();
+        onDocumentEdited();
+      } return;
+      case VirtualKeycode::VK_ENTER: {
+        m_document->insertText("\n");
+        onDocumentEdited();
+      } return;
+      case VirtualKeycode::VK_TAB_KEY: {
+        m_document->insertText("\t");
+        onDocumentEdited();
+      } return;
+      case VirtualKeycode::VK_F3_KEY: {
+        findNext((modifiers & MODIFIER_SHIFT) == 0);
+      } return;
+      case VirtualKeycode::VK_ESC: {
+        m_document->clearSecondaryCarets();
+        repaint();
+      } return;
+      default:
+        break;
+    }
+
+    // Every caret moves the same way, Shift extends the selections
+    std::vector<Selection> selections = m_document->getSelections();
+    for (auto& selection : selections) {
+      if (!moveCaret(key, selection.m_caret))
+        return; // Not a navigation key
+      if ((modifiers & MODIFIER_SHIFT) == 0)
+        selection.m_anchor = selection.m_caret;
+    }
+    m_document->setSelections(std::move(selections), m_document->getPrimarySelection());
+    ensureCaretVisible();
+    repaint(); // The caret is drawn in the overlay, the previous position has to be cleared too
+  }
+
+  bool CodeView::moveCaret(VirtualKeycode key, DocumentPosition& caret) {
+    const DocumentPosition previous = caret;
+    switch (key) {
+      case VirtualKeycode::VK_ARROW_LEFT: {
+        if (caret.x > 0)
+          caret.x = m_document->getAdjacentCharacter(caret, false);
+        else if (caret.y > 0) { // Wrap to the end of the previous line
+          --caret.y;
+          caret.x = m_document->getLineLength(caret.y);
+        }
+      } break;
+      case VirtualKeycode::VK_ARROW_RIGHT: {
+        if (caret.x < m_document->getLineLength(caret.y))
+          caret.x = m_document->getAdjacentCharacter(caret, true);
+        else if (caret.y + 1 < m_document->getLineCount()) {
+          ++caret.y;
+          caret.x = 0;
+        }
+      } break;
+      case VirtualKeycode::VK_ARROW_UP: {
+        --caret.y; // The column is clamped to the new line
+      } break;
+      case VirtualKeycode::VK_ARROW_DOWN: {
+        ++caret.y;
+      } break;
+      case VirtualKeycode::VK_HOME_KEY: {
+        caret.x = 0;
+      } break;
+      case VirtualKeycode::VK_END_KEY: {
+        caret.x = m_document->getLineLength(caret.y);
+      } break;
+      case VirtualKeycode::VK_PAGEUP:
+      case VirtualKeycode::VK_PAGEDOWN: {
+        int page = std::max(1, static_cast<int>(getRect(absoluteRect).height() / (m_characterHeightPixels * getEffectiveZoom())));
+        caret.y += (key == VirtualKeycode::VK_PAGEUP) ? -page : page;
+      } break;
+
+      default:
+        return false;
+    }
+
+    // Step over the folded regions instead of unfolding them
+    if (caret.y != previous.y) {
+      bool forward = caret.y > previous.y;
+      int line = m_document->skipFoldedLines(caret.y, forward);
+      if (line != caret.y && key == VirtualKeycode::VK_ARROW_LEFT)
+        caret.x = m_document->getLineLength(line);
+      else if (line != caret.y && key == VirtualKeycode::VK_ARROW_RIGHT)
+        caret.x = 0;
+      caret.y = line;
+    }
+    // Moving up and down keeps the column the caret is shown at, whatever the characters before it
+    if (caret.y != previous.y && key != VirtualKeycode::VK_ARROW_LEFT && key != VirtualKeycode::VK_ARROW_RIGHT) {
+      int line = std::max(0, std::min(caret.y, m_document->getLineCount() - 1));
+      caret.x = m_document->getPositionAtColumn(line, m_document->getColumn(previous));
+    }
+    return true;
+  }
+
+  void CodeView::onTextInput(const std::string& text) {
+    if (m_document == nullptr)
+      return;
+    restartCaretFade();
+    m_document->insertText(text);
+    onDocumentEdited();
+  }
+
+  // Shows the caret and fades it again for a while: called on any input which might have moved it. The fade
+  // is a finite animation of the scheduler, registered again only if it had finished
+  void CodeView::restartCaretFade() {
+    std::lock_guard<std::mutex> lock(m_caretFadeMutex);
+    m_caretFade.start();
+    if (m_caretFading)
+      return;
+    m_caretFading = true;
+    getAnimationScheduler().addAnimation([this](AnimationScheduler::Clock::time_point now) {
+      bool changed, finished;
+      {
+        std::lock_guard<std::mutex> lock(m_caretFadeMutex);
+        changed = m_caretFade.tick(now);
+        finished = m_caretFade.isFinished();
+        m_caretFading = !finished;
+      }
+      if (changed)
+        onCaretFrame(); // Only damage the caret when its alpha actually changed
+      return !finished;
+    });
+  }
+
+  // Called by the animation scheduler on its own thread: only the caret cell is damaged, the rest of the
+  // control's bitmap is still valid and needn't be redrawn nor presented again. The document and the view
+  // belong to the UI thread: the caret's area is the one published by the last paintOverlay()
+  void CodeView::onCaretFrame() {
+    SkRect caretRect;
     {
-      std::unique_lock<std::mutex> lock(m_document->m_documentMutex); // A document's bitmap might be still in rendering by the threadpool
-      canvas.drawBitmapRect(m_document->getBitmap(), bitmapPartialRect, myDestRect, nullptr,
-                            SkCanvas::SrcRectConstraint::kFast_SrcRectConstraint);
+      std::lock_guard<std::mutex> lock(m_caretDamageMutex);
+      caretRect = m_caretDamageRect;
+    }
+    if (!caretRect.isEmpty())
+      m_parentContainer.repaintRect(caretRect);
+  }
+
+  void CodeView::paintOverlay(SkCanvas& canvas) {
+
+    //////////////////////////////////////////////////////////////////////
+    // Draw the visible document strips (GPU textures and display list modes)
+    //////////////////////////////////////////////////////////////////////
+
+    if (m_document != nullptr && m_renderMode != RenderMode::Raster && isControlReady()) {
+      SkRect viewRect = getRect(absoluteRect);
+      if (m_verticalScrollBar) // Don't draw over the scrollbar
+        viewRect.fRight = m_verticalScrollBar->getRect(relativeToParentRect).fLeft;
+      if (m_minimapVisible) // Nor over the minimap
+        viewRect.fRight = m_minimap->getRect(relativeToParentRect).fLeft;
+      for (const auto& rect : getVisibleDocumentRects(viewRect, getEffectiveZoom()))
+        m_document->drawStrips(canvas, rect.first, rect.second, getEffectiveZoom());
     }
 
+    paintFoldMarkers(canvas);
+    paintSelections(canvas);
+    paintSearchMatches(canvas);
+    paintMatchingBrackets(canvas);
+    paintSaveProgress(canvas);
+
     //////////////////////////////////////////////////////////////////////
     // Draw the cursor if in sight
     //////////////////////////////////////////////////////////////////////
 
-    auto cursorPos = m_document->m_cursorPos;
+    SkRect caretRect = getCaretRect();
+    {
+      std::lock_guard<std::mutex> lock(m_caretDamageMutex);
+      m_caretDamageRect = caretRect.makeOffset(m_rect.fLeft, m_rect.fTop); // Container-relative
+    }
+    const int alpha = m_caretFade.getValue();
+    if (alpha == 0 || caretRect.isEmpty())
+      return;
+    caretRect.outset(-2.f, -1.f);
+
+    SkPaint caretPaint;
+    caretPaint.setColor(SkColorSetA(SK_ColorWHITE, static_cast<U8CPU>(alpha)));
+    caretPaint.setAntiAlias(true);
+    canvas.drawLine(caretRect.fLeft, caretRect.fTop, caretRect.fLeft, caretRect.fBottom, caretPaint);
+  }
 
-    // Is the cursor in sight?
-    SkScalar firstViewVisibleLine = this->m_currentYoffset;
-    SkScalar lastViewVisibleLine = firstViewVisibleLine + (this->getRect(absoluteRect).height() / m_characterHeightPixels);
-    if (cursorPos.y >= firstViewVisibleLine - 1 && cursorPos.y < lastViewVisibleLine + 1) {
-      SkPaint caretPaint;
-      int val = m_caretInterpolatorSequence.getValue();
-      caretPaint.setColor(SkColorSetARGB(255, val, val, val));
-      caretPaint.setAntiAlias(true);
-      SkScalar viewRelativeTopStart = (cursorPos.y - firstViewVisibleLine /* Line view-relative where the caret is at */) * m_characterHeightPixels;
-      canvas.drawLine(cursorPos.x * m_characterWidthPixels + Document::BITMAP_OFFSET_X,
-                      viewRelativeTopStart,
-                      cursorPos.x * m_characterWidthPixels + Document::BITMAP_OFFSET_X,
-                      viewRelativeTopStart + m_characterHeightPixels /* Caret length */,
-                      caretPaint);
-      m_dirty = true;
+  // Only the matches on the visible rows are fetched and drawn: a translucent box over each of them (split
+  // where a match is wrapped on the next row)
+  void CodeView::paintSearchMatches(SkCanvas& canvas) {
+    if (m_document == nullptr || !isControlReady())
+      return;
+
+    SkScalar zoom = getEffectiveZoom();
+    SkScalar lineHeight = m_characterHeightPixels * zoom;
+    SkScalar firstVisibleRow = m_currentYoffset;
+    SkScalar lastVisibleRow = firstVisibleRow + getRect(absoluteRect).height() / lineHeight;
+
+    std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+    // Physical lines shown in the view
+    size_t firstLine = static_cast<size_t>(std::max(0.f, firstVisibleRow));
+    size_t lastLine = static_cast<size_t>(std::max(0.f, lastVisibleRow)) + 1;
+    const bool hasLayout = m_document->hasLayout() && !m_document->m_physicalLines.empty();
+    const auto& index = m_document->m_rowIndex;
+    if (hasLayout) {
+      firstLine = index.findVisible(firstLine);
+      lastLine = std::min(index.findVisible(lastLine), index.size() - 1) + 1;
     }
+    std::vector<SearchMatch> matches = m_document->getSearchMatches(firstLine, lastLine);
+    if (matches.empty())
+      return;
 
-    canvas.flush();
-    if (m_dirty == true)
-      m_parentContainer.repaint(); // Schedule a repaint
+    SkPaint matchPaint;
+    matchPaint.setColor(SkColorSetARGB(90, 230, 219, 88));
+    for (const auto& match : matches) {
+      const auto& physicalLines = m_document->m_physicalLines;
+      if (hasLayout && match.m_line < physicalLines.size() && !index.isVisible(match.m_line))
+        continue; // Folded
+      int row, column, endRow, endColumn;
+      getCell(match.m_line, match.m_column, row, column);
+      getCell(match.m_line, match.m_column + match.m_length, endRow, endColumn);
+      size_t editorLine = 0; // Wrapped row of the physical line the match begins on
+      if (hasLayout && match.m_line < physicalLines.size())
+        editorLine = row - index.visiblePrefixSum(match.m_line);
+
+      for (; row <= endRow && row < lastVisibleRow + 1; ++row, ++editorLine, column = 0) {
+        size_t rowEnd = endColumn; // The whole row unless the match ends on it
+        if (row < endRow) {
+          const auto& characters = physicalLines[match.m_line].m_editorLines[editorLine].m_characters;
+          rowEnd = getColumnCount(characters.data(), characters.size(), m_document->m_tabWidth);
+        }
+        if (row + 1 > firstVisibleRow) {
+          SkScalar top = (row - firstVisibleRow) * lineHeight;
+          SkScalar left = (column * m_characterWidthPixels + Document::BITMAP_OFFSET_X) * zoom;
+          SkScalar right = (rowEnd * m_characterWidthPixels + Document::BITMAP_OFFSET_X) * zoom;
+          canvas.drawRect(SkRect::MakeLTRB(left, top, right, top + lineHeight), matchPaint);
+        }
+      }
+    }
+  }
+
+  // Boxes the bracket next to the caret and its matching one (both come straight from the lexer's index)
+  void CodeView::paintMatchingBrackets(SkCanvas& canvas) {
+    if (m_document == nullptr || !isControlReady())
+      return;
+
+    DocumentPosition bracket, match;
+    if (!m_document->findMatchingBracket(m_document->getCursorPosition(), bracket, match))
+      return;
+
+    SkScalar zoom = getEffectiveZoom();
+    SkScalar lineHeight = m_characterHeightPixels * zoom;
+    SkPaint bracketPaint;
+    bracketPaint.setColor(SkColorSetARGB(200, 200, 200, 200));
+    bracketPaint.setStyle(SkPaint::kStroke_Style);
+
+    std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+    for (const auto& position : { bracket, match }) {
+      if (m_document->hasLayout() && !m_document->m_rowIndex.isVisible(position.y))
+        continue; // Folded
+      int row, column;
+      getCell(position.y, position.x, row, column);
+      if (row + 1 < m_currentYoffset)
+        continue;
+      SkScalar top = (row - m_currentYoffset) * lineHeight;
+      SkScalar left = (column * m_characterWidthPixels + Document::BITMAP_OFFSET_X) * zoom;
+      canvas.drawRect(SkRect::MakeLTRB(left, top, left + m_characterWidthPixels * zoom, top + lineHeight), bracketPaint);
+    }
+  }
+
+  // A thin bar across the top of the view while the document is being saved
+  void CodeView::paintSaveProgress(SkCanvas& canvas) {
+    if (m_document == nullptr || !isControlReady() || !m_document->isSaving())
+      return;
+
+    SkScalar width = m_rect.width();
+    if (m_verticalScrollBar)
+      width = m_verticalScrollBar->getRect(relativeToParentRect).fLeft;
+    SkPaint progressPaint;
+    progressPaint.setColor(SkColorSetARGB(160, 102, 217, 239));
+    canvas.drawRect(SkRect::MakeWH(width * m_document->getSaveProgress(), 2.f), progressPaint);
+  }
+
+  // Only the selections on the lines in sight are drawn (they're sorted): a box over every row they cover
+  // and, for all the carets but the primary one (which blinks), a line
+  void CodeView::paintSelections(SkCanvas& canvas) {
+    if (m_document == nullptr || !isControlReady())
+      return;
+
+    SkScalar zoom = getEffectiveZoom();
+    SkScalar lineHeight = m_characterHeightPixels * zoom;
+    SkScalar firstVisibleRow = m_currentYoffset;
+    SkScalar lastVisibleRow = firstVisibleRow + getRect(absoluteRect).height() / lineHeight;
+    SkPaint selectionPaint;
+    selectionPaint.setColor(SkColorSetARGB(110, 102, 153, 204));
+    SkPaint caretPaint;
+    caretPaint.setColor(SkColorSetARGB(200, 255, 255, 255));
+    caretPaint.setAntiAlias(true);
+
+    std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+    const auto& selections = m_document->m_selections;
+    if (selections.size() == 1 && selections.front().m_anchor == selections.front().m_caret)
+      return; // Just the primary caret
+
+    const bool hasLayout = m_document->hasLayout() && !m_document->m_physicalLines.empty();
+    const auto& index = m_document->m_rowIndex;
+    const auto& physicalLines = m_document->m_physicalLines;
+    size_t firstLine = static_cast<size_t>(std::max(0.f, firstVisibleRow));
+    size_t lastLine = static_cast<size_t>(std::max(0.f, lastVisibleRow)) + 1;
+    if (hasLayout) {
+      firstLine = index.findVisible(firstLine);
+      lastLine = std::min(index.findVisible(lastLine), index.size() - 1) + 1;
+    }
+    auto isHidden = [&](size_t line) { return hasLayout && line < physicalLines.size() && !index.isVisible(line); };
+    auto rowLength = [&](size_t line, size_t editorLine) -> size_t { // Columns of a wrapped row
+      if (!hasLayout || line >= physicalLines.size()) {
+        const std::string& text = m_document->m_buffer.getLine(line);
+        return getColumnCount(text.data(), text.size(), m_document->m_tabWidth);
+      }
+      const auto& editorLines = physicalLines[line].m_editorLines;
+      if (editorLine >= editorLines.size())
+        return 0;
+      const auto& characters = editorLines[editorLine].m_characters;
+      return m_document->m_buffer.isPlain(line) ? characters.size() :
+        getColumnCount(characters.data(), characters.size(), m_document->m_tabWidth);
+    };
+    auto drawCells = [&](int row, size_t fromColumn, size_t toColumn, bool newline) {
+      if (row + 1 < firstVisibleRow || row > lastVisibleRow + 1)
+        return;
+      SkScalar top = (row - firstVisibleRow) * lineHeight;
+      SkScalar left = (fromColumn * m_characterWidthPixels + Document::BITMAP_OFFSET_X) * zoom;
+      SkScalar right = ((toColumn + (newline ? 1 : 0)) * m_characterWidthPixels + Document::BITMAP_OFFSET_X) * zoom;
+      if (right > left)
+        canvas.drawRect(SkRect::MakeLTRB(left, top, right, top + lineHeight), selectionPaint);
+    };
+
+    // Selections are disjoint: their ends are sorted too
+    auto it = std::lower_bound(selections.begin(), selections.end(), firstLine, [](const Selection& selection, size_t line) {
+      return static_cast<size_t>(std::max(selection.m_anchor, selection.m_caret).y) < line;
+    });
+    for (; it != selections.end(); ++it) {
+      DocumentPosition begin = std::min(it->m_anchor, it->m_caret);
+      DocumentPosition end = std::max(it->m_anchor, it->m_caret);
+      if (static_cast<size_t>(begin.y) >= lastLine)
+        break;
+
+      size_t lastSelected = std::min(static_cast<size_t>(end.y), lastLine);
+      for (size_t line = std::max(static_cast<size_t>(begin.y), firstLine); line <= lastSelected && !(begin == end); ++line) {
+        if (isHidden(line))
+          continue;
+        size_t from = (line == static_cast<size_t>(begin.y)) ? begin.x : 0;
+        size_t to = (line == static_cast<size_t>(end.y)) ? end.x : m_document->m_buffer.getLine(line).size();
+        int fromRow, fromColumn, toRow, toColumn;
+        getCell(line, from, fromRow, fromColumn);
+        getCell(line, to, toRow, toColumn);
+        size_t editorLine = hasLayout ? fromRow - index.visiblePrefixSum(line) : 0;
+        for (int row = fromRow; row <= toRow; ++row, ++editorLine) {
+          bool lastRow = (row == toRow);
+          drawCells(row, (row == fromRow) ? fromColumn : 0, lastRow ? toColumn : rowLength(line, editorLine),
+                    lastRow && line != static_cast<size_t>(end.y)); // The newline is selected too
+        }
+      }
+
+      if (it - selections.begin() == static_cast<std::ptrdiff_t>(m_document->m_primarySelection) || isHidden(it->m_caret.y))
+        continue;
+      int row, column;
+      getCell(it->m_caret.y, it->m_caret.x, row, column);
+      if (row + 1 < firstVisibleRow || row > lastVisibleRow + 1)
+        continue;
+      SkScalar top = (row - firstVisibleRow) * lineHeight;
+      SkScalar x = (column * m_characterWidthPixels + Document::BITMAP_OFFSET_X) * zoom;
+      canvas.drawLine(x, top + 1.f, x, top + lineHeight - 1.f, caretPaint);
+    }
+  }
+
+  // A thin line below every folded line in sight
+  void CodeView::paintFoldMarkers(SkCanvas& canvas) {
+    if (m_document == nullptr || !isControlReady())
+      return;
+
+    SkScalar zoom = getEffectiveZoom();
+    SkScalar lineHeight = m_characterHeightPixels * zoom;
+    SkScalar viewHeight = getRect(absoluteRect).height();
+    SkPaint foldPaint;
+    foldPaint.setColor(SkColorSetARGB(140, 117, 113, 94));
+
+    std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+    if (m_document->m_folds.empty() || !m_document->hasLayout())
+      return;
+    size_t firstLine = m_document->m_rowIndex.findVisible(static_cast<size_t>(std::max(0.f, m_currentYoffset)));
+    for (auto it = m_document->m_folds.lower_bound(firstLine); it != m_document->m_folds.end(); ++it) {
+      if (it->first >= m_document->m_physicalLines.size() || !m_document->m_rowIndex.isVisible(it->first))
+        continue; // Nested in another fold
+      int row, column;
+      getCell(it->first, m_document->m_buffer.getLine(it->first).size(), row, column);
+      SkScalar bottom = (row + 1 - m_currentYoffset) * lineHeight;
+      if (bottom - lineHeight > viewHeight)
+        break;
+      SkScalar left = Document::BITMAP_OFFSET_X * zoom;
+      SkScalar right = left + std::max(column, 1) * m_characterWidthPixels * zoom;
+      canvas.drawRect(SkRect::MakeLTRB(left, bottom - 1.f, right, bottom), foldPaint);
+    }
+  }
+
+  std::vector<std::pair<SkRect, SkRect>> CodeView::getVisibleDocumentRects(const SkRect& viewRect, SkScalar zoom) {
+    std::vector<std::pair<SkRect, SkRect>> rects;
+    SkScalar lineHeight = m_document->m_characterHeightPixels;
+    size_t firstRow = static_cast<size_t>(std::max(0.f, m_currentYoffset));
+    size_t rowCount = static_cast<size_t>(viewRect.height() / (lineHeight * zoom)) + 2;
+
+    std::vector<Document::RowSegment> segments;
+    {
+      std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+      segments = m_document->getVisibleSegments(firstRow, rowCount);
+    }
+    for (const auto& segment : segments) {
+      SkScalar documentTop = segment.m_documentRow * lineHeight + Document::BITMAP_OFFSET_Y;
+      SkScalar viewTop = viewRect.fTop + (segment.m_viewRow - m_currentYoffset) * lineHeight * zoom;
+      SkScalar height = segment.m_count * lineHeight;
+      SkRect documentRect = SkRect::MakeLTRB(0, documentTop, viewRect.width() / zoom, documentTop + height);
+      SkRect destRect = SkRect::MakeLTRB(viewRect.fLeft, viewTop, viewRect.fRight, viewTop + height * zoom);
+      if (destRect.fBottom > viewRect.fBottom) { // Cut both at the bottom of the view (the top is clipped anyway)
+        documentRect.fBottom -= (destRect.fBottom - viewRect.fBottom) / zoom;
+        destRect.fBottom = viewRect.fBottom;
+      }
+      if (!destRect.isEmpty())
+        rects.emplace_back(documentRect, destRect);
+    }
+    return rects;
+  }
+
+  bool CodeView::setSearchQuery(const std::string& needle, bool regex) {
+    if (m_document == nullptr)
+      return false;
+    bool valid = m_document->setSearchQuery(needle, regex);
+    repaint();
+    return valid;
+  }
+
+  void CodeView::findNext(bool forward) {
+    bool windowMoved;
+    if (m_document == nullptr || !m_document->findNext(forward, windowMoved))
+      return;
+    if (windowMoved) { // A new window of the streamed file: the view goes to the match's line
+      const size_t windowLine = static_cast<size_t>(m_document->getCursorPosition().y);
+      setVScrollbarValue(static_cast<SkScalar>(m_document->getStreamLine(windowLine)));
+      m_verticalScrollBar->m_dirty = true;
+      showStreamLine(windowLine, 0);
+    } else
+      ensureCaretVisible();
+    repaint();
+  }
+
+  void CodeView::repaintIfShowing(const Document *document) {
+    if (m_shownDocument == document)
+      repaint();
+  }
+
+  void CodeView::setRenderMode(RenderMode mode) {
+    m_renderMode = mode;
+    if (m_document == nullptr)
+      return;
+    {
+      std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+      m_document->m_renderMode = mode;
+    }
+    m_document->m_dirty = true; // Render again with the new mode
+    m_dirty = true;
+    m_parentContainer.repaint();
+  }
+
+  void CodeView::setTabWidth(int columns) {
+    m_tabWidth = std::max(columns, 1);
+    if (m_document == nullptr)
+      return;
+    m_document->setTabWidth(m_tabWidth); // Wrapped and rendered again at the next paint
+    m_dirty = true;
+    m_parentContainer.repaint();
+  }
+
+  void CodeView::setZoom(SkScalar zoom) {
+    m_zoom = std::max(zoom, 0.1f);
+    m_dirty = true; // Just a different playback, no need to render the document again
+    m_parentContainer.repaint();
+  }
+
+  SkScalar CodeView::getEffectiveZoom() const {
+    return (m_renderMode == RenderMode::Raster) ? 1.f : m_zoom;
   }
 
   void CodeView::repaint() {
@@ -303,4 +1005,8 @@ namespace varco {
     m_parentContainer.stopMouseCapture();
   }
 
+  AnimationScheduler& CodeView::getAnimationScheduler() {
+    return m_parentContainer.getAnimationScheduler();
+  }
+
 }
@@ -3,13 +3,18 @@
 
 #include <UI/UIElement.hpp>
 #include <UI/ScrollBar/ScrollBar.hpp>
+#include <UI/Minimap/Minimap.hpp>
 #include <Document/Document.hpp>
 #include <Utils/Concurrent.hpp>
 #include <Utils/Interpolators.hpp>
+#include <UI/Theme/Theme.hpp>
+#include <Utils/VKeyCodes.hpp>
 #include <SkPaint.h>
+#include <atomic>
 #include <memory>
+#include <mutex>
 
-class SkTypeface;
+class SkCanvas;
 
 namespace varco {
 
@@ -22,15 +27,24 @@ namespace varco {
 
     void resize(SkRect rect) override;
     void paint() override;
+    void paintOverlay(SkCanvas& canvas); // Draws what lives over the control's bitmap (GPU document strips, caret)
     void repaint() override;
 
     void startMouseCapture() override;
     void stopMouseCapture() override;
+    AnimationScheduler& getAnimationScheduler() override;
 
     void loadDocument(Document& doc, SkScalar vScrollbarPos = 0);
+    void setRenderMode(RenderMode mode); // Applies to the current and all the documents loaded afterwards
+    void setTabWidth(int columns); // Same as above. Tabs stay in the text, only their layout changes
+    // Magnifies the document without rendering it again. Only strip modes (GpuTextures, DisplayList) can
+    // be zoomed and only DisplayList keeps the text sharp
+    void setZoom(SkScalar zoom);
+    void setMinimapVisible(bool visible);
     SkScalar getCharacterWidthPixels() const;
     SkScalar getCharacterHeightPixels() const;
     SkPaint::FontMetrics getFontMetrics() const;
+    void setTextSize(int size);
     bool isControlReady() const;
     bool isTrackingActive() const;
 
@@ -38,7 +52,19 @@ namespace varco {
     void onLeftMouseDown(SkScalar x, SkScalar y);
     void onMouseMove(SkScalar x, SkScalar y);
     void onLeftMouseUp(SkScalar x, SkScalar y);
-    void onMouseWheel(SkScalar x, SkScalar y, int direction);
+    void onMouseWheel(SkScalar x, SkScalar y, int direction, unsigned int modifiers = MODIFIER_NONE); // Ctrl zooms
+
+    // Keyboard input: editing and caret navigation
+    void onKeyDown(VirtualKeycode key, unsigned int modifiers = MODIFIER_NONE);
+    void onTextInput(const std::string& text);
+
+    // In-document search: matches are highlighted as they're found, F3 / Shift+F3 jump between them
+    bool setSearchQuery(const std::string& needle, bool regex = false); // False if the regex is invalid
+    void findNext(bool forward = true);
+
+    // Thread-safe: render, search and saver threads ask for a repaint of the document they worked on, which
+    // might have been switched out in the meantime
+    void repaintIfShowing(const Document *document);
     
     void setViewportYOffset(SkScalar value);
 
@@ -47,7 +73,16 @@ namespace varco {
     friend class Document;
 
     Document *m_document = nullptr;
+    std::atomic<const Document*> m_shownDocument{ nullptr }; // Same as m_document, readable from any thread
     std::unique_ptr<ScrollBar> m_verticalScrollBar;    
+    std::unique_ptr<Minimap> m_minimap;
+    bool m_minimapVisible = true;
+    int computeWrapWidth() const; // Space left for the document by the scrollbar and the minimap
+    void scrollToRow(SkScalar row);
+    RenderMode m_renderMode = RenderMode::GpuTextures;
+    int m_tabWidth = Document::DEFAULT_TAB_WIDTH;
+    SkScalar m_zoom = 1.f;
+    SkScalar getEffectiveZoom() const;
 
     inline void setVScrollbarValue(SkScalar value) {
       m_verticalScrollBar->m_value = value;
@@ -56,19 +91,46 @@ namespace varco {
       return m_verticalScrollBar->m_value;
     }
 
-    sk_sp<SkTypeface> m_typeface; // Font used throughout the control
-    SkPaint m_fontPaint; // Paint data for the font
-    int m_textSize = 14;
+    std::shared_ptr<const Theme> m_theme; // Snapshot of fonts and paints used throughout the control
+    void applyTheme(std::shared_ptr<const Theme> theme);
 
     SkScalar m_characterWidthPixels, m_characterHeightPixels;
-    SkPaint::FontMetrics m_fontMetrics; // Font metrics for advanced rendering
     int m_wrapWidthInPixels = 0;
     bool m_codeViewInitialized = false; // This control is initialized and ready to render
                                         // documents as soon as the first resize happens
 
-    InterpolationSequence m_caretInterpolatorSequence;
+    SkRect getCaretRect(); // Area covered by the caret relative to the control (empty if not in sight)
+    void getCaretCell(int& row, int& column); // Where the caret is displayed (editor line and column)
+    void getCell(size_t line, size_t column, int& row, int& cellColumn); // m_documentMutex must be held
+    void paintSelections(SkCanvas& canvas);
+    void paintSearchMatches(SkCanvas& canvas);
+    void paintMatchingBrackets(SkCanvas& canvas);
+    void paintFoldMarkers(SkCanvas& canvas);
+    void paintSaveProgress(SkCanvas& canvas);
+    // The rows in sight as (rendered document rect, view rect) pairs: one pair for every run of rows which
+    // isn't interrupted by a folded region
+    std::vector<std::pair<SkRect, SkRect>> getVisibleDocumentRects(const SkRect& viewRect, SkScalar zoom);
+    bool moveCaret(VirtualKeycode key, DocumentPosition& caret); // False if the key doesn't move carets
+    void ensureCaretVisible();
+    void onDocumentEdited();
+    void restartCaretFade();
+    void onCaretFrame();
+    std::mutex m_caretFadeMutex; // Input restarts the fade while the scheduler ticks it
+    InterpolationSequence m_caretFade; // The caret's alpha, read by paintOverlay() without the lock
+    bool m_caretFading = false; // The fade is registered with the scheduler
+    std::mutex m_caretDamageMutex;
+    SkRect m_caretDamageRect = SkRect::MakeEmpty(); // Where the caret was last drawn, for the scheduler thread
 
     SkScalar m_currentYoffset = 0; // Y offset percentage in the current document (also the line we're at)
+    int m_scrollbarRows = -1; // Document rows the scrollbar was last told about in paint()
+    int getScrollbarRows(); // Rows of the document, lines of the file for streamed documents
+
+    void scrollStreamTo(SkScalar line); // Streamed documents only
+    void showStreamLine(size_t windowLine, SkScalar fraction);
+    SkScalar getStreamAnchorRow();
+    size_t m_streamAnchorLine = 0; // Line of the window the view was moved to
+    SkScalar m_streamAnchorFraction = 0;
+    bool m_streamAnchorPending = false; // Waiting for the window to be laid out
 
     ThreadPool m_threadPool;
   };
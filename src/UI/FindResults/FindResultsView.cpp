@@ -0,0 +1,174 @@
+#include <UI/FindResults/FindResultsView.hpp>
+#include <Document/ColumnMap.hpp>
+#include <Utils/Utils.hpp>
+#include <SkCanvas.h>
+#include <algorithm>
+
+namespace varco {
+
+#define ROW_PADDING 4 // Additional vertical pixels for every row
+#define WHEEL_ROWS 3 // Rows scrolled by a mouse wheel step
+#define PREVIEW_TAB_WIDTH 4 // Columns between the tab stops of the previews
+
+  FindResultsView::FindResultsView(UIElement<ui_container_tag>& parentContainer) :
+    UIElement(parentContainer)
+  {
+    m_theme = ThemeCache::get().getTheme();
+  }
+
+  void FindResultsView::setVisible(bool visible) {
+    m_visible = visible;
+    m_dirty = true;
+    m_parentContainer.repaint();
+  }
+
+  bool FindResultsView::isVisible() const {
+    return m_visible;
+  }
+
+  // Worker threads only ask for a repaint: paint() finds out on the UI thread whether the search progressed
+  void FindResultsView::invalidate() {
+    if (m_visible)
+      m_parentContainer.repaint();
+  }
+
+  void FindResultsView::setSource(FindInFiles *findInFiles) {
+    m_findInFiles = findInFiles;
+    m_firstRow = 0;
+    m_dirty = true;
+  }
+
+  SkScalar FindResultsView::getRowHeight() const {
+    return m_theme->getCharacterHeightPixels() + ROW_PADDING;
+  }
+
+  size_t FindResultsView::getVisibleRows() const {
+    SkScalar height = m_rect.height() - getRowHeight(); // The first row is the summary
+    return height > 0 ? static_cast<size_t>(height / getRowHeight()) : 0;
+  }
+
+  void FindResultsView::paint() {
+
+    std::tuple<size_t, size_t, bool> progress;
+    if (m_findInFiles != nullptr)
+      progress = std::make_tuple(m_findInFiles->getResultCount(), m_findInFiles->getFilesSearched(), m_findInFiles->isFinished());
+    if (!m_dirty && progress == m_paintedProgress)
+      return;
+
+    m_dirty = false;
+    m_paintedProgress = progress;
+
+    auto latestTheme = ThemeCache::get().getTheme();
+    if (latestTheme != m_theme)
+      m_theme = latestTheme;
+
+    SkCanvas canvas(m_bitmap);
+    SkRect rect = getRect(absoluteRect);
+
+    //////////////////////////////////////////////////////////////////////
+    // Background and a separator line from the code view
+    //////////////////////////////////////////////////////////////////////
+    {
+      SkPaint background;
+      background.setColor(m_theme->getPanelBackgroundColor());
+      canvas.drawRect(rect, background);
+      SkPaint separator;
+      separator.setColor(m_theme->getSeparatorColor());
+      canvas.drawLine(rect.fLeft, rect.fTop, rect.fRight, rect.fTop, separator);
+    }
+
+    if (m_findInFiles == nullptr)
+      return;
+
+    SkScalar rowHeight = getRowHeight();
+    SkScalar baseline = -m_theme->getFontMetrics().fTop + ROW_PADDING / 2;
+
+    //////////////////////////////////////////////////////////////////////
+    // Summary
+    //////////////////////////////////////////////////////////////////////
+    size_t resultCount = m_findInFiles->getResultCount();
+    {
+      std::string summary;
+      if (!m_findInFiles->getError().empty())
+        summary = "Invalid regular expression: " + m_findInFiles->getError();
+      else {
+        summary = std::to_string(resultCount) + " matches in " + std::to_string(m_findInFiles->getFileCount()) +
+                  " files (" + std::to_string(m_findInFiles->getFilesSearched()) + " searched)";
+        if (!m_findInFiles->isFinished())
+          summary += ", searching...";
+      }
+      SkPaint summaryPaint = m_theme->getTabTitlePaint();
+      canvas.drawText(summary.data(), summary.size(), 10, rowHeight - ROW_PADDING, summaryPaint);
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    // Visible results only
+    //////////////////////////////////////////////////////////////////////
+    size_t visibleRows = getVisibleRows();
+    if (m_firstRow >= resultCount)
+      m_firstRow = resultCount > visibleRows ? resultCount - visibleRows : 0;
+    std::vector<FileMatch> results = m_findInFiles->getResults(m_firstRow, visibleRows);
+
+    const SkPaint& locationPaint = m_theme->getStylePaint(Comment);
+    const SkPaint& previewPaint = m_theme->getStylePaint(Normal);
+    SkPaint highlight;
+    highlight.setColor(SkColorSetARGB(110, 230, 219, 88));
+    SkScalar characterWidth = m_theme->getCharacterWidthPixels();
+
+    SkScalar y = rowHeight;
+    for (const auto& result : results) {
+      std::string location = result.m_path + ":" + std::to_string(result.m_line + 1) + ": ";
+      SkScalar x = 10;
+      canvas.drawText(location.data(), location.size(), x, y + baseline, locationPaint);
+      x += location.size() * characterWidth;
+
+      // Matches are reported in bytes of the line as it is, previews are shown with their tabs expanded
+      const std::string& text = result.m_preview;
+      auto columnAt = [&text](size_t offset) {
+        size_t inPreview = std::min(offset, text.size()); // The match might go past a truncated preview
+        return getColumnCount(text.data(), inPreview, PREVIEW_TAB_WIDTH) + (offset - inPreview);
+      };
+      size_t from = columnAt(result.m_column), to = columnAt(result.m_column + result.m_length);
+      canvas.drawRect(SkRect::MakeXYWH(x + from * characterWidth, y, (to - from) * characterWidth, rowHeight), highlight);
+      std::string preview;
+      preview.reserve(text.size());
+      for (char c : text) {
+        if (c == '\t')
+          preview.append(PREVIEW_TAB_WIDTH - preview.size() % PREVIEW_TAB_WIDTH, ' ');
+        else
+          preview += c;
+      }
+      canvas.drawText(preview.data(), preview.size(), x, y + baseline, previewPaint);
+      y += rowHeight;
+    }
+  }
+
+  void FindResultsView::onLeftMouseDown(SkScalar x, SkScalar y) {
+    if (m_findInFiles == nullptr || !signalResultSelected)
+      return;
+    SkScalar relativeY = y - m_rect.fTop - getRowHeight();
+    if (relativeY < 0)
+      return;
+    size_t row = m_firstRow + static_cast<size_t>(relativeY / getRowHeight());
+    std::vector<FileMatch> results = m_findInFiles->getResults(row, 1);
+    if (!results.empty())
+      signalResultSelected(results.front());
+  }
+
+  void FindResultsView::onMouseWheel(SkScalar x, SkScalar y, int direction) {
+    if (m_findInFiles == nullptr || direction == 0)
+      return;
+
+    size_t resultCount = m_findInFiles->getResultCount();
+    size_t visibleRows = getVisibleRows();
+    size_t lastFirstRow = resultCount > visibleRows ? resultCount - visibleRows : 0;
+    if (direction == 1)
+      m_firstRow = std::min(m_firstRow + WHEEL_ROWS, lastFirstRow);
+    else
+      m_firstRow = m_firstRow > WHEEL_ROWS ? m_firstRow - WHEEL_ROWS : 0;
+
+    m_dirty = true;
+    m_parentContainer.repaint();
+  }
+
+}
@@ -0,0 +1,47 @@
+#ifndef VARCO_FINDRESULTSVIEW_HPP
+#define VARCO_FINDRESULTSVIEW_HPP
+
+#include <UI/UIElement.hpp>
+#include <UI/Theme/Theme.hpp>
+#include <Control/FindInFiles.hpp>
+#include <functional>
+#include <atomic>
+#include <tuple>
+
+namespace varco {
+
+  class DocumentManager;
+
+  // The results panel of a find-in-files search: a summary line plus a "path:line: preview" row for every
+  // match. Results stay in the FindInFiles object, only the visible rows are fetched when painting
+  class FindResultsView : public UIElement<ui_control_tag> {
+  public:
+    FindResultsView(UIElement<ui_container_tag>& parentContainer);
+
+    void paint() override;
+    void onLeftMouseDown(SkScalar x, SkScalar y);
+    void onMouseWheel(SkScalar x, SkScalar y, int direction);
+
+    void setVisible(bool visible);
+    bool isVisible() const;
+    void invalidate(); // New results are available (might be called from any thread)
+
+  private:
+    friend class DocumentManager;
+
+    void setSource(FindInFiles *findInFiles); // Also scrolls back to the first result
+    SkScalar getRowHeight() const;
+    size_t getVisibleRows() const;
+
+    FindInFiles *m_findInFiles = nullptr;
+    std::shared_ptr<const Theme> m_theme;
+    std::atomic<bool> m_visible{ false };
+    size_t m_firstRow = 0; // Index of the first result displayed
+    std::tuple<size_t, size_t, bool> m_paintedProgress; // Results, files searched and finished as last painted
+
+    std::function<void(const FileMatch&)> signalResultSelected; // Callback for document handlers
+  };
+
+}
+
+#endif // VARCO_FINDRESULTSVIEW_HPP
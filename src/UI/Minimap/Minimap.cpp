@@ -0,0 +1,132 @@
+#include <UI/Minimap/Minimap.hpp>
+#include <Document/Document.hpp>
+#include <UI/Theme/Theme.hpp>
+#include <SkCanvas.h>
+#include <algorithm>
+#include <cmath>
+
+namespace varco {
+
+#define LINE_PIXELS 1 // Vertical pixels per line (characters are a pixel wide)
+
+  Minimap::Minimap(UIElement<ui_container_tag>& parentContainer, std::function<void(SkScalar)> scrollCallback) :
+    UIElement(parentContainer),
+    m_scrollCallback(std::move(scrollCallback))
+  {}
+
+  void Minimap::setView(Document *document, SkScalar firstRow, SkScalar visibleRows) {
+    m_document = document;
+    m_firstRow = firstRow;
+    m_visibleRows = visibleRows;
+    m_dirty = true;
+  }
+
+  bool Minimap::isTrackingActive() const {
+    return m_tracking;
+  }
+
+  void Minimap::paint() {
+
+    if (!m_dirty)
+      return;
+
+    m_dirty = false;
+
+    auto theme = ThemeCache::get().getTheme();
+    SkCanvas canvas(m_bitmap);
+    SkRect rect = getRect(absoluteRect);
+
+    {
+      SkPaint background;
+      background.setColor(theme->getBackgroundColor());
+      canvas.drawRect(rect, background);
+    }
+
+    if (m_document == nullptr)
+      return;
+
+    std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+    const TextBuffer& buffer = m_document->m_buffer;
+    const auto& physicalLines = m_document->m_physicalLines;
+    const auto& index = m_document->m_rowIndex; // The view's rows skip the folded lines, the minimap doesn't
+    const size_t lineCount = buffer.getLineCount();
+    const bool hasLayout = m_document->hasLayout();
+
+    // Physical line containing a view row, O(log n)
+    auto lineOfRow = [&](SkScalar row) {
+      size_t r = static_cast<size_t>(std::max(0.f, row));
+      return std::min(hasLayout ? index.findVisible(r) : r, lineCount);
+    };
+
+    // Scroll proportionally to the view when the document doesn't fit
+    size_t shownLines = static_cast<size_t>(rect.height() / LINE_PIXELS);
+    m_firstLine = 0;
+    if (lineCount > shownLines) {
+      SkScalar rows = static_cast<SkScalar>(hasLayout ? index.visibleTotal() : lineCount);
+      SkScalar fraction = std::min(1.f, std::max(0.f, m_firstRow / std::max(1.f, rows - m_visibleRows)));
+      m_firstLine = static_cast<size_t>(fraction * (lineCount - shownLines));
+    }
+
+    auto source = [&](size_t first, size_t count) {
+      std::vector<MinimapTiles::Line> lines;
+      lines.reserve(count);
+      buffer.forEachLine(first, first + count, [&](size_t line, const std::string& text) {
+        lines.push_back({ text.substr(0, MinimapTiles::COLUMNS), {} });
+        if (hasLayout) // Runs recorded from the style database at the last render (kept up to date by edits)
+          lines.back().m_styleRuns = physicalLines[line].m_styleRuns;
+        return true;
+      });
+      return lines;
+    };
+    m_document->m_minimapTiles.draw(canvas, m_firstLine, std::min(shownLines, lineCount - m_firstLine), 0, 0,
+                                    LINE_PIXELS, theme, m_document->m_tabWidth, source);
+
+    // Lines in the view
+    size_t viewFirst = lineOfRow(m_firstRow);
+    size_t viewLast = lineOfRow(m_firstRow + m_visibleRows) + 1;
+    lock.unlock();
+
+    SkPaint viewPaint;
+    viewPaint.setColor(SkColorSetARGB(40, 255, 255, 255));
+    SkScalar top = (static_cast<SkScalar>(viewFirst) - m_firstLine) * LINE_PIXELS;
+    SkScalar bottom = (static_cast<SkScalar>(viewLast) - m_firstLine) * LINE_PIXELS;
+    canvas.drawRect(SkRect::MakeLTRB(rect.fLeft, std::max(top, rect.fTop), rect.fRight, std::min(bottom, rect.fBottom)), viewPaint);
+  }
+
+  void Minimap::scrollToPoint(SkScalar y) {
+    if (m_document == nullptr)
+      return;
+
+    size_t line = m_firstLine + static_cast<size_t>(std::max(0.f, y - m_rect.fTop) / LINE_PIXELS);
+    SkScalar row;
+    {
+      std::unique_lock<std::mutex> lock(m_document->m_documentMutex);
+      size_t lineCount = m_document->m_buffer.getLineCount();
+      line = std::min(line, lineCount > 0 ? lineCount - 1 : 0);
+      if (m_document->hasLayout()) // A folded line scrolls to the visible one after it, O(log n)
+        row = static_cast<SkScalar>(m_document->m_rowIndex.visiblePrefixSum(line));
+      else
+        row = static_cast<SkScalar>(line);
+    }
+    m_scrollCallback(std::max(0.f, std::floor(row - m_visibleRows / 2)));
+  }
+
+  void Minimap::onLeftMouseDown(SkScalar x, SkScalar y) {
+    m_tracking = true;
+    m_parentContainer.startMouseCapture();
+    scrollToPoint(y);
+  }
+
+  void Minimap::onMouseMove(SkScalar x, SkScalar y) {
+    if (m_tracking)
+      scrollToPoint(y);
+  }
+
+  void Minimap::onLeftMouseUp(SkScalar x, SkScalar y) {
+    if (!m_tracking)
+      return;
+    m_tracking = false;
+    m_parentContainer.stopMouseCapture();
+  }
+
+}
@@ -0,0 +1,41 @@
+#ifndef VARCO_MINIMAP_HPP
+#define VARCO_MINIMAP_HPP
+
+#include <UI/UIElement.hpp>
+#include <functional>
+
+namespace varco {
+
+  class Document;
+
+  // A downsampled view of the whole document next to the vertical scrollbar (one pixel per character cell).
+  // When the document is taller than the control, the minimap scrolls proportionally with the view. The
+  // image itself is kept by the document as tiles (see MinimapTiles)
+  class Minimap : public UIElement<ui_control_tag> {
+  public:
+    Minimap(UIElement<ui_container_tag>& parentContainer, std::function<void(SkScalar)> scrollCallback);
+
+    // The document and the rows of it the code view is showing. Must be set before painting
+    void setView(Document *document, SkScalar firstRow, SkScalar visibleRows);
+    void paint() override;
+
+    // Clicking or dragging scrolls the view to center the line under the pointer
+    void onLeftMouseDown(SkScalar x, SkScalar y);
+    void onMouseMove(SkScalar x, SkScalar y);
+    void onLeftMouseUp(SkScalar x, SkScalar y);
+    bool isTrackingActive() const;
+
+  private:
+    void scrollToPoint(SkScalar y);
+
+    std::function<void(SkScalar)> m_scrollCallback; // Receives the first editor row to show
+    Document *m_document = nullptr;
+    SkScalar m_firstRow = 0;
+    SkScalar m_visibleRows = 0;
+    size_t m_firstLine = 0; // First physical line shown by the minimap at the last paint
+    bool m_tracking = false;
+  };
+
+}
+
+#endif // VARCO_MINIMAP_HPP
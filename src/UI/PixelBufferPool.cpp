@@ -0,0 +1,127 @@
+#include <UI/PixelBufferPool.hpp>
+#include <algorithm>
+#include <cstdlib>
+
+namespace varco {
+
+#define MIN_BUFFER_BYTES (64 << 10) // Smaller bitmaps still take a whole bucket of this size
+#define BUFFER_HEADER_BYTES 64 // Where the capacity of a buffer is kept, before its pixels (keeps them aligned)
+
+  namespace {
+    // Rounded up to the next of four buckets between two powers of two: at most a fifth of a buffer is wasted
+    size_t getBucketCapacity(size_t bytes) {
+      if (bytes <= MIN_BUFFER_BYTES)
+        return MIN_BUFFER_BYTES;
+      size_t power = MIN_BUFFER_BYTES;
+      while (power < bytes)
+        power *= 2;
+      const size_t step = power / 8; // Between power / 2 and power
+      return (bytes + step - 1) / step * step;
+    }
+  }
+
+  PixelBufferPool& PixelBufferPool::get() {
+    // Never destroyed: bitmaps and images released during static destruction still give their pixels back
+    static PixelBufferPool *pool = new PixelBufferPool();
+    return *pool;
+  }
+
+  void PixelBufferPool::allocPixels(SkBitmap& bitmap, const SkImageInfo& info) {
+    bitmap.reset();
+    const size_t rowBytes = info.minRowBytes();
+    const size_t bytes = info.getSafeSize(rowBytes);
+    if (bytes == 0) {
+      bitmap.allocPixels(info);
+      return;
+    }
+    const size_t capacity = getBucketCapacity(bytes);
+
+    char *data = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      ++m_statistics.m_acquired;
+      // The smallest idle buffer it fits in (up to twice its bucket), the newest of them
+      auto best = m_idle.end();
+      for (auto it = m_idle.begin(); it != m_idle.end(); ++it) {
+        if (it->m_capacity >= capacity && it->m_capacity <= capacity * 2 &&
+            (best == m_idle.end() || it->m_capacity <= best->m_capacity))
+          best = it;
+      }
+      if (best != m_idle.end()) {
+        data = best->m_data;
+        m_statistics.m_bytesIdle -= best->m_capacity;
+        m_statistics.m_bytesInUse += best->m_capacity;
+        m_idle.erase(best);
+        ++m_statistics.m_reused;
+      } else {
+        // Room is made for the new buffer first: idle ones are freed to stay within the cap
+        m_statistics.m_bytesInUse += capacity;
+        enforceCap();
+      }
+    }
+
+    if (data == nullptr) {
+      data = static_cast<char*>(std::malloc(BUFFER_HEADER_BYTES + capacity));
+      if (data == nullptr) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_statistics.m_bytesInUse -= capacity;
+        lock.unlock();
+        bitmap.allocPixels(info); // Fails as SkBitmap does
+        return;
+      }
+      *reinterpret_cast<size_t*>(data) = capacity;
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_statistics.m_highWaterMark = std::max(m_statistics.m_highWaterMark, m_statistics.m_bytesInUse + m_statistics.m_bytesIdle);
+    }
+
+    if (!bitmap.installPixels(info, data + BUFFER_HEADER_BYTES, rowBytes, nullptr, &PixelBufferPool::releasePixels, this)) {
+      release(data);
+      bitmap.allocPixels(info);
+    }
+  }
+
+  void PixelBufferPool::setCap(size_t bytes) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cap = bytes;
+    enforceCap();
+  }
+
+  void PixelBufferPool::trim() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (const auto& buffer : m_idle)
+      std::free(buffer.m_data);
+    m_statistics.m_freed += m_idle.size();
+    m_statistics.m_bytesIdle = 0;
+    m_idle.clear();
+  }
+
+  PixelBufferPool::Statistics PixelBufferPool::getStatistics() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_statistics;
+  }
+
+  void PixelBufferPool::releasePixels(void *pixels, void *context) {
+    static_cast<PixelBufferPool*>(context)->release(static_cast<char*>(pixels) - BUFFER_HEADER_BYTES);
+  }
+
+  void PixelBufferPool::release(char *data) {
+    const size_t capacity = *reinterpret_cast<size_t*>(data);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_statistics.m_bytesInUse -= capacity;
+    m_statistics.m_bytesIdle += capacity;
+    m_idle.push_back({ data, capacity });
+    enforceCap();
+  }
+
+  void PixelBufferPool::enforceCap() {
+    size_t evicted = 0;
+    while (evicted < m_idle.size() && m_statistics.m_bytesInUse + m_statistics.m_bytesIdle > m_cap) {
+      std::free(m_idle[evicted].m_data);
+      m_statistics.m_bytesIdle -= m_idle[evicted].m_capacity;
+      ++evicted;
+    }
+    m_idle.erase(m_idle.begin(), m_idle.begin() + evicted);
+    m_statistics.m_freed += evicted;
+  }
+
+}
@@ -0,0 +1,59 @@
+#ifndef VARCO_PIXELBUFFERPOOL_HPP
+#define VARCO_PIXELBUFFERPOOL_HPP
+
+#include <SkBitmap.h>
+#include <SkImageInfo.h>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace varco {
+
+  // A process-wide pool of pixel buffers for the bitmaps of the controls and of the render partials. A bitmap
+  // whose pixels come from here gives them back when the last bitmap (or image) sharing them goes away, and
+  // the next bitmap of about the same size takes them again instead of allocating (and page faulting) new
+  // ones: e.g. the control bitmaps while the window is resized, or the partials of every render.
+  //
+  // Buffers are sized in buckets, four between two powers of two. The pool holds on to idle buffers as long as
+  // they and the ones in use stay within a cap: the oldest idle ones are freed first when it's exceeded
+  class PixelBufferPool {
+  public:
+    struct Statistics {
+      size_t m_acquired = 0; // Buffers handed out
+      size_t m_reused = 0; // Of them, the ones which were idle in the pool
+      size_t m_freed = 0; // Idle buffers given back to the heap (over the cap or trimmed)
+      size_t m_bytesInUse = 0;
+      size_t m_bytesIdle = 0;
+      size_t m_highWaterMark = 0; // Largest m_bytesInUse + m_bytesIdle so far
+    };
+
+    static PixelBufferPool& get();
+
+    // As SkBitmap::allocPixels() (the pixels aren't cleared either). The bitmap's previous pixels are
+    // released first, so that they can be taken again if they're still the right size
+    void allocPixels(SkBitmap& bitmap, const SkImageInfo& info);
+
+    void setCap(size_t bytes); // Idle buffers over it are freed right away
+    void trim(); // Frees all the idle buffers
+    Statistics getStatistics();
+
+  private:
+    struct Buffer {
+      char *m_data;
+      size_t m_capacity;
+    };
+
+    PixelBufferPool() = default;
+    static void releasePixels(void *pixels, void *context);
+    void release(char *data);
+    void enforceCap(); // m_mutex must be held
+
+    std::mutex m_mutex;
+    std::vector<Buffer> m_idle; // Oldest first
+    size_t m_cap = 256 << 20;
+    Statistics m_statistics;
+  };
+
+}
+
+#endif // VARCO_PIXELBUFFERPOOL_HPP
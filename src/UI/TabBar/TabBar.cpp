@@ -1,8 +1,9 @@
 #include <WindowHandling/MainWindow.hpp>
 #include <UI/TabBar/TabBar.hpp>
 #include <Utils/Utils.hpp>
+#include <Utils/AnimationScheduler.hpp>
 #include <SkCanvas.h>
-#include <SkTypeface.h>
+#include <UI/Theme/Theme.hpp>
 #include <SkGradientShader.h>
 #include <algorithm>
 
@@ -128,17 +129,7 @@ namespace varco {
     tabBorderPaint.setColor(SkColorSetARGB(255, 70, 70, 70));
     canvas.drawPath(path, tabBorderPaint); // Stroke
 
-    sk_sp<SkTypeface> arialTypeface = SkTypeface::MakeFromName("Arial",
-                                                               SkFontStyle{SkFontStyle::Weight::kNormal_Weight,
-                                                               SkFontStyle::Width::kNormal_Width,
-                                                               SkFontStyle::Slant::kUpright_Slant}); // Or closest match
-    SkPaint tabTextPaint;
-    tabTextPaint.setColor(SK_ColorWHITE);
-    tabTextPaint.setAlpha(255);
-    tabTextPaint.setTextSize(SkIntToScalar(11));
-    tabTextPaint.setAntiAlias(true);
-    tabTextPaint.setLCDRenderText(true);
-    tabTextPaint.setTypeface(arialTypeface);
+    SkPaint tabTextPaint = ThemeCache::get().getTheme()->getTabTitlePaint(); // Cheap copy, the typeface is shared
 
     SkRect textRect = SkRect::MakeLTRB(tabRect.fLeft + 20, tabRect.fTop + 5, tabRect.fRight - 15, tabRect.fBottom - 5);
     canvas.save();
@@ -159,9 +150,9 @@ namespace varco {
   }
 
   void Tab::resize() {
-    bitmap.allocPixels(SkImageInfo::Make( (int)this->parent->tabsCurrentRect.width(),
-                                          (int)this->parent->tabsCurrentRect.height(),
-                                          kN32_SkColorType, kPremul_SkAlphaType) );
+    PixelBufferPool::get().allocPixels(bitmap, SkImageInfo::Make( (int)this->parent->tabsCurrentRect.width(),
+                                                                  (int)this->parent->tabsCurrentRect.height(),
+                                                                  kN32_SkColorType, kPremul_SkAlphaType) );
     this->dirty = true;
   }
 
@@ -176,6 +167,10 @@ namespace varco {
   
   void TabBar::resize(SkRect rect) {
     UIElement::resize(rect); // Call base class first
+    {
+      std::lock_guard<std::mutex> lock(m_damageRectMutex);
+      m_damageRect = m_rect;
+    }
 
     if (this->m_dirty)
       recalculateTabsRects();
@@ -197,11 +192,10 @@ namespace varco {
     }
   }
 
-  bool TabBar::getAndDecreaseMovementOffsetForTab(int tab, SkScalar& movement) {
-    movement = tabs[tab].getMovementOffset();
+  SkScalar TabBar::getMovementOffsetForTab(int tab, std::chrono::steady_clock::time_point now) {
+    SkScalar movement = tabs[tab].getMovementOffset();
     if (movement != 0.f) {
       // Decrease movement offset over time
-      auto now = std::chrono::system_clock::now();
       auto timeFromStart = now - tabs[tab].firstMovementTime;
       // Force the amount of movement to complete in 'movementMilliseconds' ms
       auto timeFromStartInMs = std::chrono::duration_cast<std::chrono::milliseconds>(timeFromStart).count();      
@@ -212,9 +206,37 @@ namespace varco {
         auto amount = timeFromStartInMs / static_cast<float>(movementMilliseconds);
         movement -= movement * amount;
       }
-      return true; // Also needs a redraw
     }
-    return false;
+    return movement;
+  }
+
+  void TabBar::startMovementAnimation(std::chrono::steady_clock::time_point movementStart) {
+    auto deadline = movementStart + std::chrono::milliseconds(static_cast<int>(movementMilliseconds));
+    auto deadlineTicks = deadline.time_since_epoch().count();
+    auto current = m_movementDeadline.load();
+    while (current < deadlineTicks && !m_movementDeadline.compare_exchange_weak(current, deadlineTicks))
+      ; // Only ever move the deadline forward, even if another thread pushed it meanwhile
+
+    if (m_movementAnimationActive.exchange(true))
+      return; // Already being animated, the deadline update is enough
+
+    m_parentContainer.getAnimationScheduler().addAnimation([this](AnimationScheduler::Clock::time_point now) {
+      SkRect damageRect;
+      {
+        std::lock_guard<std::mutex> lock(m_damageRectMutex);
+        damageRect = m_damageRect;
+      }
+      m_dirty = true;
+      m_parentContainer.repaintRect(damageRect); // Only the tab bar needs to be presented again
+      if (now.time_since_epoch().count() < m_movementDeadline)
+        return true;
+      // All movements completed (the frame above let the tabs settle to their home positions), unless
+      // a new one started in the meantime and nobody else registered for it
+      m_movementAnimationActive = false;
+      if (now.time_since_epoch().count() < m_movementDeadline && !m_movementAnimationActive.exchange(true))
+        return true;
+      return false;
+    });
   }
 
   void TabBar::paint() {
@@ -222,7 +244,7 @@ namespace varco {
     if (!m_dirty)
       return;
 
-    m_dirty = false; // It will be false at the end of this function, unless overridden
+    m_dirty = false;
 
     SkCanvas canvas(m_bitmap);
 
@@ -275,19 +297,16 @@ namespace varco {
 
     }
 
+    // All the movement offsets of this frame are computed from the same time
+    auto now = std::chrono::steady_clock::now();
+
     SkScalar tabOffset = 0.0f;
     for (auto i = 0; i < tabs.size(); ++i) {
       Tab& tab = tabs[i];
       tab.setOffset(tabOffset);
       auto tabOffsetWithMovement = tabOffset;
-      if (i != selectedTabIndex) { // Selected one is special and is tracked
-        SkScalar movementOffset = 0.f;
-        auto needRedraw = getAndDecreaseMovementOffsetForTab(i, movementOffset);
-        if (movementOffset != 0)
-          tabOffsetWithMovement += movementOffset;
-        if (needRedraw)
-          m_dirty = true;
-      }
+      if (i != selectedTabIndex) // Selected one is special and is tracked
+        tabOffsetWithMovement += getMovementOffsetForTab(i, now);
       tab.paint(); // Render the tab into its own buffer
       if (i != selectedTabIndex) // The selected one is drawn AFTER all the others
         canvas.drawBitmap(tab.getBitmap(), rect.fLeft + tabOffsetWithMovement, rect.fTop);
@@ -312,11 +331,8 @@ namespace varco {
       auto movementOrTrackingOffset = 0.0f;
       if (m_tracking == true)
         movementOrTrackingOffset = tabs[selectedTabIndex].getTrackingOffset();
-      else {
-        auto needRedraw = getAndDecreaseMovementOffsetForTab(selectedTabIndex, movementOrTrackingOffset);
-        if (needRedraw)
-          m_dirty = true;
-      }
+      else
+        movementOrTrackingOffset = getMovementOffsetForTab(selectedTabIndex, now);
 
       selectedTabOffset = rect.fLeft + tabs[selectedTabIndex].getOffset() + movementOrTrackingOffset;
       canvas.drawBitmap(tabs[selectedTabIndex].getBitmap(), selectedTabOffset, rect.fTop);
@@ -324,9 +340,6 @@ namespace varco {
 
     canvas.flush();
     canvas.restore();
-
-    if (m_dirty == true)
-      m_parentContainer.repaint(); // Schedule a repaint
   }
 
   void TabBar::swapTabs(int tab1, int tab2) {
@@ -342,7 +355,8 @@ namespace varco {
 
       // Transfer the previous position for the unselected tab in movement offset (accumulate on it)
       tabs[unselectedTab].movementOffset += tabs[unselectedTab].getOffset() - tabs[selectedTabIndex].getOffset();
-      tabs[unselectedTab].firstMovementTime = std::chrono::system_clock::now();
+      tabs[unselectedTab].firstMovementTime = std::chrono::steady_clock::now();
+      startMovementAnimation(tabs[unselectedTab].firstMovementTime);
 
     } else { // swapped with a left unselected
 
@@ -351,7 +365,8 @@ namespace varco {
 
       // Transfer the previous position for the unselected tab in movement offset (accumulate on it)
       tabs[unselectedTab].movementOffset += tabs[unselectedTab].getOffset() - tabs[selectedTabIndex].getOffset();
-      tabs[unselectedTab].firstMovementTime = std::chrono::system_clock::now();
+      tabs[unselectedTab].firstMovementTime = std::chrono::steady_clock::now();
+      startMovementAnimation(tabs[unselectedTab].firstMovementTime);
 
     }
 
@@ -465,7 +480,8 @@ namespace varco {
 
     // Transfer the current tracking offset in movement offset (accumulate on it)
     tabs[selectedTabIndex].movementOffset += tabs[selectedTabIndex].trackingOffset;
-    tabs[selectedTabIndex].firstMovementTime = std::chrono::system_clock::now();
+    tabs[selectedTabIndex].firstMovementTime = std::chrono::steady_clock::now();
+    startMovementAnimation(tabs[selectedTabIndex].firstMovementTime);
 
     tabs[selectedTabIndex].trackingOffset = 0.0f;
 
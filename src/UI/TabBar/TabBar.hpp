@@ -7,6 +7,8 @@
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <atomic>
+#include <mutex>
 #include <map>
 #include <set>
 
@@ -73,7 +75,7 @@ namespace varco {
     SkScalar parentOffset; // The offset from the start of the parent tab control
     SkScalar movementOffset = 0.0; // A movement offset that decreases over time to reach
                                    // the parentOffset stationary value
-    std::chrono::time_point<std::chrono::system_clock> firstMovementTime;
+    std::chrono::steady_clock::time_point firstMovementTime;
     SkScalar trackingOffset = 0.0f; // The additional offset due to tracking
     bool selected = false; // Is this a selected tab?
   };
@@ -117,8 +119,15 @@ namespace varco {
     void swapTabs(int tab1, int tab2);
 
     void recalculateTabsRects(); // Recalculates all the tabs rects (e.g. shrinks them in case the window got smaller)
-    // Return true if the control needs redrawing
-    bool getAndDecreaseMovementOffsetForTab(int tab, SkScalar& movement);
+    // Returns the movement offset of a tab at the frame time 'now' (reaching zero after movementMilliseconds)
+    SkScalar getMovementOffsetForTab(int tab, std::chrono::steady_clock::time_point now);
+    // Makes sure the animation scheduler keeps repainting the control until the movement started at
+    // 'movementStart' has completed
+    void startMovementAnimation(std::chrono::steady_clock::time_point movementStart);
+    std::atomic<std::chrono::steady_clock::rep> m_movementDeadline{ 0 }; // When the last tab movement ends
+    std::atomic<bool> m_movementAnimationActive{ false };
+    std::mutex m_damageRectMutex;
+    SkRect m_damageRect = SkRect::MakeEmpty(); // m_rect as of the last resize, for the scheduler thread
 
     std::function<bool(int)> signalDocumentChange; // Callback for document handlers. Returns true if the change is allowed
   };
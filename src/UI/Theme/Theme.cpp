@@ -0,0 +1,162 @@
+#include <UI/Theme/Theme.hpp>
+#include <SkFontStyle.h>
+
+namespace varco {
+
+  ColorScheme getDefaultColorScheme() {
+    ColorScheme scheme;
+    scheme.m_background = SkColorSetARGB(255, 39, 40, 34);
+    scheme.m_panelBackground = SkColorSetARGB(255, 30, 31, 26);
+    scheme.m_separator = SkColorSetARGB(255, 70, 70, 70);
+    scheme.m_styles.fill(SK_ColorWHITE); // Normal and everything not listed below
+    scheme.m_styles[Comment] = SkColorSetARGB(255, 117, 113, 94); // Gray-ish
+    scheme.m_styles[Keyword] = SkColorSetARGB(255, 249, 38, 114); // Pink-ish
+    scheme.m_styles[QuotedString] = SkColorSetARGB(255, 230, 219, 88); // Yellow-ish
+    scheme.m_styles[Identifier] = SkColorSetARGB(255, 166, 226, 46); // Green-ish
+    scheme.m_styles[KeywordInnerScope] = SkColorSetARGB(255, 102, 217, 239); // Light blue
+    scheme.m_styles[FunctionCall] = SkColorSetARGB(255, 102, 217, 239);
+    scheme.m_styles[Literal] = SkColorSetARGB(255, 174, 129, 255); // Purple-ish
+    return scheme;
+  }
+
+  Theme::Theme(const ColorScheme& scheme, int textSize, sk_sp<SkTypeface> codeTypeface, sk_sp<SkTypeface> tabTypeface) :
+    m_scheme(scheme),
+    m_textSize(textSize)
+  {
+    SkPaint fontPaint;
+    fontPaint.setTextSize(SkIntToScalar(m_textSize));
+    fontPaint.setAntiAlias(true);
+    fontPaint.setAutohinted(true);
+    fontPaint.setLCDRenderText(true);
+    fontPaint.setTypeface(codeTypeface);
+    fontPaint.setColor(SK_ColorWHITE);
+
+    // The following is a conservative approach including kerning, hinting and antialiasing (a bit too much)
+    //SkRect bounds;
+    //fontPaint.measureText("A", 1, &bounds);
+    //m_characterWidthPixels = static_cast<int>(bounds.width());
+
+    SkScalar widths[1];
+    fontPaint.getTextWidths("A", 1, widths);
+    m_characterWidthPixels = widths[0];
+
+    /*
+     * Here is how the font metrics work
+     *
+     * ----------------------------------------- Top
+     * _________________________________ Ascent
+     *               C
+     * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ Baseline
+     * _________________________________ Descent
+     *
+     * ----------------------------------------- Bottom
+     * (leading)
+     *
+     * Notice thata character should be drawn from the baseline
+     * when drawText() is called, therefore we're also storing the Descent
+     * in order to subtract it from the line spacing before rendering.
+     *
+     */
+    fontPaint.getFontMetrics(&m_fontMetrics);
+    m_characterHeightPixels = m_fontMetrics.fBottom - m_fontMetrics.fTop;
+
+    for (size_t i = 0; i < STYLES_COUNT; ++i) {
+      m_stylePaints[i] = fontPaint;
+      m_stylePaints[i].setColor(m_scheme.m_styles[i]);
+    }
+
+    m_tabTitlePaint.setColor(SK_ColorWHITE);
+    m_tabTitlePaint.setAlpha(255);
+    m_tabTitlePaint.setTextSize(SkIntToScalar(11));
+    m_tabTitlePaint.setAntiAlias(true);
+    m_tabTitlePaint.setLCDRenderText(true);
+    m_tabTitlePaint.setTypeface(tabTypeface);
+  }
+
+  const SkPaint& Theme::getStylePaint(Style style) const {
+    return m_stylePaints[style];
+  }
+
+  const SkPaint& Theme::getTabTitlePaint() const {
+    return m_tabTitlePaint;
+  }
+
+  SkColor Theme::getBackgroundColor() const {
+    return m_scheme.m_background;
+  }
+
+  SkColor Theme::getPanelBackgroundColor() const {
+    return m_scheme.m_panelBackground;
+  }
+
+  SkColor Theme::getSeparatorColor() const {
+    return m_scheme.m_separator;
+  }
+
+  int Theme::getTextSize() const {
+    return m_textSize;
+  }
+
+  SkScalar Theme::getCharacterWidthPixels() const {
+    return m_characterWidthPixels;
+  }
+
+  SkScalar Theme::getCharacterHeightPixels() const {
+    return m_characterHeightPixels;
+  }
+
+  const SkPaint::FontMetrics& Theme::getFontMetrics() const {
+    return m_fontMetrics;
+  }
+
+  ThemeCache& ThemeCache::get() {
+    static ThemeCache cache;
+    return cache;
+  }
+
+  ThemeCache::ThemeCache() :
+    m_scheme(getDefaultColorScheme())
+  {
+    // Create a monospace typeface
+    // An alternative approach here is to ship a standard font for every/each platform
+    // e.g. SkTypeface::MakeFromFile("/home/alex/Desktop/UbuntuMono-R.ttf");
+    const char *font_family =
+#ifdef _WIN32
+      "Consolas";
+#elif defined __linux__
+      "monospace";
+#endif
+    SkFontStyle normalStyle{ SkFontStyle::Weight::kNormal_Weight,
+                             SkFontStyle::Width::kNormal_Width,
+                             SkFontStyle::Slant::kUpright_Slant };
+    // Try to match with the supplied font name or family name (or closest match)
+    m_codeTypeface = SkTypeface::MakeFromName(font_family, normalStyle);
+    m_tabTypeface = SkTypeface::MakeFromName("Arial", normalStyle); // Or closest match
+    rebuild();
+  }
+
+  std::shared_ptr<const Theme> ThemeCache::getTheme() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_theme;
+  }
+
+  void ThemeCache::setTextSize(int size) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (size == m_textSize || size <= 0)
+      return;
+    m_textSize = size;
+    rebuild();
+  }
+
+  void ThemeCache::setColorScheme(const ColorScheme& scheme) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_scheme = scheme;
+    rebuild();
+  }
+
+  void ThemeCache::rebuild() {
+    // Whoever still holds the previous snapshot keeps using it until it asks for a new one
+    m_theme = std::shared_ptr<const Theme>(new Theme(m_scheme, m_textSize, m_codeTypeface, m_tabTypeface));
+  }
+
+}
@@ -0,0 +1,79 @@
+#ifndef VARCO_THEME_HPP
+#define VARCO_THEME_HPP
+
+#include <Lexers/Lexer.hpp>
+#include <SkPaint.h>
+#include <SkTypeface.h>
+#include <memory>
+#include <mutex>
+#include <array>
+
+namespace varco {
+
+  constexpr const size_t STYLES_COUNT = CPP_include + 1; // Number of lexer styles
+
+  struct ColorScheme {
+    SkColor m_background;
+    SkColor m_panelBackground; // Panels below the code (e.g. the find results)
+    SkColor m_separator; // Lines between the code and the panels
+    std::array<SkColor, STYLES_COUNT> m_styles; // Text color for every lexer Style
+  };
+
+  ColorScheme getDefaultColorScheme(); // Monokai
+
+  // An immutable snapshot of everything needed to draw text: resolved typefaces, font metrics and a ready
+  // to use paint for every lexer style. Snapshots are shared by the UI and all the rendering threads: nobody
+  // ever modifies one after it has been built (thus no locking is needed to read them)
+  class Theme {
+  public:
+    const SkPaint& getStylePaint(Style style) const;
+    const SkPaint& getTabTitlePaint() const;
+    SkColor getBackgroundColor() const;
+    SkColor getPanelBackgroundColor() const;
+    SkColor getSeparatorColor() const;
+
+    int getTextSize() const;
+    SkScalar getCharacterWidthPixels() const;
+    SkScalar getCharacterHeightPixels() const;
+    const SkPaint::FontMetrics& getFontMetrics() const;
+
+  private:
+    friend class ThemeCache;
+    Theme(const ColorScheme& scheme, int textSize, sk_sp<SkTypeface> codeTypeface, sk_sp<SkTypeface> tabTypeface);
+
+    ColorScheme m_scheme;
+    int m_textSize;
+    SkScalar m_characterWidthPixels;
+    SkScalar m_characterHeightPixels;
+    SkPaint::FontMetrics m_fontMetrics;
+    std::array<SkPaint, STYLES_COUNT> m_stylePaints;
+    SkPaint m_tabTitlePaint;
+  };
+
+  // Owns the current Theme snapshot. Typefaces are resolved only once per process; font size and color
+  // scheme changes build a new snapshot here and nowhere else. Readers keep the snapshot they got for as
+  // long as they need it and compare it with getTheme() to know whether they should render again
+  class ThemeCache {
+  public:
+    static ThemeCache& get();
+
+    std::shared_ptr<const Theme> getTheme();
+
+    void setTextSize(int size);
+    void setColorScheme(const ColorScheme& scheme);
+
+  private:
+    ThemeCache();
+    void rebuild(); // The single invalidation point
+
+    std::mutex m_mutex;
+    sk_sp<SkTypeface> m_codeTypeface;
+    sk_sp<SkTypeface> m_tabTypeface;
+    ColorScheme m_scheme;
+    int m_textSize = 14;
+    std::shared_ptr<const Theme> m_theme;
+  };
+
+}
+
+#endif // VARCO_THEME_HPP
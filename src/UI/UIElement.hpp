@@ -1,10 +1,14 @@
 #ifndef VARCO_UIELEMENT_HPP
 #define VARCO_UIELEMENT_HPP
 
+#include <UI/PixelBufferPool.hpp>
 #include <SkBitmap.h>
+#include <atomic>
 
 namespace varco {
 
+  class AnimationScheduler;
+
   // Tag dispatching
   struct ui_container_tag {}; // This UI element is tagged to contain other UI elements
   struct ui_control_tag {}; // This UI element is a UI control
@@ -22,8 +26,14 @@ namespace varco {
     virtual ~UIElement() = default;
 
     virtual void repaint() = 0; // Might be requested by child controls (schedule or performs a repaint)
+    // Might be requested by child controls which only need a region of the container to be redrawn
+    // and presented (e.g. a blinking caret). The rect is relative to the container. Containers which
+    // can't track damaged regions just repaint everything
+    virtual void repaintRect(const SkRect&) { repaint(); }
     virtual void startMouseCapture() {} // Might be requested by child controls
     virtual void stopMouseCapture() {} // Might be requested by child controls
+    // The animation clock children register their animations with. Don't call this during construction
+    virtual AnimationScheduler& getAnimationScheduler() = 0;
   };
 
   template<>
@@ -38,7 +48,7 @@ namespace varco {
     UIElement<ui_container_tag>& m_parentContainer;
     SkRect m_rect; // Rect where to draw the control, relative to the client area of the parent
     SkBitmap m_bitmap; // The entire control will be rendered here
-    bool m_dirty = true;
+    std::atomic<bool> m_dirty{ true }; // Also set by animations on the scheduler thread
 
   public:
 
@@ -49,8 +59,9 @@ namespace varco {
         m_rect = rect;
 
         // This adjustment is necessary since the control needs not to know anything about its
-        // relative position on its parent. It always starts drawing its bitmap at top-left 0;0
-        m_bitmap.allocPixels(SkImageInfo::Make((int)(m_rect.fRight - m_rect.fLeft),
+        // relative position on its parent. It always starts drawing its bitmap at top-left 0;0.
+        // Pooled: while the window is resized the same few buffers go back and forth
+        PixelBufferPool::get().allocPixels(m_bitmap, SkImageInfo::Make((int)(m_rect.fRight - m_rect.fLeft),
           (int)(m_rect.fBottom - m_rect.fTop), kN32_SkColorType, kPremul_SkAlphaType));
         m_dirty = true;
       }
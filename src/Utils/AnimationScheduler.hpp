@@ -0,0 +1,90 @@
+#ifndef VARCO_ANIMATIONSCHEDULER_HPP
+#define VARCO_ANIMATIONSCHEDULER_HPP
+
+#include <Utils/FrameTimer.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <vector>
+
+namespace varco {
+
+  // The single animation clock of a window. Every animation registers a step function which is called
+  // once per frame with the same frame timestamp, so all the interpolated values of a frame are computed
+  // in one batch from a consistent time. The frame timer only runs while there's something animating.
+  class AnimationScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+    // Returns false when the animation has finished and should be removed
+    using AnimationStep = std::function<bool(Clock::time_point)>;
+
+    AnimationScheduler() :
+      m_frameTimer(std::chrono::milliseconds(16) /* ~60 fps */, [this]() { tick(); })
+    {}
+
+    // Returns an id which can be used to remove the animation before it finishes
+    int addAnimation(AnimationStep step) {
+      std::unique_lock<std::mutex> lock(m_animationsMutex);
+      int id = m_nextId++;
+      m_animations.emplace(id, std::make_shared<AnimationStep>(std::move(step)));
+      m_frameTimer.start();
+      return id;
+    }
+
+    void removeAnimation(int id) {
+      std::unique_lock<std::mutex> lock(m_animationsMutex);
+      m_animations.erase(id);
+    }
+
+    // Removes every animation and waits for a tick in progress to complete. After this returns no step
+    // will be called anymore, thus the owners of the animations can be safely destroyed
+    void shutdown() {
+      std::unique_lock<std::mutex> tickLock(m_tickMutex);
+      {
+        std::unique_lock<std::mutex> lock(m_animationsMutex);
+        m_animations.clear();
+        m_shutdown = true;
+      }
+      m_frameTimer.stop();
+    }
+
+  private:
+    void tick() {
+      std::unique_lock<std::mutex> tickLock(m_tickMutex);
+      auto now = Clock::now(); // One timestamp for the entire frame
+
+      // Steps are called without the animations lock held: they're free to add or remove animations
+      std::vector<std::pair<int, std::shared_ptr<AnimationStep>>> frame;
+      {
+        std::unique_lock<std::mutex> lock(m_animationsMutex);
+        if (m_shutdown)
+          return;
+        frame.assign(m_animations.begin(), m_animations.end());
+      }
+
+      std::vector<int> finished;
+      for (auto& animation : frame) {
+        if (!(*animation.second)(now))
+          finished.push_back(animation.first);
+      }
+
+      std::unique_lock<std::mutex> lock(m_animationsMutex);
+      for (auto id : finished)
+        m_animations.erase(id);
+      if (m_animations.empty())
+        m_frameTimer.stop(); // Nothing left to animate, stop ticking
+    }
+
+    std::mutex m_tickMutex;
+    std::mutex m_animationsMutex;
+    std::map<int, std::shared_ptr<AnimationStep>> m_animations;
+    int m_nextId = 0;
+    bool m_shutdown = false;
+    FrameTimer m_frameTimer; // Declared last: its thread must go away before the rest of the scheduler
+  };
+
+}
+
+#endif // VARCO_ANIMATIONSCHEDULER_HPP
@@ -0,0 +1,111 @@
+#ifndef VARCO_ARENA_HPP
+#define VARCO_ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace varco {
+
+  // A monotonic allocator for scratch data which doesn't outlive a unit of work: allocations just move a
+  // pointer forward and are only given back all together by reset(). Blocks are taken from the heap as
+  // needed; reset() merges them into a single one as large as all of them, so that once an arena has seen
+  // its largest workload it doesn't go to the heap anymore. Not thread safe: an arena per thread
+  class MonotonicArena {
+  public:
+    explicit MonotonicArena(size_t blockSize = 64 << 10) : m_blockSize(blockSize) {}
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+      ++m_allocations;
+      uintptr_t top = (reinterpret_cast<uintptr_t>(m_top) + alignment - 1) & ~(alignment - 1);
+      if (m_top == nullptr || top + bytes > reinterpret_cast<uintptr_t>(m_end)) {
+        addBlock(bytes + alignment);
+        top = (reinterpret_cast<uintptr_t>(m_top) + alignment - 1) & ~(alignment - 1);
+      }
+      m_top = reinterpret_cast<char*>(top + bytes);
+      return reinterpret_cast<void*>(top);
+    }
+
+    void deallocate(void *pointer, size_t bytes) { // Only the last allocation is given back (e.g. a vector growing)
+      if (static_cast<char*>(pointer) + bytes == m_top)
+        m_top = static_cast<char*>(pointer);
+    }
+
+    void reset() {
+      if (m_blocks.size() > 1) {
+        size_t total = 0;
+        for (const auto& block : m_blocks)
+          total += block.m_size;
+        m_blocks.clear();
+        m_blockSize = std::max(m_blockSize, total);
+        m_top = m_end = nullptr;
+        addBlock(0);
+      } else if (!m_blocks.empty())
+        m_top = m_blocks.front().m_data.get();
+    }
+
+    size_t getAllocationCount() const { return m_allocations; } // Served by the arena, since it was created
+    size_t getBlockCount() const { return m_heapBlocks; } // Taken from the heap, since it was created
+
+  private:
+    struct Block {
+      std::unique_ptr<char[]> m_data;
+      size_t m_size;
+    };
+
+    void addBlock(size_t minimumSize) {
+      Block block;
+      block.m_size = std::max(m_blockSize, minimumSize);
+      block.m_data.reset(new char[block.m_size]);
+      m_top = block.m_data.get();
+      m_end = m_top + block.m_size;
+      m_blocks.push_back(std::move(block));
+      ++m_heapBlocks;
+    }
+
+    std::vector<Block> m_blocks;
+    size_t m_blockSize;
+    char *m_top = nullptr;
+    char *m_end = nullptr;
+    size_t m_allocations = 0;
+    size_t m_heapBlocks = 0;
+  };
+
+  template <typename T>
+  class ArenaAllocator { // Lets standard containers take their storage from an arena
+  public:
+    using value_type = T;
+
+    explicit ArenaAllocator(MonotonicArena& arena) : m_arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+    T *allocate(size_t n) {
+      return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *pointer, size_t n) {
+      m_arena->deallocate(pointer, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+
+  private:
+    template <typename U>
+    friend class ArenaAllocator;
+    MonotonicArena *m_arena;
+  };
+
+  template <typename T>
+  using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}
+
+#endif // VARCO_ARENA_HPP
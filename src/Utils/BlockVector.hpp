@@ -0,0 +1,177 @@
+#ifndef VARCO_BLOCKVECTOR_HPP
+#define VARCO_BLOCKVECTOR_HPP
+
+#include <Utils/FenwickTree.hpp>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+namespace varco {
+
+  // A sequence stored in blocks of a few hundreds elements, like the lines of a TextBuffer: accessing an
+  // element is O(log n) and inserting or erasing elements only moves those of a single block. The blocks are
+  // indexed again (O(number of blocks)) only when one is added or removed
+  template <typename T>
+  class BlockVector {
+  public:
+    static constexpr size_t BLOCK_SIZE = 256; // Preferred elements per block (blocks are split at twice this)
+
+    size_t size() const {
+      return m_blockSizes.total();
+    }
+
+    bool empty() const {
+      return m_blocks.empty();
+    }
+
+    void clear() {
+      m_blocks.clear();
+      m_blockSizes.rebuild({});
+    }
+
+    T& operator[](size_t index) {
+      auto position = locate(index);
+      return m_blocks[position.first][position.second];
+    }
+
+    const T& operator[](size_t index) const {
+      auto position = locate(index);
+      return m_blocks[position.first][position.second];
+    }
+
+    T& back() {
+      return m_blocks.back().back();
+    }
+
+    // Moves 'values' at the end, reindexing once
+    void append(std::vector<T>& values) {
+      if (values.empty())
+        return;
+      for (auto& value : values) {
+        if (m_blocks.empty() || m_blocks.back().size() >= BLOCK_SIZE) {
+          m_blocks.emplace_back();
+          m_blocks.back().reserve(BLOCK_SIZE);
+        }
+        m_blocks.back().emplace_back(std::move(value));
+      }
+      values.clear();
+      reindex();
+    }
+
+    // Moves 'values' before the element at 'index'
+    void insert(size_t index, std::vector<T>& values) {
+      if (values.empty())
+        return;
+      if (index >= size()) {
+        append(values);
+        return;
+      }
+      auto position = locate(index);
+      auto& block = m_blocks[position.first];
+      block.insert(block.begin() + position.second, std::make_move_iterator(values.begin()),
+                   std::make_move_iterator(values.end()));
+      if (block.size() > 2 * BLOCK_SIZE)
+        splitBlock(position.first); // Also reindexes everything
+      else
+        m_blockSizes.add(position.first, values.size());
+      values.clear();
+    }
+
+    void erase(size_t index, size_t count) {
+      while (count > 0 && index < size()) {
+        auto position = locate(index);
+        auto& block = m_blocks[position.first];
+        size_t erased = std::min(count, block.size() - position.second);
+        block.erase(block.begin() + position.second, block.begin() + position.second + erased);
+        count -= erased;
+        if (block.empty()) {
+          m_blocks.erase(m_blocks.begin() + position.first);
+          reindex(); // Needed by locate() at the next iteration
+        } else
+          m_blockSizes.add(position.first, static_cast<size_t>(0) - erased);
+      }
+    }
+
+    class const_iterator {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const T*;
+      using reference = const T&;
+
+      const_iterator(const std::vector<std::vector<T>>* blocks, size_t block, size_t index) :
+        m_blocks(blocks), m_block(block), m_index(index) {}
+
+      const T& operator*() const {
+        return (*m_blocks)[m_block][m_index];
+      }
+
+      const T* operator->() const {
+        return &(*m_blocks)[m_block][m_index];
+      }
+
+      const_iterator& operator++() {
+        if (++m_index == (*m_blocks)[m_block].size()) {
+          ++m_block;
+          m_index = 0;
+        }
+        return *this;
+      }
+
+      bool operator==(const const_iterator& other) const {
+        return m_block == other.m_block && m_index == other.m_index;
+      }
+
+      bool operator!=(const const_iterator& other) const {
+        return !(*this == other);
+      }
+
+    private:
+      const std::vector<std::vector<T>>* m_blocks;
+      size_t m_block, m_index;
+    };
+
+    const_iterator begin() const {
+      return const_iterator(&m_blocks, 0, 0);
+    }
+
+    const_iterator end() const {
+      return const_iterator(&m_blocks, m_blocks.size(), 0);
+    }
+
+  private:
+    std::pair<size_t, size_t> locate(size_t index) const { // { block, index in the block }
+      size_t block = m_blockSizes.upperBound(index);
+      return { block, index - m_blockSizes.prefixSum(block) };
+    }
+
+    // Splits an oversized block into BLOCK_SIZE-sized ones
+    void splitBlock(size_t blockIndex) {
+      std::vector<T> elements = std::move(m_blocks[blockIndex]);
+      std::vector<std::vector<T>> newBlocks;
+      for (size_t i = 0; i < elements.size(); i += BLOCK_SIZE) {
+        size_t end = std::min(elements.size(), i + BLOCK_SIZE);
+        newBlocks.emplace_back(std::make_move_iterator(elements.begin() + i), std::make_move_iterator(elements.begin() + end));
+      }
+      m_blocks.erase(m_blocks.begin() + blockIndex);
+      m_blocks.insert(m_blocks.begin() + blockIndex, std::make_move_iterator(newBlocks.begin()),
+                      std::make_move_iterator(newBlocks.end()));
+      reindex();
+    }
+
+    void reindex() {
+      std::vector<size_t> sizes;
+      sizes.reserve(m_blocks.size());
+      for (const auto& block : m_blocks)
+        sizes.push_back(block.size());
+      m_blockSizes.rebuild(sizes);
+    }
+
+    std::vector<std::vector<T>> m_blocks;
+    FenwickTree<size_t> m_blockSizes;
+  };
+
+}
+
+#endif // VARCO_BLOCKVECTOR_HPP
@@ -2,7 +2,14 @@
 #define VARCO_CONCURRENT_HPP
 
 #include <Document/Document.hpp>
+#include <Document/TextBuffer.hpp>
+#include <Document/FileCache.hpp>
+#include <SkImage.h>
+#include <SkPicture.h>
+#include <UI/Theme/Theme.hpp>
+#include <Utils/Arena.hpp>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <vector>
 #include <thread>
@@ -31,6 +38,7 @@ namespace varco {
 
   struct EditorLine {
     EditorLine(std::string str);
+    EditorLine(const char *text, size_t size);
 
     std::vector<char> m_characters;
   };
@@ -46,10 +54,51 @@ namespace varco {
     PhysicalLine() = default;
 
     std::vector<EditorLine> m_editorLines;
+    std::vector<StyleRun> m_styleRuns; // Normal text is not stored. Lets an edited line be rendered again
+                                       // with its previous colors until the document is lexed again
   };
 
   enum SyntaxHighlight { NONE, CPP };
 
+  // How a rendered document reaches the screen
+  enum class RenderMode {
+    Raster,      // Partial renders are composited into the document bitmap which the CodeView blits on
+                 // its own bitmap (i.e. uploaded again to the GPU every time the view changes)
+    GpuTextures, // Partial renders are kept as strips which are uploaded as textures the first time they're
+                 // drawn on a GPU canvas. Scrolling and presents just draw the textures again
+    DisplayList  // Partials are recorded as pictures and replayed (only the visible lines) at every draw.
+                 // No pixels are stored at all and the playback can be scaled without rendering again
+  };
+
+  struct ThreadRequest;
+
+  // Rows of a long line which are only rendered while they're in (or close to) the view: the render which
+  // wrapped them leaves them to the WorkerPool (see Document::drawStrips())
+  struct DeferredRows {
+    std::shared_ptr<const ThreadRequest> m_settings; // Metrics, theme, wrap and tab width of the render (no text)
+    std::shared_ptr<const std::string> m_text; // The segment of the line the rows are in
+    size_t m_from; // Bytes of m_text shown by the rows
+    size_t m_to;
+    size_t m_rows;
+    SkScalar m_height;
+    std::vector<StyleRun> m_styleRuns; // Moved to begin at m_from
+
+    std::mutex m_mutex;
+    bool m_pending = false; // A WorkerPool job is rendering them
+    sk_sp<SkImage> m_image; // Or m_picture in DisplayList mode. Released once the view moves away
+    sk_sp<SkPicture> m_picture;
+  };
+
+  struct RenderedChunk { // The result of a thread's work on its chunk of lines
+    std::vector<PhysicalLine> m_physicalLines;
+    SkBitmap m_bitmap; // Raster and GpuTextures modes
+    sk_sp<SkPicture> m_picture; // DisplayList mode
+    SkScalar m_width = 0; // Effective width and height (the bitmap might be larger)
+    SkScalar m_height = 0;
+    bool m_continuation = false; // The first physical line goes on from the last one of the previous chunk
+    std::vector<std::shared_ptr<DeferredRows>> m_deferredRows; // Instead of the bitmap (or picture), top to bottom
+  };
+
   struct ThreadRequest { // A workload request for a thread
 
     std::mutex m_syncBarrier; // Sync barrier for threads of this thread request
@@ -58,20 +107,29 @@ namespace varco {
     SkScalar m_characterWidthPixels;
     SkScalar m_characterHeightPixels;
     int m_wrapWidthPixels;
+    int m_tabWidth;
     int m_maximumCharactersLine; // According to wrapWidth
-    StyleDatabase m_styleDb;
-
-    std::vector<std::string> m_plainTextLines;
-    std::vector<PhysicalLine> m_physicalLines;
-
+    std::shared_ptr<const StyleDatabase> m_styleDb; // Shared, never modified while rendering
+    std::shared_ptr<const FileCache> m_fileCache; // Where the lines were wrapped the last time, if it's the same way
+    RenderMode m_renderMode;
+    std::shared_ptr<const Theme> m_theme; // Fonts, metrics and paints to render with
+
+    TextBuffer m_buffer; // Snapshot of the document text (blocks are shared with the document, not copied)
+    unsigned int m_revision = 0; // Document revision the snapshot was taken at
+
+    struct Chunk { // Lines a thread wraps and renders: whole lines or a segment of a long line
+      size_t m_start; // Physical lines [m_start, m_end)
+      size_t m_end;
+      size_t m_from = 0; // Bytes [m_from, m_to) of the line m_start, segments only
+      size_t m_to = 0;
+    };
+    std::vector<Chunk> m_chunks; // In document order, of about the same number of bytes each
+    std::atomic<size_t> m_nextChunk{ 0 }; // Threads take the next chunk left as they finish one
     size_t m_numThreads = 1;
-    size_t m_linesPerThread;
     SkScalar m_totalBitmapHeight = 0;
     SkScalar m_maxBitmapWidth = 0;
-    std::vector<std::promise<std::tuple<std::vector<PhysicalLine>, SkBitmap,
-      SkScalar /* effective width */, SkScalar /* effective height */>>> m_partials;
-    std::vector<std::future<std::tuple<std::vector<PhysicalLine>, SkBitmap,
-      SkScalar /* effective width */, SkScalar /* effective height */>>> m_futures;
+    std::vector<std::promise<RenderedChunk>> m_partials;
+    std::vector<std::future<RenderedChunk>> m_futures;
 
     std::function<void(size_t, std::shared_ptr<ThreadRequest>)> m_callback; // Work function
     std::function<void(std::shared_ptr<ThreadRequest>)> m_endCallback; // End function
@@ -236,6 +294,8 @@ namespace varco {
   public:
     ThreadPool(){
       m_workloadReady.resize(m_NThreads, false);
+      for (size_t i = 0; i < m_NThreads; ++i)
+        m_scratchArenas.emplace_back(std::make_unique<MonotonicArena>());
       for (size_t i = 0; i < m_NThreads; ++i)
         m_threads.emplace_back(&ThreadPool::threadMain, this, i);
       m_threadsIdle = m_NThreads;
@@ -270,6 +330,12 @@ namespace varco {
       m_cv.notify_all(); // Must be done without lock
     }
 
+    // Scratch memory of a thread for the request it's working on, reset when it's done with it. Only to
+    // be used from the thread itself (i.e. from within the request's callback)
+    MonotonicArena& getScratchArena(size_t threadIdx) {
+      return *m_scratchArenas[threadIdx];
+    }
+
     const size_t m_NThreads = 15; // Number of threads of the threadpool
 
   private:
@@ -285,6 +351,7 @@ namespace varco {
           return;
 
         m_currentRequest->m_callback(threadIdx, m_currentRequest);
+        m_scratchArenas[threadIdx]->reset();
 
         {
           std::unique_lock<std::mutex> lock(m_mutex);
@@ -327,6 +394,7 @@ namespace varco {
     }
 
     std::vector<std::thread> m_threads;    
+    std::vector<std::unique_ptr<MonotonicArena>> m_scratchArenas; // One per thread
     size_t m_threadsIdle = 0;
     bool m_sigterm = false;
     std::vector<bool> m_workloadReady;
@@ -0,0 +1,122 @@
+#include <Utils/Encoding.hpp>
+#include <Utils/Unicode.hpp>
+#include <algorithm>
+
+namespace varco {
+
+#define UTF16_SAMPLE_BYTES 4096 // Bytes looked at to tell UTF-16 text without a BOM
+
+  FileEncoding detectEncoding(const char *data, size_t size) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF)
+      return { Encoding::Utf8, true };
+    if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE)
+      return { Encoding::Utf16LE, true };
+    if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF)
+      return { Encoding::Utf16BE, true };
+
+    FileEncoding result;
+
+    // Latin text in UTF-16 has a zero every other byte, text in 8-bit encodings has none at all
+    size_t sample = std::min<size_t>(size, UTF16_SAMPLE_BYTES) & ~size_t(1);
+    size_t evenZeros = 0, oddZeros = 0;
+    for (size_t i = 0; i < sample; i += 2) {
+      evenZeros += (bytes[i] == 0);
+      oddZeros += (bytes[i + 1] == 0);
+    }
+    const size_t units = sample / 2;
+    if (units > 0 && oddZeros * 4 > units && evenZeros * 16 < units)
+      result.m_encoding = Encoding::Utf16LE;
+    else if (units > 0 && evenZeros * 4 > units && oddZeros * 16 < units)
+      result.m_encoding = Encoding::Utf16BE;
+    else
+      result.m_encoding = isValidUtf8(data, size) ? Encoding::Utf8 : Encoding::Latin1;
+    return result;
+  }
+
+  bool isPlainUtf8(const FileEncoding& encoding) {
+    return encoding.m_encoding == Encoding::Utf8 && !encoding.m_bom;
+  }
+
+  std::string decodeText(const char *data, size_t size, const FileEncoding& encoding) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+    std::string text;
+    switch (encoding.m_encoding) {
+      case Encoding::Utf8: {
+        size_t skip = encoding.m_bom ? 3 : 0;
+        text.assign(data + skip, size - skip);
+      } break;
+      case Encoding::Latin1: {
+        text.reserve(size + size / 8);
+        for (size_t i = 0; i < size;) {
+          size_t run = i;
+          while (run < size && bytes[run] < 0x80)
+            ++run;
+          text.append(data + i, run - i);
+          if (run < size)
+            appendUtf8(bytes[run++], text); // Latin-1 is the first 256 code points
+          i = run;
+        }
+      } break;
+      case Encoding::Utf16LE:
+      case Encoding::Utf16BE: {
+        const bool little = (encoding.m_encoding == Encoding::Utf16LE);
+        auto unit = [&](size_t i) -> char32_t {
+          return little ? (bytes[i] | (bytes[i + 1] << 8)) : ((bytes[i] << 8) | bytes[i + 1]);
+        };
+        text.reserve(size / 2);
+        for (size_t i = encoding.m_bom ? 2 : 0; i + 1 < size; i += 2) {
+          char32_t codePoint = unit(i);
+          if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 3 < size) { // A surrogate pair
+            char32_t low = unit(i + 2);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+              codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+              i += 2;
+            }
+          }
+          if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+            codePoint = 0xFFFD; // Unpaired
+          appendUtf8(codePoint, text);
+        }
+      } break;
+    }
+    return text;
+  }
+
+  std::string encodeText(const char *text, size_t size, Encoding encoding) {
+    if (encoding == Encoding::Utf8 || (encoding == Encoding::Latin1 && isAscii(text, size)))
+      return std::string(text, size);
+    std::string result;
+    result.reserve(encoding == Encoding::Latin1 ? size : size * 2);
+    auto appendUnit = [&](char32_t unit) {
+      if (encoding == Encoding::Utf16LE) {
+        result += static_cast<char>(unit & 0xFF);
+        result += static_cast<char>(unit >> 8);
+      } else {
+        result += static_cast<char>(unit >> 8);
+        result += static_cast<char>(unit & 0xFF);
+      }
+    };
+    for (size_t offset = 0; offset < size;) {
+      char32_t codePoint = decodeUtf8(text, size, offset);
+      if (encoding == Encoding::Latin1)
+        result += (codePoint < 0x100) ? static_cast<char>(codePoint) : '?';
+      else if (codePoint >= 0x10000) {
+        appendUnit(0xD800 + ((codePoint - 0x10000) >> 10));
+        appendUnit(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+      } else
+        appendUnit(codePoint);
+    }
+    return result;
+  }
+
+  std::string getByteOrderMark(Encoding encoding) {
+    switch (encoding) {
+      case Encoding::Utf8: return "\xEF\xBB\xBF";
+      case Encoding::Utf16LE: return "\xFF\xFE";
+      case Encoding::Utf16BE: return "\xFE\xFF";
+      default: return std::string();
+    }
+  }
+
+}
@@ -0,0 +1,35 @@
+#ifndef VARCO_ENCODING_HPP
+#define VARCO_ENCODING_HPP
+
+#include <string>
+#include <cstddef>
+
+namespace varco {
+
+  enum class Encoding { Utf8, Utf16LE, Utf16BE, Latin1 };
+
+  struct FileEncoding {
+    Encoding m_encoding = Encoding::Utf8;
+    bool m_bom = false; // The file begins with a byte order mark
+  };
+
+  inline bool operator==(const FileEncoding& a, const FileEncoding& b) {
+    return a.m_encoding == b.m_encoding && a.m_bom == b.m_bom;
+  }
+
+  inline bool operator!=(const FileEncoding& a, const FileEncoding& b) {
+    return !(a == b);
+  }
+
+  // How the text of a file is encoded: its byte order mark if it has one, otherwise UTF-16 if the zeros in
+  // its first bytes fall on alternate bytes, UTF-8 if it's all valid UTF-8 (ASCII included) and Latin-1 if
+  // it's not. Documents hold UTF-8: files are converted when read and converted back when saved
+  FileEncoding detectEncoding(const char *data, size_t size);
+  bool isPlainUtf8(const FileEncoding& encoding); // Needs no conversion (UTF-8 without a byte order mark)
+  std::string decodeText(const char *data, size_t size, const FileEncoding& encoding); // The BOM is skipped
+  std::string encodeText(const char *text, size_t size, Encoding encoding); // Unencodable characters become '?'
+  std::string getByteOrderMark(Encoding encoding);
+
+}
+
+#endif // VARCO_ENCODING_HPP
@@ -0,0 +1,73 @@
+#ifndef VARCO_FENWICKTREE_HPP
+#define VARCO_FENWICKTREE_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace varco {
+
+  // A binary indexed tree: point updates and prefix sums in O(log n). Elements can't be inserted or
+  // erased, a rebuild (O(n)) is needed when the number of elements changes
+  template <typename T>
+  class FenwickTree {
+  public:
+    FenwickTree() = default;
+
+    explicit FenwickTree(const std::vector<T>& values) {
+      rebuild(values);
+    }
+
+    void rebuild(const std::vector<T>& values) {
+      m_tree.assign(values.size() + 1, T{});
+      for (size_t i = 1; i <= values.size(); ++i) { // Linear construction
+        m_tree[i] += values[i - 1];
+        size_t parent = i + (i & (~i + 1));
+        if (parent <= values.size())
+          m_tree[parent] += m_tree[i];
+      }
+    }
+
+    size_t size() const {
+      return m_tree.empty() ? 0 : m_tree.size() - 1;
+    }
+
+    void add(size_t index, T delta) {
+      for (size_t i = index + 1; i < m_tree.size(); i += (i & (~i + 1)))
+        m_tree[i] += delta;
+    }
+
+    // Sum of the first 'count' elements
+    T prefixSum(size_t count) const {
+      T sum{};
+      for (size_t i = count; i > 0; i -= (i & (~i + 1)))
+        sum += m_tree[i];
+      return sum;
+    }
+
+    T total() const {
+      return prefixSum(size());
+    }
+
+    // Returns the index of the element which contains the 'value'-th unit, i.e. the first index whose inclusive
+    // prefix sum exceeds 'value' (size() if there's none). All the elements must be non-negative
+    size_t upperBound(T value) const {
+      size_t position = 0;
+      size_t step = 1;
+      while (step * 2 < m_tree.size())
+        step *= 2;
+      for (; step > 0; step /= 2) {
+        if (position + step < m_tree.size() && !(value < m_tree[position + step])) {
+          position += step;
+          value -= m_tree[position];
+        }
+      }
+      return position; // 0-based index of the element (the tree is 1-based)
+    }
+
+  private:
+    std::vector<T> m_tree; // 1-based
+  };
+
+}
+
+#endif // VARCO_FENWICKTREE_HPP
@@ -0,0 +1,263 @@
+#include <Utils/FileWatcher.hpp>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#ifdef _WIN32
+  #include <windows.h>
+#elif defined __linux__
+  #include <sys/inotify.h>
+  #include <poll.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <cerrno>
+#endif
+
+namespace varco {
+
+#define LATENCY std::chrono::milliseconds(50) // Events of a file within this interval are reported once
+
+  namespace {
+    using Clock = std::chrono::steady_clock;
+    using PendingFiles = std::map<std::string, Clock::time_point>; // Path -> when it's due
+
+    std::pair<std::string, std::string> splitPath(const std::string& path) { // { directory, file name }
+      size_t separator = path.find_last_of("/\\");
+      if (separator == std::string::npos)
+        return { ".", path };
+      return { path.substr(0, separator == 0 ? 1 : separator), path.substr(separator + 1) };
+    }
+
+    int millisecondsUntilDue(const PendingFiles& pending) { // -1 if nothing is pending
+      if (pending.empty())
+        return -1;
+      auto due = std::min_element(pending.begin(), pending.end(), [](const auto& a, const auto& b) {
+        return a.second < b.second;
+      })->second;
+      auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count();
+      return static_cast<int>(std::max<decltype(wait)>(wait, 0));
+    }
+
+    std::vector<std::string> takeDue(PendingFiles& pending) {
+      std::vector<std::string> due;
+      auto now = Clock::now();
+      for (auto it = pending.begin(); it != pending.end();) {
+        if (it->second <= now) {
+          due.push_back(it->first);
+          it = pending.erase(it);
+        } else
+          ++it;
+      }
+      return due;
+    }
+  }
+
+#ifdef _WIN32
+
+  FileWatcher::FileWatcher(std::function<void(const std::string& path)> onChange) :
+    m_onChange(std::move(onChange))
+  {
+    m_wakeUpEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    m_thread = std::thread(&FileWatcher::run, this);
+  }
+
+  FileWatcher::~FileWatcher() {
+    m_stop = true;
+    wakeUp();
+    m_thread.join();
+    CloseHandle(m_wakeUpEvent);
+  }
+
+  void FileWatcher::watch(const std::string& path) {
+    auto split = splitPath(path);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& file = m_directories[split.first].m_files[split.second];
+    file.m_path = path;
+    ++file.m_count;
+    wakeUp(); // Change notifications are set up (and closed) by the watcher thread
+  }
+
+  void FileWatcher::unwatch(const std::string& path) {
+    auto split = splitPath(path);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto directory = m_directories.find(split.first);
+    if (directory == m_directories.end())
+      return;
+    auto file = directory->second.m_files.find(split.second);
+    if (file == directory->second.m_files.end() || --file->second.m_count > 0)
+      return;
+    directory->second.m_files.erase(file);
+    if (directory->second.m_files.empty()) {
+      m_directories.erase(directory);
+      wakeUp();
+    }
+  }
+
+  void FileWatcher::wakeUp() {
+    SetEvent(m_wakeUpEvent);
+  }
+
+  void FileWatcher::run() {
+    std::map<std::string, HANDLE> notifications; // Directory -> change notification, only used by this thread
+    PendingFiles pending;
+    while (!m_stop) {
+      std::vector<HANDLE> handles{ m_wakeUpEvent };
+      std::vector<std::string> directories{ std::string() };
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = notifications.begin(); it != notifications.end();) { // Directories no longer watched
+          if (m_directories.count(it->first) == 0) {
+            if (it->second != INVALID_HANDLE_VALUE)
+              FindCloseChangeNotification(it->second);
+            it = notifications.erase(it);
+          } else
+            ++it;
+        }
+        for (const auto& directory : m_directories) {
+          if (notifications.count(directory.first) == 0)
+            notifications[directory.first] = FindFirstChangeNotificationA(directory.first.c_str(), FALSE,
+              FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+        }
+      }
+      for (const auto& notification : notifications) {
+        if (notification.second != INVALID_HANDLE_VALUE && handles.size() < MAXIMUM_WAIT_OBJECTS) {
+          handles.push_back(notification.second);
+          directories.push_back(notification.first);
+        }
+      }
+
+      int timeout = millisecondsUntilDue(pending);
+      DWORD result = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE,
+                                            timeout < 0 ? INFINITE : static_cast<DWORD>(timeout));
+      if (result > WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles.size()) {
+        size_t index = result - WAIT_OBJECT_0;
+        FindNextChangeNotification(handles[index]);
+        // Notifications don't tell which file changed: report all of them
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto directory = m_directories.find(directories[index]);
+        if (directory != m_directories.end()) {
+          for (const auto& file : directory->second.m_files)
+            pending.emplace(file.second.m_path, Clock::now() + LATENCY); // An earlier due time is kept
+        }
+      }
+
+      for (const auto& path : takeDue(pending))
+        m_onChange(path);
+    }
+    for (const auto& notification : notifications) {
+      if (notification.second != INVALID_HANDLE_VALUE)
+        FindCloseChangeNotification(notification.second);
+    }
+  }
+
+#elif defined __linux__
+
+  FileWatcher::FileWatcher(std::function<void(const std::string& path)> onChange) :
+    m_onChange(std::move(onChange))
+  {
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (pipe2(m_wakeUpPipe, O_NONBLOCK | O_CLOEXEC) != 0)
+      m_wakeUpPipe[0] = m_wakeUpPipe[1] = -1;
+    m_thread = std::thread(&FileWatcher::run, this);
+  }
+
+  FileWatcher::~FileWatcher() {
+    m_stop = true;
+    wakeUp();
+    m_thread.join();
+    for (int fd : { m_inotify, m_wakeUpPipe[0], m_wakeUpPipe[1] }) {
+      if (fd >= 0)
+        close(fd);
+    }
+  }
+
+  void FileWatcher::watch(const std::string& path) {
+    auto split = splitPath(path);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Directory& directory = m_directories[split.first];
+    if (directory.m_watch < 0 && m_inotify >= 0) {
+      // IN_MODIFY is needed for files which are written to without being closed (e.g. logs)
+      directory.m_watch = inotify_add_watch(m_inotify, split.first.c_str(),
+                                            IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+      if (directory.m_watch >= 0)
+        m_watchDirectories[directory.m_watch] = split.first;
+    }
+    auto& file = directory.m_files[split.second];
+    file.m_path = path;
+    ++file.m_count;
+  }
+
+  void FileWatcher::unwatch(const std::string& path) {
+    auto split = splitPath(path);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto directory = m_directories.find(split.first);
+    if (directory == m_directories.end())
+      return;
+    auto file = directory->second.m_files.find(split.second);
+    if (file == directory->second.m_files.end() || --file->second.m_count > 0)
+      return;
+    directory->second.m_files.erase(file);
+    if (directory->second.m_files.empty()) {
+      if (directory->second.m_watch >= 0) {
+        inotify_rm_watch(m_inotify, directory->second.m_watch);
+        m_watchDirectories.erase(directory->second.m_watch);
+      }
+      m_directories.erase(directory);
+    }
+  }
+
+  void FileWatcher::wakeUp() {
+    if (m_wakeUpPipe[1] >= 0) {
+      char byte = 0;
+      ssize_t written = write(m_wakeUpPipe[1], &byte, 1);
+      (void)written; // A full pipe already wakes the thread up
+    }
+  }
+
+  void FileWatcher::run() {
+    if (m_inotify < 0)
+      return;
+    PendingFiles pending;
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    while (!m_stop) {
+      pollfd fds[2] = { { m_inotify, POLLIN, 0 }, { m_wakeUpPipe[0], POLLIN, 0 } };
+      int ready = poll(fds, m_wakeUpPipe[0] >= 0 ? 2 : 1, millisecondsUntilDue(pending));
+      if (ready < 0 && errno != EINTR)
+        break;
+
+      if (ready > 0 && (fds[1].revents & POLLIN)) {
+        while (read(m_wakeUpPipe[0], buffer, sizeof(buffer)) > 0) {}
+      }
+      if (ready > 0 && (fds[0].revents & POLLIN)) {
+        ssize_t length;
+        while ((length = read(m_inotify, buffer, sizeof(buffer))) > 0) {
+          auto due = Clock::now() + LATENCY;
+          std::lock_guard<std::mutex> lock(m_mutex);
+          for (char *event = buffer; event < buffer + length;) {
+            const auto *header = reinterpret_cast<const struct inotify_event*>(event);
+            event += sizeof(struct inotify_event) + header->len;
+            if (header->mask & IN_Q_OVERFLOW) { // Events were lost: any file might have changed
+              for (const auto& directory : m_directories) {
+                for (const auto& file : directory.second.m_files)
+                  pending.emplace(file.second.m_path, due);
+              }
+              continue;
+            }
+            auto directory = m_watchDirectories.find(header->wd);
+            if (directory == m_watchDirectories.end() || header->len == 0)
+              continue;
+            const auto& files = m_directories[directory->second].m_files;
+            auto file = files.find(header->name);
+            if (file != files.end())
+              pending.emplace(file->second.m_path, due); // An earlier due time is kept
+          }
+        }
+      }
+
+      for (const auto& path : takeDue(pending))
+        m_onChange(path);
+    }
+  }
+
+#endif
+
+}
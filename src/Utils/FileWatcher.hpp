@@ -0,0 +1,63 @@
+#ifndef VARCO_FILEWATCHER_HPP
+#define VARCO_FILEWATCHER_HPP
+
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <map>
+#include <set>
+
+namespace varco {
+
+  // Reports changes to a set of files from a background thread. The directories of the files are watched
+  // rather than the files themselves: most programs save by writing a new file and renaming it over the old
+  // one, which a watch on the old file would never see. On Linux inotify tells which file changed, on Windows
+  // change notifications don't and all the files watched in a directory are reported (the receiver has to
+  // check whether they really changed).
+  //
+  // Bursts of events (e.g. a log being appended to line by line) are coalesced: a file is reported at most
+  // once per LATENCY and never before LATENCY has passed since its first event
+  class FileWatcher {
+  public:
+    // 'onChange' is called on the watcher thread with the path as it was passed to watch()
+    explicit FileWatcher(std::function<void(const std::string& path)> onChange);
+    ~FileWatcher(); // Stops and joins the watcher thread
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    void watch(const std::string& path); // Watching a file twice needs unwatching it twice
+    void unwatch(const std::string& path);
+
+  private:
+    void run(); // Watcher thread
+    void wakeUp(); // Interrupts the watcher thread's wait
+
+    std::function<void(const std::string& path)> m_onChange;
+    std::mutex m_mutex;
+    struct WatchedFile {
+      std::string m_path; // As passed to watch()
+      int m_count;
+    };
+    struct Directory {
+      std::map<std::string, WatchedFile> m_files; // By file name
+#ifdef __linux__
+      int m_watch = -1; // inotify watch descriptor
+#endif
+    };
+    std::map<std::string, Directory> m_directories;
+    std::atomic<bool> m_stop{ false };
+#ifdef _WIN32
+    void *m_wakeUpEvent = nullptr;
+#elif defined __linux__
+    int m_inotify = -1;
+    int m_wakeUpPipe[2] = { -1, -1 };
+    std::map<int, std::string> m_watchDirectories; // inotify watch descriptor -> directory
+#endif
+    std::thread m_thread; // Last: started once everything else is set up
+  };
+
+}
+
+#endif // VARCO_FILEWATCHER_HPP
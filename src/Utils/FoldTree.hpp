@@ -0,0 +1,364 @@
+#ifndef VARCO_FOLDTREE_HPP
+#define VARCO_FOLDTREE_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+
+namespace varco {
+
+  // A sequence of non-negative sizes (e.g. the rows of every physical line) where ranges of elements can be
+  // hidden. Hiding or showing a range, updating an element, the prefix sums of the first elements (with or
+  // without the hidden ones), finding the element which contains a visible unit and inserting or erasing
+  // elements are all O(log n), whatever the size of the range.
+  //
+  // Ranges are counted, not flagged: nested or overlapping ranges can be hidden and shown in any order and an
+  // element is visible only when no hidden range covers it anymore. Inserted elements are visible, the
+  // others keep their counters when elements are inserted or erased before them.
+  //
+  // Elements are the nodes of a treap ordered by position: every node keeps the size of its subtree, and
+  // hiding a range adds to the counter of the subtrees which cover it (pushed down lazily, only when a node
+  // is restructured). A subtree knows its smallest counter and the sum of the elements which have it, its
+  // visible sum is the latter when the smallest counter is zero
+  class FoldTree {
+  public:
+    FoldTree() {
+      m_nodes.resize(1); // The null node
+    }
+
+    void rebuild(const std::vector<size_t>& values) {
+      m_nodes.resize(1);
+      m_free.clear();
+      m_root = build(values);
+    }
+
+    size_t size() const {
+      return m_nodes[m_root].m_size;
+    }
+
+    size_t get(size_t index) const {
+      return m_nodes[find(index)].m_value;
+    }
+
+    void set(size_t index, size_t value) {
+      set(m_root, index, value);
+    }
+
+    // Inserts 'values' (all visible) before the element at 'index'
+    void insert(size_t index, const std::vector<size_t>& values) {
+      uint32_t left, right;
+      split(m_root, index, left, right);
+      m_root = merge(merge(left, build(values)), right);
+    }
+
+    void erase(size_t index, size_t count) {
+      uint32_t left, middle, right;
+      split(m_root, index, left, right);
+      split(right, count, middle, right);
+      release(middle);
+      m_root = merge(left, right);
+    }
+
+    // Hides (or shows again) the elements in [first, last)
+    void hide(size_t first, size_t last) {
+      update(m_root, 0, first, last, 1);
+    }
+
+    void show(size_t first, size_t last) {
+      update(m_root, 0, first, last, -1);
+    }
+
+    bool isVisible(size_t index) const {
+      int hidden = 0;
+      uint32_t node = m_root;
+      while (node != 0) {
+        const Node& n = m_nodes[node];
+        size_t leftSize = m_nodes[n.m_left].m_size;
+        if (index == leftSize)
+          return hidden + n.m_hidden == 0;
+        hidden += n.m_pending;
+        if (index < leftSize)
+          node = n.m_left;
+        else {
+          index -= leftSize + 1;
+          node = n.m_right;
+        }
+      }
+      return false;
+    }
+
+    // Sum of the first 'count' elements, hidden or not
+    size_t prefixSum(size_t count) const {
+      size_t sum = 0;
+      uint32_t node = m_root;
+      while (node != 0 && count > 0) {
+        const Node& n = m_nodes[node];
+        size_t leftSize = m_nodes[n.m_left].m_size;
+        if (count <= leftSize)
+          node = n.m_left;
+        else {
+          sum += m_nodes[n.m_left].m_sum + n.m_value;
+          count -= leftSize + 1;
+          node = n.m_right;
+        }
+      }
+      return sum;
+    }
+
+    size_t total() const {
+      return m_nodes[m_root].m_sum;
+    }
+
+    size_t visibleTotal() const {
+      return visibleSum(m_root, 0);
+    }
+
+    // Sum of the visible elements among the first 'count' ones
+    size_t visiblePrefixSum(size_t count) const {
+      size_t sum = 0;
+      int hidden = 0; // Pending counters of the ancestors
+      uint32_t node = m_root;
+      while (node != 0 && count > 0) {
+        const Node& n = m_nodes[node];
+        if (hidden + n.m_min > 0)
+          break; // Everything below is hidden
+        size_t leftSize = m_nodes[n.m_left].m_size;
+        if (count >= n.m_size)
+          return sum + n.m_minSum;
+        if (count <= leftSize) {
+          hidden += n.m_pending;
+          node = n.m_left;
+        } else {
+          sum += visibleSum(n.m_left, hidden + n.m_pending) + (hidden + n.m_hidden == 0 ? n.m_value : 0);
+          count -= leftSize + 1;
+          hidden += n.m_pending;
+          node = n.m_right;
+        }
+      }
+      return sum;
+    }
+
+    // Index of the visible element which contains the 'value'-th visible unit (size() if there's none)
+    size_t findVisible(size_t value) const {
+      if (value >= visibleTotal())
+        return size();
+      size_t index = 0;
+      int hidden = 0;
+      uint32_t node = m_root;
+      while (node != 0) {
+        const Node& n = m_nodes[node];
+        size_t left = visibleSum(n.m_left, hidden + n.m_pending);
+        if (value < left) {
+          hidden += n.m_pending;
+          node = n.m_left;
+          continue;
+        }
+        value -= left;
+        index += m_nodes[n.m_left].m_size;
+        size_t own = (hidden + n.m_hidden == 0) ? n.m_value : 0;
+        if (value < own)
+          return index;
+        value -= own;
+        ++index;
+        hidden += n.m_pending;
+        node = n.m_right;
+      }
+      return size();
+    }
+
+  private:
+    struct Node {
+      size_t m_value = 0;
+      size_t m_sum = 0; // Of the subtree, hidden or not
+      size_t m_minSum = 0; // Sum of the elements of the subtree whose counter is m_min
+      uint32_t m_size = 0;
+      uint32_t m_left = 0, m_right = 0;
+      uint32_t m_priority = 0; // Larger than the children's
+      int m_hidden = 0; // Hidden ranges covering this element
+      int m_pending = 0; // Not pushed down to the children yet (already counted in m_hidden and m_min)
+      int m_min = INT_MAX; // Smallest counter in the subtree
+    };
+
+    // Visible sum of a subtree whose ancestors have 'hidden' counters pending
+    size_t visibleSum(uint32_t node, int hidden) const {
+      return (node != 0 && hidden + m_nodes[node].m_min == 0) ? m_nodes[node].m_minSum : 0;
+    }
+
+    uint32_t find(size_t index) const {
+      uint32_t node = m_root;
+      for (;;) {
+        size_t leftSize = m_nodes[m_nodes[node].m_left].m_size;
+        if (index == leftSize)
+          return node;
+        if (index < leftSize)
+          node = m_nodes[node].m_left;
+        else {
+          index -= leftSize + 1;
+          node = m_nodes[node].m_right;
+        }
+      }
+    }
+
+    uint32_t newNode(size_t value) {
+      uint32_t node;
+      if (!m_free.empty()) {
+        node = m_free.back();
+        m_free.pop_back();
+        m_nodes[node] = Node();
+      } else {
+        node = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+      }
+      m_seed ^= m_seed << 13; // xorshift32
+      m_seed ^= m_seed >> 17;
+      m_seed ^= m_seed << 5;
+      m_nodes[node].m_priority = m_seed;
+      m_nodes[node].m_value = value;
+      pull(node);
+      return node;
+    }
+
+    void release(uint32_t node) {
+      if (node == 0)
+        return;
+      release(m_nodes[node].m_left);
+      release(m_nodes[node].m_right);
+      m_free.push_back(node);
+    }
+
+    // Builds the treap of 'values' in O(n): the nodes on the right spine are kept on a stack, a node with a
+    // larger priority takes the nodes it pops as its left subtree. Nodes are complete when popped
+    uint32_t build(const std::vector<size_t>& values) {
+      std::vector<uint32_t> spine;
+      for (size_t value : values) {
+        uint32_t node = newNode(value), last = 0;
+        while (!spine.empty() && m_nodes[spine.back()].m_priority < m_nodes[node].m_priority) {
+          last = spine.back();
+          spine.pop_back();
+          pull(last);
+        }
+        m_nodes[node].m_left = last;
+        if (!spine.empty())
+          m_nodes[spine.back()].m_right = node;
+        spine.push_back(node);
+      }
+      for (size_t i = spine.size(); i-- > 0;)
+        pull(spine[i]);
+      return spine.empty() ? 0 : spine.front();
+    }
+
+    void pull(uint32_t node) {
+      Node& n = m_nodes[node];
+      const Node& left = m_nodes[n.m_left];
+      const Node& right = m_nodes[n.m_right];
+      n.m_size = left.m_size + right.m_size + 1;
+      n.m_sum = left.m_sum + right.m_sum + n.m_value;
+      n.m_min = n.m_hidden;
+      n.m_minSum = n.m_value;
+      for (const Node* child : { &left, &right }) {
+        int min = child->m_min + n.m_pending; // Children don't include the pending counters yet
+        if (child->m_size == 0 || min > n.m_min)
+          continue;
+        if (min < n.m_min) {
+          n.m_min = min;
+          n.m_minSum = 0;
+        }
+        n.m_minSum += child->m_minSum;
+      }
+    }
+
+    // Adds to the counters of a whole subtree
+    void apply(uint32_t node, int delta) {
+      if (node == 0)
+        return;
+      Node& n = m_nodes[node];
+      n.m_hidden += delta;
+      n.m_pending += delta;
+      n.m_min += delta;
+    }
+
+    void push(uint32_t node) {
+      Node& n = m_nodes[node];
+      if (n.m_pending == 0)
+        return;
+      apply(n.m_left, n.m_pending);
+      apply(n.m_right, n.m_pending);
+      n.m_pending = 0;
+    }
+
+    // Splits 'node' into the first 'count' elements and the rest
+    void split(uint32_t node, size_t count, uint32_t& left, uint32_t& right) {
+      if (node == 0) {
+        left = right = 0;
+        return;
+      }
+      push(node);
+      Node& n = m_nodes[node];
+      if (count <= m_nodes[n.m_left].m_size) {
+        uint32_t child = n.m_left;
+        split(child, count, left, m_nodes[node].m_left);
+        right = node;
+      } else {
+        uint32_t child = n.m_right;
+        split(child, count - m_nodes[n.m_left].m_size - 1, m_nodes[node].m_right, right);
+        left = node;
+      }
+      pull(node);
+    }
+
+    uint32_t merge(uint32_t left, uint32_t right) {
+      if (left == 0 || right == 0)
+        return left != 0 ? left : right;
+      if (m_nodes[left].m_priority > m_nodes[right].m_priority) {
+        push(left);
+        uint32_t child = merge(m_nodes[left].m_right, right);
+        m_nodes[left].m_right = child;
+        pull(left);
+        return left;
+      }
+      push(right);
+      uint32_t child = merge(left, m_nodes[right].m_left);
+      m_nodes[right].m_left = child;
+      pull(right);
+      return right;
+    }
+
+    void set(uint32_t node, size_t index, size_t value) {
+      push(node);
+      size_t leftSize = m_nodes[m_nodes[node].m_left].m_size;
+      if (index == leftSize)
+        m_nodes[node].m_value = value;
+      else if (index < leftSize)
+        set(m_nodes[node].m_left, index, value);
+      else
+        set(m_nodes[node].m_right, index - leftSize - 1, value);
+      pull(node);
+    }
+
+    // Adds 'delta' to the counters in [first, last) of the subtree whose first element is at 'offset'
+    void update(uint32_t node, size_t offset, size_t first, size_t last, int delta) {
+      if (node == 0 || last <= offset || offset + m_nodes[node].m_size <= first)
+        return;
+      if (first <= offset && offset + m_nodes[node].m_size <= last) { // Covered entirely
+        apply(node, delta);
+        return;
+      }
+      push(node);
+      size_t self = offset + m_nodes[m_nodes[node].m_left].m_size;
+      update(m_nodes[node].m_left, offset, first, last, delta);
+      if (first <= self && self < last)
+        m_nodes[node].m_hidden += delta;
+      update(m_nodes[node].m_right, self + 1, first, last, delta);
+      pull(node);
+    }
+
+    std::vector<Node> m_nodes; // Node 0 is the null node, children index this
+    std::vector<uint32_t> m_free; // Nodes of erased elements
+    uint32_t m_root = 0;
+    uint32_t m_seed = 2463534242u;
+  };
+
+}
+
+#endif // VARCO_FOLDTREE_HPP
@@ -0,0 +1,97 @@
+#ifndef VARCO_FRAMETIMER_HPP
+#define VARCO_FRAMETIMER_HPP
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace varco {
+
+  // A periodic timer which invokes a callback every 'interval' on its own thread while active.
+  // Deadlines are computed from the previous deadline (not from the time the callback returned) so
+  // that the frame rate doesn't drift. When stopped the thread just sleeps on a condition variable
+  // and consumes no CPU at all.
+  class FrameTimer {
+  public:
+    FrameTimer(std::chrono::milliseconds interval, std::function<void()> callback) :
+      m_interval(interval),
+      m_callback(std::move(callback))
+    {}
+
+    ~FrameTimer() {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sigterm = true;
+      }
+      m_cv.notify_all();
+      if (m_thread.joinable())
+        m_thread.join();
+    }
+
+    void start() {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_active)
+          return;
+        m_active = true;
+        if (!m_thread.joinable()) // Lazily spawn the timer thread at the first start
+          m_thread = std::thread(&FrameTimer::threadMain, this);
+      }
+      m_cv.notify_all();
+    }
+
+    void stop() {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_active = false;
+      }
+      m_cv.notify_all();
+    }
+
+    bool isActive() {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      return m_active;
+    }
+
+  private:
+    void threadMain() {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_sigterm) {
+
+        while (!m_sigterm && !m_active)
+          m_cv.wait(lock); // Idle: nothing to tick
+
+        auto deadline = std::chrono::steady_clock::now() + m_interval;
+        while (!m_sigterm && m_active) {
+          if (m_cv.wait_until(lock, deadline) == std::cv_status::no_timeout)
+            continue; // Spurious wakeup or state change, re-check the conditions
+          if (m_sigterm || !m_active)
+            break;
+
+          lock.unlock();
+          m_callback(); // Never call back with the lock held
+          lock.lock();
+
+          deadline += m_interval;
+          auto now = std::chrono::steady_clock::now();
+          if (deadline < now) // We fell behind (e.g. a long callback), don't try to catch up
+            deadline = now + m_interval;
+        }
+      }
+    }
+
+    const std::chrono::milliseconds m_interval;
+    std::function<void()> m_callback;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+    bool m_active = false;
+    bool m_sigterm = false;
+  };
+
+}
+
+#endif // VARCO_FRAMETIMER_HPP
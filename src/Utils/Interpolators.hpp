@@ -4,6 +4,7 @@
 #include <chrono>
 #include <vector>
 #include <memory>
+#include <atomic>
 
 namespace varco {
 
@@ -79,35 +80,44 @@ namespace varco {
     }
   };
 
+  // A sequence of interpolators. The sequence doesn't query the time by itself: it is advanced by
+  // tick() (usually called once per frame by the AnimationScheduler for all the registered animations)
+  // and getValue() just returns the value computed at the latest tick
   class InterpolationSequence {
   public:
-
-    void start() {
-      m_begin = std::chrono::high_resolution_clock::now();
+    using Clock = std::chrono::steady_clock;
+
+    void start(Clock::time_point now = Clock::now()) {
+      m_begin = now;
+      m_currentInterval = 0;
+      m_finished = false;
+      if (!m_sequence.empty())
+        m_currentValue = m_sequence.front()->m_startValue;
     }
 
     void addInterpolator(std::unique_ptr<InterpolatorBase> interpolator) {
       sequenceDurationMs += interpolator->m_milliseconds;
       m_sequence.emplace_back(std::move(interpolator));
-      m_intervalMap.emplace(sequenceDurationMs, m_sequence.size() - 1);
+      m_intervalEnds.push_back(sequenceDurationMs);
     }
 
-    //if (!m_cycle && elapsedMs >= m_milliseconds)
-      //return m_endValue;
-
     void setCycle(bool cycle) {
       m_cycle = cycle;
     }
 
-    // Called at any point in time, returns the right interpolator's value
-    int getValue() {
-      auto end = std::chrono::high_resolution_clock::now();
-      long long elapsedMs = 0;
+    // Advances the sequence to 'now' and caches the right interpolator's value. Returns true if
+    // the value changed since the previous tick
+    bool tick(Clock::time_point now) {
+      if (m_sequence.empty() || m_finished)
+        return false;
 
-      auto duration = end - m_begin;
-      elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+      long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_begin).count();
 
       if (elapsedMs > sequenceDurationMs) {
+        if (!m_cycle) { // Stick with the last value
+          m_finished = true;
+          return setValue(m_sequence.back()->m_endValue);
+        }
         // (beg;end) is elapsedMs and is longer than a single sequence duration
         //
         // |----|----|----|--|
@@ -115,40 +125,48 @@ namespace varco {
         //
         // Finds the segment (p;end) as delta and assigns begin to p.
         // Prevents overflow and ensures valid interpolation calculations.
-        auto deltaMs = elapsedMs - (static_cast<int>(elapsedMs / sequenceDurationMs) * sequenceDurationMs);
-        m_begin = end - std::chrono::milliseconds{deltaMs};
+        auto deltaMs = elapsedMs % sequenceDurationMs;
+        m_begin = now - std::chrono::milliseconds{deltaMs};
         elapsedMs = deltaMs;
+        m_currentInterval = 0; // Restarted the sequence
       }
 
-      if (elapsedMs > sequenceDurationMs)
-        elapsedMs = sequenceDurationMs; // Should never happen
-
-      // Detect the right interpolator to call
-      auto it = m_intervalMap.lower_bound(elapsedMs); // Returns the interval that ends at elapsedMs or goes after it
-      if (it == m_intervalMap.end()) // Should never happen
-        return -1;
+      // Detect the right interpolator to call. Time only moves forward, therefore we can just advance
+      // from the interval of the previous tick instead of searching for it every time
+      while (m_currentInterval < m_intervalEnds.size() - 1 && m_intervalEnds[m_currentInterval] < elapsedMs)
+        ++m_currentInterval;
 
       // Calculate delta into the selected interval (i.e. the offset from its start)
-      long long endPreviousInterval = 0;
-      if (it != m_intervalMap.end() && it != m_intervalMap.begin()) {
-        auto previous = it;
-        --previous;
-        // There's an interval before this one, grab its end value
-        endPreviousInterval = previous->first;
-      }
+      long long endPreviousInterval = (m_currentInterval > 0) ? m_intervalEnds[m_currentInterval - 1] : 0;
       long long msIntervalDelta = elapsedMs - endPreviousInterval;
 
-      return m_sequence[it->second]->getValue(msIntervalDelta);
+      return setValue(m_sequence[m_currentInterval]->getValue(msIntervalDelta));
+    }
 
-      //return (static_cast<float>(elapsedMs) / static_cast<float>(m_milliseconds)) * (m_endValue - m_startValue) + m_startValue;
+    // Returns the value calculated at the latest tick
+    int getValue() const {
+      return m_currentValue;
+    }
+
+    bool isFinished() const {
+      return m_finished;
     }
 
   private:
+    bool setValue(int value) {
+      if (value == -1) // Invalid value
+        return false;
+      return m_currentValue.exchange(value) != value;
+    }
+
     std::vector<std::unique_ptr<InterpolatorBase>> m_sequence;
-    std::map<long long /* end of a sequence in ms */, size_t /* index into m_sequence */> m_intervalMap;
+    std::vector<long long> m_intervalEnds; // End of every interval in ms, index matches m_sequence
+    size_t m_currentInterval = 0;
     long long sequenceDurationMs = 0;
-    bool  m_cycle; // Whether we should be cycling the results or just stick with the endValue
-    std::chrono::time_point<std::chrono::high_resolution_clock> m_begin;
+    bool  m_cycle = true; // Whether we should be cycling the results or just stick with the endValue
+    bool  m_finished = false;
+    std::atomic<int> m_currentValue{ 0 }; // Written by the ticking thread, read by the rendering one
+    Clock::time_point m_begin;
   };
 
 }
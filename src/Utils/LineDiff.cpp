@@ -0,0 +1,122 @@
+#include <Utils/LineDiff.hpp>
+#include <algorithm>
+
+namespace varco {
+
+  namespace {
+
+    // Myers' linear space refinement: the middle snake of the shortest script is found by searching from
+    // both ends at once, then the two halves around it are diffed the same way. Only the furthest x reached
+    // on every diagonal is kept (one array per direction, shared by all the halves) so memory is O(N + M)
+    class MyersDiff {
+    public:
+      MyersDiff(const std::vector<size_t>& oldLines, const std::vector<size_t>& newLines, long long maxD) :
+        m_old(oldLines), m_new(newLines), m_offset(maxD / 2 + 2),
+        m_forward(2 * m_offset + 1), m_backward(2 * m_offset + 1)
+      {}
+
+      // False if the lines in range differ by more than maxD edits
+      bool diff(long long oldBegin, long long oldEnd, long long newBegin, long long newEnd, long long maxD) {
+        while (oldBegin < oldEnd && newBegin < newEnd && m_old[oldBegin] == m_new[newBegin])
+          ++oldBegin, ++newBegin;
+        while (oldBegin < oldEnd && newBegin < newEnd && m_old[oldEnd - 1] == m_new[newEnd - 1])
+          --oldEnd, --newEnd;
+        if (oldBegin == oldEnd || newBegin == newEnd) {
+          if (oldBegin != oldEnd || newBegin != newEnd)
+            addEdits(oldBegin, oldEnd - oldBegin, newBegin, newEnd - newBegin);
+          return true;
+        }
+
+        // Without a common first or last line the script has at least two edits, each half has fewer
+        long long snakeX, snakeY, snakeEndX, snakeEndY;
+        if (!findMiddleSnake(oldBegin, oldEnd, newBegin, newEnd, maxD, snakeX, snakeY, snakeEndX, snakeEndY))
+          return false;
+        long long unlimited = (oldEnd - oldBegin) + (newEnd - newBegin);
+        diff(oldBegin, snakeX, newBegin, snakeY, unlimited);
+        diff(snakeEndX, oldEnd, snakeEndY, newEnd, unlimited);
+        return true;
+      }
+
+      std::vector<DiffHunk> m_hunks;
+
+    private:
+      // Adjacent edits (not separated by matching lines) make up a hunk
+      void addEdits(long long oldStart, long long oldCount, long long newStart, long long newCount) {
+        if (m_hunks.empty() || static_cast<long long>(m_hunks.back().m_oldStart + m_hunks.back().m_oldCount) != oldStart ||
+            static_cast<long long>(m_hunks.back().m_newStart + m_hunks.back().m_newCount) != newStart)
+          m_hunks.push_back({ static_cast<size_t>(oldStart), 0, static_cast<size_t>(newStart), 0 });
+        m_hunks.back().m_oldCount += static_cast<size_t>(oldCount);
+        m_hunks.back().m_newCount += static_cast<size_t>(newCount);
+      }
+
+      // forward[k] is the furthest x reached on diagonal k (y = x - k) from the beginning of the range,
+      // backward[k] the same from the end (x and y counted backwards). Both searches advance one edit at a
+      // time until they overlap: the snake where they do is part of a shortest script
+      bool findMiddleSnake(long long oldBegin, long long oldEnd, long long newBegin, long long newEnd, long long maxD,
+                           long long& snakeX, long long& snakeY, long long& snakeEndX, long long& snakeEndY) {
+        const long long n = oldEnd - oldBegin, m = newEnd - newBegin, delta = n - m;
+        const bool odd = (delta % 2) != 0;
+        auto forward = [&](long long k) -> long long& { return m_forward[k + m_offset]; };
+        auto backward = [&](long long k) -> long long& { return m_backward[k + m_offset]; };
+        forward(1) = backward(1) = 0;
+
+        for (long long d = 0; 2 * d - 1 <= maxD; ++d) {
+          for (long long k = -d; k <= d; k += 2) {
+            long long x = (k == -d || (k != d && forward(k - 1) < forward(k + 1))) ? forward(k + 1) : forward(k - 1) + 1;
+            long long y = x - k, startX = x, startY = y;
+            while (x < n && y < m && m_old[oldBegin + x] == m_new[newBegin + y])
+              ++x, ++y;
+            forward(k) = x;
+            // 2d - 1 edits: the backward search has done d - 1 steps
+            if (odd && delta - k >= -(d - 1) && delta - k <= d - 1 && x + backward(delta - k) >= n) {
+              snakeX = oldBegin + startX, snakeY = newBegin + startY;
+              snakeEndX = oldBegin + x, snakeEndY = newBegin + y;
+              return true;
+            }
+          }
+          if (2 * d > maxD)
+            break;
+          for (long long k = -d; k <= d; k += 2) {
+            long long x = (k == -d || (k != d && backward(k - 1) < backward(k + 1))) ? backward(k + 1) : backward(k - 1) + 1;
+            long long y = x - k, startX = x, startY = y;
+            while (x < n && y < m && m_old[oldEnd - 1 - x] == m_new[newEnd - 1 - y])
+              ++x, ++y;
+            backward(k) = x;
+            // 2d edits: the forward search has done d steps too
+            if (!odd && delta - k >= -d && delta - k <= d && x + forward(delta - k) >= n) {
+              snakeX = oldEnd - x, snakeY = newEnd - y;
+              snakeEndX = oldEnd - startX, snakeEndY = newEnd - startY;
+              return true;
+            }
+          }
+        }
+        return false;
+      }
+
+      const std::vector<size_t>& m_old;
+      const std::vector<size_t>& m_new;
+      const long long m_offset; // Diagonal 0 in the arrays below
+      std::vector<long long> m_forward, m_backward;
+    };
+
+  }
+
+  std::vector<DiffHunk> diffLines(const std::vector<size_t>& oldLines, const std::vector<size_t>& newLines, size_t maxEdits) {
+    const long long n = static_cast<long long>(oldLines.size()), m = static_cast<long long>(newLines.size());
+    const long long maxD = std::min(static_cast<long long>(maxEdits), n + m);
+    MyersDiff diff(oldLines, newLines, maxD);
+    if (diff.diff(0, n, 0, m, maxD))
+      return std::move(diff.m_hunks);
+
+    // Too many differences: everything between the common prefix and suffix is replaced
+    size_t prefix = 0;
+    while (prefix < oldLines.size() && prefix < newLines.size() && oldLines[prefix] == newLines[prefix])
+      ++prefix;
+    size_t suffix = 0;
+    while (suffix < oldLines.size() - prefix && suffix < newLines.size() - prefix &&
+           oldLines[oldLines.size() - 1 - suffix] == newLines[newLines.size() - 1 - suffix])
+      ++suffix;
+    return { { prefix, oldLines.size() - prefix - suffix, prefix, newLines.size() - prefix - suffix } };
+  }
+
+}
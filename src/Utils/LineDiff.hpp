@@ -0,0 +1,24 @@
+#ifndef VARCO_LINEDIFF_HPP
+#define VARCO_LINEDIFF_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace varco {
+
+  struct DiffHunk { // Lines [m_oldStart, m_oldStart + m_oldCount) replaced by [m_newStart, m_newStart + m_newCount)
+    size_t m_oldStart;
+    size_t m_oldCount;
+    size_t m_newStart;
+    size_t m_newCount;
+  };
+
+  // The shortest edit script between two sequences of lines given as hashes (Myers' O(ND) algorithm in
+  // linear space, after skipping the common prefix and suffix), as sorted hunks of replaced lines. Its cost
+  // grows with the number of differences, not with the size of the sequences: past 'maxEdits' changed lines
+  // a single hunk replacing everything between the common prefix and suffix is returned instead
+  std::vector<DiffHunk> diffLines(const std::vector<size_t>& oldLines, const std::vector<size_t>& newLines, size_t maxEdits);
+
+}
+
+#endif // VARCO_LINEDIFF_HPP
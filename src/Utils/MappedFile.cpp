@@ -0,0 +1,128 @@
+#include <Utils/MappedFile.hpp>
+#ifdef _WIN32
+  #include <windows.h>
+#elif defined __linux__
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+namespace varco {
+
+#define MAP_THRESHOLD (1 << 20) // Smaller files are read rather than mapped
+
+  MappedFile::~MappedFile() {
+    close();
+  }
+
+#ifdef _WIN32
+
+  bool MappedFile::open(const std::string& path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+      CloseHandle(file);
+      return false;
+    }
+    m_file = file;
+    m_size = static_cast<size_t>(size.QuadPart);
+    m_open = true;
+    if (m_size == 0)
+      return true; // Empty files can't be mapped
+    if (m_size < MAP_THRESHOLD) {
+      m_buffer.resize(m_size);
+      DWORD read = 0;
+      if (!ReadFile(file, m_buffer.data(), static_cast<DWORD>(m_size), &read, nullptr) || read != m_size) {
+        close();
+        return false;
+      }
+      m_data = m_buffer.data();
+      return true;
+    }
+    m_mapped = true;
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping != nullptr)
+      m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void MappedFile::close() {
+    if (m_mapped && m_data != nullptr)
+      UnmapViewOfFile(m_data);
+    if (m_mapping != nullptr)
+      CloseHandle(m_mapping);
+    if (m_file != nullptr)
+      CloseHandle(m_file);
+    m_data = nullptr;
+    m_mapping = m_file = nullptr;
+    m_size = 0;
+    m_open = false;
+    m_mapped = false;
+  }
+
+#elif defined __linux__
+
+  bool MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+      ::close(fd);
+      return false;
+    }
+    m_fd = fd;
+    m_size = static_cast<size_t>(info.st_size);
+    m_open = true;
+    if (m_size == 0)
+      return true; // Empty files can't be mapped
+    if (m_size < MAP_THRESHOLD) {
+      m_buffer.resize(m_size);
+      size_t done = 0;
+      while (done < m_size) {
+        ssize_t count = ::read(fd, m_buffer.data() + done, m_size - done);
+        if (count <= 0)
+          break;
+        done += count;
+      }
+      m_size = done; // The file might have been truncated meanwhile
+      m_data = m_buffer.data();
+      return true;
+    }
+    m_mapped = true;
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      m_mapped = false;
+      close();
+      return false;
+    }
+    madvise(data, m_size, MADV_SEQUENTIAL); // Read-ahead aggressively, drop pages behind
+    m_data = static_cast<const char*>(data);
+    return true;
+  }
+
+  void MappedFile::close() {
+    if (m_mapped && m_data != nullptr)
+      munmap(const_cast<char*>(m_data), m_size);
+    if (m_fd >= 0)
+      ::close(m_fd);
+    m_data = nullptr;
+    m_fd = -1;
+    m_size = 0;
+    m_open = false;
+    m_mapped = false;
+  }
+
+#endif
+
+}
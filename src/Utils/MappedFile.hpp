@@ -0,0 +1,44 @@
+#ifndef VARCO_MAPPEDFILE_HPP
+#define VARCO_MAPPEDFILE_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace varco {
+
+  // A read-only memory mapping of an entire file. The OS pages the contents in on demand (and can drop
+  // them again under pressure): nothing is copied into the process. Small files are read into a buffer
+  // instead since setting up and tearing down a mapping costs more than copying them (the buffer is
+  // reused by the following open() calls)
+  class MappedFile {
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path); // Returns false if the file can't be opened or mapped
+    void close();
+
+    bool isOpen() const { return m_open; }
+    const char *getData() const { return m_data; } // Null for empty files
+    size_t getSize() const { return m_size; }
+
+  private:
+    bool m_open = false;
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    std::vector<char> m_buffer; // Small files
+#ifdef _WIN32
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#elif defined __linux__
+    int m_fd = -1;
+#endif
+  };
+
+}
+
+#endif // VARCO_MAPPEDFILE_HPP
@@ -0,0 +1,729 @@
+#include <Utils/Regex.hpp>
+#include <Utils/SubstringSearch.hpp>
+#include <algorithm>
+#include <cctype>
+
+namespace varco {
+
+#define MAX_REPEAT 1000 // Largest {n,m} bound accepted
+#define MAX_INSTRUCTIONS 100000 // Patterns compiling to larger NFAs are rejected
+#define MAX_DFA_STATES 2048 // The DFA cache is flushed when it grows beyond this (256 transitions per state)
+
+  struct Regex::Node {
+    enum Type { Empty, Char, Concat, Alternation, Repeat, LineBegin, LineEnd };
+    Type m_type;
+    int m_class = -1; // Char
+    int m_min = 0, m_max = -1; // Repeat (-1: unbounded)
+    std::vector<std::unique_ptr<Node>> m_children;
+
+    explicit Node(Type type) : m_type(type) {}
+  };
+
+  // Recursive descent parser. Errors are reported by setting m_error and unwinding with nullptrs
+  class Regex::Parser {
+  public:
+    Parser(const std::string& pattern, bool caseSensitive, std::vector<std::bitset<256>>& classes) :
+      m_pattern(pattern), m_caseSensitive(caseSensitive), m_classes(classes)
+    {}
+
+    std::unique_ptr<Node> parse() {
+      auto node = parseAlternation();
+      if (node && m_position < m_pattern.size())
+        fail("unmatched )");
+      return m_error.empty() ? std::move(node) : nullptr;
+    }
+
+    std::string m_error;
+
+  private:
+    bool atEnd() const { return m_position >= m_pattern.size(); }
+    char peek() const { return m_pattern[m_position]; }
+
+    std::unique_ptr<Node> fail(const std::string& error) {
+      if (m_error.empty())
+        m_error = error + " at position " + std::to_string(m_position);
+      return nullptr;
+    }
+
+    std::unique_ptr<Node> makeChar(std::bitset<256> set) {
+      if (!m_caseSensitive)
+        foldCase(set);
+      auto node = std::make_unique<Node>(Node::Char);
+      node->m_class = static_cast<int>(m_classes.size());
+      m_classes.push_back(set);
+      return node;
+    }
+
+    static void foldCase(std::bitset<256>& set) {
+      for (int c = 'a'; c <= 'z'; ++c) {
+        if (set[c] || set[std::toupper(c)])
+          set.set(c).set(std::toupper(c));
+      }
+    }
+
+    std::unique_ptr<Node> parseAlternation() {
+      auto node = parseConcat();
+      if (!node || atEnd() || peek() != '|')
+        return node;
+      auto alternation = std::make_unique<Node>(Node::Alternation);
+      alternation->m_children.emplace_back(std::move(node));
+      while (!atEnd() && peek() == '|') {
+        ++m_position;
+        auto branch = parseConcat();
+        if (!branch)
+          return nullptr;
+        alternation->m_children.emplace_back(std::move(branch));
+      }
+      return alternation;
+    }
+
+    std::unique_ptr<Node> parseConcat() {
+      auto concat = std::make_unique<Node>(Node::Concat);
+      while (!atEnd() && peek() != '|' && peek() != ')') {
+        auto node = parseRepeat();
+        if (!node)
+          return nullptr;
+        concat->m_children.emplace_back(std::move(node));
+      }
+      if (concat->m_children.empty())
+        return std::make_unique<Node>(Node::Empty);
+      if (concat->m_children.size() == 1)
+        return std::move(concat->m_children.front());
+      return concat;
+    }
+
+    std::unique_ptr<Node> parseRepeat() {
+      auto node = parseAtom();
+      while (node && !atEnd()) {
+        int min, max;
+        char c = peek();
+        if (c == '*') {
+          min = 0; max = -1;
+        } else if (c == '+') {
+          min = 1; max = -1;
+        } else if (c == '?') {
+          min = 0; max = 1;
+        } else if (c == '{') {
+          size_t start = m_position;
+          if (!parseBounds(min, max)) {
+            if (!m_error.empty())
+              return nullptr;
+            m_position = start; // Not a quantifier: a literal '{'
+            break;
+          }
+          --m_position; // Consumed below with the others
+        } else
+          break;
+        ++m_position;
+        if (!atEnd() && peek() == '?')
+          ++m_position; // Lazy quantifiers are leftmost-longest as well
+
+        if (node->m_type == Node::LineBegin || node->m_type == Node::LineEnd || node->m_type == Node::Empty)
+          return fail("nothing to repeat");
+        auto repeat = std::make_unique<Node>(Node::Repeat);
+        repeat->m_min = min;
+        repeat->m_max = max;
+        repeat->m_children.emplace_back(std::move(node));
+        node = std::move(repeat);
+      }
+      return node;
+    }
+
+    bool parseNumber(int& value) {
+      size_t start = m_position;
+      value = 0;
+      while (!atEnd() && std::isdigit(static_cast<unsigned char>(peek())))
+        value = std::min(value * 10 + (m_pattern[m_position++] - '0'), MAX_REPEAT + 1);
+      return m_position > start;
+    }
+
+    bool parseBounds(int& min, int& max) { // '{' is at m_position, leaves m_position after '}'
+      ++m_position;
+      if (!parseNumber(min))
+        return false;
+      max = min;
+      if (!atEnd() && peek() == ',') {
+        ++m_position;
+        if (!parseNumber(max))
+          max = -1;
+      }
+      if (atEnd() || peek() != '}')
+        return false;
+      ++m_position;
+      if (min > MAX_REPEAT || max > MAX_REPEAT) {
+        fail("repetition count too large");
+        return false;
+      }
+      if (max != -1 && max < min) {
+        fail("invalid repetition bounds");
+        return false;
+      }
+      return true;
+    }
+
+    std::unique_ptr<Node> parseAtom() {
+      char c = m_pattern[m_position++];
+      switch (c) {
+        case '(': {
+          if (m_pattern.compare(m_position, 2, "?:") == 0)
+            m_position += 2;
+          else if (!atEnd() && peek() == '?')
+            return fail("unsupported group");
+          auto node = parseAlternation();
+          if (!node)
+            return nullptr;
+          if (atEnd() || peek() != ')')
+            return fail("missing )");
+          ++m_position;
+          return node;
+        }
+        case '[': return parseClass();
+        case '.': return makeChar(std::bitset<256>().set());
+        case '^': return std::make_unique<Node>(Node::LineBegin);
+        case '$': return std::make_unique<Node>(Node::LineEnd);
+        case '*': case '+': case '?': return fail("nothing to repeat");
+        case '\\': {
+          std::bitset<256> set;
+          if (!parseEscape(set))
+            return nullptr;
+          return makeChar(set);
+        }
+        default: {
+          std::bitset<256> set;
+          set.set(static_cast<unsigned char>(c));
+          return makeChar(set);
+        }
+      }
+    }
+
+    // '\\' was just consumed
+    bool parseEscape(std::bitset<256>& set) {
+      if (atEnd()) {
+        fail("trailing \\");
+        return false;
+      }
+      char c = m_pattern[m_position++];
+      bool negate = std::isupper(static_cast<unsigned char>(c)) && std::string("DWS").find(c) != std::string::npos;
+      switch (std::tolower(static_cast<unsigned char>(c))) {
+        case 'd': for (int i = '0'; i <= '9'; ++i) set.set(i); break;
+        case 's': for (char i : std::string(" \t\r\n\f\v")) set.set(static_cast<unsigned char>(i)); break;
+        case 'w': {
+          for (int i = 0; i < 256; ++i) {
+            if (std::isalnum(i) || i == '_')
+              set.set(i);
+          }
+        } break;
+        default: {
+          negate = false;
+          if (std::isalnum(static_cast<unsigned char>(c))) {
+            switch (c) {
+              case 't': set.set('\t'); return true;
+              case 'n': set.set('\n'); return true;
+              case 'r': set.set('\r'); return true;
+              default: fail("unsupported escape"); return false; // e.g. backreferences
+            }
+          }
+          set.set(static_cast<unsigned char>(c)); // Escaped metacharacter
+        }
+      }
+      if (negate)
+        set.flip();
+      return true;
+    }
+
+    std::unique_ptr<Node> parseClass() { // '[' was just consumed
+      bool negate = false;
+      if (!atEnd() && peek() == '^') {
+        negate = true;
+        ++m_position;
+      }
+      std::bitset<256> set;
+      bool first = true;
+      while (!atEnd() && (peek() != ']' || first)) {
+        first = false;
+        int low;
+        char c = m_pattern[m_position++];
+        if (c == '\\') {
+          std::bitset<256> escaped;
+          if (!parseEscape(escaped))
+            return nullptr;
+          if (escaped.count() != 1) { // \d, \w and the like can't be range ends
+            set |= escaped;
+            continue;
+          }
+          for (low = 0; !escaped[low]; ++low);
+        } else
+          low = static_cast<unsigned char>(c);
+
+        int high = low;
+        if (m_position + 1 < m_pattern.size() && peek() == '-' && m_pattern[m_position + 1] != ']') {
+          ++m_position;
+          char end = m_pattern[m_position++];
+          if (end == '\\') {
+            std::bitset<256> escaped;
+            if (!parseEscape(escaped))
+              return nullptr;
+            if (escaped.count() != 1)
+              return fail("invalid class range");
+            for (high = 0; !escaped[high]; ++high);
+          } else
+            high = static_cast<unsigned char>(end);
+          if (high < low)
+            return fail("invalid class range");
+        }
+        for (int i = low; i <= high; ++i)
+          set.set(i);
+      }
+      if (atEnd())
+        return fail("missing ]");
+      ++m_position;
+
+      if (!m_caseSensitive)
+        foldCase(set); // Before negating: [^a] mustn't match 'A' either
+      if (negate)
+        set.flip();
+      auto node = std::make_unique<Node>(Node::Char);
+      node->m_class = static_cast<int>(m_classes.size());
+      m_classes.push_back(set);
+      return node;
+    }
+
+    const std::string& m_pattern;
+    size_t m_position = 0;
+    bool m_caseSensitive;
+    std::vector<std::bitset<256>>& m_classes;
+  };
+
+  std::shared_ptr<const Regex> Regex::compile(const std::string& pattern, bool caseSensitive, std::string *error) {
+    std::shared_ptr<Regex> regex(new Regex());
+    regex->m_pattern = pattern;
+
+    Parser parser(pattern, caseSensitive, regex->m_classes);
+    std::unique_ptr<Node> root = parser.parse();
+    if (!root) {
+      if (error)
+        *error = parser.m_error;
+      return nullptr;
+    }
+
+    // The longest run of single characters the pattern can't do without
+    const Node *sequence = root.get();
+    std::vector<const Node*> parts;
+    if (sequence->m_type == Node::Concat) {
+      for (const auto& child : sequence->m_children)
+        parts.push_back(child.get());
+    } else
+      parts.push_back(sequence);
+    std::string literal;
+    for (const Node *part : parts) {
+      const auto& set = (part->m_type == Node::Char) ? regex->m_classes[part->m_class] : std::bitset<256>();
+      if (part->m_type == Node::Char && set.count() == 1) {
+        for (int c = 0; c < 256; ++c) {
+          if (set[c])
+            literal += static_cast<char>(c);
+        }
+        if (literal.size() > regex->m_requiredLiteral.size())
+          regex->m_requiredLiteral = literal;
+      } else if (part->m_type != Node::LineBegin && part->m_type != Node::LineEnd)
+        literal.clear();
+    }
+
+    for (bool reverse : { false, true }) {
+      Program& program = reverse ? regex->m_reverse : regex->m_forward;
+      program.m_instructions.push_back({ Instruction::Match });
+      program.m_start = regex->compileNode(*root, 0, program, reverse);
+      if (program.m_start < 0) {
+        if (error)
+          *error = "pattern too large";
+        return nullptr;
+      }
+    }
+    return regex;
+  }
+
+  const std::string& Regex::getPattern() const {
+    return m_pattern;
+  }
+
+  // Compiles a node given the instruction which follows it, returns its entry instruction (or -1 if the
+  // program got too large). The reverse program matches the reversed language: sequences are compiled in
+  // the opposite order and the anchors are swapped
+  int Regex::compileNode(const Node& node, int next, Program& program, bool reverse) const {
+    auto& instructions = program.m_instructions;
+    if (next < 0 || instructions.size() > MAX_INSTRUCTIONS)
+      return -1;
+    auto add = [&](Instruction instruction) {
+      instructions.push_back(instruction);
+      return static_cast<int>(instructions.size()) - 1;
+    };
+
+    switch (node.m_type) {
+      case Node::Empty:
+        return next;
+      case Node::Char: {
+        Instruction instruction{ Instruction::Char };
+        instruction.m_class = node.m_class;
+        instruction.m_out = next;
+        return add(instruction);
+      }
+      case Node::LineBegin:
+      case Node::LineEnd: {
+        Instruction instruction{ ((node.m_type == Node::LineBegin) != reverse) ? Instruction::LineBegin : Instruction::LineEnd };
+        instruction.m_out = next;
+        return add(instruction);
+      }
+      case Node::Concat: {
+        if (reverse) {
+          for (const auto& child : node.m_children)
+            next = compileNode(*child, next, program, reverse);
+        } else {
+          for (auto it = node.m_children.rbegin(); it != node.m_children.rend(); ++it)
+            next = compileNode(**it, next, program, reverse);
+        }
+        return next;
+      }
+      case Node::Alternation: {
+        int entry = compileNode(*node.m_children.back(), next, program, reverse);
+        for (size_t i = node.m_children.size() - 1; i-- > 0 && entry >= 0;) {
+          Instruction split{ Instruction::Split };
+          split.m_out = compileNode(*node.m_children[i], next, program, reverse);
+          split.m_out1 = entry;
+          entry = split.m_out < 0 ? -1 : add(split);
+        }
+        return entry;
+      }
+      case Node::Repeat: {
+        const Node& child = *node.m_children.front();
+        if (node.m_max < 0) { // A loop: the body goes back to a split which either repeats or exits
+          Instruction split{ Instruction::Split };
+          split.m_out1 = next;
+          int loop = add(split);
+          int body = compileNode(child, loop, program, reverse);
+          if (body < 0)
+            return -1;
+          instructions[loop].m_out = body;
+          next = loop;
+        } else {
+          for (int i = node.m_min; i < node.m_max && next >= 0; ++i) { // Optional copies
+            Instruction split{ Instruction::Split };
+            split.m_out = compileNode(child, next, program, reverse);
+            split.m_out1 = next;
+            next = split.m_out < 0 ? -1 : add(split);
+          }
+        }
+        for (int i = 0; i < node.m_min && next >= 0; ++i) // Mandatory copies
+          next = compileNode(child, next, program, reverse);
+        return next;
+      }
+    }
+    return -1;
+  }
+
+  RegexMatcher::Dfa::Dfa(const Regex& regex, const Regex::Program& program, bool unanchored) :
+    m_regex(regex), m_program(program), m_unanchored(unanchored)
+  {}
+
+  void RegexMatcher::Dfa::addClosure(int instruction, bool atBegin, std::vector<int>& set, std::vector<bool>& visited) const {
+    std::vector<int> stack(1, instruction);
+    while (!stack.empty()) {
+      int index = stack.back();
+      stack.pop_back();
+      if (visited[index])
+        continue;
+      visited[index] = true;
+      const auto& current = m_program.m_instructions[index];
+      switch (current.m_type) {
+        case Regex::Instruction::Char:
+        case Regex::Instruction::Match:
+        case Regex::Instruction::LineEnd: // Followed only when the input ends (see intern)
+          set.push_back(index);
+          break;
+        case Regex::Instruction::Split:
+          stack.push_back(current.m_out1);
+          stack.push_back(current.m_out);
+          break;
+        case Regex::Instruction::LineBegin:
+          if (atBegin)
+            stack.push_back(current.m_out);
+          break;
+      }
+    }
+  }
+
+  int RegexMatcher::Dfa::intern(std::vector<int> set, bool atBegin) {
+    std::sort(set.begin(), set.end());
+    auto key = std::make_pair(atBegin, set);
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+      return it->second;
+
+    if (m_states.size() >= MAX_DFA_STATES)
+      flush();
+
+    State state;
+    const auto& instructions = m_program.m_instructions;
+    for (int index : set) {
+      if (instructions[index].m_type == Regex::Instruction::Match)
+        state.m_accepting = true;
+    }
+    // Whether a match is reached by also following the LineEnd assertions
+    m_visited.assign(instructions.size(), false);
+    std::vector<int> stack;
+    for (int index : set) {
+      if (instructions[index].m_type == Regex::Instruction::LineEnd)
+        stack.push_back(index);
+    }
+    while (!stack.empty() && !state.m_acceptingAtEnd) {
+      int index = stack.back();
+      stack.pop_back();
+      if (m_visited[index])
+        continue;
+      m_visited[index] = true;
+      const auto& current = instructions[index];
+      switch (current.m_type) {
+        case Regex::Instruction::Match: state.m_acceptingAtEnd = true; break;
+        case Regex::Instruction::LineEnd: stack.push_back(current.m_out); break;
+        case Regex::Instruction::LineBegin: if (atBegin) stack.push_back(current.m_out); break;
+        case Regex::Instruction::Split: stack.push_back(current.m_out); stack.push_back(current.m_out1); break;
+        case Regex::Instruction::Char: break;
+      }
+    }
+    state.m_acceptingAtEnd = state.m_acceptingAtEnd || state.m_accepting;
+    state.m_nfaStates = std::move(key.second);
+
+    int id = static_cast<int>(m_states.size());
+    m_index.emplace(std::make_pair(atBegin, state.m_nfaStates), id);
+    m_states.emplace_back(std::move(state));
+    m_transitions.resize(m_states.size() * 256, -1);
+    return id;
+  }
+
+  void RegexMatcher::Dfa::flush() {
+    m_states.clear();
+    m_index.clear();
+    m_transitions.clear();
+    m_start[0] = m_start[1] = -1;
+    ++m_flushes;
+  }
+
+  int RegexMatcher::Dfa::getStart(bool atBegin) {
+    if (m_start[atBegin] < 0) {
+      std::vector<int> set;
+      m_visited.assign(m_program.m_instructions.size(), false);
+      addClosure(m_program.m_start, atBegin, set, m_visited);
+      int state = intern(std::move(set), atBegin);
+      m_start[atBegin] = state;
+    }
+    return m_start[atBegin];
+  }
+
+  int RegexMatcher::Dfa::computeNext(int state, unsigned char byte) {
+    std::vector<int> set;
+    m_visited.assign(m_program.m_instructions.size(), false);
+    for (int index : m_states[state].m_nfaStates) {
+      const auto& instruction = m_program.m_instructions[index];
+      if (instruction.m_type == Regex::Instruction::Char && m_regex.m_classes[instruction.m_class][byte])
+        addClosure(instruction.m_out, false, set, m_visited);
+    }
+    if (m_unanchored)
+      addClosure(m_program.m_start, false, set, m_visited);
+
+    unsigned int flushes = m_flushes;
+    int nextState = intern(std::move(set), false);
+    int encoded = (nextState << 1) | (m_states[nextState].m_accepting ? 1 : 0);
+    if (flushes == m_flushes) // Otherwise 'state' doesn't exist anymore
+      m_transitions[state * 256 + byte] = encoded;
+    return encoded;
+  }
+
+  bool RegexMatcher::Dfa::isDead(int state) const {
+    return m_states[state].m_nfaStates.empty();
+  }
+
+  bool RegexMatcher::Dfa::isAccepting(int state, bool atEnd) const {
+    return atEnd ? m_states[state].m_acceptingAtEnd : m_states[state].m_accepting;
+  }
+
+  const std::vector<int>& RegexMatcher::Dfa::getNfaStates(int state) const {
+    return m_states[state].m_nfaStates;
+  }
+
+  std::vector<int> RegexMatcher::Dfa::getClosure(int instruction, bool atBegin) const {
+    std::vector<int> set;
+    std::vector<bool> visited(m_program.m_instructions.size(), false);
+    addClosure(instruction, atBegin, set, visited);
+    std::sort(set.begin(), set.end());
+    return set;
+  }
+
+  RegexMatcher::Liveness::Liveness(const Regex& regex, const Dfa& forward) :
+    m_regex(regex)
+  {
+    const auto& instructions = regex.m_forward.m_instructions;
+    m_closures.resize(instructions.size());
+    std::vector<int> endSet(1, 0);
+    for (size_t i = 0; i < instructions.size(); ++i) {
+      const auto& instruction = instructions[i];
+      if (instruction.m_type == Regex::Instruction::Char) {
+        m_charInstructions.push_back(static_cast<int>(i));
+        m_closures[i] = forward.getClosure(instruction.m_out, false);
+      }
+    }
+    // A LineEnd assertion holds at the end of the line: it leads to a match if what follows it does (through
+    // other LineEnd assertions). Followed to a fixed point since they might come in any order
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (size_t i = 0; i < instructions.size(); ++i) {
+        if (instructions[i].m_type != Regex::Instruction::LineEnd || std::binary_search(endSet.begin(), endSet.end(), static_cast<int>(i)))
+          continue;
+        for (int index : forward.getClosure(instructions[i].m_out, false)) {
+          if (std::binary_search(endSet.begin(), endSet.end(), index)) {
+            endSet.insert(std::lower_bound(endSet.begin(), endSet.end(), static_cast<int>(i)), static_cast<int>(i));
+            changed = true;
+            break;
+          }
+        }
+      }
+    }
+    m_endSet = intern(std::move(endSet));
+  }
+
+  int RegexMatcher::Liveness::intern(std::vector<int> set) {
+    auto it = m_index.find(set);
+    if (it != m_index.end())
+      return it->second;
+    int id = static_cast<int>(m_sets.size());
+    m_index.emplace(set, id);
+    m_sets.emplace_back(std::move(set));
+    if (m_sets.size() <= MAX_DFA_STATES)
+      m_transitions.resize(m_sets.size() * 256, -1);
+    return id;
+  }
+
+  // The Char instructions which read the byte and then reach a live instruction of the next position
+  int RegexMatcher::Liveness::next(int set, unsigned char byte) {
+    bool cached = set < MAX_DFA_STATES;
+    if (cached && m_transitions[set * 256 + byte] >= 0)
+      return m_transitions[set * 256 + byte];
+
+    std::vector<int> previous(1, 0); // Match: a match can end anywhere
+    for (int index : m_charInstructions) {
+      if (!m_regex.m_classes[m_regex.m_forward.m_instructions[index].m_class][byte])
+        continue;
+      const auto& closure = m_closures[index];
+      const auto& live = m_sets[set];
+      auto first = closure.begin(), second = live.begin();
+      while (first != closure.end() && second != live.end() && *first != *second) { // Sorted: merge
+        if (*first < *second)
+          ++first;
+        else
+          ++second;
+      }
+      if (first != closure.end() && second != live.end())
+        previous.push_back(index);
+    }
+    int previousSet = intern(std::move(previous)); // Sorted since the Char instructions are
+    if (cached)
+      m_transitions[set * 256 + byte] = previousSet;
+    return previousSet;
+  }
+
+  void RegexMatcher::Liveness::compute(const char *text, size_t size, size_t from) {
+    if (m_sets.size() > MAX_DFA_STATES) { // Only between lines: the sets of the positions are in use meanwhile
+      std::vector<int> endSet = std::move(m_sets[m_endSet]);
+      m_sets.clear();
+      m_index.clear();
+      m_transitions.clear();
+      m_endSet = intern(std::move(endSet));
+    }
+    m_from = from;
+    m_setAt.resize(size - from + 1);
+    int set = m_endSet;
+    m_setAt[size - from] = set;
+    for (size_t position = size; position-- > from;) {
+      set = next(set, static_cast<unsigned char>(text[position]));
+      m_setAt[position - from] = set;
+    }
+  }
+
+  bool RegexMatcher::Liveness::canGrow(const std::vector<int>& nfaStates, size_t position) const {
+    if (position + 1 >= m_from + m_setAt.size())
+      return false; // At the end of the line
+    const auto& live = m_sets[m_setAt[position - m_from]];
+    auto first = nfaStates.begin(), second = live.begin() + 1; // A match ending here was already seen
+    while (first != nfaStates.end() && second != live.end()) {
+      if (*first == *second)
+        return true;
+      if (*first < *second)
+        ++first;
+      else
+        ++second;
+    }
+    return false;
+  }
+
+  RegexMatcher::RegexMatcher(std::shared_ptr<const Regex> regex) :
+    m_regex(std::move(regex)),
+    m_forward(*m_regex, m_regex->m_forward, false),
+    m_reverse(*m_regex, m_regex->m_reverse, true),
+    m_liveness(*m_regex, m_forward)
+  {}
+
+  // A backward scan of the line with the reversed pattern marks every position where a match begins (one
+  // DFA transition per byte, most lines stop here). Then, from the leftmost of those, the forward DFA finds
+  // the longest match and the search goes on after its end. Runs stop where their match can't grow anymore
+  // (see Liveness) rather than where the DFA dies: with patterns like '.*x|a' that would be the end of the
+  // line for every 'a', quadratic time
+  void RegexMatcher::findAll(const char *text, size_t size, std::vector<std::pair<size_t, size_t>>& matches) {
+    const std::string& literal = m_regex->m_requiredLiteral;
+    if (!literal.empty() && findSubstring(text, size, literal.data(), literal.size()) == nullptr)
+      return;
+
+    m_matchBegins.clear();
+    int state = m_reverse.getStart(true);
+    for (size_t position = size; position-- > 0;) {
+      int encoded = m_reverse.next(state, static_cast<unsigned char>(text[position]));
+      state = encoded >> 1;
+      if (encoded & 1)
+        m_matchBegins.push_back(position);
+    }
+    if (size > 0 && m_reverse.isAccepting(state, true) && (m_matchBegins.empty() || m_matchBegins.back() != 0))
+      m_matchBegins.push_back(0); // Patterns beginning with ^
+
+    if (m_matchBegins.empty())
+      return;
+    m_liveness.compute(text, size, m_matchBegins.back());
+
+    size_t searchFrom = 0;
+    for (auto it = m_matchBegins.rbegin(); it != m_matchBegins.rend(); ++it) { // Ascending
+      size_t begin = *it;
+      if (begin < searchFrom)
+        continue; // Inside the previous match
+      size_t end = begin;
+      state = m_forward.getStart(begin == 0);
+      for (size_t position = begin; position < size; ++position) {
+        int encoded = m_forward.next(state, static_cast<unsigned char>(text[position]));
+        state = encoded >> 1;
+        if ((encoded & 1) || (position + 1 == size && m_forward.isAccepting(state, true)))
+          end = position + 1;
+        if (!m_liveness.canGrow(m_forward.getNfaStates(state), position + 1))
+          break;
+      }
+      if (end > begin) { // Empty matches aren't reported
+        matches.emplace_back(begin, end);
+        searchFrom = end;
+      }
+    }
+  }
+
+  bool RegexMatcher::matches(const char *text, size_t size) {
+    int state = m_forward.getStart(true);
+    for (size_t position = 0; position < size; ++position) {
+      state = m_forward.next(state, static_cast<unsigned char>(text[position])) >> 1;
+      if (m_forward.isDead(state))
+        return false;
+    }
+    return m_forward.isAccepting(state, true);
+  }
+
+}
@@ -0,0 +1,142 @@
+#ifndef VARCO_REGEX_HPP
+#define VARCO_REGEX_HPP
+
+#include <bitset>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace varco {
+
+  // A regular expression compiled to a Thompson NFA. There's no backtracking at all: patterns are matched
+  // by RegexMatcher through a DFA built lazily out of the NFA, i.e. in time linear in the input.
+  //
+  // Supported syntax: literals, '.', classes ([a-z], [^...]), escapes (\d \w \s \D \W \S and escaped
+  // metacharacters), groups ((...), (?:...)), alternation, the * + ? {n} {n,} {n,m} quantifiers (lazy
+  // forms are accepted but matches are always leftmost-longest) and the ^ $ line anchors.
+  // No backreferences nor lookarounds: they can't be matched by a DFA
+  class Regex {
+  public:
+    // Returns nullptr (and the reason in 'error') if the pattern isn't valid
+    static std::shared_ptr<const Regex> compile(const std::string& pattern, bool caseSensitive = true,
+                                                std::string *error = nullptr);
+
+    const std::string& getPattern() const;
+
+  private:
+    friend class RegexMatcher;
+    struct Node;
+    class Parser;
+
+    struct Instruction {
+      enum Type { Char, Split, LineBegin, LineEnd, Match };
+      Type m_type;
+      int m_class = -1; // Char only: index in m_classes
+      int m_out = -1;
+      int m_out1 = -1; // Split only
+    };
+
+    struct Program { // The NFA
+      std::vector<Instruction> m_instructions;
+      int m_start = -1;
+    };
+
+    Regex() = default;
+    int compileNode(const Node& node, int next, Program& program, bool reverse) const;
+
+    std::string m_pattern;
+    std::string m_requiredLiteral; // Every match contains it: lines without it are skipped at memchr speed
+    std::vector<std::bitset<256>> m_classes; // Bytes matched by each Char instruction
+    Program m_forward;
+    Program m_reverse; // Matches the reversed pattern: scanning a line backwards finds where matches begin
+  };
+
+  // Runs a Regex on lines of text. The DFA states are built on demand and cached (the cache is flushed if
+  // it grows too large, which costs time but never correctness). Not thread safe: use one per thread
+  class RegexMatcher {
+  public:
+    explicit RegexMatcher(std::shared_ptr<const Regex> regex);
+
+    // Appends the leftmost-longest, non overlapping, non empty matches found in a line as { start, end }
+    void findAll(const char *text, size_t size, std::vector<std::pair<size_t, size_t>>& matches);
+    bool matches(const char *text, size_t size); // Whether the whole text matches
+
+  private:
+    class Dfa {
+    public:
+      Dfa(const Regex& regex, const Regex::Program& program, bool unanchored);
+
+      int getStart(bool atBegin);
+      // The next state shifted left by one, the lowest bit tells whether it's accepting (not at the end of
+      // the input). A single table lookup per byte in the common case
+      int next(int state, unsigned char byte) {
+        int cached = m_transitions[state * 256 + byte];
+        return cached >= 0 ? cached : computeNext(state, byte);
+      }
+      bool isDead(int state) const;
+      bool isAccepting(int state, bool atEnd) const;
+      const std::vector<int>& getNfaStates(int state) const;
+      std::vector<int> getClosure(int instruction, bool atBegin) const; // Sorted
+
+    private:
+      struct State {
+        std::vector<int> m_nfaStates; // Char, Match and LineEnd instructions reached (sorted)
+        bool m_accepting = false;
+        bool m_acceptingAtEnd = false;
+      };
+
+      int computeNext(int state, unsigned char byte);
+      void addClosure(int instruction, bool atBegin, std::vector<int>& set, std::vector<bool>& visited) const;
+      int intern(std::vector<int> set, bool atBegin);
+      void flush();
+
+      const Regex& m_regex;
+      const Regex::Program& m_program;
+      bool m_unanchored; // Every position may begin a match (as if the pattern was prefixed by .*)
+      std::vector<State> m_states;
+      std::map<std::pair<bool, std::vector<int>>, int> m_index;
+      std::vector<int> m_transitions; // 256 per state (see next()), -1 until computed
+      int m_start[2] = { -1, -1 };
+      unsigned int m_flushes = 0;
+      std::vector<bool> m_visited; // Scratch
+    };
+
+    // For every position of a line, the instructions of the forward program from which a match can still
+    // be reached. A forward run stops as soon as none of its NFA states is among them: its match can't grow
+    // anymore, thus every byte of the line is read by a single run (see findAll). The sets are built out of
+    // the next position's one and the byte in between, and cached like DFA states
+    class Liveness {
+    public:
+      Liveness(const Regex& regex, const Dfa& forward);
+
+      void compute(const char *text, size_t size, size_t from); // Positions [from; size], backwards
+      // Whether a match longer than 'position' can be reached from the NFA states of a forward run
+      bool canGrow(const std::vector<int>& nfaStates, size_t position) const;
+
+    private:
+      int intern(std::vector<int> set);
+      int next(int set, unsigned char byte);
+
+      const Regex& m_regex;
+      std::vector<std::vector<int>> m_closures; // What follows every Char instruction (sorted)
+      std::vector<int> m_charInstructions;
+      std::vector<std::vector<int>> m_sets; // Sorted, the Match instruction (0) is in all of them
+      std::map<std::vector<int>, int> m_index;
+      std::vector<int> m_transitions; // 256 per set (only for the first few thousands), -1 until computed
+      int m_endSet = -1; // At the end of the line: Match and the LineEnd assertions which lead to it
+      std::vector<int> m_setAt; // Scratch: set of every position of the line, from m_from on
+      size_t m_from = 0;
+    };
+
+    std::shared_ptr<const Regex> m_regex;
+    Dfa m_forward; // Anchored: finds the longest match from a given start
+    Dfa m_reverse; // Unanchored: finds every position where a match begins
+    Liveness m_liveness;
+    std::vector<size_t> m_matchBegins; // Scratch, descending
+  };
+
+}
+
+#endif // VARCO_REGEX_HPP
@@ -0,0 +1,77 @@
+#ifndef VARCO_SUBSTRINGSEARCH_HPP
+#define VARCO_SUBSTRINGSEARCH_HPP
+
+#include <cstring>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define VARCO_SSE2
+  #include <emmintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#endif
+
+namespace varco {
+
+#ifdef VARCO_SSE2
+  namespace {
+    inline int countTrailingZeros(unsigned int mask) { // mask != 0
+#ifdef _MSC_VER
+      unsigned long index;
+      _BitScanForward(&index, mask);
+      return static_cast<int>(index);
+#else
+      return __builtin_ctz(mask);
+#endif
+    }
+  }
+#endif
+
+  // Returns the first occurrence of 'needle' in 'haystack' (or nullptr). 16 candidate positions at a time
+  // are compared against both the first and the last byte of the needle, only positions where both match
+  // are compared entirely: on real text almost every block is discarded with a handful of instructions.
+  // The tail (or everything, without SSE2) is scanned with memchr on the first byte
+  inline const char* findSubstring(const char *haystack, size_t size, const char *needle, size_t needleSize) {
+    if (needleSize == 0)
+      return haystack;
+    if (needleSize > size)
+      return nullptr;
+    if (needleSize == 1)
+      return static_cast<const char*>(std::memchr(haystack, needle[0], size));
+
+    const char *end = haystack + (size - needleSize + 1); // Candidates start before this
+    const char *position = haystack;
+
+#ifdef VARCO_SSE2
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleSize - 1]);
+    for (; position + 16 <= end; position += 16) {
+      __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+      __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position + needleSize - 1));
+      unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+      while (mask != 0) {
+        int bit = countTrailingZeros(mask);
+        if (std::memcmp(position + bit + 1, needle + 1, needleSize - 2) == 0)
+          return position + bit;
+        mask &= mask - 1;
+      }
+    }
+#endif
+
+    while (position < end) {
+      position = static_cast<const char*>(std::memchr(position, needle[0], end - position));
+      if (position == nullptr)
+        return nullptr;
+      if (position[needleSize - 1] == needle[needleSize - 1] &&
+          std::memcmp(position + 1, needle + 1, needleSize - 2) == 0)
+        return position;
+      ++position;
+    }
+    return nullptr;
+  }
+
+}
+
+#endif // VARCO_SUBSTRINGSEARCH_HPP
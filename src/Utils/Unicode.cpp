@@ -0,0 +1,198 @@
+#include <Utils/Unicode.hpp>
+#include <algorithm>
+#include <iterator>
+
+namespace varco {
+
+  namespace {
+    struct Range {
+      char32_t m_first;
+      char32_t m_last;
+    };
+
+    bool inRanges(const Range *begin, const Range *end, char32_t codePoint) {
+      auto it = std::upper_bound(begin, end, codePoint, [](char32_t value, const Range& range) {
+        return value < range.m_first;
+      });
+      return it != begin && codePoint <= (it - 1)->m_last;
+    }
+
+    // Characters which extend the cluster before them: combining marks (the common blocks), zero width
+    // joiners, variation selectors and emoji skin tone modifiers
+    const Range EXTENDING[] = {
+      { 0x0300, 0x036F }, { 0x0483, 0x0489 }, { 0x0591, 0x05BD }, { 0x05BF, 0x05BF }, { 0x05C1, 0x05C2 },
+      { 0x05C4, 0x05C5 }, { 0x05C7, 0x05C7 }, { 0x0610, 0x061A }, { 0x064B, 0x065F }, { 0x0670, 0x0670 },
+      { 0x06D6, 0x06DC }, { 0x06DF, 0x06E4 }, { 0x06E7, 0x06E8 }, { 0x06EA, 0x06ED }, { 0x0900, 0x0903 },
+      { 0x093A, 0x093C }, { 0x093E, 0x094F }, { 0x0951, 0x0957 }, { 0x0962, 0x0963 }, { 0x0E31, 0x0E31 },
+      { 0x0E34, 0x0E3A }, { 0x0E47, 0x0E4E }, { 0x1AB0, 0x1AFF }, { 0x1DC0, 0x1DFF }, { 0x200C, 0x200D },
+      { 0x20D0, 0x20FF }, { 0x302A, 0x302F }, { 0x3099, 0x309A }, { 0xFE00, 0xFE0F }, { 0xFE20, 0xFE2F },
+      { 0x1F3FB, 0x1F3FF }, { 0xE0020, 0xE007F }, { 0xE0100, 0xE01EF }
+    };
+
+    // East Asian wide and fullwidth characters, and emoji: two columns
+    const Range WIDE[] = {
+      { 0x1100, 0x115F }, { 0x231A, 0x231B }, { 0x2329, 0x232A }, { 0x23E9, 0x23EC }, { 0x23F0, 0x23F0 },
+      { 0x23F3, 0x23F3 }, { 0x25FD, 0x25FE }, { 0x2614, 0x2615 }, { 0x2648, 0x2653 }, { 0x267F, 0x267F },
+      { 0x2693, 0x2693 }, { 0x26A1, 0x26A1 }, { 0x26AA, 0x26AB }, { 0x26BD, 0x26BE }, { 0x26C4, 0x26C5 },
+      { 0x26CE, 0x26CE }, { 0x26D4, 0x26D4 }, { 0x26EA, 0x26EA }, { 0x26F2, 0x26F3 }, { 0x26F5, 0x26F5 },
+      { 0x26FA, 0x26FA }, { 0x26FD, 0x26FD }, { 0x2705, 0x2705 }, { 0x270A, 0x270B }, { 0x2728, 0x2728 },
+      { 0x274C, 0x274C }, { 0x274E, 0x274E }, { 0x2753, 0x2755 }, { 0x2757, 0x2757 }, { 0x2795, 0x2797 },
+      { 0x27B0, 0x27B0 }, { 0x27BF, 0x27BF }, { 0x2B1B, 0x2B1C }, { 0x2B50, 0x2B50 }, { 0x2B55, 0x2B55 },
+      { 0x2E80, 0x303E }, { 0x3041, 0x33FF }, { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF },
+      { 0xA960, 0xA97F }, { 0xAC00, 0xD7A3 }, { 0xF900, 0xFAFF }, { 0xFE10, 0xFE19 }, { 0xFE30, 0xFE6F },
+      { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x16FE0, 0x16FE4 }, { 0x17000, 0x18CFF }, { 0x1B000, 0x1B2FF },
+      { 0x1F004, 0x1F004 }, { 0x1F0CF, 0x1F0CF }, { 0x1F18E, 0x1F18E }, { 0x1F191, 0x1F19A }, { 0x1F200, 0x1F251 },
+      { 0x1F300, 0x1F320 }, { 0x1F32D, 0x1F335 }, { 0x1F337, 0x1F37C }, { 0x1F37E, 0x1F393 }, { 0x1F3A0, 0x1F3CA },
+      { 0x1F3CF, 0x1F3D3 }, { 0x1F3E0, 0x1F3F0 }, { 0x1F3F4, 0x1F3F4 }, { 0x1F3F8, 0x1F43E }, { 0x1F440, 0x1F440 },
+      { 0x1F442, 0x1F4FC }, { 0x1F4FF, 0x1F53D }, { 0x1F54B, 0x1F54E }, { 0x1F550, 0x1F567 }, { 0x1F57A, 0x1F57A },
+      { 0x1F595, 0x1F596 }, { 0x1F5A4, 0x1F5A4 }, { 0x1F5FB, 0x1F64F }, { 0x1F680, 0x1F6C5 }, { 0x1F6CC, 0x1F6CC },
+      { 0x1F6D0, 0x1F6D2 }, { 0x1F6D5, 0x1F6D7 }, { 0x1F6EB, 0x1F6EC }, { 0x1F6F4, 0x1F6FC }, { 0x1F7E0, 0x1F7EB },
+      { 0x1F90C, 0x1F93A }, { 0x1F93C, 0x1F945 }, { 0x1F947, 0x1F9FF }, { 0x1FA70, 0x1FAFF }, { 0x20000, 0x2FFFD },
+      { 0x30000, 0x3FFFD }
+    };
+
+    const char32_t ZERO_WIDTH_JOINER = 0x200D;
+
+    bool isExtending(char32_t codePoint) {
+      return codePoint >= 0x0300 && inRanges(std::begin(EXTENDING), std::end(EXTENDING), codePoint);
+    }
+
+    bool isWide(char32_t codePoint) {
+      return codePoint >= 0x1100 && inRanges(std::begin(WIDE), std::end(WIDE), codePoint);
+    }
+
+    bool isRegionalIndicator(char32_t codePoint) { // Flags are pairs of these
+      return codePoint >= 0x1F1E6 && codePoint <= 0x1F1FF;
+    }
+
+    size_t previousCodePoint(const char *text, size_t offset) { // Where the code point before 'offset' begins
+      size_t start = offset - 1;
+      while (start > 0 && offset - start < 4 && isUtf8Continuation(text[start]))
+        --start;
+      size_t end = start;
+      decodeUtf8(text, offset, end);
+      return (end == offset) ? start : offset - 1; // An invalid sequence: just its last byte
+    }
+  }
+
+  char32_t decodeUtf8(const char *text, size_t size, size_t& offset) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(text);
+    const unsigned char lead = bytes[offset];
+    if (lead < 0x80) {
+      ++offset;
+      return lead;
+    }
+    size_t length;
+    char32_t codePoint, minimum;
+    if ((lead & 0xE0) == 0xC0) {
+      length = 2, codePoint = lead & 0x1F, minimum = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+      length = 3, codePoint = lead & 0x0F, minimum = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+      length = 4, codePoint = lead & 0x07, minimum = 0x10000;
+    } else {
+      ++offset;
+      return 0xFFFD;
+    }
+    if (offset + length > size) {
+      ++offset;
+      return 0xFFFD;
+    }
+    for (size_t i = 1; i < length; ++i) {
+      if ((bytes[offset + i] & 0xC0) != 0x80) {
+        ++offset;
+        return 0xFFFD;
+      }
+      codePoint = (codePoint << 6) | (bytes[offset + i] & 0x3F);
+    }
+    if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+      ++offset; // Overlong encodings and surrogates
+      return 0xFFFD;
+    }
+    offset += length;
+    return codePoint;
+  }
+
+  void appendUtf8(char32_t codePoint, std::string& text) {
+    if (codePoint < 0x80)
+      text += static_cast<char>(codePoint);
+    else if (codePoint < 0x800) {
+      text += static_cast<char>(0xC0 | (codePoint >> 6));
+      text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+      text += static_cast<char>(0xE0 | (codePoint >> 12));
+      text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+      text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+      text += static_cast<char>(0xF0 | (codePoint >> 18));
+      text += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+      text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+      text += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+  }
+
+  // ASCII runs are skipped 16 bytes at a time: only the other characters are decoded
+  bool isValidUtf8(const char *text, size_t size) {
+    size_t offset = 0;
+    while (offset < size) {
+      if (!(static_cast<unsigned char>(text[offset]) & 0x80)) {
+        while (offset + 16 <= size && isAscii(text + offset, 16))
+          offset += 16;
+        while (offset < size && !(static_cast<unsigned char>(text[offset]) & 0x80))
+          ++offset;
+        continue;
+      }
+      size_t start = offset;
+      if (decodeUtf8(text, size, offset) == 0xFFFD && offset == start + 1)
+        return false; // A valid U+FFFD takes three bytes
+    }
+    return true;
+  }
+
+  size_t getNextCluster(const char *text, size_t size, size_t offset, int *width) {
+    char32_t base = decodeUtf8(text, size, offset);
+    if (width)
+      *width = isWide(base) ? 2 : 1;
+    if (isRegionalIndicator(base) && offset < size) { // A flag
+      size_t next = offset;
+      if (isRegionalIndicator(decodeUtf8(text, size, next))) {
+        offset = next;
+        if (width)
+          *width = 2;
+      }
+    }
+    while (offset < size) {
+      size_t next = offset;
+      char32_t codePoint = decodeUtf8(text, size, next);
+      if (!isExtending(codePoint))
+        break;
+      offset = next;
+      if (codePoint == ZERO_WIDTH_JOINER && offset < size)
+        decodeUtf8(text, size, offset); // The joined character is part of the cluster
+    }
+    return offset;
+  }
+
+  // Steps back over the extending characters (and the characters they're joined to) to the base of the cluster
+  size_t getPreviousCluster(const char *text, size_t size, size_t offset) {
+    if (offset == 0)
+      return 0;
+    size_t start = previousCodePoint(text, offset);
+    while (start > 0) {
+      size_t next = start;
+      char32_t codePoint = decodeUtf8(text, size, next);
+      size_t before = previousCodePoint(text, start);
+      size_t end = before;
+      char32_t previous = decodeUtf8(text, size, end);
+      if (isExtending(codePoint) || previous == ZERO_WIDTH_JOINER || (isRegionalIndicator(codePoint) && isRegionalIndicator(previous)))
+        start = before; // Flags are paired going forward, from the first of a run of indicators
+      else
+        break;
+    }
+    // The cluster might begin after 'start' (e.g. the second flag of a run): find it going forward
+    size_t cluster = start;
+    for (size_t next; (next = getNextCluster(text, size, cluster)) < offset; cluster = next) {}
+    return cluster;
+  }
+
+}
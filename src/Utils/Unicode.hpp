@@ -0,0 +1,60 @@
+#ifndef VARCO_UNICODE_HPP
+#define VARCO_UNICODE_HPP
+
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define VARCO_SSE2
+  #include <emmintrin.h>
+#endif
+
+namespace varco {
+
+  // True if every byte is 7-bit: such text has a character per byte and a column per character, the common
+  // case which skips all of the decoding below. 16 bytes at a time with SSE2 (8 at a time otherwise)
+  inline bool isAscii(const char *text, size_t size) {
+    size_t i = 0;
+#ifdef VARCO_SSE2
+    for (; i + 16 <= size; i += 16) {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+      if (_mm_movemask_epi8(block) != 0) // The high bit of every byte
+        return false;
+    }
+#else
+    for (; i + 8 <= size; i += 8) {
+      uint64_t block;
+      std::memcpy(&block, text + i, 8);
+      if (block & 0x8080808080808080ULL)
+        return false;
+    }
+#endif
+    for (; i < size; ++i) {
+      if (static_cast<unsigned char>(text[i]) & 0x80)
+        return false;
+    }
+    return true;
+  }
+
+  inline bool isUtf8Continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+  }
+
+  // The code point at 'offset', which is moved past it. An invalid (or truncated) sequence decodes to U+FFFD
+  // and takes a single byte
+  char32_t decodeUtf8(const char *text, size_t size, size_t& offset);
+  void appendUtf8(char32_t codePoint, std::string& text);
+  bool isValidUtf8(const char *text, size_t size);
+
+  // Text is laid out in grapheme clusters: a character along with the combining marks, variation selectors
+  // and emoji modifiers which follow it (and the characters joined to it by a ZWJ). A cluster takes a column,
+  // two if it's a wide character of an East Asian script or an emoji. Invalid bytes take a column each (see
+  // ColumnMap.hpp for tabs). Offsets are in bytes and always on cluster boundaries
+  size_t getNextCluster(const char *text, size_t size, size_t offset, int *width = nullptr); // Where the cluster at 'offset' ends
+  size_t getPreviousCluster(const char *text, size_t size, size_t offset); // Where the cluster before 'offset' begins
+
+}
+
+#endif // VARCO_UNICODE_HPP
@@ -11,9 +11,21 @@ namespace varco {
     VK_O, VK_P, VK_Q, VK_R, VK_S, VK_T, VK_U, VK_V, VK_W, VK_X, VK_Y, VK_Z,
     VK_0, VK_1, VK_2, VK_3, VK_4, VK_5, VK_6, VK_7, VK_8, VK_9,
     VK_CTRL,
+    // Careful: these names must not clash with the windows.h VK_* macros
+    VK_BACKSPACE, VK_DEL, VK_ENTER, VK_TAB_KEY, VK_ESC,
+    VK_ARROW_LEFT, VK_ARROW_RIGHT, VK_ARROW_UP, VK_ARROW_DOWN,
+    VK_HOME_KEY, VK_END_KEY, VK_PAGEUP, VK_PAGEDOWN, VK_F3_KEY,
     VK_UNRECOGNIZED
   };
 
+  // Modifier keys held down when a key is pressed (bitmask)
+  enum KeyModifiers : unsigned int {
+    MODIFIER_NONE  = 0,
+    MODIFIER_CTRL  = 1 << 0,
+    MODIFIER_SHIFT = 1 << 1,
+    MODIFIER_ALT   = 1 << 2
+  };
+
 }
 
 #endif // VARCO_VKEYCODES_HPP
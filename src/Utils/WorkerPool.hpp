@@ -0,0 +1,80 @@
+#ifndef VARCO_WORKERPOOL_HPP
+#define VARCO_WORKERPOOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace varco {
+
+  // A process-wide pool of worker threads (one per core) consuming a FIFO queue of jobs. Unlike the
+  // rendering ThreadPool, which only ever keeps the latest request, every job posted here is run: it's
+  // meant for background work split into many small independent jobs (e.g. searches). Jobs should check
+  // their own cancellation flags, the pool doesn't know about them
+  class WorkerPool {
+  public:
+    using Job = std::function<void()>;
+
+    static WorkerPool& get() {
+      static WorkerPool pool;
+      return pool;
+    }
+
+    ~WorkerPool() {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sigterm = true;
+      }
+      m_cv.notify_all();
+      for (auto& thread : m_threads)
+        thread.join();
+    }
+
+    void post(Job job) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobs.emplace_back(std::move(job));
+      }
+      m_cv.notify_one();
+    }
+
+    size_t getThreadCount() const {
+      return m_threads.size();
+    }
+
+  private:
+    WorkerPool() {
+      size_t count = std::max(1U, std::thread::hardware_concurrency());
+      for (size_t i = 0; i < count; ++i)
+        m_threads.emplace_back(&WorkerPool::threadMain, this);
+    }
+
+    void threadMain() {
+      while (true) {
+        Job job;
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_cv.wait(lock, [this]() { return m_sigterm || !m_jobs.empty(); });
+          if (m_sigterm)
+            return;
+          job = std::move(m_jobs.front());
+          m_jobs.pop_front();
+        }
+        job();
+      }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Job> m_jobs;
+    bool m_sigterm = false;
+    std::vector<std::thread> m_threads;
+  };
+
+}
+
+#endif // VARCO_WORKERPOOL_HPP
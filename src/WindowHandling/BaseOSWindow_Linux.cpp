@@ -2,6 +2,8 @@
 
 #include <X11/Xatom.h>
 #include <X11/XKBlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
 
 #include <SkEvent.h>
 #include <gl/GrGLInterface.h>
@@ -374,8 +376,27 @@ namespace varco {
         return static_cast<VirtualKeycode>(static_cast<enumType>(VirtualKeycode::VK_A) + (keysym - 'A'));
       else if (keysym >= '0' && keysym <= '9')
         return static_cast<VirtualKeycode>(static_cast<enumType>(VirtualKeycode::VK_0) + (keysym - '0'));
-      else
-        return VirtualKeycode::VK_UNRECOGNIZED;
+
+      switch (keysym) {
+        case XK_Control_L:
+        case XK_Control_R: return VirtualKeycode::VK_CTRL;
+        case XK_BackSpace: return VirtualKeycode::VK_BACKSPACE;
+        case XK_Delete: return VirtualKeycode::VK_DEL;
+        case XK_Return:
+        case XK_KP_Enter: return VirtualKeycode::VK_ENTER;
+        case XK_Tab: return VirtualKeycode::VK_TAB_KEY;
+        case XK_Escape: return VirtualKeycode::VK_ESC;
+        case XK_Left: return VirtualKeycode::VK_ARROW_LEFT;
+        case XK_Right: return VirtualKeycode::VK_ARROW_RIGHT;
+        case XK_Up: return VirtualKeycode::VK_ARROW_UP;
+        case XK_Down: return VirtualKeycode::VK_ARROW_DOWN;
+        case XK_Home: return VirtualKeycode::VK_HOME_KEY;
+        case XK_End: return VirtualKeycode::VK_END_KEY;
+        case XK_Page_Up: return VirtualKeycode::VK_PAGEUP;
+        case XK_Page_Down: return VirtualKeycode::VK_PAGEDOWN;
+        case XK_F3: return VirtualKeycode::VK_F3_KEY;
+        default: return VirtualKeycode::VK_UNRECOGNIZED;
+      }
     }
 
   }
@@ -455,6 +476,12 @@ namespace varco {
       fRenderTarget = setupRenderTarget(Width, Height); // render target has to be reset
       fSurface.reset(SkSurface::MakeRenderTargetDirect(fRenderTarget, fSurfaceProps.get()).release());
 
+      // Partial presents are only possible if we can copy a region of the back buffer to the front one
+      // without swapping them (Mesa, including llvmpipe, always exposes this)
+      const char *glxExtensions = glXQueryExtensionsString(fDisplay, fVi->screen);
+      if (glxExtensions != nullptr && strstr(glxExtensions, "GLX_MESA_copy_sub_buffer") != nullptr)
+        copySubBuffer = reinterpret_cast<CopySubBufferProc>(GLX_GET_PROC_ADDR("glXCopySubBufferMESA"));
+
       //setVsync(false);
     }
 
@@ -493,9 +520,32 @@ namespace varco {
         threadHeight = Height;
       }
 
+      // Grab what needs to be redrawn: either everything or just the damaged region
+      bool fullRedraw;
+      SkRect damage;
+      {
+        std::unique_lock<std::mutex> lk(damageMutex);
+        fullRedraw = fullRedrawNeeded || resizing || copySubBuffer == nullptr;
+        damage = damagedRect;
+        fullRedrawNeeded = false;
+        damagedRect.setEmpty();
+      }
+
+      SkIRect presentRect = SkIRect::MakeWH(Width, Height);
+      if (!fullRedraw && backBufferValid) {
+        damage.roundOut(&presentRect);
+        if (!presentRect.intersect(SkIRect::MakeWH(Width, Height))) {
+          redrawNeeded = false; // Damage was already presented by a previous frame
+          continue;
+        }
+      }
+
       // Call the OS-independent draw function
       auto surfacePtr = fSurface->getCanvas();
+      surfacePtr->save();
+      surfacePtr->clipRect(SkRect::Make(presentRect));
       this->draw(*surfacePtr);
+      surfacePtr->restore();
 
       if(stopRendering == true) {
         fContext->releaseResourcesAndAbandonContext();
@@ -508,7 +558,16 @@ namespace varco {
 
 
       fContext->flush();
-      glXSwapBuffers(fDisplay, fWin);      
+      if (!fullRedraw) {
+        // Copy the drawn region to the front buffer. Unlike a swap this leaves the back buffer intact and
+        // ready to be patched by the next partial frame. Notice that GL's origin is bottom-left
+        copySubBuffer(fDisplay, fWin, presentRect.x(), Height - presentRect.y() - presentRect.height(),
+                      presentRect.width(), presentRect.height());
+        backBufferValid = true;
+      } else {
+        glXSwapBuffers(fDisplay, fWin);
+        backBufferValid = false; // Back buffer contents are undefined after a swap
+      }
 
       if (Width == threadWidth && Height == threadHeight) {// Check for size to be updated
         redrawNeeded = false;
@@ -537,7 +596,16 @@ namespace varco {
         if (evt->xexpose.count == 0) { // Only handle the LAST expose redraw event
                                        // if there are multiple ones
 
-            while (XCheckTypedWindowEvent(fDisplay, fWin, Expose, evt));
+            // Synthetic events are sent by repaint() requests and carry their own damaged region,
+            // expose events generated by the X server require the entire window to be redrawn
+            bool exposedByServer = (evt->xexpose.send_event == False);
+            while (XCheckTypedWindowEvent(fDisplay, fWin, Expose, evt))
+              exposedByServer |= (evt->xexpose.send_event == False);
+
+            if (exposedByServer) {
+              std::unique_lock<std::mutex> lk(damageMutex);
+              fullRedrawNeeded = true;
+            }
 
             std::unique_lock<std::mutex> lk(renderMutex);
             redrawNeeded = true;
@@ -560,6 +628,10 @@ namespace varco {
 //        }
 
         this->resize(evt->xconfigure.width, evt->xconfigure.height);
+        {
+          std::unique_lock<std::mutex> lk(damageMutex);
+          fullRedrawNeeded = true;
+        }
         redrawNeeded = true;
         renderCV.notify_one();
 
@@ -703,12 +775,12 @@ namespace varco {
           case Button4: { // Mouse wheel up
             auto x = evt->xbutton.x;
             auto y = evt->xbutton.y;
-            this->onMouseWheel(x, y, -1);
+            this->onMouseWheel(x, y, -1, (evt->xbutton.state & ControlMask) ? MODIFIER_CTRL : MODIFIER_NONE);
           } break;
           case Button5: { // Mouse wheel down
             auto x = evt->xbutton.x;
             auto y = evt->xbutton.y;
-            this->onMouseWheel(x, y, 1);
+            this->onMouseWheel(x, y, 1, (evt->xbutton.state & ControlMask) ? MODIFIER_CTRL : MODIFIER_NONE);
           } break;
 
           default:
@@ -734,7 +806,29 @@ namespace varco {
       case KeyPress: {
         auto keysym = XkbKeycodeToKeysym(this->fDisplay, evt->xkey.keycode, 0,
                                          /*evt->xkey.state & ShiftMask ? 1 : 0*/ 1);
-        this->onKeyDown(remapKeyToVarcoKey(keysym));
+        auto unshifted = XkbKeycodeToKeysym(this->fDisplay, evt->xkey.keycode, 0, 0);
+        if (keysym == NoSymbol || (unshifted >= '0' && unshifted <= '9')) // Single level keys (e.g. arrows), digits
+          keysym = unshifted;
+        unsigned int modifiers = MODIFIER_NONE;
+        if (evt->xkey.state & ControlMask)
+          modifiers |= MODIFIER_CTRL;
+        if (evt->xkey.state & ShiftMask)
+          modifiers |= MODIFIER_SHIFT;
+        if (evt->xkey.state & Mod1Mask)
+          modifiers |= MODIFIER_ALT;
+        this->onKeyDown(remapKeyToVarcoKey(keysym), modifiers);
+
+        // Printable characters also go through the keyboard layout. Only ASCII for now: document
+        // columns are counted in bytes
+        char buffer[32];
+        int length = XLookupString(&evt->xkey, buffer, sizeof(buffer), nullptr, nullptr);
+        std::string text;
+        for (int i = 0; i < length; ++i) {
+          if (buffer[i] >= 0x20 && buffer[i] < 0x7F)
+            text += buffer[i];
+        }
+        if (!text.empty() && !(evt->xkey.state & ControlMask))
+          this->onTextInput(text);
       } break;
 
       case LeaveNotify: {
@@ -809,6 +903,18 @@ namespace varco {
   }
 
   void BaseOSWindow::repaint() {
+    {
+      std::unique_lock<std::mutex> lk(damageMutex);
+      fullRedrawNeeded = true;
+    }
+    invalidateWindow();
+  }
+
+  void BaseOSWindow::repaint(const SkRect& damagedRect) {
+    {
+      std::unique_lock<std::mutex> lk(damageMutex);
+      this->damagedRect.join(damagedRect);
+    }
     invalidateWindow();
   }
 
@@ -15,6 +15,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <vector>
+#include <string>
 
 class GrContext;
 struct GrGLInterface;
@@ -32,16 +33,18 @@ namespace varco {
 
     virtual void draw(SkCanvas& canvas) = 0;
     void repaint();
+    void repaint(const SkRect& damagedRect); // Only redraw and present a region of the window
     virtual void onMouseMove(SkScalar x, SkScalar y) = 0;
     virtual void onLeftMouseDown(SkScalar x, SkScalar y) = 0;
     virtual void onLeftMouseMove(SkScalar x, SkScalar y) = 0;
-    virtual void onMouseWheel(SkScalar x, SkScalar y, int direction) = 0;
+    virtual void onMouseWheel(SkScalar x, SkScalar y, int direction, unsigned int modifiers) = 0;
     virtual void onFileDrop(SkScalar x, SkScalar y, std::vector<std::string> files) = 0;
     void startMouseCapture();
     void stopMouseCapture();
     virtual void onMouseLeave() = 0;
     virtual void onLeftMouseUp(SkScalar x, SkScalar y) = 0;
-    virtual void onKeyDown(VirtualKeycode key) = 0;
+    virtual void onKeyDown(VirtualKeycode key, unsigned int modifiers) = 0;
+    virtual void onTextInput(const std::string& text) = 0; // Characters typed (after keyboard layout translation)
 
   protected:
     int Argc;
@@ -80,6 +83,15 @@ namespace varco {
     std::mutex renderMutex;
     std::condition_variable renderCV;
     bool redrawNeeded = false;
+
+    // Damaged regions tracking. If no full redraw has been requested, only the damaged region
+    // is drawn and then copied to the front buffer (this requires GLX_MESA_copy_sub_buffer)
+    std::mutex damageMutex;
+    SkRect damagedRect = SkRect::MakeEmpty(); // Accumulated damaged region since the last frame
+    bool fullRedrawNeeded = true;
+    bool backBufferValid = false; // Whether the back buffer still holds the last presented frame
+    using CopySubBufferProc = void(*)(Display*, GLXDrawable, int, int, int, int);
+    CopySubBufferProc copySubBuffer = nullptr;
     std::thread renderThread;
     void renderThreadFn();
     bool stopRendering = false;
@@ -193,8 +193,25 @@ namespace varco {
         return static_cast<VirtualKeycode>(static_cast<enumType>(VirtualKeycode::VK_A) + (param - 'A'));
       else if (param >= '0' && param <= '9')
         return static_cast<VirtualKeycode>(static_cast<enumType>(VirtualKeycode::VK_0) + (param - '0'));
-      else
-        return VirtualKeycode::VK_UNRECOGNIZED;
+
+      switch (param) {
+        case VK_CONTROL: return VirtualKeycode::VK_CTRL;
+        case VK_BACK: return VirtualKeycode::VK_BACKSPACE;
+        case VK_DELETE: return VirtualKeycode::VK_DEL;
+        case VK_RETURN: return VirtualKeycode::VK_ENTER;
+        case VK_TAB: return VirtualKeycode::VK_TAB_KEY;
+        case VK_ESCAPE: return VirtualKeycode::VK_ESC;
+        case VK_LEFT: return VirtualKeycode::VK_ARROW_LEFT;
+        case VK_RIGHT: return VirtualKeycode::VK_ARROW_RIGHT;
+        case VK_UP: return VirtualKeycode::VK_ARROW_UP;
+        case VK_DOWN: return VirtualKeycode::VK_ARROW_DOWN;
+        case VK_HOME: return VirtualKeycode::VK_HOME_KEY;
+        case VK_END: return VirtualKeycode::VK_END_KEY;
+        case VK_PRIOR: return VirtualKeycode::VK_PAGEUP;
+        case VK_NEXT: return VirtualKeycode::VK_PAGEDOWN;
+        case VK_F3: return VirtualKeycode::VK_F3_KEY;
+        default: return VirtualKeycode::VK_UNRECOGNIZED;
+      }
     }
   }
 
@@ -221,7 +238,20 @@ namespace varco {
       } break;
 
       case WM_KEYDOWN: {
-        this->onKeyDown(remapKeyToVarcoKey(wParam));
+        unsigned int modifiers = MODIFIER_NONE;
+        if (GetKeyState(VK_CONTROL) & 0x8000)
+          modifiers |= MODIFIER_CTRL;
+        if (GetKeyState(VK_SHIFT) & 0x8000)
+          modifiers |= MODIFIER_SHIFT;
+        if (GetKeyState(VK_MENU) & 0x8000)
+          modifiers |= MODIFIER_ALT;
+        this->onKeyDown(remapKeyToVarcoKey(wParam), modifiers);
+      } break;
+
+      case WM_CHAR: { // Generated by TranslateMessage with the keyboard layout applied
+        // Only ASCII for now: document columns are counted in bytes
+        if (wParam >= 0x20 && wParam < 0x7F && !(GetKeyState(VK_CONTROL) & 0x8000))
+          this->onTextInput(std::string(1, static_cast<char>(wParam)));
       } break;
 
       case WM_MOUSEMOVE: {
@@ -249,7 +279,7 @@ namespace varco {
         ScreenToClient(this->hWnd, &pt);
         auto zDelta = (short)HIWORD(wParam);
         this->onMouseWheel(static_cast<SkScalar>(pt.x), static_cast<SkScalar>(pt.y), 
-                           (zDelta > 0) ? -1 : 1);
+                           (zDelta > 0) ? -1 : 1, (wParam & MK_CONTROL) ? MODIFIER_CTRL : MODIFIER_NONE);
       } break;
 
       case WM_DROPFILES: {
@@ -351,6 +381,12 @@ namespace varco {
     }
   }
 
+  void BaseOSWindow::repaint(const SkRect&) {
+    // The WGL swap chain leaves the back buffer undefined after every swap, therefore partial presents
+    // aren't possible here: the damaged region gets redrawn along with the rest of the window
+    repaint();
+  }
+
   void BaseOSWindow::renderThreadFn() {
     {
       std::unique_lock<std::mutex> lk(renderMutex);
@@ -32,16 +32,18 @@ namespace varco {
     
     virtual void draw(SkCanvas& canvas) = 0;
     void repaint();
+    void repaint(const SkRect& damagedRect); // Only redraw and present a region of the window
     virtual void onMouseMove(SkScalar x, SkScalar y) = 0;
     virtual void onLeftMouseDown(SkScalar x, SkScalar y) = 0;
     virtual void onLeftMouseMove(SkScalar x, SkScalar y) = 0;
-    virtual void onMouseWheel(SkScalar x, SkScalar y, int direction) = 0;
+    virtual void onMouseWheel(SkScalar x, SkScalar y, int direction, unsigned int modifiers) = 0;
     virtual void onFileDrop(SkScalar x, SkScalar y, std::vector<std::string> files) = 0;
     void startMouseCapture();
     void stopMouseCapture();
     virtual void onMouseLeave() = 0;
     virtual void onLeftMouseUp(SkScalar x, SkScalar y) = 0;
-    virtual void onKeyDown(VirtualKeycode key) = 0;
+    virtual void onKeyDown(VirtualKeycode key, unsigned int modifiers) = 0;
+    virtual void onTextInput(const std::string& text) = 0; // Characters typed (after keyboard layout translation)
 
   protected:
     HINSTANCE Instance, PrevInstance;
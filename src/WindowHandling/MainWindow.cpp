@@ -2,6 +2,8 @@
 #include <SkCanvas.h>
 #include <Utils/Utils.hpp>
 
+#define FIND_RESULTS_HEIGHT 200.0f // Height of the find results panel (when visible)
+
 namespace varco {
 
 #ifdef _WIN32
@@ -13,19 +15,31 @@ namespace varco {
 #endif
       m_tabCtrl(*this),
       m_codeEditCtrl(*this),
-      m_documentManager(m_codeEditCtrl, m_tabCtrl)
+      m_findResultsCtrl(*this),
+      m_documentManager(m_codeEditCtrl, m_tabCtrl, m_findResultsCtrl)
   {}
 
+  MainWindow::~MainWindow() {
+    // Animation steps point into the controls: make sure none is running or will run while they're destroyed
+    m_animationScheduler.shutdown();
+  }
+
   void MainWindow::repaint() {
     // Call the OS-specific repaint routine
     BaseOSWindow::repaint();
   }
 
+  void MainWindow::repaintRect(const SkRect& rect) {
+    // Only the damaged region will be redrawn and presented
+    BaseOSWindow::repaint(rect);
+  }
+
   void MainWindow::onMouseMove(SkScalar x, SkScalar y) {
     // [] Other controls' tests should go here
   }
 
-  // Main window drawing entry point
+  // Main window drawing entry point. The canvas might be clipped to a damaged region: controls
+  // which are entirely outside of it are not blitted again
   void MainWindow::draw(SkCanvas& canvas) {
     // Clear background color
     //canvas.drawColor(SkColorSetARGB(255, 39, 40, 34));
@@ -35,15 +49,40 @@ namespace varco {
     // Draw the TabBar region if needed
     m_tabCtrl.resize(tabCtrlRect);
     m_tabCtrl.paint();
-    canvas.drawBitmap(m_tabCtrl.getBitmap(), m_tabCtrl.getRect().left(),
-                      m_tabCtrl.getRect().top());
-
-    // Calculate CodeView region in the remaining space
-    SkRect codeEditCtrlRect = SkRect::MakeLTRB(0, 33.0f, (SkScalar)this->Width, (SkScalar)this->Height);
+    if (!canvas.quickReject(m_tabCtrl.getRect()))
+      canvas.drawBitmap(m_tabCtrl.getBitmap(), m_tabCtrl.getRect().left(),
+                        m_tabCtrl.getRect().top());
+
+    // Calculate CodeView region in the remaining space (the find results panel takes the bottom part of it)
+    SkScalar codeEditCtrlBottom = (SkScalar)this->Height;
+    if (m_findResultsCtrl.isVisible() && codeEditCtrlBottom - FIND_RESULTS_HEIGHT > 2 * 33.0f)
+      codeEditCtrlBottom -= FIND_RESULTS_HEIGHT;
+    SkRect codeEditCtrlRect = SkRect::MakeLTRB(0, 33.0f, (SkScalar)this->Width, codeEditCtrlBottom);
     // Draw the CodeView region if needed
     m_codeEditCtrl.resize(codeEditCtrlRect);
     m_codeEditCtrl.paint();
-    canvas.drawBitmap(m_codeEditCtrl.getBitmap(), 0, 33.0f);
+    if (!canvas.quickReject(m_codeEditCtrl.getRect())) {
+      canvas.drawBitmap(m_codeEditCtrl.getBitmap(), 0, 33.0f);
+
+      canvas.save();
+      canvas.translate(m_codeEditCtrl.getRect().left(), m_codeEditCtrl.getRect().top());
+      canvas.clipRect(m_codeEditCtrl.getRect(UIElement<ui_control_tag>::absoluteRect));
+      m_codeEditCtrl.paintOverlay(canvas);
+      canvas.restore();
+    }
+
+    // Draw the find results panel if needed
+    if (codeEditCtrlBottom < (SkScalar)this->Height) {
+      m_findResultsCtrl.resize(SkRect::MakeLTRB(0, codeEditCtrlBottom, (SkScalar)this->Width, (SkScalar)this->Height));
+      m_findResultsCtrl.paint();
+      if (!canvas.quickReject(m_findResultsCtrl.getRect()))
+        canvas.drawBitmap(m_findResultsCtrl.getBitmap(), m_findResultsCtrl.getRect().left(),
+                          m_findResultsCtrl.getRect().top());
+    }
+  }
+
+  bool MainWindow::isFindResultsShown() {
+    return m_findResultsCtrl.isVisible() && m_codeEditCtrl.getRect().fBottom < (SkScalar)this->Height;
   }
 
   void MainWindow::onLeftMouseDown(SkScalar x, SkScalar y) {
@@ -53,15 +92,19 @@ namespace varco {
       m_tabCtrl.onLeftMouseDown(x, y);
     else if (isPointInsideRect(x, y, m_codeEditCtrl.getRect()))
       m_codeEditCtrl.onLeftMouseDown(x, y);
+    else if (isFindResultsShown() && isPointInsideRect(x, y, m_findResultsCtrl.getRect()))
+      m_findResultsCtrl.onLeftMouseDown(x, y);
 
     // [] Other controls' tests should go here
   }
 
-  void MainWindow::onMouseWheel(SkScalar x, SkScalar y, int direction) {
+  void MainWindow::onMouseWheel(SkScalar x, SkScalar y, int direction, unsigned int modifiers) {
 
     // Forward the event to a container control
     if (isPointInsideRect(x, y, m_codeEditCtrl.getRect()))
-      m_codeEditCtrl.onMouseWheel(x, y, direction);
+      m_codeEditCtrl.onMouseWheel(x, y, direction, modifiers);
+    else if (isFindResultsShown() && isPointInsideRect(x, y, m_findResultsCtrl.getRect()))
+      m_findResultsCtrl.onMouseWheel(x, y, direction);
 
     // [] Other controls' tests should go here
   }
@@ -101,13 +144,25 @@ namespace varco {
     // [] Other controls' tests should go here
   }
 
-  void MainWindow::onKeyDown(VirtualKeycode key) {
+  void MainWindow::onKeyDown(VirtualKeycode key, unsigned int modifiers) {
+    // Window-wide chords first, every other key event is directed to the code edit control
+    if (key == VirtualKeycode::VK_F && modifiers == (MODIFIER_CTRL | MODIFIER_SHIFT)) {
+      m_documentManager.findWordAtCaretInFiles();
+      return;
+    }
+    if (key == VirtualKeycode::VK_T && modifiers == (MODIFIER_CTRL | MODIFIER_SHIFT)) {
+      m_documentManager.toggleFollowTail();
+      return;
+    }
+    if (key == VirtualKeycode::VK_ESC && m_findResultsCtrl.isVisible()) {
+      m_findResultsCtrl.setVisible(false);
+      return;
+    }
+    m_codeEditCtrl.onKeyDown(key, modifiers);
+  }
 
-    // TODO: every key event should be directed to the code edit control, except Ctrl+ and Alt+ augmented chords
-    
-    // DEBUG
-    if (key == VirtualKeycode::VK_N)
-      m_tabCtrl.addNewTab("New tab!");
+  void MainWindow::onTextInput(const std::string& text) {
+    m_codeEditCtrl.onTextInput(text);
   }
 
   void MainWindow::startMouseCapture() {
@@ -118,4 +173,8 @@ namespace varco {
     BaseOSWindow::stopMouseCapture();
   }
 
+  AnimationScheduler& MainWindow::getAnimationScheduler() {
+    return m_animationScheduler;
+  }
+
 } // namespace varco
@@ -8,7 +8,9 @@
 #endif
 #include <UI/TabBar/TabBar.hpp>
 #include <UI/CodeView/CodeView.hpp>
+#include <UI/FindResults/FindResultsView.hpp>
 #include <Control/DocumentManager.hpp>
+#include <Utils/AnimationScheduler.hpp>
 #include <SkCanvas.h>
 #include <string>
 
@@ -22,25 +24,33 @@ namespace varco {
 #elif defined __linux__
     MainWindow(int argc, char **argv);
 #endif
+    ~MainWindow();
 
     void draw(SkCanvas& canvas) override;
     void repaint() override;
+    void repaintRect(const SkRect& rect) override;
     void onMouseMove(SkScalar x, SkScalar y) override;
     void onLeftMouseDown(SkScalar x, SkScalar y) override;
     void onLeftMouseMove(SkScalar x, SkScalar y) override;
-    void onMouseWheel(SkScalar x, SkScalar y, int direction) override;
+    void onMouseWheel(SkScalar x, SkScalar y, int direction, unsigned int modifiers) override;
     void onFileDrop(SkScalar x, SkScalar y, std::vector<std::string> files) override;
     void onMouseLeave() override;
     void onLeftMouseUp(SkScalar x, SkScalar y) override;
-    void onKeyDown(VirtualKeycode key) override;
+    void onKeyDown(VirtualKeycode key, unsigned int modifiers) override;
+    void onTextInput(const std::string& text) override;
     void startMouseCapture() override;
     void stopMouseCapture() override;
+    AnimationScheduler& getAnimationScheduler() override;
 
   private:
+    bool isFindResultsShown(); // Visible and laid out (there might not be enough room for it)
+
     // Warning: keep these in order
     // (per 12.6.2.5 these define the order for the ctor initialization list)
+    AnimationScheduler m_animationScheduler; // Outlives the controls which register animations
     TabBar m_tabCtrl;
     CodeView m_codeEditCtrl;
+    FindResultsView m_findResultsCtrl;
     DocumentManager m_documentManager;
   };
 